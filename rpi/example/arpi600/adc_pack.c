@@ -0,0 +1,189 @@
+/**
+ * @brief Example storing a TLC1543 channel packed and compressed
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-03-08
+ *
+ * @example adc_pack.c
+ * Samples of channel 0 (or a noisy sine with `--sim`) are kept in a packed ring of the last 10 seconds
+ * and written to a log of compressed blocks, then the log is read back and checked against the ring.
+ * The sizes are compared with the same samples stored as `int` and `uint16_t`.
+ *
+ * The log starts with "ADCP", then the number of samples (uint32_t), then the blocks of ADC_PACK_BLOCK samples
+ * (the last one may be shorter).
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../include path is relative to the folder where this file is.
+ * gcc -Wall -O2 -I../include adc_pack.c -lgpiod -lm -o adc_pack.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./adc_pack.out [--sim] [samples] [log]`, 100000 samples to `adc.log` by default.
+ */
+
+#include <arpi600/tlc1543.h>
+#include <adc-pack.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Samples kept in the ring (10 s at 10 kHz). */
+#define RING_SIZE 100000
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Fill a block with samples from the ADC or the simulation.
+ */
+static int acquire(struct tlc1543 *tlc, uint16_t *block, size_t n,
+		   unsigned long long first)
+{
+	for (size_t i = 0; i < n; ++i) {
+		if (!tlc) {
+			const double t = (first + i) / 10000.0;
+			block[i] = 512 + 400 * sin(2 * M_PI * 5 * t) +
+				   rand() % 5 - 2;
+			continue;
+		}
+
+		const int sample = tlc1543_get_sample(tlc, 0);
+		if (sample < 0)
+			return sample;
+		block[i] = sample;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the log back and compare it with the samples still in the ring.
+ */
+static int verify(const char *path, const struct adc_pack_ring *ring)
+{
+	FILE *log = fopen(path, "rb");
+	if (!log) {
+		perror("unable to open the log");
+		return -1;
+	}
+
+	char magic[4];
+	uint32_t total;
+	if (fread(magic, 1, 4, log) != 4 || memcmp(magic, "ADCP", 4) ||
+	    fread(&total, sizeof(total), 1, log) != 1) {
+		fprintf(stderr, "Not a sample log\n");
+		fclose(log);
+		return -1;
+	}
+
+	/* Blocks are read whole, their size is only known once decoded */
+	uint8_t block[ADC_PACK_BLOCK_MAX];
+	uint16_t samples[ADC_PACK_BLOCK], kept[ADC_PACK_BLOCK];
+	size_t avail = fread(block, 1, sizeof(block), log);
+	unsigned long long index = 0;
+	int errors = 0;
+	while (index < total) {
+		const size_t n = total - index < ADC_PACK_BLOCK ?
+					 total - index :
+					 ADC_PACK_BLOCK;
+		const size_t len = adc_pack_block_decode(samples, block, n);
+		if (len == 0 || len > avail) {
+			fprintf(stderr, "Corrupted block at sample %llu\n",
+				index);
+			errors = -1;
+			break;
+		}
+
+		const long got = adc_pack_ring_read(ring, kept, index, n);
+		for (long i = 0; i < got; ++i)
+			errors += kept[i] != samples[i];
+
+		memmove(block, block + len, avail - len);
+		avail -= len;
+		avail += fread(block + avail, 1, sizeof(block) - avail, log);
+		index += n;
+	}
+	fclose(log);
+
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	const int sim = argc > 1 && strcmp(argv[1], "--sim") == 0;
+	const uint32_t total = argc > 1 + sim ? atol(argv[1 + sim]) : 100000;
+	const char *path = argc > 2 + sim ? argv[2 + sim] : "adc.log";
+	struct tlc1543 tlc;
+	struct adc_pack_ring ring;
+
+	if (!sim && tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+	if (adc_pack_ring_init(&ring, RING_SIZE) < 0) {
+		perror("unable to allocate the ring");
+		return EXIT_FAILURE;
+	}
+	FILE *log = fopen(path, "wb");
+	if (!log) {
+		perror("unable to create the log");
+		return EXIT_FAILURE;
+	}
+	fwrite("ADCP", 1, 4, log);
+	fwrite(&total, sizeof(total), 1, log);
+
+	uint16_t samples[ADC_PACK_BLOCK];
+	uint8_t block[ADC_PACK_BLOCK_MAX];
+	size_t log_size = 8;
+	double pack_time = 0;
+	for (unsigned long long index = 0; index < total;
+	     index += ADC_PACK_BLOCK) {
+		const size_t n = total - index < ADC_PACK_BLOCK ?
+					 total - index :
+					 ADC_PACK_BLOCK;
+		if (acquire(sim ? NULL : &tlc, samples, n, index) < 0) {
+			fprintf(stderr, "Unable to read the TLC1543\n");
+			break;
+		}
+
+		const double start = now();
+		adc_pack_ring_push(&ring, samples, n);
+		const size_t len = adc_pack_block_encode(block, samples, n);
+		pack_time += now() - start;
+
+		fwrite(block, 1, len, log);
+		log_size += len;
+	}
+	fclose(log);
+
+	const size_t kept = total < ring.capacity ? total : ring.capacity;
+	printf("%u samples, the last %zu kept in the ring\n", total, kept);
+	printf("As int:      %10zu bytes\n", kept * sizeof(int));
+	printf("As uint16_t: %10zu bytes\n", kept * sizeof(uint16_t));
+	printf("Packed ring: %10zu bytes\n", (size_t)ADC_PACK10_SIZE(kept));
+	printf("Log:         %10zu bytes for %u samples (%.2f bits per sample)\n",
+	       log_size, total, log_size * 8.0 / total);
+	printf("Packing and encoding: %.1f MB/s of uint16_t samples\n",
+	       total * sizeof(uint16_t) / pack_time / 1e6);
+
+	const int errors = verify(path, &ring);
+	if (errors)
+		fprintf(stderr, "The log does not match the ring (%d)\n",
+			errors);
+	else
+		printf("Log checked against the ring\n");
+
+	adc_pack_ring_delete(&ring);
+	if (!sim)
+		tlc1543_delete(&tlc);
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/**
+ * @brief Example monitoring the spectrum of a TLC1543 channel
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-26
+ *
+ * @example adc_spectrum.c
+ * Channel 0 is sampled at 1 kHz, every 128 samples the last 256 go through an FFT and the energy
+ * of 4 bands and the peak frequency are displayed (about 8 lines per second instead of 1000 samples).
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../include path is relative to the folder where this file is.
+ * gcc -Wall -O2 -I../include adc_spectrum.c -lgpiod -lm -o adc_spectrum.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./adc_spectrum.out [seconds]`, runs for 10 seconds by default.
+ */
+
+#include <arpi600/tlc1543.h>
+#include <adc-spectrum.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Sampling rate (Hz). */
+#define SAMPLE_RATE 1000
+/* Samples per block and new samples between blocks. */
+#define BLOCK_SIZE 256
+#define BLOCK_HOP 128
+/* Samples acquired before feeding them. */
+#define BATCH 32
+
+/*
+ * Display the result of a block.
+ */
+static void on_block(const struct adc_spectrum_result *res, void *data)
+{
+	(void)data;
+	printf("Block %4lu: peak %6.1f Hz, bands", res->block, res->peak_hz);
+	for (unsigned int b = 0; b < res->num_bands; ++b)
+		printf(" %10.2f", res->bands[b]);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	/* 4 bands: 1-10 Hz, 10-50 Hz, 50-200 Hz and 200-500 Hz */
+	static const float edges[] = { 1, 10, 50, 200, 500 };
+	const int seconds = argc > 1 ? atoi(argv[1]) : 10;
+	struct adc_spectrum spec;
+	struct tlc1543 tlc;
+	uint16_t samples[BATCH];
+	struct timespec next;
+
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+
+	if (adc_spectrum_init(&spec, BLOCK_SIZE, BLOCK_HOP, SAMPLE_RATE, edges,
+			      4, on_block, NULL) < 0) {
+		perror("unable to init the spectrum monitor");
+		tlc1543_delete(&tlc);
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (long n = 0; n < (long)seconds * SAMPLE_RATE / BATCH; ++n) {
+		for (int i = 0; i < BATCH; ++i) {
+			/* Sample at a fixed rate */
+			next.tv_nsec += 1000000000L / SAMPLE_RATE;
+			if (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				++next.tv_sec;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+					NULL);
+
+			const int value = tlc1543_get_sample(&tlc, 0);
+			samples[i] = value < 0 ? 0 : value;
+		}
+		adc_spectrum_feed(&spec, samples, BATCH);
+	}
+
+	adc_spectrum_delete(&spec);
+	tlc1543_delete(&tlc);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/**
+ * @brief Measure how many samples per second the TLC1543 library gets with each waiting method
+ * @copyright (c) Pierre Boisselier
+ *
+ * @example tlc1543_bench.c
+ * Samples channel 0 for one second with usleep, with the busy-wait delay and, when the EOC pin
+ * is wired, by spinning on EOC and by waiting for its rising edge.
+ *
+ * The EOC pin is not connected on the ArPi600, wire it to a free GPIO and give its number as argument:
+ * `sudo ./tlc1543_bench.out 26`
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpi600/arpi600.h>
+
+/*
+ * Get as many samples as possible during one second.
+ * Returns the number of samples, negative value on error.
+ */
+static long bench(struct tlc1543 *tlc)
+{
+	struct timespec start, now;
+	long samples = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		if (tlc1543_get_sample(tlc, 0) < 0)
+			return -1;
+		++samples;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000000000LL +
+			 (now.tv_nsec - start.tv_nsec) <
+		 1000000000LL);
+
+	return samples;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = { "usleep", "delay", "eoc spin",
+				       "eoc edge" };
+	struct tlc1543 tlc;
+	int last = TLC1543_WAIT_DELAY;
+
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 1) {
+		if (tlc1543_set_eoc(&tlc, atoi(argv[1]),
+				    TLC1543_WAIT_EOC_SPIN) < 0) {
+			perror("unable to use the EOC pin");
+			tlc1543_delete(&tlc);
+			return EXIT_FAILURE;
+		}
+		last = TLC1543_WAIT_EOC_EDGE;
+	}
+
+	printf("%10s %10s\n", "method", "samples/s");
+	for (int wait = TLC1543_WAIT_SLEEP; wait <= last; ++wait) {
+		if (tlc1543_set_wait(&tlc, wait) < 0) {
+			perror("unable to change the waiting method");
+			break;
+		}
+		const long samples = bench(&tlc);
+		if (samples < 0)
+			printf("%10s %10s\n", names[wait], "error");
+		else
+			printf("%10s %10ld\n", names[wait], samples);
+	}
+
+	tlc1543_delete(&tlc);
+
+	return EXIT_SUCCESS;
+}
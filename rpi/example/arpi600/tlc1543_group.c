@@ -0,0 +1,53 @@
+/**
+ * @brief Example reading several TLC1543 sharing the same clock
+ * @copyright (c) Pierre Boisselier
+ *
+ * @example tlc1543_group.c
+ * Two TLC1543 share I/O CLK (GPIO 16) and ADDR (GPIO 20), the first one uses the DATA_OUT pin of
+ * the ArPi600 (GPIO 21) and the second one GPIO 26.
+ * Channels 0 to 9 of both chips are scanned 10 times and displayed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpi600/arpi600.h>
+
+#define NUM_CHIPS 2
+#define NUM_CHANNELS 10
+
+int main(void)
+{
+	static const int data[NUM_CHIPS] = { TLC1543_PIN_DATA, 26 };
+	static const uint8_t channels[NUM_CHANNELS] = { 0, 1, 2, 3, 4,
+							5, 6, 7, 8, 9 };
+	uint16_t samples[NUM_CHANNELS * NUM_CHIPS];
+	struct tlc1543_group grp;
+
+	/* Initialize the group, both chips are clocked together. */
+	if (tlc1543_group_init(&grp, TLC1543_GPIO_CHIP_DEV, TLC1543_PIN_IOCLK,
+			       TLC1543_PIN_ADDR, data, NUM_CHIPS) < 0) {
+		perror("unable to init the TLC1543 group");
+		return EXIT_FAILURE;
+	}
+
+	for (int n = 0; n < 10; ++n) {
+		/* Acquire every channel of every chip. */
+		if (tlc1543_group_scan(&grp, channels, NUM_CHANNELS, samples) <
+		    0) {
+			perror("unable to read from the ADCs");
+			continue;
+		}
+		/* Display one line per chip. */
+		for (int c = 0; c < NUM_CHIPS; ++c) {
+			printf("ADC %d:", c);
+			for (int i = 0; i < NUM_CHANNELS; ++i)
+				printf(" %4u", samples[i * NUM_CHIPS + c]);
+			printf("\n");
+		}
+	}
+
+	/* Free up resources. */
+	tlc1543_group_delete(&grp);
+
+	return EXIT_SUCCESS;
+}
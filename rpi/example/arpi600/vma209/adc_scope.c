@@ -0,0 +1,162 @@
+/**
+ * @brief This examples uses the ArPi600 with the Vellmann VMA209 shield. It captures the potentiometer waveform around the moment it crosses a threshold.
+ * @example adc_scope.c
+ * @date 2022-02-25
+ * @copyright (c) Pierre Boisselier
+ *
+ * @details
+ * The potentiometer is sampled continuously into the rings of an @ref adc_scope.
+ * Each time it goes over the threshold (or when a falling edge happens on the GPIO pin given as second argument,
+ * e.g. a push button), the 64 samples before and 192 samples after are displayed as a small plot,
+ * straight from the frozen ring.
+ *
+ * @warning On the ArPi600 you need to make sure to set the A0 Jumper to T_A0, this will ensure that the potentiometer is tied to the
+ * ADC and not to the GPIO.
+ *
+ * ### Setup
+ *
+ * - Plug the ArPi600 on the Raspberry Pi GPIO header, then plug the VMA209 on the arduino adapter on the ArPi600.
+ * - Ensure that the A0 jumper is set on the T_A0 input.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../../include path is relative to the folder where this file is.
+ * gcc -Wall -g -I../../include adc_scope.c -lgpiod -pthread -o adc_scope.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./adc_scope.out [threshold] [trigger pin]`, shows 5 captures then quits.
+ */
+
+#include <arpi600/tlc1543.h>
+#include <adc-scope.h>
+#include <gpiod-isr.h>
+#include <gpiod-registry.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Default ADC channel for the potentiometer on the VMA209. */
+static const int adc_channel = 0;
+/* Samples kept before and after the trigger. */
+#define SCOPE_PRE 64
+#define SCOPE_POST 192
+/* Width and height of the plot. */
+#define PLOT_WIDTH 64
+#define PLOT_HEIGHT 8
+
+/* Scope, global so the GPIO interrupt handler can trigger it. */
+static struct adc_scope scope;
+
+/*
+ * Get a sample for the scope.
+ */
+static int acquire(void *tlc)
+{
+	return tlc1543_get_sample((struct tlc1543 *)tlc, adc_channel);
+}
+
+/*
+ * External trigger.
+ */
+static void on_gpio(struct gpiod_line *line, struct gpiod_line_event *event)
+{
+	(void)line;
+	(void)event;
+	adc_scope_trigger(&scope);
+}
+
+/*
+ * Display a capture, each column is the mean of size / PLOT_WIDTH samples.
+ */
+static void plot(const struct adc_scope_capture *cap)
+{
+	const size_t size = cap->len[0] + cap->len[1];
+	const size_t step = size / PLOT_WIDTH;
+	int columns[PLOT_WIDTH] = { 0 };
+
+	for (size_t i = 0; i < PLOT_WIDTH * step; ++i) {
+		/* Samples are read in place, from both segments */
+		const uint16_t value = i < cap->len[0] ?
+					       cap->samples[0][i] :
+					       cap->samples[1][i - cap->len[0]];
+		columns[i / step] += value;
+	}
+
+	printf("Capture %lu, trigger at sample %llu\n", cap->sequence,
+	       cap->index);
+	for (int row = PLOT_HEIGHT - 1; row >= 0; --row) {
+		for (int col = 0; col < PLOT_WIDTH; ++col)
+			putchar(columns[col] / (int)step * PLOT_HEIGHT / 1024 ==
+						row ?
+					'*' :
+					' ');
+		putchar('\n');
+	}
+	for (int col = 0; col < PLOT_WIDTH; ++col)
+		putchar(col == (int)(cap->trigger / step) ? '^' : '-');
+	putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+	const int threshold = argc > 1 ? atoi(argv[1]) : 512;
+	struct gpiod_chip *chip = NULL;
+	struct gpiod_isr *isr = NULL;
+	struct tlc1543 tlc;
+
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+
+	if (adc_scope_init(&scope, SCOPE_PRE, SCOPE_POST,
+			   argc > 2 ? ADC_SCOPE_TRIG_EXTERNAL :
+				      ADC_SCOPE_TRIG_RISING,
+			   threshold) < 0) {
+		perror("unable to init the scope");
+		tlc1543_delete(&tlc);
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 2) {
+		chip = gpiod_registry_chip_get("/dev/gpiochip0");
+		if (chip)
+			isr = gpiod_isr_request_falling_edge_events(
+				gpiod_chip_get_line(chip, atoi(argv[2])),
+				"adc_scope", on_gpio);
+		if (!isr) {
+			perror("unable to register the trigger interrupt");
+			goto cleanup;
+		}
+	}
+
+	if (adc_scope_start(&scope, acquire, &tlc) < 0) {
+		perror("unable to start the acquisition");
+		goto cleanup;
+	}
+
+	for (int n = 0; n < 5;) {
+		struct adc_scope_capture *cap = adc_scope_wait(&scope, 1000);
+		if (!cap)
+			continue;
+		plot(cap);
+		adc_scope_release(&scope, cap);
+		++n;
+	}
+
+	adc_scope_stop(&scope);
+	printf("Triggers missed: %lu\n", scope.missed);
+
+cleanup:
+	if (isr)
+		gpiod_isr_release(isr);
+	if (chip)
+		gpiod_registry_chip_put(chip);
+	adc_scope_delete(&scope);
+	tlc1543_delete(&tlc);
+
+	return EXIT_SUCCESS;
+}
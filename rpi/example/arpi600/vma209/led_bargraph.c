@@ -0,0 +1,99 @@
+/**
+ * @brief This examples uses the ArPi600 with the Vellmann VMA209 shield. The 4 LEDs show the value of the potentiometer as a bar graph.
+ * @example led_bargraph.c
+ * @date 2022-02-21
+ * @copyright (c) Pierre Boisselier
+ *
+ * @details
+ * Every LED is set on its own with @ref gpiod_output_group_set, but the LEDs are only written once per tick
+ * with @ref gpiod_output_group_flush, and not at all when the bar graph did not change.
+ * The number of writes done and saved is displayed when quitting.
+ *
+ * @warning On the ArPi600 you need to make sure to set the A0 Jumper to T_A0, this will ensure that the potentiometer is tied to the
+ * ADC and not to the GPIO.
+ *
+ * ### Setup
+ *
+ * - Plug the ArPi600 on the Raspberry Pi GPIO header, then plug the VMA209 on the arduino adapter on the ArPi600.
+ * - Ensure that the A0 jumper is set on the T_A0 input.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../../include path is relative to the folder where this file is.
+ * gcc -Wall -g -I../../include led_bargraph.c -lgpiod -pthread -o led_bargraph.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./led_bargraph.out [seconds]`, runs for 10 seconds by default.
+ */
+
+#include <arpi600/tlc1543.h>
+#include <gpiod-output.h>
+#include <gpiod-registry.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gpiod.h>
+
+/* GPIO Lines where the LEDs are connected (BCM ordering). */
+static const unsigned int gpio_leds[4] = { 11, 9, 10, 8 };
+/* All LEDs off, HIGH because the VMA209 uses pull-ups. */
+static const int leds_off[4] = { 1, 1, 1, 1 };
+/* Default ADC channel for the potentiometer on the VMA209. */
+static const int adc_channel = 0;
+/* Time between two ticks (us). */
+static const int tick_us = 20000;
+
+int main(int argc, char **argv)
+{
+	const int duration = argc > 1 ? atoi(argv[1]) : 10;
+
+	struct tlc1543 tlc;
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_chip *chip = gpiod_registry_chip_get("/dev/gpiochip0");
+	if (!chip) {
+		perror("unable to open gpiochip");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_line_bulk bulk;
+	struct gpiod_output_group leds;
+	if (gpiod_chip_get_lines(chip, (unsigned int *)gpio_leds, 4, &bulk) <
+		    0 ||
+	    gpiod_output_group_init(&leds, &bulk, "led_bargraph", leds_off) <
+		    0) {
+		perror("unable to request the LEDs");
+		gpiod_registry_chip_put(chip);
+		return EXIT_FAILURE;
+	}
+
+	for (int tick = 0; tick < duration * 1000000 / tick_us; ++tick) {
+		const int value = tlc1543_get_sample(&tlc, adc_channel);
+		if (value < 0)
+			continue;
+
+		/* Between 0 and 4 LEDs lit, LOW turns a LED on */
+		const int lit = value * 5 / 1024;
+		for (int i = 0; i < 4; ++i)
+			gpiod_output_group_set(&leds, i, i >= lit);
+
+		/* A single write for the 4 LEDs, none if the graph did not change */
+		gpiod_output_group_flush(&leds);
+		usleep(tick_us);
+	}
+
+	printf("Writes: %lu, skipped: %lu\n", leds.flushes, leds.skipped);
+
+	gpiod_output_group_release(&leds);
+	gpiod_registry_chip_put(chip);
+	tlc1543_delete(&tlc);
+
+	return EXIT_SUCCESS;
+}
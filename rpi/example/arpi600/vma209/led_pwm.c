@@ -0,0 +1,85 @@
+/**
+ * @brief This examples uses the ArPi600 with the Vellmann VMA209 shield. The 4 LEDs breathe with software PWM.
+ * @example led_pwm.c
+ * @date 2022-02-22
+ * @copyright (c) Pierre Boisselier
+ *
+ * @details
+ * The 4 LEDs are driven by a single thread with gpiod-pwm.h, each one fades in and out with a different phase.
+ * The jitter and the CPU usage of the PWM thread are displayed every second.
+ *
+ * @note The VMA209 LEDs are active low (pull-ups), the channels are inverted.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../../include path is relative to the folder where this file is.
+ * gcc -Wall -g -I../../include led_pwm.c -lgpiod -pthread -o led_pwm.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./led_pwm.out [seconds] [frequency]`, runs for 10 seconds at 200 Hz by default.
+ *
+ * ### Troubleshooting
+ *
+ * If the LEDs do not light up, this is probably because you enabled the SPI interface on the RaspberryPi, this interferes with the GPIO pins the LEDs are connected to.
+ */
+
+#include <gpiod-pwm.h>
+#include <gpiod-registry.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gpiod.h>
+
+/* GPIO Lines where the LEDs are connected (BCM ordering). */
+static const unsigned int gpio_leds[4] = { 11, 9, 10, 8 };
+/* Time to fade in or out (ms). */
+static const unsigned int fade_ms = 1000;
+
+int main(int argc, char **argv)
+{
+	const int duration = argc > 1 ? atoi(argv[1]) : 10;
+	const unsigned int frequency = argc > 2 ? atoi(argv[2]) : 200;
+
+	struct gpiod_chip *chip = gpiod_registry_chip_get("/dev/gpiochip0");
+	if (!chip) {
+		perror("unable to open gpiochip");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_line_bulk bulk;
+	struct gpiod_pwm pwm;
+	if (gpiod_chip_get_lines(chip, (unsigned int *)gpio_leds, 4, &bulk) <
+		    0 ||
+	    gpiod_pwm_init(&pwm, &bulk, "led_pwm", frequency, 0xf) < 0) {
+		perror("unable to start the PWM");
+		gpiod_registry_chip_put(chip);
+		return EXIT_FAILURE;
+	}
+
+	for (int second = 0; second < duration; ++second) {
+		/* Every LED changes direction each second, one LED out of two is in phase */
+		for (unsigned int i = 0; i < 4; ++i)
+			gpiod_pwm_fade(&pwm, i,
+				       (second + i) % 2 ? 0 :
+							  GPIOD_PWM_RESOLUTION,
+				       fade_ms);
+		sleep(1);
+
+		struct gpiod_pwm_stats stats;
+		gpiod_pwm_stats(&pwm, &stats);
+		printf("Periods: %lu, writes: %lu, jitter: %lld us (max %lld us), CPU: %.2f %%\n",
+		       stats.periods, stats.writes,
+		       (long long)stats.jitter_mean_ns / 1000,
+		       (long long)stats.jitter_max_ns / 1000,
+		       stats.cpu_usage * 100.0);
+	}
+
+	gpiod_pwm_release(&pwm);
+	gpiod_registry_chip_put(chip);
+
+	return EXIT_SUCCESS;
+}
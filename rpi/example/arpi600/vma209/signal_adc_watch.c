@@ -29,7 +29,7 @@
  * ### Run
  * 
  * The program will continuously run until the user inputs the letter 'q' and press return.
- * The value from the ADC will be continuously displayed for reference.
+ * The value from the ADC is displayed each time the alarm is triggered or un-triggered.
  * You can also start the example with a custom threshold, like so: 
  * `./signal_adc_watch.out 100`
  * DO NOT QUIT WITH SIGINT (Ctrl+C), this may cause the ADC to bug and you will not be able to read correct values from it until you restart the Raspberry Pi.
@@ -40,6 +40,8 @@
  */
 
 #include <arpi600/tlc1543.h>
+#include <adc-alarm.h>
+#include <gpiod-registry.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,6 +57,14 @@
 static const int adc_channel = 0;
 /* LEDs flash tempo. */
 static const int led_flash_tempo = 1;
+/* Hysteresis around the threshold. */
+static const uint16_t adc_hysteresis = 16;
+/* Time the value must stay over or under the threshold (ms). */
+static const unsigned int adc_dwell = 20;
+/* Approximate time taken by a sample (us). */
+static const unsigned int adc_period = 100;
+/* Number of samples acquired before running the alarm. */
+#define ADC_BATCH 32
 
 /* GPIO Lines where the LEDs are connected (BCM ordering). */
 static const unsigned int gpio_leds[4] = { 11, 9, 10, 8 };
@@ -107,7 +117,7 @@ void proc_led_flasher(void)
 	sigaction(SIGTERM, &sig, NULL);
 
 	/* Open GPIO chip and request lines. */
-	struct gpiod_chip *chip = gpiod_chip_open("/dev/gpiochip0");
+	struct gpiod_chip *chip = gpiod_registry_chip_get("/dev/gpiochip0");
 	struct gpiod_line_bulk lines;
 	gpiod_chip_get_lines(chip, gpio_leds, 4, &lines);
 	if (gpiod_line_request_bulk_output(&lines, "ADC Watcher)", leds_off) <
@@ -129,7 +139,7 @@ void proc_led_flasher(void)
 
 	/* Free resources. */
 	gpiod_line_release_bulk(&lines);
-	gpiod_chip_close(chip);
+	gpiod_registry_chip_put(chip);
 }
 
 /**
@@ -144,6 +154,29 @@ void proc_adc_watcher_sighandler(int signo)
 	}
 }
 
+/**
+ * @brief Called by the alarm engine when the potentiometer crosses the threshold.
+ * @param channel ADC channel.
+ * @param state ADC_ALARM_HIGH when over the threshold, ADC_ALARM_NORMAL otherwise.
+ * @param value Value read.
+ * @param data PID of the flasher process.
+ */
+void on_alarm(unsigned int channel, int state, uint16_t value, void *data)
+{
+	const pid_t flasher_pid = *(const pid_t *)data;
+
+	if (state == ADC_ALARM_HIGH) {
+		printf("Threshold triggered! (ADC %u: %u)\n", channel, value);
+		/* Send signal to flasher process to start flashing. */
+		kill(flasher_pid, SIGUSR1);
+	} else {
+		printf("Threshold un-triggered! (ADC %u: %u)\n", channel,
+		       value);
+		/* Send signal again to flasher process to stop flashing. */
+		kill(flasher_pid, SIGUSR2);
+	}
+}
+
 /**
  * @brief ADC watcher process.
  * @param flasher_pid Flasher process PID.
@@ -158,9 +191,15 @@ void proc_adc_watcher(const pid_t flasher_pid, int adc_threshold)
 	sigemptyset(&sig.sa_mask);
 	sigaction(SIGTERM, &sig, NULL);
 
-	bool threshold_triggered = false;
+	uint16_t samples[ADC_BATCH];
+	unsigned int num_samples = 0;
 	int value = 0;
 
+	/* Only the high threshold is used, the potentiometer is never too low. */
+	struct adc_alarm alarm;
+	adc_alarm_init(&alarm, 1, adc_period, on_alarm, (void *)&flasher_pid);
+	adc_alarm_set(&alarm, 0, 0, adc_threshold, adc_hysteresis, adc_dwell);
+
 	/* Initialize the ADC and take full ownership. */
 	struct tlc1543 tlc;
 	tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE);
@@ -173,19 +212,11 @@ void proc_adc_watcher(const pid_t flasher_pid, int adc_threshold)
 			continue;
 		}
 
-		printf("ADC Read: %d\n", value);
-
-		/* Trigger alarm or untrigger alarm depending on the value. */
-		if (value > adc_threshold && !threshold_triggered) {
-			threshold_triggered = true;
-			printf("Threshold triggered!\n");
-			/* Send signal to flasher process to start flashing. */
-			kill(flasher_pid, SIGUSR1);
-		} else if (value <= adc_threshold && threshold_triggered) {
-			threshold_triggered = false;
-			printf("Threshold un-triggered!\n");
-			/* Send signal again to flasher process to stop flashing. */
-			kill(flasher_pid, SIGUSR2);
+		samples[num_samples++] = value;
+		/* Run the alarm once per batch, it only calls on_alarm when the state changes. */
+		if (num_samples == ADC_BATCH) {
+			adc_alarm_feed(&alarm, 0, samples, num_samples);
+			num_samples = 0;
 		}
 	}
 
@@ -28,7 +28,7 @@
  * ### Run
  * 
  * The program will continuously run until the user inputs the letter 'q' and press return.
- * The value from the ADC will be continuously displayed for reference.
+ * The value from the ADC is displayed each time the alarm is triggered or un-triggered.
  * You can also start the example with a custom threshold, like so: 
  * `./thread_adc_watch.out 100`
  * DO NOT QUIT WITH SIGINT (Ctrl+C), this may cause the ADC to bug and you will not be able to read correct values from it until you restart the Raspberry Pi.
@@ -39,6 +39,8 @@
  */
 
 #include <arpi600/tlc1543.h>
+#include <adc-alarm.h>
+#include <gpiod-registry.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +62,14 @@ static const int leds_on[4] = { 0, 0, 0, 0 };
 static const int led_tempo = 1;
 /* Threshold for the potentiometer. */
 static int adc_threshold = 512;
+/* Hysteresis around the threshold. */
+static const uint16_t adc_hysteresis = 16;
+/* Time the value must stay over or under the threshold (ms). */
+static const unsigned int adc_dwell = 20;
+/* Approximate time taken by a sample (us). */
+static const unsigned int adc_period = 100;
+/* Number of samples acquired before running the alarm. */
+#define ADC_BATCH 32
 
 /* Shared boolean between threads, beware, this should be atomic for this program to be safer, however this is fine as an example. */
 static bool threshold_triggered = false;
@@ -101,6 +111,23 @@ void *flash_leds_thread(void *_gpio_leds)
 	return NULL;
 }
 
+/**
+ * @brief Called by the alarm engine when the potentiometer crosses the threshold.
+ * @param channel ADC channel.
+ * @param state ADC_ALARM_HIGH when over the threshold, ADC_ALARM_NORMAL otherwise.
+ * @param value Value read.
+ * @param data Unused.
+ */
+void on_alarm(unsigned int channel, int state, uint16_t value, void *data)
+{
+	(void)data;
+	printf("ADC %u: %d, threshold %s\n", channel, value,
+	       state == ADC_ALARM_HIGH ? "triggered" : "un-triggered");
+	/* NOTE: This should be relatively safe to do. 
+	 * But would be better if explicitly atomic. */
+	threshold_triggered = state == ADC_ALARM_HIGH;
+}
+
 /**
  * @brief Function that will keep reading the value of the potentiometer from the ADC and trigger the alarm.
  * @param _tlc Valid pointer to a tlc1543 structure which was initialized.
@@ -110,9 +137,16 @@ void *adc_watcher(void *_tlc)
 {
 	/* Convert the void pointer. */
 	struct tlc1543 *tlc = (struct tlc1543 *)_tlc;
-	/* ADC Value that was read. Goes from 0 to 1023. */
+	/* ADC Values that were read. Go from 0 to 1023. */
+	uint16_t samples[ADC_BATCH];
+	unsigned int num_samples = 0;
 	int value = 0;
 
+	/* Only the high threshold is used, the potentiometer is never too low. */
+	struct adc_alarm alarm;
+	adc_alarm_init(&alarm, 1, adc_period, on_alarm, NULL);
+	adc_alarm_set(&alarm, 0, 0, adc_threshold, adc_hysteresis, adc_dwell);
+
 	/* This will quit if we can get the lock, meaning the user wants to quit. */
 	while (pthread_mutex_trylock(&flag_quit) != 0) {
 		/* Get the value of the potentiometer. */
@@ -121,15 +155,11 @@ void *adc_watcher(void *_tlc)
 		if (value < 0) {
 			continue;
 		}
-		/* Display the value. */
-		printf("ADC: %d\n", value);
-		/* If the value is over the threshold, trigger the alarm. */
-		if (value > adc_threshold) {
-			/* NOTE: This should be relatively safe to do. 
-                         * But would be better if explicitly atomic. */
-			threshold_triggered = true;
-		} else {
-			threshold_triggered = false;
+		samples[num_samples++] = value;
+		/* Run the alarm once per batch, it only calls on_alarm when the state changes. */
+		if (num_samples == ADC_BATCH) {
+			adc_alarm_feed(&alarm, 0, samples, num_samples);
+			num_samples = 0;
 		}
 	}
 
@@ -159,7 +189,7 @@ int main(int argc, char **argv)
 	tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE);
 
 	/* Open the GPIO chip. */
-	struct gpiod_chip *chip = gpiod_chip_open("/dev/gpiochip0");
+	struct gpiod_chip *chip = gpiod_registry_chip_get("/dev/gpiochip0");
 	/* Get the lines where the LEDs are connected to. */
 	struct gpiod_line_bulk leds;
 	gpiod_chip_get_lines(chip, gpio_leds, 4, &leds);
@@ -200,7 +230,7 @@ int main(int argc, char **argv)
 	/* Release all acquired resources. */
 	tlc1543_delete(&tlc);
 	gpiod_line_release_bulk(&leds);
-	gpiod_chip_close(chip);
+	gpiod_registry_chip_put(chip);
 
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+/**
+ * @brief Example of a fixed-rate control loop from an ADC channel to a PWM duty cycle.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-03-07
+ * @example control_loop.c
+ * A PID loop runs at 1 kHz on the control-loop.h runtime, the setpoint steps from 300 to 700 (ADC counts) halfway through.
+ * The measurement and the output are displayed every 250 ms, then the deadline misses and the histograms
+ * of the wakeup latency and of the time spent in each tick.
+ *
+ * ### Simulation
+ *
+ * With `--sim` the loop runs end to end without any hardware, on the same runtime and timers:
+ * - The plant is a first-order system (e.g. a small heater): it settles to 100 + 0.8 * duty counts with a 50 ms time constant.
+ * - The ADC backend samples the plant when its conversion is started (pipelined, see @ref control_loop_input)
+ *   and quantizes it to 10 bits with some noise.
+ * - The PWM backend changes the input of the plant.
+ *
+ * ### Hardware
+ *
+ * Without `--sim` the loop reads a TLC1543 channel and drives a gpiod-pwm.h channel on a GPIO line,
+ * e.g. an LED lighting a photoresistor wired to the ADC.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * gcc -Wall -O2 -I../include control_loop.c -lgpiod -lm -pthread -o control_loop.out
+ * ```
+ *
+ * ### Usage
+ *
+ * ```sh
+ * ./control_loop.out --sim [seconds]
+ * chrt -f 50 ./control_loop.out <adc channel> <gpio line> [seconds]
+ * ```
+ */
+
+#include <control-loop.h>
+#include <gpiod-pwm.h>
+#include <gpiod-registry.h>
+#include <arpi600/tlc1543.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Simulated plant, ADC and PWM. */
+struct sim {
+	double value; ///< Output of the plant (ADC counts)
+	double duty; ///< Input of the plant (0 to GPIOD_PWM_RESOLUTION)
+	int64_t time_ns; ///< Time the plant was last advanced to
+	double sample; ///< Value captured by the last conversion
+	pthread_mutex_t lock; ///< The plant is shared with the display
+};
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Exact step of the first-order plant over the time elapsed */
+static void sim_advance(struct sim *sim)
+{
+	const int64_t now = now_ns();
+	const double target = 100.0 + 0.8 * sim->duty;
+	sim->value = target + (sim->value - target) *
+				      exp(-(now - sim->time_ns) / 50e6);
+	sim->time_ns = now;
+}
+
+static int sim_adc_start(void *data)
+{
+	struct sim *sim = (struct sim *)data;
+
+	pthread_mutex_lock(&sim->lock);
+	sim_advance(sim);
+	const double noisy = sim->value + (rand() % 5 - 2);
+	sim->sample = noisy < 0 ? 0 : noisy > 1023 ? 1023 : (int)noisy;
+	pthread_mutex_unlock(&sim->lock);
+
+	return 0;
+}
+
+static int sim_adc_read(void *data, double *value)
+{
+	struct sim *sim = (struct sim *)data;
+
+	pthread_mutex_lock(&sim->lock);
+	*value = sim->sample;
+	pthread_mutex_unlock(&sim->lock);
+
+	return 0;
+}
+
+static int sim_pwm_write(void *data, double duty)
+{
+	struct sim *sim = (struct sim *)data;
+
+	pthread_mutex_lock(&sim->lock);
+	sim_advance(sim);
+	sim->duty = duty;
+	pthread_mutex_unlock(&sim->lock);
+
+	return 0;
+}
+
+/** @brief ADC channel used as the input of the loop. */
+struct adc_input {
+	struct tlc1543 *tlc;
+	uint8_t channel;
+};
+
+static int adc_read(void *data, double *value)
+{
+	struct adc_input *in = (struct adc_input *)data;
+
+	const int sample = tlc1543_get_sample(in->tlc, in->channel);
+	if (sample < 0)
+		return sample;
+
+	*value = sample;
+	return 0;
+}
+
+static int pwm_write(void *data, double duty)
+{
+	return gpiod_pwm_set((struct gpiod_pwm *)data, 0,
+			     (unsigned int)(duty + 0.5));
+}
+
+static void print_histogram(const char *title, const unsigned long *hist)
+{
+	printf("%s\n", title);
+	for (int i = 0; i < CONTROL_LOOP_HIST_BUCKETS; ++i) {
+		if (!hist[i])
+			continue;
+		if (i == 0)
+			printf("   <  %6d us: %lu\n", 1, hist[i]);
+		else
+			printf("   >= %6d us: %lu\n", 1 << (i - 1), hist[i]);
+	}
+}
+
+static void run(struct control_loop *loop, double seconds)
+{
+	struct control_runtime rt;
+	if (control_runtime_init(&rt) < 0 ||
+	    control_runtime_add(&rt, loop) < 0 ||
+	    control_runtime_start(&rt) < 0) {
+		perror("unable to start the control loop");
+		return;
+	}
+
+	const int steps = seconds * 4;
+	for (int i = 0; i < steps; ++i) {
+		const double setpoint = i < steps / 2 ? 300.0 : 700.0;
+		control_loop_set_setpoint(loop, setpoint);
+		usleep(250000);
+
+		double measurement, output;
+		control_loop_get(loop, &measurement, &output);
+		printf("%6.2f s  setpoint %4.0f  measurement %7.2f  output %7.2f\n",
+		       (i + 1) / 4.0, setpoint, measurement, output);
+	}
+	control_runtime_destroy(&rt);
+
+	struct control_loop_stats stats;
+	control_loop_stats(loop, &stats);
+	printf("%lu ticks, %lu misses, %lu skipped, %lu errors\n", stats.ticks,
+	       stats.misses, stats.skipped, stats.errors);
+	printf("Wakeup latency max %lld us, tick max %lld us\n",
+	       (long long)stats.late_max_ns / 1000,
+	       (long long)stats.loop_max_ns / 1000);
+	print_histogram("Wakeup latency:", stats.late_hist);
+	print_histogram("Tick duration:", stats.loop_hist);
+}
+
+static int run_sim(double seconds)
+{
+	struct sim sim = { .value = 100.0, .time_ns = now_ns() };
+	pthread_mutex_init(&sim.lock, NULL);
+
+	struct control_loop_input in = { .start = sim_adc_start,
+					 .read = sim_adc_read,
+					 .data = &sim };
+	struct control_loop_output out = { .write = sim_pwm_write,
+					   .data = &sim };
+	struct control_loop loop;
+	if (control_loop_init(&loop, "sim", 1000, &in, &out) < 0) {
+		perror("unable to create the control loop");
+		return EXIT_FAILURE;
+	}
+	control_pid_init(&loop.pid, 0.5, 20.0, 0.0, 0.0,
+			 GPIOD_PWM_RESOLUTION);
+	control_filter_init(&loop.filter, 100.0, 1000.0);
+
+	run(&loop, seconds);
+
+	control_loop_destroy(&loop);
+	pthread_mutex_destroy(&sim.lock);
+	return EXIT_SUCCESS;
+}
+
+static int run_hardware(uint8_t channel, unsigned int gpio, double seconds)
+{
+	struct tlc1543 tlc;
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		fprintf(stderr, "Unable to open the TLC1543\n");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_line *line =
+		gpiod_registry_line_get(TLC1543_GPIO_CHIP_DEV, gpio);
+	struct gpiod_line_bulk bulk;
+	gpiod_line_bulk_init(&bulk);
+	if (line)
+		gpiod_line_bulk_add(&bulk, line);
+
+	struct gpiod_pwm pwm;
+	if (!line ||
+	    gpiod_pwm_init(&pwm, &bulk, "control_loop", 1000, 0) < 0) {
+		perror("unable to drive the PWM line");
+		gpiod_registry_line_put(line);
+		tlc1543_delete(&tlc);
+		return EXIT_FAILURE;
+	}
+
+	struct adc_input adc = { .tlc = &tlc, .channel = channel };
+	struct control_loop_input in = { .read = adc_read, .data = &adc };
+	struct control_loop_output out = { .write = pwm_write, .data = &pwm };
+	struct control_loop loop;
+	control_loop_init(&loop, "adc-pwm", 1000, &in, &out);
+	control_pid_init(&loop.pid, 0.5, 20.0, 0.0, 0.0,
+			 GPIOD_PWM_RESOLUTION);
+	control_filter_init(&loop.filter, 100.0, 1000.0);
+
+	run(&loop, seconds);
+
+	control_loop_destroy(&loop);
+	gpiod_pwm_release(&pwm);
+	gpiod_registry_chip_put(gpiod_line_get_chip(line));
+	tlc1543_delete(&tlc);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--sim") == 0)
+		return run_sim(argc > 2 ? atof(argv[2]) : 4.0);
+
+	if (argc < 3) {
+		fprintf(stderr,
+			"Usage: %s --sim [seconds]\n"
+			"       %s <adc channel> <gpio line> [seconds]\n",
+			argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return run_hardware(atoi(argv[1]), atoi(argv[2]),
+			    argc > 3 ? atof(argv[3]) : 4.0);
+}
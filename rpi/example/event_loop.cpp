@@ -0,0 +1,134 @@
+/**
+ * @brief Example using the coroutine event loop, several control sequences run on a single thread.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-16
+ * @example event_loop.cpp
+ * This watches falling edges on GPIO pin 12, samples the 10 channels of the TLC1543 every 100 ms
+ * and reads the pressure from the LPS25H every second, all without any thread.
+ * The program stops after 10 seconds.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../include path is relative to the folder where this file is.
+ * g++ -std=c++20 -Wall -I../include event_loop.cpp -lgpiod -o event_loop.out
+ * ```
+ */
+
+#include <event-loop.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std::chrono_literals;
+
+/* One sequence per ADC channel, they all share the same TLC1543. */
+static const int adc_channels = 10;
+
+/*
+ * Print every falling edge on a line.
+ */
+rpi::task<void> watch_button(rpi::event_loop &loop, struct gpiod_line *line)
+{
+	struct gpiod_line_event event;
+
+	for (;;) {
+		if (co_await loop.edge(line, event) < 0) {
+			perror("unable to wait for events");
+			co_return;
+		}
+		printf("Button pressed at %lld.%.9ld\n",
+		       (long long)event.ts.tv_sec, event.ts.tv_nsec);
+	}
+}
+
+/*
+ * Sample one ADC channel every 100 ms.
+ * The sequences wake up together, rpi::tlc1543_sample locks the ADC for each conversion
+ * so they take turns in the order they asked.
+ */
+rpi::task<void> sample_channel(rpi::event_loop &loop, struct tlc1543 &tlc,
+			       uint8_t channel)
+{
+	rpi::ticker tick(loop, 100ms);
+
+	for (;;) {
+		co_await tick.next();
+		int value = co_await rpi::tlc1543_sample(loop, tlc, channel);
+		if (value >= 0)
+			printf("ADC channel %d: %d\n", channel, value);
+	}
+}
+
+/*
+ * Read the pressure every second.
+ */
+rpi::task<void> read_pressure(rpi::event_loop &loop, struct lps25h &lps)
+{
+	rpi::ticker tick(loop, 1s);
+
+	for (;;) {
+		co_await tick.next();
+		double pressure = co_await rpi::lps25h_pressure(loop, lps);
+		printf("Pressure: %lf hPa\n", pressure);
+	}
+}
+
+/*
+ * Stop the loop after a delay.
+ */
+rpi::task<void> stop_after(rpi::event_loop &loop, std::chrono::seconds delay)
+{
+	co_await loop.sleep_for(delay);
+	loop.stop();
+}
+
+int main(void)
+{
+	rpi::event_loop loop;
+	if (!loop.valid()) {
+		perror("unable to create the event loop");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_chip *chip = gpiod_registry_chip_get("/dev/gpiochip0");
+	if (!chip) {
+		perror("unable to open gpiochip");
+		return EXIT_FAILURE;
+	}
+	struct gpiod_line *button = gpiod_chip_get_line(chip, 12);
+	if (!button || gpiod_line_request_falling_edge_events(
+			       button, "event_loop") < 0) {
+		perror("unable to request button line");
+		gpiod_registry_chip_put(chip);
+		return EXIT_FAILURE;
+	}
+
+	struct tlc1543 tlc;
+	if (tlc1543_init(&tlc, TLC1543_OPT_EXCLUSIVE) < 0) {
+		perror("unable to init the TLC1543");
+		return EXIT_FAILURE;
+	}
+
+	struct lps25h lps;
+	if (lps25h_init(&lps) < 0) {
+		perror("unable to init the LPS25H");
+		return EXIT_FAILURE;
+	}
+
+	loop.spawn(watch_button(loop, button));
+	for (int i = 0; i < adc_channels; ++i)
+		loop.spawn(sample_channel(loop, tlc, i));
+	loop.spawn(read_pressure(loop, lps));
+	loop.spawn(stop_after(loop, 10s));
+
+	loop.run();
+
+	lps25h_close(&lps);
+	tlc1543_delete(&tlc);
+	gpiod_line_release(button);
+	gpiod_registry_chip_put(chip);
+
+	return EXIT_SUCCESS;
+}
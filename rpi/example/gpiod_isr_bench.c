@@ -0,0 +1,170 @@
+/**
+ * @brief Benchmark of the gpiod-isr bulk watcher on 16 lines of a gpio-sim chip.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-14
+ * @example gpiod_isr_bench.c
+ * This toggles 16 simulated lines as fast as possible for a few seconds while a bulk watcher listens to both edges,
+ * then displays how many events per second were handled and how many wait/read calls the watcher needed per event.
+ *
+ * ### Setup
+ *
+ * The gpio-sim kernel module is needed (Linux 5.17+), create a chip with 16 lines through configfs:
+ *
+ * ```sh
+ * sudo modprobe gpio-sim
+ * sudo mkdir -p /sys/kernel/config/gpio-sim/bench/bank0
+ * echo 16 | sudo tee /sys/kernel/config/gpio-sim/bench/bank0/num_lines
+ * echo 1 | sudo tee /sys/kernel/config/gpio-sim/bench/live
+ * # Name of the chip created (e.g. gpiochip2)
+ * cat /sys/kernel/config/gpio-sim/bench/bank0/chip_name
+ * ```
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # libgpiod v1
+ * gcc -Wall -O2 -I../include gpiod_isr_bench.c -lgpiod -pthread -o gpiod_isr_bench.out
+ * # libgpiod v2
+ * gcc -Wall -O2 -I../include -DLIBGPIOD_V2 gpiod_isr_bench.c -lgpiod -pthread -o gpiod_isr_bench_v2.out
+ * ```
+ *
+ * ### Run
+ *
+ * `sudo ./gpiod_isr_bench.out gpiochip2 [seconds]`
+ */
+
+#include <gpiod-isr.h>
+#include <gpiod-registry.h>
+#include <gpiod.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/* Number of lines watched. */
+#define BENCH_NUM_LINES 16
+
+/* Set to 0 to stop the toggler thread. */
+static volatile int toggler_run = 1;
+/* Number of edges generated by the toggler thread. */
+static unsigned long edges_generated = 0;
+
+/*
+ * Interrupt handler, nothing to do as the watcher already counts events.
+ */
+void bench_handler(struct gpiod_line *line, struct gpiod_line_event *event)
+{
+	(void)line;
+	(void)event;
+}
+
+/*
+ * Toggle every simulated line by changing its pull, each write generates an edge.
+ */
+void *toggler(void *_pulls)
+{
+	int *pulls = (int *)_pulls;
+	int level = 0;
+
+	while (toggler_run) {
+		level = !level;
+		for (int i = 0; i < BENCH_NUM_LINES; ++i) {
+			const char *pull = level ? "pull-up" : "pull-down";
+			if (pwrite(pulls[i], pull, strlen(pull), 0) > 0)
+				++edges_generated;
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <gpiochipX> [seconds]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const int duration = argc > 2 ? atoi(argv[2]) : 5;
+	char path[128];
+	int pulls[BENCH_NUM_LINES];
+	unsigned int offsets[BENCH_NUM_LINES];
+
+	/* Open the pull attribute of every simulated line. */
+	for (int i = 0; i < BENCH_NUM_LINES; ++i) {
+		snprintf(path, sizeof(path),
+			 "/sys/bus/gpio/devices/%s/sim_gpio%d/pull", argv[1], i);
+		pulls[i] = open(path, O_WRONLY);
+		if (pulls[i] < 0) {
+			perror("unable to open gpio-sim pull attribute");
+			return EXIT_FAILURE;
+		}
+		offsets[i] = i;
+	}
+
+	snprintf(path, sizeof(path), "/dev/%s", argv[1]);
+	struct gpiod_chip *chip = gpiod_registry_chip_get(path);
+	if (!chip) {
+		perror("unable to open gpiochip");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_line_bulk lines;
+	if (gpiod_chip_get_lines(chip, offsets, BENCH_NUM_LINES, &lines) < 0) {
+		perror("unable to get lines");
+		gpiod_registry_chip_put(chip);
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_isr_bulk *isr = gpiod_isr_request_bulk_both_edges_events(
+		&lines, "gpiod_isr_bench", bench_handler);
+	if (!isr) {
+		perror("unable to register interrupt");
+		gpiod_registry_chip_put(chip);
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start, end;
+	pthread_t thread;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&thread, NULL, toggler, (void *)pulls);
+	sleep(duration);
+	toggler_run = 0;
+	pthread_join(thread, NULL);
+	/* Let the watcher drain the last events. */
+	usleep(100000);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const double elapsed = (end.tv_sec - start.tv_sec) +
+			       (end.tv_nsec - start.tv_nsec) / 1e9;
+	const unsigned long events = __atomic_load_n(&isr->events,
+						     __ATOMIC_RELAXED);
+	const unsigned long syscalls = __atomic_load_n(&isr->syscalls,
+						       __ATOMIC_RELAXED);
+	const unsigned long errors = __atomic_load_n(&isr->errors,
+						     __ATOMIC_RELAXED);
+
+	printf("Backend:          libgpiod %s\n",
+#ifdef LIBGPIOD_V2
+	       "v2"
+#else
+	       "v1"
+#endif
+	);
+	printf("Edges generated:  %lu\n", edges_generated);
+	printf("Events handled:   %lu (%.0f events/s)\n", events,
+	       events / elapsed);
+	printf("Watcher syscalls: %lu (%.3f per event)\n", syscalls,
+	       events ? (double)syscalls / events : 0.0);
+	printf("Watcher errors:   %lu\n", errors);
+
+	gpiod_isr_release_bulk(isr);
+	gpiod_registry_chip_put(chip);
+	for (int i = 0; i < BENCH_NUM_LINES; ++i)
+		close(pulls[i]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/**
+ * @brief Replay recorded edge traces through the pulse-width decoders of gpiod-pulse.h.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-19
+ * @example gpiod_pulse_replay.c
+ * Traces were recorded with a bulk watcher printing the time between edges, they are given to the
+ * decoders exactly like the watcher does, and the decoded frames are compared to what was sent.
+ * The program fails if a frame is missing or wrong, which makes it handy to check a change to a decoder.
+ *
+ * Decoding live from a GPIO only needs `gpiod_pulse_request` instead of `gpiod_pulse_feed`.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../include path is relative to the folder where this file is.
+ * gcc -Wall -I../include gpiod_pulse_replay.c -lgpiod -pthread -o gpiod_pulse_replay.out
+ * ```
+ */
+
+#include <gpiod-pulse.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Pulse widths in microseconds, levels alternate starting with the level given to replay().
+ */
+/* DHT22 answering 65.3 % and 23.1 °C, starts with the 1 ms low start signal. */
+static const unsigned int dht22_trace[] = {
+	1077, 29, 81, 76, 50, 27, 47, 27, 47, 27, 47, 26, 50, 28, 48, 26, 51,
+	74, 50, 27, 53, 66, 52, 26, 48, 26, 49, 28, 48, 71, 51, 69, 50, 26, 47,
+	68, 51, 27, 49, 27, 50, 26, 52, 28, 48, 27, 50, 28, 51, 26, 53, 26, 50,
+	72, 48, 70, 47, 71, 52, 27, 52, 26, 51, 71, 50, 70, 52, 74, 50, 28, 47,
+	72, 51, 74, 52, 68, 49, 28, 47, 70, 48, 67, 47, 28, 48,
+};
+
+/* NEC remote, address 0x00 command 0x45, then a repeat code, starts high (idle). */
+static const unsigned int nec_trace[] = {
+	20000, 8864, 4471, 585, 532, 557, 563, 586, 581, 584, 545, 554, 551,
+	586, 591, 537, 538, 542, 542, 559, 1708, 544, 1589, 555, 1663, 564,
+	1782, 573, 1693, 568, 1726, 530, 1771, 579, 1766, 580, 1668, 553, 533,
+	569, 1601, 531, 540, 537, 549, 530, 526, 537, 1609, 551, 528, 585, 568,
+	536, 1640, 550, 551, 535, 1761, 593, 1683, 559, 1606, 533, 549, 544,
+	1757, 537, 39618, 9244, 2254, 536,
+};
+
+/* 433 MHz remote sending 0x5a3c96 (24 bits) three times, starts high. */
+static const unsigned int rc433_trace[] = {
+	342, 10341, 341, 1079, 1064, 348, 330, 1004, 979, 351, 1024, 351, 333,
+	986, 1058, 360, 354, 1057, 353, 1049, 329, 1022, 1002, 321, 962, 331,
+	991, 348, 1076, 338, 358, 1080, 359, 1003, 986, 329, 328, 984, 345,
+	1069, 1062, 339, 346, 1057, 969, 347, 1070, 352, 350, 1017, 327, 10662,
+	333, 1057, 1078, 336, 336, 1075, 1048, 327, 974, 326, 357, 1058, 977,
+	353, 360, 1039, 334, 1026, 325, 961, 1078, 346, 1023, 358, 1012, 355,
+	1060, 328, 330, 995, 329, 1031, 991, 337, 325, 1070, 334, 1015, 1030,
+	356, 337, 1071, 1020, 341, 1023, 320, 338, 981, 320, 10666, 327, 1017,
+	1048, 342, 333, 1022, 1027, 352, 972, 342, 330, 993, 1053, 340, 343,
+	1052, 357, 1013, 345, 1021, 1021, 348, 1014, 341, 1017, 358, 1044, 355,
+	358, 991, 342, 1074, 1062, 325, 325, 1013, 323, 988, 968, 347, 352,
+	1069, 978, 349, 1040, 325, 356, 1077, 329, 10731,
+};
+
+/* Frames decoded by the last replay. */
+static struct gpiod_pulse_frame frames[8];
+static unsigned int num_frames = 0;
+
+/*
+ * Frame handler, keeps a copy of every frame.
+ */
+void on_frame(struct gpiod_pulse_decoder *dec,
+	      const struct gpiod_pulse_frame *frame)
+{
+	(void)dec;
+	if (num_frames < sizeof(frames) / sizeof(*frames))
+		frames[num_frames++] = *frame;
+}
+
+/*
+ * Feed a trace to a new decoder, an edge is generated at the start of every pulse.
+ */
+static void replay(int protocol, const unsigned int *trace, size_t len,
+		   int first_level)
+{
+	struct gpiod_pulse_decoder dec;
+	struct gpiod_line_event event;
+	long long ns = 1000000000LL;
+	int level = first_level;
+
+	gpiod_pulse_init(&dec, protocol, on_frame, NULL);
+	num_frames = 0;
+
+	for (size_t i = 0; i <= len; ++i) {
+		event.ts.tv_sec = ns / 1000000000LL;
+		event.ts.tv_nsec = ns % 1000000000LL;
+		event.event_type = level ? GPIOD_LINE_EVENT_RISING_EDGE :
+					   GPIOD_LINE_EVENT_FALLING_EDGE;
+		gpiod_pulse_feed(&dec, &event);
+
+		if (i < len)
+			ns += trace[i] * 1000LL;
+		level = !level;
+	}
+
+	printf("%lu frame(s), %lu error(s)\n", dec.frames, dec.errors);
+}
+
+/*
+ * Print the result of a check.
+ */
+static int check(const char *what, int ok)
+{
+	printf("  %-40s %s\n", what, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(void)
+{
+	int failures = 0;
+
+	printf("DHT22: ");
+	replay(GPIOD_PULSE_DHT22, dht22_trace,
+	       sizeof(dht22_trace) / sizeof(*dht22_trace), 0);
+	failures += check("one frame", num_frames == 1);
+	if (num_frames) {
+		printf("  %.1f %%, %.1f C\n",
+		       gpiod_pulse_dht22_humidity(&frames[0]),
+		       gpiod_pulse_dht22_temperature(&frames[0]));
+		failures += check("humidity 65.3 %",
+				  frames[0].data[0] == 0x02 &&
+					  frames[0].data[1] == 0x8d);
+		failures += check("temperature 23.1 C",
+				  frames[0].data[2] == 0x00 &&
+					  frames[0].data[3] == 0xe7);
+	}
+
+	printf("NEC: ");
+	replay(GPIOD_PULSE_NEC, nec_trace,
+	       sizeof(nec_trace) / sizeof(*nec_trace), 1);
+	failures += check("frame and repeat", num_frames == 2);
+	if (num_frames == 2) {
+		printf("  address %#x, command %#x\n", frames[0].data[0],
+		       frames[0].data[2]);
+		failures += check("address 0x00 command 0x45",
+				  frames[0].data[0] == 0x00 &&
+					  frames[0].data[2] == 0x45);
+		failures += check("repeat code",
+				  frames[1].repeat == 1 &&
+					  frames[1].data[2] == 0x45);
+	}
+
+	printf("433 MHz: ");
+	replay(GPIOD_PULSE_RC433, rc433_trace,
+	       sizeof(rc433_trace) / sizeof(*rc433_trace), 1);
+	failures += check("three transmissions", num_frames == 3);
+	for (unsigned int i = 0; i < num_frames; ++i) {
+		const uint8_t *d = frames[i].data;
+		printf("  %u bits, T = %u us, code %#x, repeat %u\n",
+		       frames[i].bits, frames[i].pulse_us,
+		       (d[0] << 16) | (d[1] << 8) | d[2], frames[i].repeat);
+		const int ok = frames[i].bits == 24 && d[0] == 0x5a &&
+			       d[1] == 0x3c && d[2] == 0x96 &&
+			       frames[i].repeat == i;
+		failures += check("code 0x5a3c96", ok);
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/**
+ * @brief Find the maximum edge rate the quadrature decoder keeps up with, using 2 lines of a gpio-sim chip.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-18
+ * @example gpiod_quadrature_bench.c
+ * This simulates an encoder turning forward on lines 0 (A) and 1 (B) at increasing edge rates.
+ * Each rate runs for one second, it is sustained if the decoded position matches the number of
+ * generated edges without any error.
+ * The benchmark stops at the first rate that is not sustained.
+ *
+ * ### Setup
+ *
+ * The gpio-sim kernel module is needed (Linux 5.17+), create a chip with 2 lines through configfs:
+ *
+ * ```sh
+ * sudo modprobe gpio-sim
+ * sudo mkdir -p /sys/kernel/config/gpio-sim/encoder/bank0
+ * echo 2 | sudo tee /sys/kernel/config/gpio-sim/encoder/bank0/num_lines
+ * echo 1 | sudo tee /sys/kernel/config/gpio-sim/encoder/live
+ * # Name of the chip created (e.g. gpiochip2)
+ * cat /sys/kernel/config/gpio-sim/encoder/bank0/chip_name
+ * ```
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../include path is relative to the folder where this file is.
+ * gcc -Wall -O2 -I../include gpiod_quadrature_bench.c -lgpiod -pthread -o gpiod_quadrature_bench.out
+ * ```
+ *
+ * ### Run
+ *
+ * `sudo ./gpiod_quadrature_bench.out gpiochip2`
+ */
+
+#include <gpiod-quadrature.h>
+#include <gpiod.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/* First rate tested (edges/s), doubled at each step. */
+#define BENCH_START_RATE 1000
+/* Last rate tested (edges/s). */
+#define BENCH_MAX_RATE 4096000
+
+/*
+ * Set the level of a simulated line by changing its pull.
+ */
+static int set_level(int pull, int level)
+{
+	const char *value = level ? "pull-up" : "pull-down";
+	return pwrite(pull, value, strlen(value), 0) > 0 ? 0 : -1;
+}
+
+/*
+ * Generate edges forward at the given rate for one second.
+ * Returns the number of edges generated, the rate can be lower than asked if writing is too slow.
+ */
+static long turn(int *pulls, long rate)
+{
+	/* Gray code sequence, one line changes at each step */
+	static const int sequence[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+	static int step = 0;
+	struct timespec next, start, now;
+	long edges = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+
+	do {
+		const int next_step = (step + 1) % 4;
+		/* Only the line that changes is written, on failure the same step is tried again */
+		const int line = sequence[step][0] != sequence[next_step][0] ? 0 : 1;
+		if (set_level(pulls[line], sequence[next_step][line]) == 0) {
+			step = next_step;
+			++edges;
+		}
+
+		next.tv_nsec += 1000000000L / rate;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			++next.tv_sec;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while ((now.tv_sec - start.tv_sec) * 1000000000LL +
+			 (now.tv_nsec - start.tv_nsec) <
+		 1000000000LL);
+
+	return edges;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <gpiochipX>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char path[128];
+	int pulls[2];
+
+	for (int i = 0; i < 2; ++i) {
+		snprintf(path, sizeof(path),
+			 "/sys/bus/gpio/devices/%s/sim_gpio%d/pull", argv[1], i);
+		pulls[i] = open(path, O_WRONLY);
+		if (pulls[i] < 0 || set_level(pulls[i], 0) < 0) {
+			perror("unable to open gpio-sim pull attribute");
+			return EXIT_FAILURE;
+		}
+	}
+
+	snprintf(path, sizeof(path), "/dev/%s", argv[1]);
+	struct gpiod_chip *chip = gpiod_chip_open(path);
+	if (!chip) {
+		perror("unable to open gpiochip");
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_quadrature enc;
+	if (gpiod_quadrature_init(&enc, gpiod_chip_get_line(chip, 0),
+				  gpiod_chip_get_line(chip, 1),
+				  "gpiod_quadrature_bench") < 0) {
+		perror("unable to start the decoder");
+		gpiod_chip_close(chip);
+		return EXIT_FAILURE;
+	}
+	/* Let the watcher read the initial state */
+	usleep(100000);
+
+	printf("%12s %12s %12s %12s %8s\n", "asked/s", "edges/s", "position",
+	       "errors", "status");
+
+	long sustained = 0;
+	for (long rate = BENCH_START_RATE; rate <= BENCH_MAX_RATE; rate *= 2) {
+		gpiod_quadrature_reset(&enc);
+		const unsigned long errors = gpiod_quadrature_errors(&enc);
+
+		const long edges = turn(pulls, rate);
+		/* Let the watcher drain the last events */
+		usleep(100000);
+
+		const long position = gpiod_quadrature_position(&enc);
+		const unsigned long new_errors =
+			gpiod_quadrature_errors(&enc) - errors;
+		const int ok = position == edges && new_errors == 0;
+
+		printf("%12ld %12ld %12ld %12lu %8s\n", rate, edges, position,
+		       new_errors, ok ? "ok" : "lost");
+		if (!ok)
+			break;
+		sustained = edges;
+	}
+
+	printf("Maximum sustained rate: %ld edges/s\n", sustained);
+
+	gpiod_quadrature_release(&enc);
+	gpiod_chip_close(chip);
+	for (int i = 0; i < 2; ++i)
+		close(pulls[i]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/**
+ * @brief Example keeping the history of the LPS25H pressure in a rollup.
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-03-09
+ * @example rollup.c
+ * The pressure is sampled 10 times per second into rollup.h tiers, every 10 seconds the minimum,
+ * maximum and mean of the last minute, hour and day are displayed, each from a few dozen buckets.
+ *
+ * ### Simulation
+ *
+ * With `--sim` three days of a simulated pressure (a daily swing with noise, 10 samples per second)
+ * are added with their timestamps in a few seconds, then the same queries are compared with a scan of the raw samples:
+ * the memory of both and the time taken by each query are displayed.
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * gcc -Wall -O2 -I../include rollup.c -lm -pthread -o rollup.out
+ * ```
+ *
+ * ### Usage
+ *
+ * ```sh
+ * ./rollup.out --sim
+ * ./rollup.out [seconds]
+ * ```
+ */
+
+#include <rollup.h>
+#include <sense-hat/lps25h.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Samples per second. */
+#define RATE 10
+/* Simulated history (s). */
+#define SIM_SECONDS (3 * 86400)
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_bucket(const char *name, const struct rollup_bucket *b)
+{
+	printf("%-8s %8lu samples  min %8.2f  max %8.2f  mean %8.2f\n", name,
+	       b->count, b->min, b->max, rollup_mean(b));
+}
+
+static int run_sim(void)
+{
+	static const struct {
+		const char *name;
+		unsigned int seconds;
+	} ranges[] = { { "1 min", 60 }, { "1 hour", 3600 }, { "1 day", 86400 },
+		       { "3 days", SIM_SECONDS } };
+	const size_t total = (size_t)SIM_SECONDS * RATE;
+
+	struct rollup rollup;
+	float *raw = (float *)malloc(total * sizeof(*raw));
+	if (!raw || rollup_init(&rollup, 0, 0, 0) < 0) {
+		perror("unable to allocate the history");
+		free(raw);
+		return EXIT_FAILURE;
+	}
+
+	/* The history ends now */
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	const int64_t end = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	const int64_t start = end - (int64_t)SIM_SECONDS * 1000000000LL;
+	const int64_t step = 1000000000LL / RATE;
+	double t0 = now();
+	for (size_t i = 0; i < total; ++i) {
+		const double day = (double)i / RATE / 86400;
+		raw[i] = 1013.25 + 4 * sin(2 * M_PI * day) +
+			 (rand() % 100 - 50) / 100.0;
+		rollup_add_at(&rollup, start + (int64_t)i * step, raw[i]);
+	}
+	printf("%zu samples added in %.2f s (%.1f ns each)\n", total,
+	       now() - t0, (now() - t0) * 1e9 / total);
+
+	size_t buckets = 0;
+	for (int k = 0; k < ROLLUP_TIERS; ++k)
+		buckets += rollup.tiers[k].size;
+	printf("Raw samples: %zu bytes, rollup: %zu bytes\n\n",
+	       total * sizeof(*raw), buckets * sizeof(struct rollup_bucket));
+
+	for (size_t q = 0; q < sizeof(ranges) / sizeof(*ranges); ++q) {
+		const int64_t from =
+			end - (int64_t)ranges[q].seconds * 1000000000LL;
+		struct rollup_bucket res, scan = { 0 };
+
+		t0 = now();
+		rollup_query(&rollup, from, end, &res);
+		const double rollup_us = (now() - t0) * 1e6;
+
+		t0 = now();
+		scan.min = scan.max = raw[total - 1];
+		for (size_t i = (from - start) / step; i < total; ++i) {
+			scan.min = raw[i] < scan.min ? raw[i] : scan.min;
+			scan.max = raw[i] > scan.max ? raw[i] : scan.max;
+			scan.sum += raw[i];
+			++scan.count;
+		}
+		const double scan_us = (now() - t0) * 1e6;
+
+		print_bucket(ranges[q].name, &res);
+		print_bucket("  scan", &scan);
+		printf("  rollup %.1f us, scan %.1f us\n", rollup_us, scan_us);
+	}
+
+	rollup_delete(&rollup);
+	free(raw);
+	return EXIT_SUCCESS;
+}
+
+static int run_sensor(unsigned int seconds)
+{
+	struct lps25h lps;
+	if (lps25h_init(&lps) < 0) {
+		fprintf(stderr, "Unable to open the LPS25H\n");
+		return EXIT_FAILURE;
+	}
+	struct rollup rollup;
+	if (rollup_init(&rollup, 0, 0, 0) < 0) {
+		perror("unable to allocate the history");
+		lps25h_close(&lps);
+		return EXIT_FAILURE;
+	}
+
+	for (unsigned int i = 1; i <= seconds * RATE; ++i) {
+		double hpa;
+		if (lps25h_get_cached(&lps, 0, &hpa, NULL) >= 0)
+			rollup_add(&rollup, hpa);
+		usleep(1000000 / RATE);
+
+		if (i % (10 * RATE))
+			continue;
+		struct rollup_bucket minute, hour, day;
+		rollup_last(&rollup, 60, &minute);
+		rollup_last(&rollup, 3600, &hour);
+		rollup_last(&rollup, 86400, &day);
+		print_bucket("1 min", &minute);
+		print_bucket("1 hour", &hour);
+		print_bucket("1 day", &day);
+	}
+
+	rollup_delete(&rollup);
+	lps25h_close(&lps);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--sim") == 0)
+		return run_sim();
+
+	return run_sensor(argc > 1 ? atoi(argv[1]) : 60);
+}
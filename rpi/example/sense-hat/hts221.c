@@ -0,0 +1,79 @@
+/**
+ * @brief Example using the humidity sensor HTS221.
+ * @date 2022-03-03
+ *
+ * @copyright (c) Pierre Boisselier
+ * @example hts221.c
+ * Reads one one-shot sample, then samples continuously at 12.5 Hz and prints the new values.
+ *
+ * ## Compilation
+ *
+ * ```
+ * gcc -Wall -g -I../../include hts221.c -o hts221.out
+ * ```
+ *
+ * ## Usage
+ *
+ * `./hts221.out [i2c device] [samples]`, uses /dev/i2c-1 and 50 samples by default.
+ *
+ * ### Without the hardware
+ *
+ * The sensor can be faked with i2c-stub, a register map is then accessed through SMBus transfers.
+ * i2c-stub has no auto-increment bit: multi-register reads start at `register | 0x80`,
+ * so the calibration and the outputs are loaded there.
+ *
+ * ```sh
+ * sudo modprobe i2c-stub chip_addr=0x5f
+ * # WHO_AM_I
+ * sudo i2cset -y X 0x5f 0x0f 0xbc
+ * # Calibration: 30 %rH at 0, 70 %rH at 4000, 10 °C at 0, 30 °C at 2000
+ * sudo i2cset -y X 0x5f 0xb0 0x3c 0x8c 0x50 0xf0 0 0 0 0 0 0 0xa0 0x0f 0 0 0xd0 0x07 i
+ * # Status (new values), read alone and with the outputs
+ * sudo i2cset -y X 0x5f 0x27 0x03
+ * # Humidity 2000 and temperature 1000: 50 %rH and 20 °C
+ * sudo i2cset -y X 0x5f 0xa7 0x03 0xd0 0x07 0xe8 0x03 i
+ *
+ * ./hts221.out /dev/i2c-X 5
+ * ```
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sense-hat/hts221.h>
+
+int main(int argc, char *argv[])
+{
+	const char *device = argc > 1 ? argv[1] : RPI_I2C_DEVICE;
+	const int samples = argc > 2 ? atoi(argv[2]) : 50;
+
+	struct hts221 hts;
+	int ret = hts221_init_c_l(&hts, device, HTS221_I2C_ADDR);
+	if (ret < 0) {
+		fprintf(stderr, "Unable to open the HTS221 (%d)\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	double humidity, temperature;
+	if (hts221_get(&hts, &humidity, &temperature) < 0) {
+		fprintf(stderr, "Unable to read the HTS221\n");
+		hts221_close(&hts);
+		return EXIT_FAILURE;
+	}
+	printf("One-shot: %.1f %%rH, %.2f °C\n", humidity, temperature);
+
+	/* 80 ms between conversions, poll a bit faster and only print new values */
+	hts221_set_rate(&hts, HTS221_ODR_12_5HZ);
+	for (int i = 0; i < samples;) {
+		ret = hts221_read(&hts, &humidity, &temperature);
+		if (ret < 0)
+			break;
+		if (ret == (HTS221_STATUS_H_DA | HTS221_STATUS_T_DA)) {
+			printf("%.1f %%rH, %.2f °C\n", humidity, temperature);
+			++i;
+		}
+		usleep(20000);
+	}
+
+	hts221_close(&hts);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/**
+ * @brief Example fusing the LSM9DS1 FIFO into an orientation.
+ * @date 2022-03-04
+ *
+ * @copyright (c) Pierre Boisselier
+ * @example imu_fusion.c
+ * Runs the accelerometer and gyroscope at 476 Hz, drains the FIFO every 20 ms and fuses each batch.
+ * Prints the orientation 10 times per second along with the CPU time spent.
+ *
+ * Samples can be recorded to a trace and replayed later without the sensor,
+ * e.g. to compare the filters or tune their gains on the same motion.
+ *
+ * ## Compilation
+ *
+ * ```
+ * gcc -Wall -O2 -g -I../../include imu_fusion.c -lm -o imu_fusion.out
+ * ```
+ *
+ * ## Usage
+ *
+ * - `./imu_fusion.out [seconds] [mahony]`: live orientation, 10 s by default.
+ * - `./imu_fusion.out --record trace.txt [seconds]`: record a trace.
+ * - `./imu_fusion.out --replay trace.txt [mahony]`: print the orientation of every sample of a trace.
+ *
+ * ## Trace format
+ *
+ * The first line is `# <rate in Hz>`, then one sample per line:
+ * `gx gy gz ax ay az mx my mz` in rad/s, g and gauss (the magnetic field is `0 0 0` when not read).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sense-hat/lsm9ds1.h>
+
+static double now(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_orientation(const struct imu_fusion *fusion)
+{
+	float roll, pitch, yaw;
+	imu_fusion_euler(fusion, &roll, &pitch, &yaw);
+	printf("roll %7.2f pitch %7.2f yaw %7.2f\n", roll * 180.0f / M_PI,
+	       pitch * 180.0f / M_PI, yaw * 180.0f / M_PI);
+}
+
+static int open_imu(struct lsm9ds1 *imu)
+{
+	int ret = lsm9ds1_init(imu);
+	if (ret < 0) {
+		fprintf(stderr, "Unable to open the LSM9DS1 (%d)\n", ret);
+		return ret;
+	}
+	lsm9ds1_set_rate(imu, LSM9DS1_ODR_476HZ);
+	lsm9ds1_set_scale(imu, LSM9DS1_ACCEL_4G, LSM9DS1_GYRO_500DPS);
+	return lsm9ds1_fifo_enable(imu, 1);
+}
+
+static int run_live(double seconds, int algorithm)
+{
+	struct lsm9ds1 imu;
+	if (open_imu(&imu) < 0)
+		return EXIT_FAILURE;
+
+	struct imu_fusion fusion;
+	imu_fusion_init(&fusion, algorithm, imu.rate_hz);
+
+	struct imu_sample samples[LSM9DS1_FIFO_SIZE];
+	float mag[3];
+	const double start = now(CLOCK_MONOTONIC);
+	const double cpu_start = now(CLOCK_PROCESS_CPUTIME_ID);
+	for (int i = 0; now(CLOCK_MONOTONIC) - start < seconds; ++i) {
+		usleep(20000);
+		const int n = lsm9ds1_fifo_read(&imu, samples, LSM9DS1_FIFO_SIZE);
+		if (n < 0) {
+			fprintf(stderr, "Unable to read the FIFO (%d)\n", n);
+			break;
+		}
+		imu_fusion_update_batch(&fusion, samples, n,
+					lsm9ds1_read_mag(&imu, mag) < 0 ? NULL :
+									  mag);
+		if (i % 5 == 0)
+			print_orientation(&fusion);
+	}
+
+	const double wall = now(CLOCK_MONOTONIC) - start;
+	const double cpu = now(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+	printf("%lu samples (%.0f Hz), %lu transfers, %lu overruns, CPU %.2f %%\n",
+	       imu.samples, imu.samples / wall, imu.transfers, imu.overruns,
+	       100.0 * cpu / wall);
+
+	lsm9ds1_close(&imu);
+	return EXIT_SUCCESS;
+}
+
+static int run_record(const char *path, double seconds)
+{
+	FILE *trace = fopen(path, "w");
+	if (!trace) {
+		perror("unable to create the trace");
+		return EXIT_FAILURE;
+	}
+
+	struct lsm9ds1 imu;
+	if (open_imu(&imu) < 0) {
+		fclose(trace);
+		return EXIT_FAILURE;
+	}
+	fprintf(trace, "# %g\n", imu.rate_hz);
+
+	struct imu_sample samples[LSM9DS1_FIFO_SIZE];
+	float mag[3];
+	const double start = now(CLOCK_MONOTONIC);
+	while (now(CLOCK_MONOTONIC) - start < seconds) {
+		usleep(20000);
+		const int n = lsm9ds1_fifo_read(&imu, samples, LSM9DS1_FIFO_SIZE);
+		if (n < 0)
+			break;
+		if (lsm9ds1_read_mag(&imu, mag) < 0)
+			mag[0] = mag[1] = mag[2] = 0.0f;
+		for (int i = 0; i < n; ++i)
+			fprintf(trace, "%g %g %g %g %g %g %g %g %g\n",
+				samples[i].gyro[0], samples[i].gyro[1],
+				samples[i].gyro[2], samples[i].accel[0],
+				samples[i].accel[1], samples[i].accel[2],
+				mag[0], mag[1], mag[2]);
+	}
+	printf("%lu samples recorded, %lu overruns\n", imu.samples,
+	       imu.overruns);
+
+	lsm9ds1_close(&imu);
+	fclose(trace);
+	return EXIT_SUCCESS;
+}
+
+static int run_replay(const char *path, int algorithm)
+{
+	FILE *trace = fopen(path, "r");
+	if (!trace) {
+		perror("unable to open the trace");
+		return EXIT_FAILURE;
+	}
+
+	float rate;
+	if (fscanf(trace, "# %f", &rate) != 1) {
+		fprintf(stderr, "Missing rate in the trace\n");
+		fclose(trace);
+		return EXIT_FAILURE;
+	}
+	struct imu_fusion fusion;
+	if (imu_fusion_init(&fusion, algorithm, rate) < 0) {
+		perror("invalid rate");
+		fclose(trace);
+		return EXIT_FAILURE;
+	}
+
+	/* Samples are fused one by one to print every orientation, fusion time only */
+	struct imu_sample sample;
+	float mag[3];
+	double fusing = 0.0;
+	while (fscanf(trace, "%f %f %f %f %f %f %f %f %f", &sample.gyro[0],
+		      &sample.gyro[1], &sample.gyro[2], &sample.accel[0],
+		      &sample.accel[1], &sample.accel[2], &mag[0], &mag[1],
+		      &mag[2]) == 9) {
+		const double start = now(CLOCK_MONOTONIC);
+		imu_fusion_update(&fusion, &sample, mag);
+		fusing += now(CLOCK_MONOTONIC) - start;
+		print_orientation(&fusion);
+	}
+	fclose(trace);
+
+	fprintf(stderr, "%lu samples, %.0f ns per sample\n", fusion.updates,
+		fusion.updates ? fusing * 1e9 / fusion.updates : 0.0);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 2 && strcmp(argv[1], "--record") == 0)
+		return run_record(argv[2], argc > 3 ? atof(argv[3]) : 10.0);
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+		return run_replay(argv[2], argc > 3 && strcmp(argv[3], "mahony") == 0 ?
+						   IMU_FUSION_MAHONY :
+						   IMU_FUSION_MADGWICK);
+
+	return run_live(argc > 1 ? atof(argv[1]) : 10.0,
+			argc > 2 && strcmp(argv[2], "mahony") == 0 ?
+				IMU_FUSION_MAHONY :
+				IMU_FUSION_MADGWICK);
+}
@@ -0,0 +1,156 @@
+/**
+ * @brief Example using the joystick of the Sense-Hat.
+ * @date 2022-03-02
+ *
+ * @copyright (c) Pierre Boisselier
+ * @example joystick.c
+ * Prints every key event of the joystick and the keys held until the middle button is held for 2 seconds.
+ *
+ * Without a Sense-Hat, `--uinput` creates a virtual joystick with the same name through `/dev/uinput`
+ * (needs the `uinput` module and write access to /dev/uinput), presses a few keys on it and exits.
+ *
+ * ## Compilation
+ *
+ * ```
+ * gcc -Wall -g -I../../include joystick.c -pthread -o joystick.out
+ * ```
+ *
+ * ## Usage
+ *
+ * `./joystick.out [--uinput]`
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/uinput.h>
+#include <sense-hat/joystick.h>
+
+static const char *key_name(unsigned int code)
+{
+	switch (code) {
+	case KEY_UP:
+		return "up";
+	case KEY_DOWN:
+		return "down";
+	case KEY_LEFT:
+		return "left";
+	case KEY_RIGHT:
+		return "right";
+	case KEY_ENTER:
+		return "enter";
+	default:
+		return "?";
+	}
+}
+
+void on_key(struct joystick *js, const struct input_event *event)
+{
+	static const char *actions[] = { "released", "pressed", "repeated" };
+
+	printf("%ld.%06ld %-5s %-8s held: 0x%02x\n", (long)event->time.tv_sec,
+	       (long)event->time.tv_usec, key_name(event->code),
+	       actions[event->value], joystick_state(js));
+}
+
+static void uinput_emit(int fd, unsigned short type, unsigned short code,
+			int value)
+{
+	struct input_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.code = code;
+	event.value = value;
+	if (write(fd, &event, sizeof(event)) != sizeof(event))
+		perror("uinput write");
+}
+
+static void uinput_key(int fd, unsigned short code, int value)
+{
+	uinput_emit(fd, EV_KEY, code, value);
+	uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+	usleep(100000);
+}
+
+/* Create a virtual joystick, press a few keys on it and check what was received */
+static int run_uinput(void)
+{
+	static const unsigned short keys[] = { KEY_UP, KEY_DOWN, KEY_LEFT,
+					       KEY_RIGHT, KEY_ENTER };
+
+	int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror("unable to open /dev/uinput");
+		return EXIT_FAILURE;
+	}
+
+	struct uinput_setup setup;
+	memset(&setup, 0, sizeof(setup));
+	setup.id.bustype = BUS_VIRTUAL;
+	strncpy(setup.name, JOYSTICK_NAME, UINPUT_MAX_NAME_SIZE - 1);
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	for (unsigned int i = 0; i < sizeof(keys) / sizeof(*keys); ++i)
+		ioctl(fd, UI_SET_KEYBIT, keys[i]);
+	if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 ||
+	    ioctl(fd, UI_DEV_CREATE) < 0) {
+		perror("unable to create the virtual joystick");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	/* Let udev create the node */
+	sleep(1);
+
+	struct joystick *js = joystick_request_events(NULL, 0, on_key, NULL);
+	if (!js) {
+		perror("virtual joystick not found");
+		ioctl(fd, UI_DEV_DESTROY);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	uinput_key(fd, KEY_UP, 1);
+	uinput_key(fd, KEY_UP, 2); /* Filtered out */
+	uinput_key(fd, KEY_ENTER, 1);
+	uinput_key(fd, KEY_UP, 0);
+	uinput_key(fd, KEY_ENTER, 0);
+
+	printf("Delivered %lu events, filtered %lu, %lu syscalls\n", js->events,
+	       js->filtered, js->syscalls);
+	const int ok = js->events == 4 && joystick_state(js) == 0;
+
+	joystick_release(js);
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--uinput") == 0)
+		return run_uinput();
+
+	struct joystick *js = joystick_request_events(NULL, 0, on_key, NULL);
+	if (!js) {
+		perror("unable to open the joystick");
+		return EXIT_FAILURE;
+	}
+	joystick_grab(js, 1);
+
+	puts("Hold the middle button for 2 seconds to quit");
+
+	/* The state is read without touching the device */
+	int held = 0;
+	while (held < 20) {
+		held = joystick_state(js) & JOYSTICK_ENTER ? held + 1 : 0;
+		usleep(100000);
+	}
+
+	printf("Delivered %lu events, filtered %lu, %lu syscalls\n", js->events,
+	       js->filtered, js->syscalls);
+	joystick_release(js);
+
+	return EXIT_SUCCESS;
+}
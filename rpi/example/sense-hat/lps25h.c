@@ -5,6 +5,8 @@
  * @copyright (c) Pierre Boisselier
  * @example lps25h.c
  * This example will acquire 50 samples of temperature and pressures and display them.
+ * With LPS25H_OPT_WAKEUP the sensor stays powered during the 50 readings and is powered down
+ * LPS25H_AUTOSUSPEND_MS after the last one (compile with `-pthread`).
  */
 
 #include <stdio.h>
@@ -25,5 +27,6 @@ int main(void)
 		printf("Temperature: %lf °C\n", temperature);
 	}
 
+	lps25h_close(&lps);
 	return 0;
 }
\ No newline at end of file
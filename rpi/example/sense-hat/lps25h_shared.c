@@ -0,0 +1,90 @@
+/**
+ * @brief Example sharing the Pressure Sensor LPS25H between threads.
+ * @date 2022-03-05
+ *
+ * @copyright (c) Pierre Boisselier
+ * @example lps25h_shared.c
+ * Four threads read the pressure in a loop for 5 seconds, each accepting a different age:
+ * a logger wanting a fresh value every time, a display happy with 100 ms, and so on.
+ * Conversions are shared through @ref lps25h_get_cached, the count printed at the end
+ * follows the freshest demand and not the number of threads.
+ *
+ * ## Compilation
+ *
+ * ```
+ * gcc -Wall -O2 -I../../include lps25h_shared.c -pthread -o lps25h_shared.out
+ * ```
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <sense-hat/lps25h.h>
+
+struct reader {
+	struct lps25h *lps;
+	unsigned int max_age_us;
+	unsigned long reads;
+	unsigned long errors;
+	double pressure;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *read_pressure(void *arg)
+{
+	struct reader *reader = (struct reader *)arg;
+	const double start = now();
+
+	while (now() - start < 5.0) {
+		if (lps25h_get_cached(reader->lps, reader->max_age_us,
+				      &reader->pressure, NULL) < 0)
+			++reader->errors;
+		++reader->reads;
+		usleep(1000);
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	struct lps25h lps;
+	if (lps25h_init(&lps) < 0) {
+		fprintf(stderr, "Unable to open the LPS25H\n");
+		return EXIT_FAILURE;
+	}
+
+	struct reader readers[] = {
+		{ .lps = &lps, .max_age_us = 0 },
+		{ .lps = &lps, .max_age_us = 0 },
+		{ .lps = &lps, .max_age_us = 20000 },
+		{ .lps = &lps, .max_age_us = 100000 },
+	};
+	const int n = sizeof(readers) / sizeof(*readers);
+	pthread_t threads[sizeof(readers) / sizeof(*readers)];
+
+	for (int i = 0; i < n; ++i)
+		pthread_create(&threads[i], NULL, read_pressure, &readers[i]);
+	for (int i = 0; i < n; ++i)
+		pthread_join(threads[i], NULL);
+
+	unsigned long reads = 0;
+	for (int i = 0; i < n; ++i) {
+		printf("max age %6u us: %lu reads, %lu errors, last %.2f hPa\n",
+		       readers[i].max_age_us, readers[i].reads,
+		       readers[i].errors, readers[i].pressure);
+		reads += readers[i].reads;
+	}
+	printf("%lu reads, %lu conversions, %lu cached, %lu joined\n", reads,
+	       lps.sf->flights, lps.sf->hits, lps.sf->joined);
+
+	lps25h_close(&lps);
+	return EXIT_SUCCESS;
+}
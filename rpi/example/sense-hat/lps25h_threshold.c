@@ -0,0 +1,131 @@
+/**
+ * @brief Example using the threshold interrupt of the Pressure Sensor LPS25H.
+ * @date 2022-03-01
+ *
+ * @copyright (c) Pierre Boisselier
+ * @example lps25h_threshold.c
+ * The current pressure becomes the reference and the sensor raises its INT pin when the pressure
+ * moves away from it by more than the threshold (1 hPa by default).
+ * The program sleeps until then: the edge is delivered by gpiod-isr, nothing polls the I2C bus.
+ *
+ * ### Setup
+ *
+ * The INT pin of the LPS25H is only tied to a pad on the Sense-Hat, solder a wire from it to a free GPIO (e.g. GPIO 26).
+ *
+ * ### Compilation
+ *
+ * ```sh
+ * # The -I../../include path is relative to the folder where this file is.
+ * gcc -Wall -g -I../../include lps25h_threshold.c -lgpiod -pthread -o lps25h_threshold.out
+ * ```
+ *
+ * ### Run
+ *
+ * `./lps25h_threshold.out [i2c device] [gpiochip] [INT pin] [threshold hPa]`,
+ * defaults to `/dev/i2c-1 /dev/gpiochip0 26 1.0`, press return to quit.
+ *
+ * ### Without the hardware
+ *
+ * The I2C side can be faked with i2c-stub and the INT pin with gpio-sim (Linux 5.17+):
+ *
+ * ```sh
+ * sudo modprobe i2c-stub chip_addr=0x5c
+ * sudo modprobe gpio-sim
+ * sudo mkdir -p /sys/kernel/config/gpio-sim/lps/bank0
+ * echo 1 | sudo tee /sys/kernel/config/gpio-sim/lps/bank0/num_lines
+ * echo 1 | sudo tee /sys/kernel/config/gpio-sim/lps/live
+ * CHIP=$(cat /sys/kernel/config/gpio-sim/lps/bank0/chip_name)
+ *
+ * sudo ./lps25h_threshold.out /dev/i2c-X /dev/$CHIP 0 1.0 &
+ * # Check the configuration written by the example: CTRL_REG1 (DIFF_EN), INT_CFG, THS_P
+ * # (i2c-stub ignores the auto-increment bit, multi-register writes land at register | 0x80)
+ * sudo i2cget -y X 0x5c 0x20; sudo i2cget -y X 0x5c 0x24; sudo i2cget -y X 0x5c 0xb0
+ * # Flag a high pressure event and raise INT
+ * sudo i2cset -y X 0x5c 0x25 0x05
+ * echo pull-up | sudo tee /sys/bus/gpio/devices/$CHIP/sim_gpio0/pull
+ * ```
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gpiod.h>
+#include <gpiod-isr.h>
+#include <gpiod-registry.h>
+#include <sense-hat/lps25h.h>
+
+/* Sensor, global so the interrupt handler can use it. */
+static struct lps25h lps;
+
+/*
+ * Called by gpiod-isr on the rising edge of INT.
+ */
+static void on_threshold(struct gpiod_line *line,
+			 struct gpiod_line_event *event)
+{
+	(void)line;
+
+	/* Reading the source also releases the INT pin. */
+	const int source = lps25h_interrupt_source(&lps);
+	if (source < 0) {
+		perror("unable to read the interrupt source");
+		return;
+	}
+
+	printf("[%lld.%09ld] Pressure %s threshold: %lf hPa\n",
+	       (long long)event->ts.tv_sec, event->ts.tv_nsec,
+	       source & LPS25H_INT_HIGH ? "over" : "under",
+	       lps25h_read_pressure(&lps));
+}
+
+int main(int argc, char **argv)
+{
+	const char *i2c_device = argc > 1 ? argv[1] : RPI_I2C_DEVICE;
+	const char *gpio_device = argc > 2 ? argv[2] : "/dev/gpiochip0";
+	const unsigned int int_pin = argc > 3 ? atoi(argv[3]) : 26;
+	const double threshold = argc > 4 ? atof(argv[4]) : 1.0;
+
+	if (lps25h_init_c_l(&lps, i2c_device, LPS25H_I2C_ADDR, 0) < 0) {
+		perror("unable to open the LPS25H");
+		return EXIT_FAILURE;
+	}
+
+	/* The current pressure becomes the reference, then compare once per second. */
+	if (lps25h_set_int_pin(&lps, 0, 0) < 0 || lps25h_autozero(&lps) < 0 ||
+	    lps25h_set_threshold(&lps, threshold,
+				 LPS25H_INT_HIGH | LPS25H_INT_LOW) < 0 ||
+	    lps25h_set_rate(&lps, LPS25H_ODR_1HZ) < 0) {
+		perror("unable to configure the threshold interrupt");
+		lps25h_close(&lps);
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_chip *chip = gpiod_registry_chip_get(gpio_device);
+	if (!chip) {
+		perror("unable to open gpiochip");
+		lps25h_close(&lps);
+		return EXIT_FAILURE;
+	}
+
+	struct gpiod_isr *isr = gpiod_isr_request_rising_edge_events(
+		gpiod_chip_get_line(chip, int_pin), "lps25h_threshold",
+		on_threshold);
+	if (!isr) {
+		perror("unable to register the interrupt");
+		goto cleanup;
+	}
+
+	/* Release a request latched before the handler was registered. */
+	lps25h_interrupt_source(&lps);
+
+	printf("Waiting for a pressure change of %.2f hPa...\n", threshold);
+	getchar();
+
+	gpiod_isr_release(isr);
+cleanup:
+	lps25h_set_threshold(&lps, 0, 0);
+	lps25h_set_rate(&lps, LPS25H_ODR_ONESHOT);
+	gpiod_registry_chip_put(chip);
+	lps25h_close(&lps);
+
+	return EXIT_SUCCESS;
+}
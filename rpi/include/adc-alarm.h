@@ -0,0 +1,313 @@
+/**
+ * @brief Window-comparator alarms with hysteresis for ADC channels
+ *
+ * @file adc-alarm.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-24
+ *
+ * @details
+ * Each channel has a low and a high threshold and is in one of three states:
+ * @ref ADC_ALARM_LOW, @ref ADC_ALARM_NORMAL or @ref ADC_ALARM_HIGH.
+ * Samples are fed in batches, straight from the acquisition loop, and the handler is only called
+ * when a channel changes state, so the work done after acquisition scales with the number of alarms
+ * and not with the sample rate.
+ *
+ * - Hysteresis: once over the high threshold, a channel only goes back to normal below `high - hysteresis`
+ *   (and above `low + hysteresis` once under the low threshold), so noise around a threshold does not flood the handler.
+ * - Dwell time: a new state must be seen for every sample during the dwell time before the transition happens,
+ *   short spikes are ignored. The dwell time is converted to a number of samples using the sample period
+ *   given to @ref adc_alarm_init.
+ *
+ * ## Usage
+ *
+ * ```c
+ * void on_alarm(unsigned int channel, int state, uint16_t value, void *data)
+ * {
+ * 	printf("Channel %u is now %d (%u)\n", channel, state, value);
+ * }
+ *
+ * struct adc_alarm alarm;
+ * adc_alarm_init(&alarm, 1, 50, on_alarm, NULL);          // 1 channel sampled every 50 us
+ * adc_alarm_set(&alarm, 0, 100, 900, 20, 10);             // Hysteresis of 20, 10 ms dwell time
+ *
+ * uint16_t samples[64];
+ * // ... acquire 64 samples ...
+ * adc_alarm_feed(&alarm, 0, samples, 64);
+ * ```
+ *
+ * Interleaved samples from several channels (e.g. from `tlc1543_group_scan`) are fed with @ref adc_alarm_feed_frames.
+ *
+ * @note Feeding is not thread-safe, feed every channel from the same thread (usually the acquisition loop).
+ */
+
+#ifndef ADC_ALARM_H
+#define ADC_ALARM_H
+
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of channels watched by an alarm engine. */
+#define ADC_ALARM_MAX_CHANNELS 64
+
+/** @brief Value under the low threshold. */
+#define ADC_ALARM_LOW -1
+/** @brief Value between the thresholds. */
+#define ADC_ALARM_NORMAL 0
+/** @brief Value over the high threshold. */
+#define ADC_ALARM_HIGH 1
+
+/**
+ * @brief Called when a channel changes state.
+ * @param channel Channel that changed.
+ * @param state New state (e.g. ADC_ALARM_HIGH).
+ * @param value Sample that completed the transition.
+ * @param data User data given to @ref adc_alarm_init.
+ */
+typedef void (*adc_alarm_handler)(unsigned int channel, int state,
+				  uint16_t value, void *data);
+
+/**
+ * @brief Thresholds and state of a channel.
+ */
+struct adc_alarm_channel {
+	uint16_t low;
+	///< Low threshold, the channel is low under it
+	uint16_t high;
+	///< High threshold, the channel is high over it
+	uint16_t hysteresis;
+	///< Distance to cross back over a threshold before going back to normal
+	unsigned int dwell;
+	///< Number of consecutive samples a new state must last
+	int enabled;
+	///< Whether the channel is watched
+	int state;
+	///< Current state
+	int pending;
+	///< State being confirmed during the dwell time
+	unsigned int count;
+	///< Number of consecutive samples seen in the pending state
+	unsigned long transitions;
+	///< Number of state changes
+};
+
+/**
+ * @brief Alarm engine.
+ */
+struct adc_alarm {
+	struct adc_alarm_channel channels[ADC_ALARM_MAX_CHANNELS];
+	///< Channels, only the first num_channels are used
+	unsigned int num_channels;
+	///< Number of channels
+	unsigned int period_us;
+	///< Time between two samples of a channel (us)
+	adc_alarm_handler handler;
+	///< Called on state changes
+	void *data;
+	///< User data given to the handler
+};
+
+/**
+ * @brief Initialize an alarm engine, every channel is disabled.
+ * @param alarm Alarm engine to initialize.
+ * @param num_channels Number of channels.
+ * @param period_us Time between two samples of a channel in micro seconds, used for dwell times.
+ * @param handler Called on state changes.
+ * @param data User data given to the handler.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_alarm_init(struct adc_alarm *alarm, unsigned int num_channels,
+		   unsigned int period_us, adc_alarm_handler handler,
+		   void *data)
+{
+	if (!alarm || !handler || num_channels == 0 ||
+	    num_channels > ADC_ALARM_MAX_CHANNELS || period_us == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	alarm->num_channels = num_channels;
+	alarm->period_us = period_us;
+	alarm->handler = handler;
+	alarm->data = data;
+	for (unsigned int i = 0; i < num_channels; ++i)
+		alarm->channels[i] = (struct adc_alarm_channel){
+			.state = ADC_ALARM_NORMAL,
+			.pending = ADC_ALARM_NORMAL,
+		};
+
+	return 0;
+}
+
+/**
+ * @brief Set the thresholds of a channel and start watching it, its state goes back to normal.
+ * @param alarm Alarm engine.
+ * @param channel Channel.
+ * @param low Low threshold.
+ * @param high High threshold, must be over the low threshold.
+ * @param hysteresis Distance to cross back over a threshold before going back to normal.
+ * @param dwell_ms Time a new state must last before the transition (ms), 0 for immediate transitions.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_alarm_set(struct adc_alarm *alarm, unsigned int channel, uint16_t low,
+		  uint16_t high, uint16_t hysteresis, unsigned int dwell_ms)
+{
+	if (!alarm || channel >= alarm->num_channels || low > high) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const unsigned long long dwell =
+		((unsigned long long)dwell_ms * 1000 + alarm->period_us - 1) /
+		alarm->period_us;
+
+	alarm->channels[channel] = (struct adc_alarm_channel){
+		.low = low,
+		.high = high,
+		.hysteresis = hysteresis,
+		.dwell = dwell > 1 ? (unsigned int)dwell : 1,
+		.enabled = 1,
+		.state = ADC_ALARM_NORMAL,
+		.pending = ADC_ALARM_NORMAL,
+	};
+
+	return 0;
+}
+
+/**
+ * @brief Stop watching a channel.
+ * @param alarm Alarm engine.
+ * @param channel Channel.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_alarm_disable(struct adc_alarm *alarm, unsigned int channel)
+{
+	if (!alarm || channel >= alarm->num_channels) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	alarm->channels[channel].enabled = 0;
+	return 0;
+}
+
+/**
+ * @brief Get the state a sample puts a channel in, hysteresis included.
+ * @param ch Channel.
+ * @param value Sample.
+ * @return State given by the sample.
+ */
+static inline int _adc_alarm_classify(const struct adc_alarm_channel *ch,
+				      uint16_t value)
+{
+	if (ch->state == ADC_ALARM_HIGH && value + ch->hysteresis >= ch->high)
+		return ADC_ALARM_HIGH;
+	if (ch->state == ADC_ALARM_LOW && value <= ch->low + ch->hysteresis)
+		return ADC_ALARM_LOW;
+	if (value > ch->high)
+		return ADC_ALARM_HIGH;
+	if (value < ch->low)
+		return ADC_ALARM_LOW;
+	return ADC_ALARM_NORMAL;
+}
+
+/**
+ * @brief Run a sample through the comparator of a channel, calls the handler on a transition.
+ * @param alarm Alarm engine.
+ * @param channel Channel.
+ * @param value Sample.
+ */
+static inline void _adc_alarm_step(struct adc_alarm *alarm,
+				   unsigned int channel, uint16_t value)
+{
+	struct adc_alarm_channel *ch = &alarm->channels[channel];
+	const int state = _adc_alarm_classify(ch, value);
+
+	/* Fast path, nothing is going on */
+	if (state == ch->state) {
+		ch->count = 0;
+		return;
+	}
+
+	if (state != ch->pending || ch->count == 0) {
+		ch->pending = state;
+		ch->count = 0;
+	}
+	if (++ch->count < ch->dwell)
+		return;
+
+	ch->state = state;
+	ch->count = 0;
+	++ch->transitions;
+	alarm->handler(channel, state, value, alarm->data);
+}
+
+/**
+ * @brief Feed a batch of samples of one channel.
+ * @param alarm Alarm engine.
+ * @param channel Channel the samples come from.
+ * @param samples Samples, oldest first.
+ * @param num_samples Number of samples.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_alarm_feed(struct adc_alarm *alarm, unsigned int channel,
+		   const uint16_t *samples, unsigned int num_samples)
+{
+	if (!alarm || channel >= alarm->num_channels || !samples) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!alarm->channels[channel].enabled)
+		return 0;
+
+	for (unsigned int i = 0; i < num_samples; ++i)
+		_adc_alarm_step(alarm, channel, samples[i]);
+
+	return 0;
+}
+
+/**
+ * @brief Feed a batch of frames, each holding one sample of every channel.
+ * @param alarm Alarm engine.
+ * @param samples Samples, samples[f * num_channels + c] is the sample of channel c in frame f.
+ * @param num_frames Number of frames.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_alarm_feed_frames(struct adc_alarm *alarm, const uint16_t *samples,
+			  unsigned int num_frames)
+{
+	if (!alarm || !samples) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const unsigned int num_channels = alarm->num_channels;
+	for (unsigned int f = 0; f < num_frames; ++f)
+		for (unsigned int c = 0; c < num_channels; ++c)
+			if (alarm->channels[c].enabled)
+				_adc_alarm_step(alarm, c,
+						samples[f * num_channels + c]);
+
+	return 0;
+}
+
+/**
+ * @brief Get the current state of a channel.
+ * @param alarm Alarm engine.
+ * @param channel Channel.
+ * @return State (e.g. ADC_ALARM_NORMAL).
+ */
+static inline int adc_alarm_state(const struct adc_alarm *alarm,
+				  unsigned int channel)
+{
+	return alarm->channels[channel].state;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADC_ALARM_H
@@ -0,0 +1,538 @@
+/**
+ * @brief Packed storage and compression of 10-bit ADC samples
+ *
+ * @file adc-pack.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-08
+ *
+ * @details
+ * A TLC1543 sample has 10 significant bits, kept in an `int` it wastes 22 bits out of 32 (6 out of 16 in a `uint16_t`).
+ * This header stores samples with the bits they need:
+ *
+ * - **Bit packing**: @ref adc_pack10 and @ref adc_unpack10 store 4 samples in 5 bytes, a third of an `int` array.
+ *   A run of samples stays randomly accessible (sample i is in the group i / 4).
+ *   The kernels handle 16 samples per iteration with GCC vector extensions (one group of 4 samples per 64-bit lane,
+ *   NEON on the Raspberry Pi), the tail is packed bit by bit.
+ * - **Blocks**: @ref adc_pack_block_encode compresses up to @ref ADC_PACK_BLOCK samples, choosing the smallest of:
+ *   - @ref ADC_PACK_RAW, bit packed samples (10 bits each).
+ *   - @ref ADC_PACK_FOR, frame of reference: the samples minus the lowest one, with just enough bits for the largest.
+ *   - @ref ADC_PACK_DELTA, the difference with the previous sample mapped to unsigned numbers (zigzag: 0, -1, 1, -2...)
+ *     then frame of reference, a slowly changing signal needs a few bits per sample.
+ *
+ *   A block is never bigger than @ref ADC_PACK_BLOCK_MAX, and decodes with @ref adc_pack_block_decode.
+ *   Blocks are self-contained, a log made of blocks can be cut and read from any block.
+ * - **Ring**: @ref adc_pack_ring keeps the last samples of a long capture bit packed, for a third of the memory of an `int` ring.
+ *
+ * ## Usage
+ *
+ * ```c
+ * uint8_t packed[ADC_PACK10_SIZE(1024)];
+ * adc_pack10(packed, samples, 1024);
+ * adc_unpack10(samples, packed, 1024);
+ *
+ * uint8_t block[ADC_PACK_BLOCK_MAX];
+ * size_t len = adc_pack_block_encode(block, samples, ADC_PACK_BLOCK);
+ * fwrite(block, 1, len, log);
+ * ```
+ *
+ * @note Only the 10 low bits of a sample are stored.
+ * @warning The packed layout is little-endian, as on the Raspberry Pi.
+ */
+
+#ifndef ADC_PACK_H
+#define ADC_PACK_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "adc-pack.h only supports little-endian targets"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Bits of a sample. */
+#define ADC_PACK_BITS 10
+/** @brief Mask of the bits of a sample. */
+#define ADC_PACK_MASK 0x3ff
+/** @brief Bytes taken by n bit packed samples. */
+#define ADC_PACK10_SIZE(n) (((n)*ADC_PACK_BITS + 7) / 8)
+
+/** @brief Maximum number of samples of a block. */
+#define ADC_PACK_BLOCK 128
+/** @brief Size of the header of a block: mode, width, reference and base. */
+#define ADC_PACK_HEADER 6
+/** @brief Largest size of an encoded block. */
+#define ADC_PACK_BLOCK_MAX (ADC_PACK_HEADER + ADC_PACK10_SIZE(ADC_PACK_BLOCK))
+
+/**
+ * @name Encodings of a block
+ * @{
+ */
+
+/** @brief Bit packed samples. */
+#define ADC_PACK_RAW 0
+/** @brief Samples minus the reference (lowest sample). */
+#define ADC_PACK_FOR 1
+/** @brief Zigzag differences minus the base, the reference is the first sample. */
+#define ADC_PACK_DELTA 2
+
+/**
+ * @}
+ */
+
+/** @brief 4 groups of 4 samples, one per 64-bit lane. */
+typedef uint64_t _adc_pack_v4 __attribute__((vector_size(32)));
+/** @brief 8 samples. */
+typedef int16_t _adc_pack_v8 __attribute__((vector_size(16)));
+
+/**
+ * @brief Pack samples bit by bit.
+ * @param dst Packed data.
+ * @param src Samples.
+ * @param n Number of samples.
+ * @param width Bits per sample (0 to 16).
+ * @return Number of bytes written.
+ */
+static size_t _adc_pack_bits(uint8_t *dst, const uint16_t *src, size_t n,
+			     unsigned int width)
+{
+	const uint32_t mask = (1U << width) - 1;
+	uint64_t acc = 0;
+	unsigned int bits = 0;
+	size_t len = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		acc |= (uint64_t)(src[i] & mask) << bits;
+		bits += width;
+		while (bits >= 8) {
+			dst[len++] = (uint8_t)acc;
+			acc >>= 8;
+			bits -= 8;
+		}
+	}
+	if (bits)
+		dst[len++] = (uint8_t)acc;
+
+	return len;
+}
+
+/**
+ * @brief Unpack samples bit by bit.
+ * @param dst Samples.
+ * @param src Packed data.
+ * @param n Number of samples.
+ * @param width Bits per sample (0 to 16).
+ * @return Number of bytes read.
+ */
+static size_t _adc_unpack_bits(uint16_t *dst, const uint8_t *src, size_t n,
+			       unsigned int width)
+{
+	const uint32_t mask = (1U << width) - 1;
+	uint64_t acc = 0;
+	unsigned int bits = 0;
+	size_t len = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		while (bits < width) {
+			acc |= (uint64_t)src[len++] << bits;
+			bits += 8;
+		}
+		dst[i] = (uint16_t)(acc & mask);
+		acc >>= width;
+		bits -= width;
+	}
+
+	return len;
+}
+
+/**
+ * @brief Pack 10-bit samples, 4 samples in 5 bytes.
+ * @param dst Packed data, ADC_PACK10_SIZE(n) bytes.
+ * @param src Samples.
+ * @param n Number of samples.
+ * @return Number of bytes written.
+ */
+size_t adc_pack10(uint8_t *dst, const uint16_t *src, size_t n)
+{
+	size_t i = 0;
+	uint8_t *out = dst;
+
+	for (; i + 16 <= n; i += 16, out += 20) {
+		_adc_pack_v4 x;
+		memcpy(&x, src + i, sizeof(x));
+
+		/* Lane a | b << 16 | c << 32 | d << 48 becomes a | b << 10 | c << 20 | d << 30 */
+		const _adc_pack_v4 w =
+			(x & ADC_PACK_MASK) |
+			((x >> 6) & ((uint64_t)ADC_PACK_MASK << 10)) |
+			((x >> 12) & ((uint64_t)ADC_PACK_MASK << 20)) |
+			((x >> 18) & ((uint64_t)ADC_PACK_MASK << 30));
+		for (int k = 0; k < 4; ++k) {
+			const uint64_t lane = w[k];
+			memcpy(out + 5 * k, &lane, 5);
+		}
+	}
+
+	/* Whole groups end on a byte, the tail starts aligned */
+	return (out - dst) + _adc_pack_bits(out, src + i, n - i, ADC_PACK_BITS);
+}
+
+/**
+ * @brief Unpack 10-bit samples packed by @ref adc_pack10.
+ * @param dst Samples.
+ * @param src Packed data.
+ * @param n Number of samples.
+ * @return Number of bytes read.
+ */
+size_t adc_unpack10(uint16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i = 0;
+	const uint8_t *in = src;
+
+	for (; i + 16 <= n; i += 16, in += 20) {
+		_adc_pack_v4 w;
+		for (int k = 0; k < 4; ++k) {
+			uint64_t lane = 0;
+			memcpy(&lane, in + 5 * k, 5);
+			w[k] = lane;
+		}
+
+		const _adc_pack_v4 x =
+			(w & ADC_PACK_MASK) |
+			((w << 6) & ((uint64_t)ADC_PACK_MASK << 16)) |
+			((w << 12) & ((uint64_t)ADC_PACK_MASK << 32)) |
+			((w << 18) & ((uint64_t)ADC_PACK_MASK << 48));
+		memcpy(dst + i, &x, sizeof(x));
+	}
+
+	return (in - src) + _adc_unpack_bits(dst + i, in, n - i, ADC_PACK_BITS);
+}
+
+/**
+ * @brief Lowest of two vectors, lane by lane.
+ * @param a Vector.
+ * @param b Vector.
+ * @return Lowest lanes.
+ */
+static inline _adc_pack_v8 _adc_pack_min(_adc_pack_v8 a, _adc_pack_v8 b)
+{
+	const _adc_pack_v8 m = a < b;
+	return (a & m) | (b & ~m);
+}
+
+/**
+ * @brief Highest of two vectors, lane by lane.
+ * @param a Vector.
+ * @param b Vector.
+ * @return Highest lanes.
+ */
+static inline _adc_pack_v8 _adc_pack_max(_adc_pack_v8 a, _adc_pack_v8 b)
+{
+	const _adc_pack_v8 m = a > b;
+	return (a & m) | (b & ~m);
+}
+
+/**
+ * @brief Number of bits needed by a value.
+ * @param value Value.
+ * @return Bits, 0 for 0.
+ */
+static inline unsigned int _adc_pack_width(uint32_t value)
+{
+	return value ? 32 - __builtin_clz(value) : 0;
+}
+
+/**
+ * @brief Encode a block of samples.
+ * @param dst Encoded block, at most ADC_PACK_BLOCK_MAX bytes.
+ * @param samples Samples.
+ * @param n Number of samples, 1 to ADC_PACK_BLOCK.
+ * @return Number of bytes written, 0 on failure.
+ * @note The number of samples is not stored, the reader must know it (e.g. every block is full but the last).
+ */
+size_t adc_pack_block_encode(uint8_t *dst, const uint16_t *samples, size_t n)
+{
+	if (!dst || !samples || n == 0 || n > ADC_PACK_BLOCK) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	uint16_t values[ADC_PACK_BLOCK];
+	uint16_t zigzag[ADC_PACK_BLOCK];
+	for (size_t i = 0; i < n; ++i)
+		values[i] = samples[i] & ADC_PACK_MASK;
+
+	/* Zigzag of the differences, lowest and highest values, 8 samples at a time */
+	_adc_pack_v8 vlo = { 0 }, vhi = { 0 }, vzlo = { 0 }, vzhi = { 0 };
+	vlo += values[0];
+	vhi += values[0];
+	vzlo += INT16_MAX;
+	size_t i = 1;
+	for (; i + 8 <= n; i += 8) {
+		_adc_pack_v8 v, prev;
+		memcpy(&v, values + i, sizeof(v));
+		memcpy(&prev, values + i - 1, sizeof(prev));
+		const _adc_pack_v8 d = v - prev;
+		const _adc_pack_v8 z = (d << 1) ^ (d >> 15);
+		memcpy(zigzag + i, &z, sizeof(z));
+		vlo = _adc_pack_min(v, vlo);
+		vhi = _adc_pack_max(v, vhi);
+		vzlo = _adc_pack_min(z, vzlo);
+		vzhi = _adc_pack_max(z, vzhi);
+	}
+
+	uint16_t lo = vlo[0], hi = vhi[0], zlo = vzlo[0], zhi = vzhi[0];
+	for (int k = 1; k < 8; ++k) {
+		lo = vlo[k] < lo ? vlo[k] : lo;
+		hi = vhi[k] > hi ? vhi[k] : hi;
+		zlo = vzlo[k] < zlo ? vzlo[k] : zlo;
+		zhi = vzhi[k] > zhi ? vzhi[k] : zhi;
+	}
+	for (; i < n; ++i) {
+		const int16_t d = values[i] - values[i - 1];
+		zigzag[i] = (uint16_t)((uint16_t)d << 1) ^ (uint16_t)(d >> 15);
+		lo = values[i] < lo ? values[i] : lo;
+		hi = values[i] > hi ? values[i] : hi;
+		zlo = zigzag[i] < zlo ? zigzag[i] : zlo;
+		zhi = zigzag[i] > zhi ? zigzag[i] : zhi;
+	}
+	if (n == 1)
+		zlo = zhi = 0;
+
+	const unsigned int for_width = _adc_pack_width(hi - lo);
+	const unsigned int delta_width = _adc_pack_width(zhi - zlo);
+	const size_t raw_size = ADC_PACK10_SIZE(n);
+	const size_t for_size = (n * for_width + 7) / 8;
+	const size_t delta_size = ((n - 1) * delta_width + 7) / 8;
+
+	uint8_t mode = ADC_PACK_RAW, width = ADC_PACK_BITS;
+	uint16_t ref = 0, base = 0;
+	if (delta_size < for_size && delta_size < raw_size) {
+		mode = ADC_PACK_DELTA;
+		width = delta_width;
+		ref = values[0];
+		base = zlo;
+	} else if (for_size < raw_size) {
+		mode = ADC_PACK_FOR;
+		width = for_width;
+		ref = lo;
+	}
+
+	dst[0] = mode;
+	dst[1] = width;
+	memcpy(dst + 2, &ref, sizeof(ref));
+	memcpy(dst + 4, &base, sizeof(base));
+
+	size_t len = ADC_PACK_HEADER;
+	if (mode == ADC_PACK_RAW) {
+		len += adc_pack10(dst + len, values, n);
+	} else if (mode == ADC_PACK_FOR) {
+		for (size_t j = 0; j < n; ++j)
+			values[j] -= lo;
+		len += _adc_pack_bits(dst + len, values, n, width);
+	} else {
+		for (size_t j = 1; j < n; ++j)
+			zigzag[j] -= zlo;
+		len += _adc_pack_bits(dst + len, zigzag + 1, n - 1, width);
+	}
+
+	return len;
+}
+
+/**
+ * @brief Decode a block encoded by @ref adc_pack_block_encode.
+ * @param samples Samples.
+ * @param src Encoded block.
+ * @param n Number of samples of the block.
+ * @return Number of bytes read, 0 on failure (e.g. corrupted block).
+ */
+size_t adc_pack_block_decode(uint16_t *samples, const uint8_t *src, size_t n)
+{
+	if (!samples || !src || n == 0 || n > ADC_PACK_BLOCK) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const uint8_t mode = src[0];
+	const uint8_t width = src[1];
+	uint16_t ref, base;
+	memcpy(&ref, src + 2, sizeof(ref));
+	memcpy(&base, src + 4, sizeof(base));
+
+	if (width > 16 || mode > ADC_PACK_DELTA) {
+		errno = EILSEQ;
+		return 0;
+	}
+
+	size_t len = ADC_PACK_HEADER;
+	if (mode == ADC_PACK_RAW) {
+		len += adc_unpack10(samples, src + len, n);
+	} else if (mode == ADC_PACK_FOR) {
+		len += _adc_unpack_bits(samples, src + len, n, width);
+		for (size_t i = 0; i < n; ++i)
+			samples[i] += ref;
+	} else {
+		len += _adc_unpack_bits(samples + 1, src + len, n - 1, width);
+		samples[0] = ref;
+		for (size_t i = 1; i < n; ++i) {
+			const uint16_t z = samples[i] + base;
+			const int16_t d = (int16_t)((z >> 1) ^ -(z & 1));
+			samples[i] = (uint16_t)(samples[i - 1] + d) &
+				     ADC_PACK_MASK;
+		}
+	}
+
+	return len;
+}
+
+/**
+ * @brief Ring of the last samples of a capture, bit packed.
+ */
+struct adc_pack_ring {
+	uint8_t *data;
+	///< Packed samples, groups of 4
+	size_t capacity;
+	///< Number of samples kept, a multiple of 16
+	unsigned long long count;
+	///< Number of samples pushed
+	uint16_t pending[4];
+	///< Samples of the group being filled, packed once complete
+};
+
+/**
+ * @brief Allocate a ring.
+ * @param ring Ring.
+ * @param capacity Number of samples kept, rounded up to a multiple of 16.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_pack_ring_init(struct adc_pack_ring *ring, size_t capacity)
+{
+	if (!ring || capacity == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(ring, 0, sizeof(*ring));
+	ring->capacity = (capacity + 15) & ~(size_t)15;
+	ring->data = (uint8_t *)malloc(ADC_PACK10_SIZE(ring->capacity));
+	return ring->data ? 0 : -1;
+}
+
+/**
+ * @brief Free a ring.
+ * @param ring Ring.
+ */
+void adc_pack_ring_delete(struct adc_pack_ring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->data);
+	ring->data = NULL;
+}
+
+/**
+ * @brief Append samples, the oldest ones are overwritten once the ring is full.
+ * @param ring Ring.
+ * @param samples Samples.
+ * @param n Number of samples.
+ */
+void adc_pack_ring_push(struct adc_pack_ring *ring, const uint16_t *samples,
+			size_t n)
+{
+	while (n > 0) {
+		const size_t offset = ring->count % ring->capacity;
+		uint8_t *group = ring->data + ADC_PACK10_SIZE(offset & ~(size_t)3);
+
+		/* Complete groups go straight to the ring, up to its end */
+		size_t whole = 0;
+		if ((offset & 3) == 0) {
+			whole = n < ring->capacity - offset ?
+					n : ring->capacity - offset;
+			whole &= ~(size_t)3;
+		}
+		if (whole) {
+			adc_pack10(group, samples, whole);
+		} else {
+			ring->pending[offset & 3] = samples[0];
+			whole = 1;
+			if ((offset & 3) == 3)
+				adc_pack10(group, ring->pending, 4);
+		}
+
+		ring->count += whole;
+		samples += whole;
+		n -= whole;
+	}
+}
+
+/**
+ * @brief Read samples still in the ring.
+ * @param ring Ring.
+ * @param dst Samples.
+ * @param first Index of the first sample (number of samples pushed before it).
+ * @param n Number of samples.
+ * @return Number of samples read, -1 if the first sample was overwritten or not pushed yet.
+ */
+long adc_pack_ring_read(const struct adc_pack_ring *ring, uint16_t *dst,
+			unsigned long long first, size_t n)
+{
+	if (first >= ring->count ||
+	    ring->count - first > ring->capacity) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (n > ring->count - first)
+		n = ring->count - first;
+
+	/* The group being filled is only in pending */
+	const unsigned long long packed = ring->count & ~3ULL;
+	size_t done = 0;
+	while (done < n) {
+		const unsigned long long index = first + done;
+		const size_t left = n - done;
+		if (index >= packed) {
+			dst[done++] = ring->pending[index & 3];
+			continue;
+		}
+
+		/* Whole groups, up to the end of the ring or of the packed samples */
+		const size_t offset = index % ring->capacity;
+		if ((offset & 3) == 0) {
+			size_t run = ring->capacity - offset;
+			if (run > packed - index)
+				run = packed - index;
+			if (run > left)
+				run = left & ~(size_t)3;
+			if (run > 0) {
+				adc_unpack10(dst + done,
+					     ring->data + ADC_PACK10_SIZE(offset),
+					     run);
+				done += run;
+				continue;
+			}
+		}
+
+		/* Part of a group, through a copy */
+		uint16_t group[4];
+		const size_t skip = offset & 3;
+		adc_unpack10(group, ring->data + ADC_PACK10_SIZE(offset - skip),
+			     4);
+		const size_t take = 4 - skip < left ? 4 - skip : left;
+		memcpy(dst + done, group + skip, take * sizeof(*dst));
+		done += take;
+	}
+
+	return (long)n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADC_PACK_H
@@ -0,0 +1,462 @@
+/**
+ * @brief Pre-trigger capture buffer ("scope mode") for ADC channels
+ *
+ * @file adc-scope.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-25
+ *
+ * @details
+ * Samples are written continuously into a ring holding exactly one capture window:
+ * `pre` samples before the trigger, the trigger sample and `post` samples after it.
+ * Once the last post-trigger sample is written the ring is frozen and handed out as is,
+ * as one or two segments (the window can wrap around the end of the ring), nothing is copied.
+ *
+ * There are two rings, acquisition goes on in the other one while a capture is being looked at.
+ * A trigger is ignored (and counted as missed) when both rings hold captures that were not released yet.
+ * A fresh ring must hold `pre` samples before the trigger is armed again, like the holdoff of a scope.
+ *
+ * Triggers:
+ * - @ref ADC_SCOPE_TRIG_LEVEL, a sample is over (or at) the level.
+ * - @ref ADC_SCOPE_TRIG_RISING / @ref ADC_SCOPE_TRIG_FALLING, samples cross the level.
+ * - @ref ADC_SCOPE_TRIG_EXTERNAL, only @ref adc_scope_trigger triggers, it can be called from any thread,
+ *   e.g. from a gpiod-isr handler. The trigger sample is the next sample fed.
+ *   An external trigger happening during a capture is ignored.
+ *
+ * ## Usage
+ *
+ * ```c
+ * int acquire(void *tlc)
+ * {
+ * 	return tlc1543_get_sample(tlc, 0);
+ * }
+ *
+ * struct adc_scope scope;
+ * adc_scope_init(&scope, 256, 768, ADC_SCOPE_TRIG_RISING, 512);
+ * adc_scope_start(&scope, acquire, &tlc); // Or feed samples with adc_scope_feed
+ *
+ * struct adc_scope_capture *cap = adc_scope_wait(&scope, 1000);
+ * if (cap) {
+ * 	for (size_t i = 0; i < cap->len[0]; ++i) ... cap->samples[0][i] ...
+ * 	for (size_t i = 0; i < cap->len[1]; ++i) ... cap->samples[1][i] ...
+ * 	adc_scope_release(&scope, cap);
+ * }
+ *
+ * adc_scope_stop(&scope);
+ * adc_scope_delete(&scope);
+ * ```
+ *
+ * @warning This uses pthread, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef ADC_SCOPE_H
+#define ADC_SCOPE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Trigger when a sample is at or over the level. */
+#define ADC_SCOPE_TRIG_LEVEL 0
+/** @brief Trigger when samples go from under the level to at or over it. */
+#define ADC_SCOPE_TRIG_RISING 1
+/** @brief Trigger when samples go from over the level to at or under it. */
+#define ADC_SCOPE_TRIG_FALLING 2
+/** @brief Trigger only with @ref adc_scope_trigger. */
+#define ADC_SCOPE_TRIG_EXTERNAL 3
+
+/** @brief Number of samples acquired by the acquisition thread before feeding them. */
+#define ADC_SCOPE_BATCH 16
+
+/** @brief The ring is being written. */
+#define _ADC_SCOPE_FREE 0
+/** @brief The ring holds a capture not handed out yet. */
+#define _ADC_SCOPE_READY 1
+/** @brief The ring holds a capture handed out, until released. */
+#define _ADC_SCOPE_TAKEN 2
+
+/**
+ * @brief Frozen capture window, points inside a ring of the scope.
+ */
+struct adc_scope_capture {
+	const uint16_t *samples[2];
+	///< Segments of the window, oldest first, the second one is empty if the window does not wrap
+	size_t len[2];
+	///< Number of samples of each segment
+	size_t trigger;
+	///< Position of the trigger sample in the window (number of pre-trigger samples)
+	unsigned long long index;
+	///< Number of samples fed to the scope before the trigger sample
+	unsigned long sequence;
+	///< Number of the capture, starting at 0
+};
+
+/**
+ * @brief Scope.
+ */
+struct adc_scope {
+	uint16_t *rings[2];
+	///< Rings, each holds a capture window
+	int states[2];
+	///< State of each ring (e.g. _ADC_SCOPE_FREE)
+	struct adc_scope_capture captures[2];
+	///< Capture held by each ring
+	size_t size;
+	///< Size of a ring (pre + 1 + post)
+	size_t pre;
+	///< Number of samples before the trigger
+	size_t post;
+	///< Number of samples after the trigger
+	int mode;
+	///< Trigger mode (e.g. ADC_SCOPE_TRIG_RISING)
+	uint16_t level;
+	///< Trigger level
+	unsigned int current;
+	///< Ring being written
+	size_t head;
+	///< Next position written in the current ring
+	size_t filled;
+	///< Number of samples in the current ring
+	size_t remaining;
+	///< Post-trigger samples left to write, 0 when not triggered
+	int external;
+	///< Set by adc_scope_trigger
+	uint16_t last;
+	///< Last sample fed, for edge triggers
+	unsigned long long count;
+	///< Number of samples fed
+	unsigned long sequence;
+	///< Number of captures
+	unsigned long missed;
+	///< Number of triggers ignored because no ring was free
+	pthread_mutex_t lock;
+	///< Protects the ring states
+	pthread_cond_t ready;
+	///< Signaled when a capture is frozen
+	pthread_t thread;
+	///< Acquisition thread
+	int running;
+	///< Whether the acquisition thread runs
+	int (*acquire)(void *);
+	///< Gets a sample for the acquisition thread, negative value on error
+	void *data;
+	///< Given to acquire
+};
+
+/**
+ * @brief Initialize a scope.
+ * @param scope Scope to initialize.
+ * @param pre Number of samples kept before the trigger.
+ * @param post Number of samples kept after the trigger.
+ * @param mode Trigger mode (e.g. ADC_SCOPE_TRIG_RISING).
+ * @param level Trigger level, unused with ADC_SCOPE_TRIG_EXTERNAL.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_scope_init(struct adc_scope *scope, size_t pre, size_t post, int mode,
+		   uint16_t level)
+{
+	if (!scope || mode < ADC_SCOPE_TRIG_LEVEL ||
+	    mode > ADC_SCOPE_TRIG_EXTERNAL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	scope->size = pre + 1 + post;
+	scope->rings[0] = malloc(2 * scope->size * sizeof(uint16_t));
+	if (!scope->rings[0])
+		return -1;
+	scope->rings[1] = scope->rings[0] + scope->size;
+
+	scope->states[0] = _ADC_SCOPE_FREE;
+	scope->states[1] = _ADC_SCOPE_FREE;
+	scope->pre = pre;
+	scope->post = post;
+	scope->mode = mode;
+	scope->level = level;
+	scope->current = 0;
+	scope->head = 0;
+	scope->filled = 0;
+	scope->remaining = 0;
+	scope->external = 0;
+	scope->last = 0;
+	scope->count = 0;
+	scope->sequence = 0;
+	scope->missed = 0;
+	scope->running = 0;
+	pthread_mutex_init(&scope->lock, NULL);
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&scope->ready, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return 0;
+}
+
+/**
+ * @brief Free a scope, the acquisition thread must be stopped and captures are no longer valid.
+ * @param scope Scope.
+ */
+void adc_scope_delete(struct adc_scope *scope)
+{
+	if (!scope)
+		return;
+
+	free(scope->rings[0]);
+	pthread_cond_destroy(&scope->ready);
+	pthread_mutex_destroy(&scope->lock);
+}
+
+/**
+ * @brief Trigger the scope on the next sample fed, can be called from any thread.
+ * @param scope Scope.
+ */
+static inline void adc_scope_trigger(struct adc_scope *scope)
+{
+	__atomic_store_n(&scope->external, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Freeze the current ring and move to the other one, called once the last post-trigger sample is written.
+ * @param scope Scope.
+ */
+static void _adc_scope_freeze(struct adc_scope *scope)
+{
+	struct adc_scope_capture *cap = &scope->captures[scope->current];
+	const uint16_t *ring = scope->rings[scope->current];
+	/* The ring is full, the oldest sample is the next one that would be written */
+	const size_t start = scope->head;
+
+	cap->samples[0] = ring + start;
+	cap->len[0] = scope->size - start;
+	cap->samples[1] = ring;
+	cap->len[1] = start;
+	cap->trigger = scope->pre;
+	cap->index = scope->count - 1 - scope->post;
+	cap->sequence = scope->sequence++;
+
+	pthread_mutex_lock(&scope->lock);
+	__atomic_store_n(&scope->states[scope->current], _ADC_SCOPE_READY,
+			 __ATOMIC_RELEASE);
+	pthread_cond_signal(&scope->ready);
+	pthread_mutex_unlock(&scope->lock);
+
+	/* The other ring was checked free when triggering */
+	scope->current ^= 1;
+	scope->head = 0;
+	scope->filled = 0;
+}
+
+/**
+ * @brief Check if a sample triggers the scope.
+ * @param scope Scope.
+ * @param value Sample.
+ * @return 1 if triggered, 0 otherwise.
+ */
+static inline int _adc_scope_triggered(struct adc_scope *scope, uint16_t value)
+{
+	switch (scope->mode) {
+	case ADC_SCOPE_TRIG_LEVEL:
+		return value >= scope->level;
+	case ADC_SCOPE_TRIG_RISING:
+		return scope->last < scope->level && value >= scope->level;
+	case ADC_SCOPE_TRIG_FALLING:
+		return scope->last > scope->level && value <= scope->level;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Feed samples to the scope, from the acquisition loop.
+ * @param scope Scope.
+ * @param samples Samples, oldest first.
+ * @param num_samples Number of samples.
+ *
+ * Do not call this while the acquisition thread runs.
+ */
+void adc_scope_feed(struct adc_scope *scope, const uint16_t *samples,
+		    size_t num_samples)
+{
+	for (size_t i = 0; i < num_samples; ++i) {
+		const uint16_t value = samples[i];
+		const int triggered =
+			__atomic_exchange_n(&scope->external, 0,
+					    __ATOMIC_ACQUIRE) ||
+			(scope->count > 0 && _adc_scope_triggered(scope, value));
+
+		scope->rings[scope->current][scope->head] = value;
+		if (++scope->head == scope->size)
+			scope->head = 0;
+		if (scope->filled < scope->size)
+			++scope->filled;
+		++scope->count;
+		scope->last = value;
+
+		if (scope->remaining) {
+			if (--scope->remaining == 0)
+				_adc_scope_freeze(scope);
+			continue;
+		}
+
+		/* Armed once enough pre-trigger samples are there */
+		if (!triggered || scope->filled <= scope->pre)
+			continue;
+
+		if (__atomic_load_n(&scope->states[scope->current ^ 1],
+				    __ATOMIC_ACQUIRE) != _ADC_SCOPE_FREE) {
+			++scope->missed;
+			continue;
+		}
+
+		/* Only keep the last pre + 1 samples */
+		scope->filled = scope->size;
+		if (scope->post) {
+			scope->remaining = scope->post;
+		} else {
+			_adc_scope_freeze(scope);
+		}
+	}
+}
+
+/**
+ * @brief Wait for a capture.
+ * @param scope Scope.
+ * @param timeout_ms Maximum time to wait in milliseconds, negative to wait forever.
+ * @return Frozen capture, valid until @ref adc_scope_release, NULL on timeout.
+ */
+struct adc_scope_capture *adc_scope_wait(struct adc_scope *scope,
+					 int timeout_ms)
+{
+	struct timespec deadline;
+	struct adc_scope_capture *cap = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		++deadline.tv_sec;
+	}
+
+	pthread_mutex_lock(&scope->lock);
+	for (;;) {
+		int ring = -1;
+		/* Oldest capture first */
+		for (int i = 0; i < 2; ++i)
+			if (scope->states[i] == _ADC_SCOPE_READY &&
+			    (ring < 0 || scope->captures[i].sequence <
+						 scope->captures[ring].sequence))
+				ring = i;
+		if (ring >= 0) {
+			__atomic_store_n(&scope->states[ring],
+					 _ADC_SCOPE_TAKEN, __ATOMIC_RELAXED);
+			cap = &scope->captures[ring];
+			break;
+		}
+
+		if (timeout_ms < 0)
+			pthread_cond_wait(&scope->ready, &scope->lock);
+		else if (pthread_cond_timedwait(&scope->ready, &scope->lock,
+						&deadline) == ETIMEDOUT)
+			break;
+	}
+	pthread_mutex_unlock(&scope->lock);
+
+	return cap;
+}
+
+/**
+ * @brief Give a capture back to the scope, its ring can be written again.
+ * @param scope Scope.
+ * @param cap Capture returned by @ref adc_scope_wait.
+ */
+void adc_scope_release(struct adc_scope *scope, struct adc_scope_capture *cap)
+{
+	const int ring = cap == &scope->captures[0] ? 0 : 1;
+
+	pthread_mutex_lock(&scope->lock);
+	__atomic_store_n(&scope->states[ring], _ADC_SCOPE_FREE,
+			 __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&scope->lock);
+}
+
+/**
+ * @brief Acquisition thread.
+ * @param _scope Scope.
+ * @return Nothing.
+ */
+static void *_adc_scope_thread(void *_scope)
+{
+	struct adc_scope *scope = (struct adc_scope *)_scope;
+	uint16_t samples[ADC_SCOPE_BATCH];
+	size_t num_samples = 0;
+
+	while (__atomic_load_n(&scope->running, __ATOMIC_RELAXED)) {
+		const int value = scope->acquire(scope->data);
+		if (value < 0)
+			continue;
+
+		samples[num_samples++] = value;
+		if (num_samples == ADC_SCOPE_BATCH) {
+			adc_scope_feed(scope, samples, num_samples);
+			num_samples = 0;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Acquire samples continuously in a thread.
+ * @param scope Scope.
+ * @param acquire Called to get each sample, returns a negative value on error (e.g. a wrapper of tlc1543_get_sample).
+ * @param data Given to acquire.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_scope_start(struct adc_scope *scope, int (*acquire)(void *),
+		    void *data)
+{
+	if (!scope || !acquire || scope->running) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	scope->acquire = acquire;
+	scope->data = data;
+	scope->running = 1;
+	if (pthread_create(&scope->thread, NULL, _adc_scope_thread, scope)) {
+		scope->running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Stop the acquisition thread.
+ * @param scope Scope.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_scope_stop(struct adc_scope *scope)
+{
+	if (!scope || !scope->running) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	__atomic_store_n(&scope->running, 0, __ATOMIC_RELAXED);
+	return pthread_join(scope->thread, NULL) ? -1 : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADC_SCOPE_H
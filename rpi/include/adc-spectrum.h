@@ -0,0 +1,481 @@
+/**
+ * @brief Streaming FFT band-energy monitor for ADC channels
+ *
+ * @file adc-spectrum.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-26
+ *
+ * @details
+ * Samples are fed as they are acquired, every `hop` samples the last `size` samples (overlapping blocks)
+ * go through a Hann window and a real FFT, then the handler gets the energy of each band and the peak frequency.
+ * Only a handful of values per block leave the acquisition, instead of every raw sample.
+ *
+ * The real FFT of `size` samples is done as a complex FFT of `size / 2` points followed by a split step.
+ * The complex FFT works in place on separate real and imaginary arrays: bit-reversal from a precomputed table,
+ * a first radix-4 pass (its twiddles are only ±1 and ±j so it needs no multiplication) then radix-2 passes
+ * using a precomputed twiddle table laid out contiguously for each pass.
+ * Windowing, the radix-2 butterflies and the power computation work on 4 floats at once using GCC vector
+ * extensions, which compile to NEON on the Raspberry Pi (`-mfpu=neon` on 32-bit) and SSE on x86.
+ *
+ * Band energies are the mean square of the signal in each band (ADC units²), the mean of the block is removed first
+ * so the DC component does not leak into the lowest bands.
+ *
+ * ## Usage
+ *
+ * ```c
+ * void on_block(const struct adc_spectrum_result *res, void *data)
+ * {
+ * 	printf("%.1f Hz, bands: %f %f\n", res->peak_hz, res->bands[0], res->bands[1]);
+ * }
+ *
+ * const float edges[] = { 10, 50, 200, 500 }; // 3 bands: 10-50 Hz, 50-200 Hz and 200-500 Hz
+ * struct adc_spectrum spec;
+ * adc_spectrum_init(&spec, 256, 128, 1000, edges, 3, on_block, NULL); // 1 kHz sampling, 50% overlap
+ *
+ * adc_spectrum_feed(&spec, samples, num_samples);
+ *
+ * adc_spectrum_delete(&spec);
+ * ```
+ *
+ * @warning This uses libm, do not forget to add `-lm` when compiling!
+ */
+
+#ifndef ADC_SPECTRUM_H
+#define ADC_SPECTRUM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/** @brief Smallest block size. */
+#define ADC_SPECTRUM_MIN_SIZE 8
+/** @brief Largest block size. */
+#define ADC_SPECTRUM_MAX_SIZE 65536
+/** @brief Maximum number of bands. */
+#define ADC_SPECTRUM_MAX_BANDS 32
+
+/** @brief 4 floats handled at once. */
+typedef float _adc_spectrum_v4 __attribute__((vector_size(16)));
+
+/**
+ * @brief Result of a block.
+ */
+struct adc_spectrum_result {
+	const float *bands;
+	///< Energy of each band (mean square, ADC units²)
+	unsigned int num_bands;
+	///< Number of bands
+	float peak_hz;
+	///< Frequency of the strongest bin (DC excluded), interpolated between bins
+	float peak;
+	///< Energy of the strongest bin
+	float total;
+	///< Energy of the whole block, DC excluded
+	unsigned long block;
+	///< Number of the block, starting at 0
+};
+
+/**
+ * @brief Called at the end of every block.
+ * @param res Result, only valid during the call.
+ * @param data User data given to @ref adc_spectrum_init.
+ */
+typedef void (*adc_spectrum_handler)(const struct adc_spectrum_result *res,
+				     void *data);
+
+/**
+ * @brief Spectrum monitor.
+ */
+struct adc_spectrum {
+	unsigned int size;
+	///< Number of samples per block (power of 2)
+	unsigned int hop;
+	///< Number of new samples between two blocks
+	float rate;
+	///< Sampling rate (Hz)
+	uint16_t *ring;
+	///< Last size samples
+	unsigned int head;
+	///< Next position written in the ring
+	unsigned long long count;
+	///< Number of samples fed
+	unsigned int pending;
+	///< Samples fed since the last block
+	float *window;
+	///< Hann window (size)
+	float *re;
+	///< Real parts of the complex FFT (size / 2)
+	float *im;
+	///< Imaginary parts of the complex FFT (size / 2)
+	float *power;
+	///< Energy of each bin (size / 2 + 1)
+	float *twiddle_re;
+	///< Twiddles of the radix-2 passes, the pass of half-size h uses [h, 2h)
+	float *twiddle_im;
+	///< Imaginary parts of twiddle_re
+	float *split_re;
+	///< Twiddles of the split step (size / 2)
+	float *split_im;
+	///< Imaginary parts of split_re
+	uint32_t *reverse;
+	///< Bit-reversal permutation (size / 2)
+	float scale;
+	///< Converts |X|² to energy
+	unsigned int band_bins[ADC_SPECTRUM_MAX_BANDS + 1];
+	///< First bin of each band, the last entry ends the last band
+	float bands[ADC_SPECTRUM_MAX_BANDS];
+	///< Energy of each band
+	unsigned int num_bands;
+	///< Number of bands
+	unsigned long blocks;
+	///< Number of blocks computed
+	adc_spectrum_handler handler;
+	///< Called at the end of every block
+	void *data;
+	///< User data given to the handler
+};
+
+/**
+ * @brief Free a spectrum monitor.
+ * @param spec Spectrum monitor.
+ */
+void adc_spectrum_delete(struct adc_spectrum *spec)
+{
+	if (!spec)
+		return;
+
+	free(spec->ring);
+	free(spec->window);
+	free(spec->re);
+	free(spec->im);
+	free(spec->power);
+	free(spec->twiddle_re);
+	free(spec->twiddle_im);
+	free(spec->split_re);
+	free(spec->split_im);
+	free(spec->reverse);
+}
+
+/**
+ * @brief Initialize a spectrum monitor.
+ * @param spec Spectrum monitor to initialize.
+ * @param size Number of samples per block, power of 2 between @ref ADC_SPECTRUM_MIN_SIZE and @ref ADC_SPECTRUM_MAX_SIZE.
+ * @param hop Number of new samples between two blocks (size / 2 for 50% overlap), at most size.
+ * @param rate Sampling rate (Hz).
+ * @param edges Edges of the bands in Hz, increasing, num_bands + 1 values.
+ * @param num_bands Number of bands, at most @ref ADC_SPECTRUM_MAX_BANDS.
+ * @param handler Called at the end of every block.
+ * @param data User data given to the handler.
+ * @return 0 on success, -1 on failure.
+ */
+int adc_spectrum_init(struct adc_spectrum *spec, unsigned int size,
+		      unsigned int hop, float rate, const float *edges,
+		      unsigned int num_bands, adc_spectrum_handler handler,
+		      void *data)
+{
+	if (!spec || size < ADC_SPECTRUM_MIN_SIZE ||
+	    size > ADC_SPECTRUM_MAX_SIZE || (size & (size - 1)) || hop == 0 ||
+	    hop > size || rate <= 0 || !edges || num_bands == 0 ||
+	    num_bands > ADC_SPECTRUM_MAX_BANDS || !handler) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const unsigned int half = size / 2;
+
+	memset(spec, 0, sizeof(*spec));
+	spec->size = size;
+	spec->hop = hop;
+	spec->rate = rate;
+	spec->num_bands = num_bands;
+	spec->handler = handler;
+	spec->data = data;
+
+	/* Sizes are multiples of 4 (size >= 8), as needed by the vector loads */
+	spec->ring = calloc(size, sizeof(uint16_t));
+	spec->window = malloc(size * sizeof(float));
+	spec->re = malloc(half * sizeof(float));
+	spec->im = malloc(half * sizeof(float));
+	spec->power = malloc((half + 1) * sizeof(float));
+	spec->twiddle_re = malloc(half * sizeof(float));
+	spec->twiddle_im = malloc(half * sizeof(float));
+	spec->split_re = malloc(half * sizeof(float));
+	spec->split_im = malloc(half * sizeof(float));
+	spec->reverse = malloc(half * sizeof(uint32_t));
+	if (!spec->ring || !spec->window || !spec->re || !spec->im ||
+	    !spec->power || !spec->twiddle_re || !spec->twiddle_im ||
+	    !spec->split_re || !spec->split_im || !spec->reverse) {
+		adc_spectrum_delete(spec);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Hann window, scale so the energies of a block add up to its mean square */
+	double sum2 = 0;
+	for (unsigned int n = 0; n < size; ++n) {
+		const double w = 0.5 - 0.5 * cos(2 * M_PI * n / size);
+		spec->window[n] = w;
+		sum2 += w * w;
+	}
+	spec->scale = 2.0 / (size * sum2);
+
+	unsigned int bits = 0;
+	while ((1U << bits) < half)
+		++bits;
+	for (unsigned int k = 0; k < half; ++k) {
+		uint32_t r = 0;
+		for (unsigned int b = 0; b < bits; ++b)
+			r |= ((k >> b) & 1) << (bits - 1 - b);
+		spec->reverse[k] = r;
+	}
+
+	/* Twiddles of the pass combining blocks of h points: exp(-i * pi * j / h) */
+	for (unsigned int h = 1; h < half; h <<= 1)
+		for (unsigned int j = 0; j < h; ++j) {
+			spec->twiddle_re[h + j] = cos(M_PI * j / h);
+			spec->twiddle_im[h + j] = -sin(M_PI * j / h);
+		}
+	spec->twiddle_re[0] = 1;
+	spec->twiddle_im[0] = 0;
+
+	for (unsigned int k = 0; k < half; ++k) {
+		spec->split_re[k] = cos(2 * M_PI * k / size);
+		spec->split_im[k] = -sin(2 * M_PI * k / size);
+	}
+
+	/* Bands from frequencies to bins, bin k is at k * rate / size */
+	for (unsigned int b = 0; b <= num_bands; ++b) {
+		if (edges[b] < 0 || (b > 0 && edges[b] < edges[b - 1])) {
+			adc_spectrum_delete(spec);
+			errno = EINVAL;
+			return -1;
+		}
+		const float bin = ceilf(edges[b] * size / rate);
+		spec->band_bins[b] = bin > half + 1 ? half + 1 : bin;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Load 4 floats, the address does not need to be aligned.
+ * @param p Address.
+ * @return Vector.
+ */
+static inline _adc_spectrum_v4 _adc_spectrum_load(const float *p)
+{
+	_adc_spectrum_v4 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+ * @brief Store 4 floats, the address does not need to be aligned.
+ * @param p Address.
+ * @param v Vector.
+ */
+static inline void _adc_spectrum_store(float *p, _adc_spectrum_v4 v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/**
+ * @brief In-place complex FFT of the bit-reversed re/im arrays.
+ * @param spec Spectrum monitor.
+ */
+static void _adc_spectrum_fft(struct adc_spectrum *spec)
+{
+	const unsigned int n = spec->size / 2;
+	float *re = spec->re;
+	float *im = spec->im;
+
+	/* Radix-4 pass, same as the first two radix-2 passes (twiddles 1 and -j) */
+	for (unsigned int g = 0; g < n; g += 4) {
+		const float b0r = re[g] + re[g + 1], b0i = im[g] + im[g + 1];
+		const float b1r = re[g] - re[g + 1], b1i = im[g] - im[g + 1];
+		const float b2r = re[g + 2] + re[g + 3],
+			    b2i = im[g + 2] + im[g + 3];
+		const float b3r = re[g + 2] - re[g + 3],
+			    b3i = im[g + 2] - im[g + 3];
+
+		re[g] = b0r + b2r;
+		im[g] = b0i + b2i;
+		re[g + 2] = b0r - b2r;
+		im[g + 2] = b0i - b2i;
+		/* -j * b3 = b3i - j * b3r */
+		re[g + 1] = b1r + b3i;
+		im[g + 1] = b1i - b3r;
+		re[g + 3] = b1r - b3i;
+		im[g + 3] = b1i + b3r;
+	}
+
+	/* Radix-2 passes, at least 4 butterflies per group so they are done 4 at a time */
+	for (unsigned int h = 4; h < n; h <<= 1) {
+		const float *wr = spec->twiddle_re + h;
+		const float *wi = spec->twiddle_im + h;
+
+		for (unsigned int g = 0; g < n; g += 2 * h)
+			for (unsigned int j = 0; j < h; j += 4) {
+				float *ar = re + g + j, *ai = im + g + j;
+				float *br = ar + h, *bi = ai + h;
+
+				const _adc_spectrum_v4 vwr =
+					_adc_spectrum_load(wr + j);
+				const _adc_spectrum_v4 vwi =
+					_adc_spectrum_load(wi + j);
+				const _adc_spectrum_v4 vbr =
+					_adc_spectrum_load(br);
+				const _adc_spectrum_v4 vbi =
+					_adc_spectrum_load(bi);
+				const _adc_spectrum_v4 var =
+					_adc_spectrum_load(ar);
+				const _adc_spectrum_v4 vai =
+					_adc_spectrum_load(ai);
+
+				const _adc_spectrum_v4 tr = vbr * vwr - vbi * vwi;
+				const _adc_spectrum_v4 ti = vbr * vwi + vbi * vwr;
+
+				_adc_spectrum_store(ar, var + tr);
+				_adc_spectrum_store(ai, vai + ti);
+				_adc_spectrum_store(br, var - tr);
+				_adc_spectrum_store(bi, vai - ti);
+			}
+	}
+}
+
+/**
+ * @brief Compute the spectrum of the last size samples and call the handler.
+ * @param spec Spectrum monitor.
+ */
+static void _adc_spectrum_block(struct adc_spectrum *spec)
+{
+	const unsigned int size = spec->size;
+	const unsigned int half = size / 2;
+	/* Oldest sample first, in the windowed and packed block */
+	const unsigned int start = spec->head;
+	float block[4];
+	float mean = 0;
+
+	for (unsigned int i = 0; i < size; ++i)
+		mean += spec->ring[i];
+	mean /= size;
+
+	/* Window and pack even samples as real parts, odd samples as imaginary parts */
+	const _adc_spectrum_v4 vmean = { mean, mean, mean, mean };
+	for (unsigned int i = 0; i < size; i += 4) {
+		for (unsigned int k = 0; k < 4; ++k)
+			block[k] = spec->ring[(start + i + k) & (size - 1)];
+		const _adc_spectrum_v4 v =
+			(_adc_spectrum_load(block) - vmean) *
+			_adc_spectrum_load(spec->window + i);
+		const unsigned int k = i / 2;
+		spec->re[spec->reverse[k]] = v[0];
+		spec->im[spec->reverse[k]] = v[1];
+		spec->re[spec->reverse[k + 1]] = v[2];
+		spec->im[spec->reverse[k + 1]] = v[3];
+	}
+
+	_adc_spectrum_fft(spec);
+
+	/* Split step: X[k] = (Z[k] + conj(Z[n - k])) / 2 - j * W^k * (Z[k] - conj(Z[n - k])) / 2 */
+	for (unsigned int k = 0; k <= half; ++k) {
+		const unsigned int a = k == half ? 0 : k;
+		const unsigned int b = k == 0 ? 0 : half - k;
+		const float er = (spec->re[a] + spec->re[b]) / 2;
+		const float ei = (spec->im[a] - spec->im[b]) / 2;
+		const float or_ = (spec->im[a] + spec->im[b]) / 2;
+		const float oi = (spec->re[b] - spec->re[a]) / 2;
+		/* W^half = -1 */
+		const float wr = k == half ? -1 : spec->split_re[k];
+		const float wi = k == half ? 0 : spec->split_im[k];
+		const float xr = er + wr * or_ - wi * oi;
+		const float xi = ei + wr * oi + wi * or_;
+		spec->power[k] = xr * xr + xi * xi;
+	}
+
+	/* Scale 4 bins at a time, DC and Nyquist bins only count once */
+	const _adc_spectrum_v4 vscale = { spec->scale, spec->scale, spec->scale,
+					  spec->scale };
+	for (unsigned int k = 0; k + 4 <= half + 1; k += 4)
+		_adc_spectrum_store(spec->power + k,
+				    _adc_spectrum_load(spec->power + k) * vscale);
+	for (unsigned int k = (half + 1) & ~3U; k <= half; ++k)
+		spec->power[k] *= spec->scale;
+	spec->power[0] /= 2;
+	spec->power[half] /= 2;
+
+	struct adc_spectrum_result res = {
+		.bands = spec->bands,
+		.num_bands = spec->num_bands,
+		.block = spec->blocks++,
+	};
+
+	unsigned int peak = 1;
+	for (unsigned int k = 1; k <= half; ++k) {
+		res.total += spec->power[k];
+		if (spec->power[k] > spec->power[peak])
+			peak = k;
+	}
+	res.peak = spec->power[peak];
+
+	/* Parabolic interpolation on the magnitudes around the peak */
+	float offset = 0;
+	if (peak < half) {
+		const float l = sqrtf(spec->power[peak - 1]);
+		const float c = sqrtf(spec->power[peak]);
+		const float r = sqrtf(spec->power[peak + 1]);
+		const float d = l - 2 * c + r;
+		if (d < 0)
+			offset = 0.5f * (l - r) / d;
+	}
+	res.peak_hz = (peak + offset) * spec->rate / size;
+
+	for (unsigned int b = 0; b < spec->num_bands; ++b) {
+		float energy = 0;
+		for (unsigned int k = spec->band_bins[b];
+		     k < spec->band_bins[b + 1]; ++k)
+			energy += spec->power[k];
+		spec->bands[b] = energy;
+	}
+
+	spec->handler(&res, spec->data);
+}
+
+/**
+ * @brief Feed samples, the handler is called from here at the end of every block.
+ * @param spec Spectrum monitor.
+ * @param samples Samples, oldest first.
+ * @param num_samples Number of samples.
+ */
+void adc_spectrum_feed(struct adc_spectrum *spec, const uint16_t *samples,
+		       size_t num_samples)
+{
+	const unsigned int mask = spec->size - 1;
+
+	for (size_t i = 0; i < num_samples; ++i) {
+		spec->ring[spec->head] = samples[i];
+		spec->head = (spec->head + 1) & mask;
+		++spec->count;
+
+		if (++spec->pending >= spec->hop && spec->count >= spec->size) {
+			spec->pending = 0;
+			_adc_spectrum_block(spec);
+		}
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ADC_SPECTRUM_H
@@ -12,6 +12,7 @@
  * Libraries availabe:
  *      - PCF8563 Real-Time Clock
  *      - TLC1543 10-Bit ADC
+ *      - Groups of TLC1543 sharing the same clock
  */
 
 #ifndef ARPI600_H
@@ -23,6 +24,7 @@ extern "C" {
 
 #include "pcf8563.h"
 #include "tlc1543.h"
+#include "tlc1543-group.h"
 
 #ifdef __cplusplus
 }
@@ -46,6 +46,27 @@
  * pcf8563_close(pcf); 
  * ```
  * 
+ * ## Register cache
+ *
+ * Registers go through a cached register map (see regmap.h) attached to the file descriptor by @ref pcf8563_init,
+ * the functions fail with PCF8563_ERR_NOPEN (errno ENODEV) on a file descriptor that was not opened this way:
+ * control registers are only read once (e.g. @ref pcf8563_is_running does not touch the bus after the first call),
+ * time, status and timer registers are volatile and always read from the RTC.
+ *
+ * ## Clock output
+ *
+ * The CLKOUT pin is gated with runtime PM (see runtime-pm.h): users hold the clock with @ref pcf8563_clkout_get
+ * and release it with @ref pcf8563_clkout_put, the output is switched off once nobody held it for
+ * @ref PCF8563_CLKOUT_AUTOSUSPEND_MS, so short gaps between users do not glitch the clock.
+ *
+ * ```c
+ * pcf8563_clkout_get(pcf, PCF8563_CLKOUT_1HZ);
+ * // ... count the 1 Hz ticks ...
+ * pcf8563_clkout_put(pcf);
+ * ```
+ *
+ * The autosuspend thread needs `-pthread`.
+ *
  * ## ARPI600 Implementation specific:
  *      - Set the RTC jumper on the board
  */
@@ -92,6 +113,22 @@
 #define PCF8563_TIMER_CTRL 0x0E
 #define PCF8563_TIMER 0x0F
 
+/**
+ * @}
+ * @name CLKOUT frequencies
+ * @{
+ */
+#define PCF8563_CLKOUT_32768HZ 0x00
+#define PCF8563_CLKOUT_1024HZ 0x01
+#define PCF8563_CLKOUT_32HZ 0x02
+#define PCF8563_CLKOUT_1HZ 0x03
+/** @brief CLKOUT enable bit (FE) */
+#define PCF8563_CLKOUT_FE 0x80
+#ifndef PCF8563_CLKOUT_AUTOSUSPEND_MS
+/** @brief Time without user before the clock output is switched off (ms) */
+#define PCF8563_CLKOUT_AUTOSUSPEND_MS 1000
+#endif
+
 /**
  * @}
  * @name Error returned by functions
@@ -121,6 +158,10 @@
 #include <string.h>
 #include <linux/i2c-dev.h>
 
+#include "../regmap.h"
+#include "../runtime-pm.h"
+#include "../rpi-probes.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -135,6 +176,103 @@ static inline uint8_t dec_to_bcd(int value)
 	return ((uint8_t)(value / 10) << 4) | ((uint8_t)(value % 10));
 }
 
+/**
+ * @brief Get the register map of a connection
+ *
+ * @param i2c_fd Connection to the PCF8563 as a file descriptor
+ * @return Register map, NULL with errno set to ENODEV if the connection was not opened with pcf8563_init
+ */
+static struct regmap *_pcf8563_regmap(const int i2c_fd)
+{
+	struct regmap *map = regmap_get(i2c_fd);
+	if (!map)
+		errno = ENODEV;
+
+	return map;
+}
+
+/**
+ * @brief Clock output of a connection, gated with runtime PM
+ */
+struct _pcf8563_clkout {
+	struct runtime_pm pm; ///< Power state of the output
+	int fd; ///< Connection to the PCF8563
+	uint8_t freq; ///< Frequency used when the output is switched on
+	int in_use; ///< Whether the output is managed
+};
+
+/** @brief Clock outputs, same index as the register map of the connection */
+static struct _pcf8563_clkout _pcf8563_clkout_table[REGMAP_MAX_DEVICES];
+
+/**
+ * @brief Switch the clock output off, runtime PM suspend callback
+ *
+ * @param data Clock output
+ * @return 0 on success, negative value on error
+ */
+static int _pcf8563_clkout_suspend(void *data)
+{
+	const struct _pcf8563_clkout *out = (struct _pcf8563_clkout *)data;
+	struct regmap *map = regmap_get(out->fd);
+
+	if (!map ||
+	    regmap_update_bits(map, PCF8563_REG_CLKOUT, PCF8563_CLKOUT_FE, 0) < 0)
+		return PCF8563_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Switch the clock output on, runtime PM resume callback
+ *
+ * @param data Clock output
+ * @return 0 on success, negative value on error
+ */
+static int _pcf8563_clkout_resume(void *data)
+{
+	const struct _pcf8563_clkout *out = (struct _pcf8563_clkout *)data;
+	struct regmap *map = regmap_get(out->fd);
+
+	if (!map || regmap_write(map, PCF8563_REG_CLKOUT,
+				 PCF8563_CLKOUT_FE | out->freq) < 0)
+		return PCF8563_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Get the clock output of a connection, managed from the first call
+ *
+ * @param i2c_fd Connection to the PCF8563 as a file descriptor
+ * @return Clock output, NULL on error
+ */
+static struct _pcf8563_clkout *_pcf8563_clkout(const int i2c_fd)
+{
+	struct regmap *map = _pcf8563_regmap(i2c_fd);
+	if (!map)
+		return NULL;
+
+	struct _pcf8563_clkout *out = &_pcf8563_clkout_table[map - _regmap_table];
+	if (out->in_use)
+		return out;
+
+	/* The output is enabled at power-on, start from its current state */
+	uint8_t clkout;
+	if (regmap_read(map, PCF8563_REG_CLKOUT, &clkout) < 0)
+		return NULL;
+
+	out->fd = i2c_fd;
+	out->freq = clkout & 0x03;
+	if (runtime_pm_init(&out->pm, _pcf8563_clkout_suspend,
+			    _pcf8563_clkout_resume, out,
+			    PCF8563_CLKOUT_AUTOSUSPEND_MS,
+			    (clkout & PCF8563_CLKOUT_FE) != 0) < 0)
+		return NULL;
+	out->in_use = 1;
+
+	return out;
+}
+
 /**
  * @brief Print PCF8563 errors, useful when getting a negative value from a function
  * 
@@ -190,6 +328,16 @@ int pcf8563_init_c_ui16(const char *i2c_device, const long slave_addr)
 		return PCF8563_ERR_NOPEN;
 	}
 
+	/* The PCF8563 always auto-increments the register address */
+	struct regmap *map = regmap_open(fd, 0);
+	if (!map) {
+		(void)close(fd);
+		return PCF8563_ERR;
+	}
+	/* Flags, time (with the VL bit) and timer change on their own */
+	regmap_set_volatile(map, PCF8563_REG_CSTATUS_2, PCF8563_REG_YEAR);
+	regmap_set_volatile(map, PCF8563_TIMER, PCF8563_TIMER);
+
 	return fd;
 }
 
@@ -225,6 +373,14 @@ int pcf8563_close(const int i2c_fd)
 	if (i2c_fd < 0)
 		return PCF8563_ERR_ARG;
 
+	/* A clock output still managed is switched off */
+	struct regmap *map = regmap_get(i2c_fd);
+	if (map && _pcf8563_clkout_table[map - _regmap_table].in_use) {
+		runtime_pm_remove(&_pcf8563_clkout_table[map - _regmap_table].pm);
+		_pcf8563_clkout_table[map - _regmap_table].in_use = 0;
+	}
+
+	regmap_close(i2c_fd);
 	if (close(i2c_fd) < 0)
 		return PCF8563_ERR;
 
@@ -237,6 +393,7 @@ int pcf8563_close(const int i2c_fd)
  * @param i2c_fd Opened connection to the RTC clock 
  * @param time Pointer to a time_t that will contain the time
  * @return 0 on success, negative value on error
+ * @note Probes `pcf8563:read_time_start(i2c_fd)` and `pcf8563:read_time_end(i2c_fd, ret)`.
  */
 int pcf8563_read_time(const int i2c_fd, time_t *time)
 {
@@ -246,17 +403,20 @@ int pcf8563_read_time(const int i2c_fd, time_t *time)
 		return PCF8563_ERR_ARG;
 
 	uint8_t buf[7];
-	uint8_t start_read = PCF8563_REG_VLSEC;
+	struct regmap *map = _pcf8563_regmap(i2c_fd);
+	if (!map)
+		return PCF8563_ERR_NOPEN;
 
 	/* Following recommended method to read time from the datasheet (c 8.5)
          * - Send 0x02 (VL_SEC register)
          * - Read all time registers
          * - Convert BCD values to decimal
          */
-	if (write(i2c_fd, &start_read, 1) < 0)
-		return PCF8563_ERR_WRITE;
-	if (read(i2c_fd, buf, sizeof(buf)) < 0)
+	RPI_PROBE1(pcf8563, read_time_start, i2c_fd);
+	if (regmap_bulk_read(map, PCF8563_REG_VLSEC, buf, sizeof(buf)) < 0) {
+		RPI_PROBE2(pcf8563, read_time_end, i2c_fd, PCF8563_ERR_READ);
 		return PCF8563_ERR_READ;
+	}
 
 	struct tm tm_pcf = { 0 };
 
@@ -271,6 +431,7 @@ int pcf8563_read_time(const int i2c_fd, time_t *time)
 
 	*time = mktime(&tm_pcf);
 
+	RPI_PROBE2(pcf8563, read_time_end, i2c_fd, 0);
 	return 0;
 }
 
@@ -280,6 +441,7 @@ int pcf8563_read_time(const int i2c_fd, time_t *time)
  * @param i2c_fd Opened connection to the RTC clock 
  * @param time Pointer to a time_t that will contain the time
  * @return 0 on success, negative value on error
+ * @note Probes `pcf8563:set_time_start(i2c_fd)` and `pcf8563:set_time_end(i2c_fd, ret)`.
  */
 int pcf8563_set_time(const int i2c_fd, const time_t *time)
 {
@@ -288,23 +450,31 @@ int pcf8563_set_time(const int i2c_fd, const time_t *time)
 	if (!time)
 		return PCF8563_ERR_ARG;
 
+	struct regmap *map = _pcf8563_regmap(i2c_fd);
+	if (!map)
+		return PCF8563_ERR_NOPEN;
+
+	RPI_PROBE1(pcf8563, set_time_start, i2c_fd);
 	struct tm *tm_pcf = localtime(time);
-	uint8_t buf[8];
-
-	buf[0] = PCF8563_REG_VLSEC; // Writing starts at VLSEC register
-	buf[1] = dec_to_bcd(tm_pcf->tm_sec) & 0x7F;
-	buf[2] = dec_to_bcd(tm_pcf->tm_min) & 0x7F;
-	buf[3] = dec_to_bcd(tm_pcf->tm_hour) & 0x3F;
-	buf[4] = dec_to_bcd(tm_pcf->tm_mday) & 0x3F;
-	buf[5] = dec_to_bcd(tm_pcf->tm_wday) & 0x07;
-	buf[6] = (dec_to_bcd(tm_pcf->tm_mon + 1) & 0x1F) |
+	uint8_t buf[7];
+
+	/* Writing starts at VLSEC register */
+	buf[0] = dec_to_bcd(tm_pcf->tm_sec) & 0x7F;
+	buf[1] = dec_to_bcd(tm_pcf->tm_min) & 0x7F;
+	buf[2] = dec_to_bcd(tm_pcf->tm_hour) & 0x3F;
+	buf[3] = dec_to_bcd(tm_pcf->tm_mday) & 0x3F;
+	buf[4] = dec_to_bcd(tm_pcf->tm_wday) & 0x07;
+	buf[5] = (dec_to_bcd(tm_pcf->tm_mon + 1) & 0x1F) |
 		 (tm_pcf->tm_mon > 99 ? 0x80 : 0x00);
-	buf[7] = dec_to_bcd((tm_pcf->tm_year - 100) % 100);
+	buf[6] = dec_to_bcd((tm_pcf->tm_year - 100) % 100);
 
-	if (write(i2c_fd, buf, sizeof(buf)) < 0)
-		return PCF8563_ERR_WRITE;
+	const int ret = regmap_bulk_write(map, PCF8563_REG_VLSEC, buf,
+					  sizeof(buf)) < 0 ?
+				PCF8563_ERR_WRITE :
+				0;
+	RPI_PROBE2(pcf8563, set_time_end, i2c_fd, ret);
 
-	return 0;
+	return ret;
 }
 
 /**
@@ -318,10 +488,12 @@ int pcf8563_is_voltage_low(const int i2c_fd)
 	if (i2c_fd < 0)
 		return PCF8563_ERR_NOPEN;
 
-	uint8_t vl = PCF8563_REG_VLSEC;
-	if (write(i2c_fd, &vl, sizeof(vl)) < 0)
-		return PCF8563_ERR_WRITE;
-	if (read(i2c_fd, &vl, sizeof(vl)) < 0)
+	struct regmap *map = _pcf8563_regmap(i2c_fd);
+	if (!map)
+		return PCF8563_ERR_NOPEN;
+
+	uint8_t vl;
+	if (regmap_read(map, PCF8563_REG_VLSEC, &vl) < 0)
 		return PCF8563_ERR_READ;
 
 	/* Return directly the value of the VL bit */
@@ -339,18 +511,95 @@ int pcf8563_is_running(const int i2c_fd)
 	if (i2c_fd < 0)
 		return PCF8563_ERR_NOPEN;
 
-	/* Read the Control Status 1 Register */
-	uint8_t cstatus = PCF8563_REG_CSTATUS_1;
+	struct regmap *map = _pcf8563_regmap(i2c_fd);
+	if (!map)
+		return PCF8563_ERR_NOPEN;
 
-	if (write(i2c_fd, &cstatus, sizeof(cstatus)) < 0)
-		return PCF8563_ERR_WRITE;
-	if (read(i2c_fd, &cstatus, sizeof(cstatus)) < 0)
+	/* Read the Control Status 1 Register, from the cache after the first time */
+	uint8_t cstatus;
+	if (regmap_read(map, PCF8563_REG_CSTATUS_1, &cstatus) < 0)
 		return PCF8563_ERR_READ;
 
 	/* Test the STOP bit */
 	return ((cstatus & (1 << 5)) == 0);
 }
 
+/**
+ * @brief Hold the clock output on, it is switched on if needed
+ *
+ * @param i2c_fd Opened connection to the RTC clock
+ * @param freq Frequency (e.g. PCF8563_CLKOUT_1HZ), shared by every user: the last one sets it
+ * @return 0 on success, negative value on error
+ * @note Release the output with @ref pcf8563_clkout_put.
+ */
+int pcf8563_clkout_get(const int i2c_fd, const int freq)
+{
+	if (i2c_fd < 0)
+		return PCF8563_ERR_NOPEN;
+	if (freq & ~0x03)
+		return PCF8563_ERR_ARG;
+
+	struct _pcf8563_clkout *out = _pcf8563_clkout(i2c_fd);
+	if (!out)
+		return PCF8563_ERR;
+
+	out->freq = freq;
+	if (runtime_pm_get(&out->pm) < 0)
+		return PCF8563_ERR_WRITE;
+
+	/* Already on: only written if the frequency changed */
+	if (regmap_write(regmap_get(i2c_fd), PCF8563_REG_CLKOUT,
+			 PCF8563_CLKOUT_FE | out->freq) < 0) {
+		runtime_pm_put(&out->pm);
+		return PCF8563_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Release the clock output, it is switched off after PCF8563_CLKOUT_AUTOSUSPEND_MS without user
+ *
+ * @param i2c_fd Opened connection to the RTC clock
+ * @return 0 on success, negative value on error
+ */
+int pcf8563_clkout_put(const int i2c_fd)
+{
+	if (i2c_fd < 0)
+		return PCF8563_ERR_NOPEN;
+
+	struct _pcf8563_clkout *out = _pcf8563_clkout(i2c_fd);
+	if (!out)
+		return PCF8563_ERR;
+
+	if (runtime_pm_put(&out->pm) < 0)
+		return PCF8563_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Change the time without user before the clock output is switched off
+ *
+ * @param i2c_fd Opened connection to the RTC clock
+ * @param delay_ms Delay (ms), 0 to switch it off on the last release, negative to never switch it off
+ * @return 0 on success, negative value on error
+ */
+int pcf8563_clkout_set_autosuspend(const int i2c_fd, const int delay_ms)
+{
+	if (i2c_fd < 0)
+		return PCF8563_ERR_NOPEN;
+
+	struct _pcf8563_clkout *out = _pcf8563_clkout(i2c_fd);
+	if (!out)
+		return PCF8563_ERR;
+
+	if (runtime_pm_set_autosuspend(&out->pm, delay_ms) < 0)
+		return PCF8563_ERR_WRITE;
+
+	return 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,248 @@
+/**
+ * @brief Several TLC1543 ADCs sharing I/O CLK and ADDR, read in parallel
+ *
+ * @file tlc1543-group.h
+ * @ingroup ArPi600
+ * @copyright (c) Pierre Boisselier
+ * @date 2022-02-23
+ *
+ * @details
+ * Each @ref tlc1543 clocks its chip on its own, so N chips take N times as long to sample.
+ * A group drives the I/O CLK and ADDR pins of every chip from the same two GPIO lines
+ * while each chip keeps its own DATA_OUT line.
+ * A single clock sequence then converts the same channel on every chip, and the DATA_OUT lines
+ * are all read with one bulk read per clock, so adding chips does not lower the rate per channel.
+ *
+ * @ref tlc1543_group_scan pipelines the conversions of several channels:
+ * each clock sequence sends the next address while reading the previous result,
+ * which takes N + 1 sequences for N channels instead of 2N.
+ *
+ * ## Usage
+ *
+ * ```c
+ * const int data[] = { 21, 26 };
+ * struct tlc1543_group grp;
+ * tlc1543_group_init(&grp, TLC1543_GPIO_CHIP_DEV, TLC1543_PIN_IOCLK, TLC1543_PIN_ADDR, data, 2);
+ *
+ * uint16_t samples[2];
+ * tlc1543_group_get_samples(&grp, 0, samples); // Channel 0 of both chips
+ *
+ * tlc1543_group_delete(&grp);
+ * ```
+ *
+ * @note The CS pin of every chip must be tied low, as on the ArPi600.
+ * @note Lines are always requested for the lifetime of the group (as with @ref TLC1543_OPT_EXCLUSIVE).
+ */
+
+#ifndef TLC1543_GROUP_H
+#define TLC1543_GROUP_H
+
+#include "tlc1543.h"
+
+/** @brief Maximum number of chips in a group */
+#define TLC1543_GROUP_MAX_CHIPS GPIOD_LINE_BULK_MAX_LINES
+
+/**
+ * @brief Access to a group of TLC1543 sharing I/O CLK and ADDR
+ */
+struct tlc1543_group {
+	struct gpiod_chip *chip; ///< GPIO chip used
+	struct gpiod_line *ioclk; ///< GPIO line for I/O CLK, shared
+	struct gpiod_line *addr; ///< GPIO line for ADDR, shared
+	struct gpiod_line_bulk data; ///< GPIO lines for DATA_OUT, one per chip
+};
+
+/**
+ * @brief Initialize an access to a group of TLC1543
+ *
+ * @param grp Allocated structure that will serve as the access
+ * @param gpio_dev GPIO chip device path (e.g. "/dev/gpiochipX")
+ * @param gpio_ioclk GPIO pin where the I/O clock of every chip is connected
+ * @param gpio_addr GPIO pin where the address line of every chip is connected
+ * @param gpio_data GPIO pins where the Data Out line of each chip is connected
+ * @param num_chips Number of chips (size of gpio_data)
+ * @return 0 on success, negative value on error
+ */
+int tlc1543_group_init(struct tlc1543_group *grp, const char *gpio_dev,
+		       const int gpio_ioclk, const int gpio_addr,
+		       const int *gpio_data, unsigned int num_chips)
+{
+	if (!grp || !gpio_data || num_chips == 0 ||
+	    num_chips > TLC1543_GROUP_MAX_CHIPS)
+		return TLC1543_ERR_ARG;
+
+	grp->chip = gpiod_registry_chip_get(gpio_dev);
+	if (!grp->chip)
+		return TLC1543_ERR_OPEN_CHIP;
+
+	grp->ioclk = gpiod_chip_get_line(grp->chip, gpio_ioclk);
+	grp->addr = gpiod_chip_get_line(grp->chip, gpio_addr);
+	if (!grp->ioclk || !grp->addr)
+		goto err_chip;
+
+	gpiod_line_bulk_init(&grp->data);
+	for (unsigned int i = 0; i < num_chips; ++i) {
+		struct gpiod_line *line =
+			gpiod_chip_get_line(grp->chip, gpio_data[i]);
+		if (!line)
+			goto err_chip;
+		gpiod_line_bulk_add(&grp->data, line);
+	}
+
+	if (gpiod_line_request_output(grp->ioclk, "tlc1543", 0) < 0)
+		goto err_chip;
+	if (gpiod_line_request_output(grp->addr, "tlc1543", 0) < 0)
+		goto err_ioclk;
+	if (gpiod_line_request_bulk_input(&grp->data, "tlc1543") < 0)
+		goto err_addr;
+
+	return TLC1543_SUCCESS;
+
+err_addr:
+	gpiod_line_release(grp->addr);
+err_ioclk:
+	gpiod_line_release(grp->ioclk);
+err_chip:
+	gpiod_registry_chip_put(grp->chip);
+	grp->chip = NULL;
+	return TLC1543_ERR_OPEN_LINE;
+}
+
+/**
+ * @brief Delete and free an access to a group of TLC1543
+ *
+ * @param grp Valid and initialized access to the group
+ * @return 0 on success, negative value on error
+ */
+int tlc1543_group_delete(struct tlc1543_group *grp)
+{
+	if (!grp || !grp->chip)
+		return TLC1543_ERR_NOINIT;
+
+	gpiod_line_release_bulk(&grp->data);
+	gpiod_line_release(grp->addr);
+	gpiod_line_release(grp->ioclk);
+	gpiod_registry_chip_put(grp->chip);
+	grp->chip = NULL;
+
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Run one I/O cycle on every chip: send an address and read the previous result
+ *
+ * @param grp Valid and initialized access to the group
+ * @param channel Channel to convert next
+ * @param samples Result of the previous conversion of each chip, NULL to discard it
+ * @return 0 on success, negative value on error
+ * @note A new conversion starts after the 10th clock, wait @ref TLC1543_SAMPLING_TIME before the next cycle.
+ */
+static int _tlc1543_group_cycle(struct tlc1543_group *grp, uint8_t channel,
+				uint16_t *samples)
+{
+	int values[TLC1543_GROUP_MAX_CHIPS];
+	const unsigned int num_chips = grp->data.num_lines;
+
+	if (samples)
+		for (unsigned int c = 0; c < num_chips; ++c)
+			samples[c] = 0;
+
+	for (short i = 0; i < 10; ++i) {
+		/* First 4 clocks are used to send the address (channel), MSB first */
+		if (i < 4) {
+			if (gpiod_line_set_value(grp->addr, (channel & 0x08)) <
+			    0)
+				return TLC1543_ERR_WRITE;
+			channel <<= 1;
+		}
+		if (gpiod_line_set_value(grp->ioclk, 1) < 0)
+			return TLC1543_ERR_WRITE;
+
+		/* One read for the data bit of every chip */
+		if (samples) {
+			if (gpiod_line_get_value_bulk(&grp->data, values) < 0)
+				return TLC1543_ERR_READ;
+			for (unsigned int c = 0; c < num_chips; ++c)
+				samples[c] = (samples[c] << 1) |
+					     (values[c] & 0x01);
+		}
+
+		if (gpiod_line_set_value(grp->ioclk, 0) < 0)
+			return TLC1543_ERR_WRITE;
+	}
+
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Acquire the same channel on every chip of the group
+ *
+ * @param grp Valid and initialized access to the group
+ * @param channel Which channel to use (0 through 13)
+ * @param samples Array of one sample per chip, in the order of the DATA_OUT pins given at init
+ * @return 0 on success, negative value on error
+ */
+int tlc1543_group_get_samples(struct tlc1543_group *grp, uint8_t channel,
+			      uint16_t *samples)
+{
+	if (!grp || !grp->chip)
+		return TLC1543_ERR_NOINIT;
+	if (channel > 13 || !samples)
+		return TLC1543_ERR_ARG;
+
+	int ret = _tlc1543_group_cycle(grp, channel, NULL);
+	if (ret < 0)
+		return ret;
+	tlc1543_delay_us(TLC1543_SAMPLING_TIME);
+
+	ret = _tlc1543_group_cycle(grp, channel, samples);
+	if (ret < 0)
+		return ret;
+	/* Reading also started a new conversion, let it finish */
+	tlc1543_delay_us(TLC1543_SAMPLING_TIME);
+
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Acquire several channels on every chip of the group, pipelining the conversions
+ *
+ * @param grp Valid and initialized access to the group
+ * @param channels Channels to acquire (0 through 13)
+ * @param num_channels Number of channels
+ * @param samples Array of num_channels * number of chips samples,
+ *                samples[i * num_chips + c] is channel channels[i] of chip c
+ * @return 0 on success, negative value on error
+ */
+int tlc1543_group_scan(struct tlc1543_group *grp, const uint8_t *channels,
+		       unsigned int num_channels, uint16_t *samples)
+{
+	if (!grp || !grp->chip)
+		return TLC1543_ERR_NOINIT;
+	if (!channels || !samples || num_channels == 0)
+		return TLC1543_ERR_ARG;
+	for (unsigned int i = 0; i < num_channels; ++i)
+		if (channels[i] > 13)
+			return TLC1543_ERR_ARG;
+
+	const unsigned int num_chips = grp->data.num_lines;
+
+	int ret = _tlc1543_group_cycle(grp, channels[0], NULL);
+	if (ret < 0)
+		return ret;
+
+	for (unsigned int i = 0; i < num_channels; ++i) {
+		tlc1543_delay_us(TLC1543_SAMPLING_TIME);
+		/* The last cycle only reads, the address sent does not matter */
+		ret = _tlc1543_group_cycle(
+			grp, i + 1 < num_channels ? channels[i + 1] : 0,
+			samples + i * num_chips);
+		if (ret < 0)
+			return ret;
+	}
+	tlc1543_delay_us(TLC1543_SAMPLING_TIME);
+
+	return TLC1543_SUCCESS;
+}
+
+#endif // TLC1543_GROUP_H
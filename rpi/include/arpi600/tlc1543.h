@@ -42,6 +42,30 @@
  * 	- @ref TLC1543_OPT_EXCLUSIVE, will take exclusive control of the GPIO pins for its lifetime (until @ref tlc1543_delete)
  * 
  * @note Using both flags will wait in the @ref tlc1543_init function until all GPIO pins are unused. 
+ *
+ * ## Waiting for the conversion
+ *
+ * The ADC needs @ref TLC1543_SAMPLING_TIME us to convert a sample, `usleep` oversleeps by far more than that
+ * on Linux so by default the driver busy-waits with @ref tlc1543_delay_us instead.
+ * When the EOC pin is wired, @ref tlc1543_set_eoc makes the driver wait for the end of conversion instead,
+ * either spinning on the pin value or sleeping until its rising edge:
+ *
+ * ```c
+ * tlc1543_set_eoc(&tlc, 26, TLC1543_WAIT_EOC_SPIN);
+ * ```
+ *
+ * The waiting method can be changed with @ref tlc1543_set_wait.
+ *
+ * ## Sharing the ADC between threads
+ *
+ * Two samples must not be clocked at the same time, @ref tlc1543_get_sample_cached goes through
+ * a single-flight front-end (see single-flight.h): one conversion at a time, threads asking for
+ * the same channel at the same time share a single conversion, and a sample younger than the age
+ * given by the caller is served without clocking anything.
+ *
+ * ```c
+ * int value = tlc1543_get_sample_cached(&tlc, 3, 5000); // Any sample from the last 5 ms is fine
+ * ```
  * 
  * ## Compilation 
  * 
@@ -49,7 +73,7 @@
  * If you are on a Debian based system you can use the `libgpiod-dev` package.
  * 
  * ```sh
- * cc test.c -I./rpi/include -Wall -lgpiod -o test
+ * cc test.c -I./rpi/include -Wall -lgpiod -lpthread -o test
  * ```
  * 
  * @warning Do not forget to compile with "-lgpiod" flag!
@@ -119,6 +143,23 @@
 #define TLC1543_ERR_WRITE -30
 /** @brief Cannot read a GPIO pin value */
 #define TLC1543_ERR_READ -31
+/** @brief End of conversion never signaled on the EOC pin */
+#define TLC1543_ERR_TIMEOUT -40
+
+/**
+ * @}
+ * @name Methods used to wait for the end of a conversion
+ * @{
+ */
+
+/** @brief Sleep with usleep (oversleeps, slowest) */
+#define TLC1543_WAIT_SLEEP 0
+/** @brief Busy-wait for the sampling time (default) */
+#define TLC1543_WAIT_DELAY 1
+/** @brief Spin on the value of the EOC pin */
+#define TLC1543_WAIT_EOC_SPIN 2
+/** @brief Sleep until the rising edge of the EOC pin */
+#define TLC1543_WAIT_EOC_EDGE 3
 
 /**
  * @} 
@@ -126,6 +167,10 @@
 
 /** @brief Sampling time of the TLC1543 in micro seconds (us) */
 #define TLC1543_SAMPLING_TIME 21
+/** @brief Time after which the EOC pin is considered stuck in micro seconds (us) */
+#define TLC1543_EOC_TIMEOUT 1000
+/** @brief Number of channels, including the self-test ones */
+#define TLC1543_NUM_CHANNELS 14
 
 #include <error.h>
 #include <stdlib.h>
@@ -133,8 +178,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 #include <gpiod.h>
 
+#include "../gpiod-registry.h"
+#include "../rpi-probes.h"
+#include "../single-flight.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -147,9 +197,37 @@ struct tlc1543 {
 	struct gpiod_line *ioclk; ///< GPIO line for IOCLK
 	struct gpiod_line *addr; ///< GPIO line for ADDR
 	struct gpiod_line *data; ///< GPIO line for DATA_OUT
+	struct gpiod_line *eoc; ///< GPIO line for EOC, NULL if not wired
 	int options; ///< Optional flags
+	int wait; ///< Method used to wait for a conversion (e.g. TLC1543_WAIT_DELAY)
+	struct single_flight *sf; ///< Sampling front-end shared by the threads
 };
 
+/**
+ * @brief Busy-wait for a short time, for delays usleep cannot honor
+ *
+ * @param us Time to wait in micro seconds
+ * @note The deadline is checked with CLOCK_MONOTONIC, read through the vDSO without any system call,
+ *       so the delay stays right whatever the CPU frequency is, unlike a calibrated loop count.
+ */
+void tlc1543_delay_us(unsigned int us)
+{
+	struct timespec now, deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_nsec += us * 1000L;
+	while (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		++deadline.tv_sec;
+	}
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (now.tv_sec < deadline.tv_sec ||
+		 (now.tv_sec == deadline.tv_sec &&
+		  now.tv_nsec < deadline.tv_nsec));
+}
+
 /**
  * @brief Request access to GPIO lines
  * 
@@ -176,39 +254,41 @@ static int tlc1543_request_lines(struct tlc1543 *tlc, int options)
 	return TLC1543_SUCCESS;
 }
 
+static int _tlc1543_fetch(void *data, unsigned int key, double *values);
+
 /**
- * @brief Initialize an access to the TLC1543 chip
+ * @brief Get the chip and the lines of the TLC1543, without the sampling front-end
  * 
  * @param tlc Allocated structure that will serve as the access
  * @param gpio_dev GPIO chip device path (e.g. "/dev/gpiochipX")
  * @param gpio_ioclk GPIO pin where the I/O clock is connected
  * @param gpio_addr GPIO pin where the address line is connected
  * @param gpio_data GPIO pin where the Data Out line is connected
- * @param options Optional flags (e.g. TLC1543_OPT_WAIT), use 0 if unsure
+ * @param options Optional flags (e.g. TLC1543_OPT_WAIT)
  * @return 0 on success, negative value on error 
  */
-int tlc1543_init_c_i_i_i(struct tlc1543 *tlc, const char *gpio_dev,
+static int _tlc1543_open(struct tlc1543 *tlc, const char *gpio_dev,
 			 const int gpio_ioclk, const int gpio_addr,
 			 const int gpio_data, int options)
 {
-	if (!tlc)
-		return TLC1543_ERR_ARG;
-
-	tlc->chip = gpiod_chip_open(gpio_dev);
+	/* Shared with the other drivers, opened once per process */
+	tlc->chip = gpiod_registry_chip_get(gpio_dev);
 	if (!tlc->chip)
 		return TLC1543_ERR_OPEN_CHIP;
 
 	tlc->addr = gpiod_chip_get_line(tlc->chip, gpio_addr);
-	if (!tlc->addr)
-		return TLC1543_ERR_OPEN_LINE;
 	tlc->data = gpiod_chip_get_line(tlc->chip, gpio_data);
-	if (!tlc->data)
-		return TLC1543_ERR_OPEN_LINE;
 	tlc->ioclk = gpiod_chip_get_line(tlc->chip, gpio_ioclk);
-	if (!tlc->ioclk)
+	if (!tlc->addr || !tlc->data || !tlc->ioclk) {
+		gpiod_registry_chip_put(tlc->chip);
+		tlc->chip = NULL;
 		return TLC1543_ERR_OPEN_LINE;
+	}
 
+	tlc->eoc = NULL;
 	tlc->options = options;
+	tlc->wait = TLC1543_WAIT_DELAY;
+	tlc->sf = NULL;
 
 	if (options & TLC1543_OPT_EXCLUSIVE)
 		tlc1543_request_lines(tlc, options);
@@ -216,6 +296,46 @@ int tlc1543_init_c_i_i_i(struct tlc1543 *tlc, const char *gpio_dev,
 	return TLC1543_SUCCESS;
 }
 
+/**
+ * @brief Initialize an access to the TLC1543 chip
+ * 
+ * @param tlc Allocated structure that will serve as the access
+ * @param gpio_dev GPIO chip device path (e.g. "/dev/gpiochipX")
+ * @param gpio_ioclk GPIO pin where the I/O clock is connected
+ * @param gpio_addr GPIO pin where the address line is connected
+ * @param gpio_data GPIO pin where the Data Out line is connected
+ * @param options Optional flags (e.g. TLC1543_OPT_WAIT), use 0 if unsure
+ * @return 0 on success, negative value on error 
+ * @note The structure must not move once initialized, the sampling front-end keeps its address.
+ */
+int tlc1543_init_c_i_i_i(struct tlc1543 *tlc, const char *gpio_dev,
+			 const int gpio_ioclk, const int gpio_addr,
+			 const int gpio_data, int options)
+{
+	if (!tlc)
+		return TLC1543_ERR_ARG;
+
+	int ret = _tlc1543_open(tlc, gpio_dev, gpio_ioclk, gpio_addr,
+				gpio_data, options);
+	if (ret < 0)
+		return ret;
+
+	tlc->sf = (struct single_flight *)malloc(sizeof(*tlc->sf));
+	if (!tlc->sf || single_flight_init(tlc->sf, _tlc1543_fetch, (void *)tlc,
+					   TLC1543_NUM_CHANNELS) < 0) {
+		free(tlc->sf);
+		tlc->sf = NULL;
+		gpiod_line_release(tlc->addr);
+		gpiod_line_release(tlc->ioclk);
+		gpiod_line_release(tlc->data);
+		gpiod_registry_chip_put(tlc->chip);
+		tlc->chip = NULL;
+		return TLC1543_ERR;
+	}
+
+	return TLC1543_SUCCESS;
+}
+
 /**
  * @brief Initialize an access to the TLC1543 chip with default GPIO pins
  * 
@@ -257,20 +377,170 @@ int tlc1543_delete(struct tlc1543 *tlc)
 	gpiod_line_release(tlc->addr);
 	gpiod_line_release(tlc->ioclk);
 	gpiod_line_release(tlc->data);
-	gpiod_chip_close(tlc->chip);
+	if (tlc->eoc)
+		gpiod_line_release(tlc->eoc);
+	gpiod_registry_chip_put(tlc->chip);
+	if (tlc->sf) {
+		single_flight_destroy(tlc->sf);
+		free(tlc->sf);
+		tlc->sf = NULL;
+	}
+
+	/* The chip is shared, a second delete must not give it back again */
+	tlc->chip = NULL;
+	tlc->addr = tlc->ioclk = tlc->data = tlc->eoc = NULL;
 
 	return TLC1543_SUCCESS;
 }
 
 /**
- * @brief Acquire a sample from the ADC
+ * @brief Select how the driver waits for a conversion
  * 
- * @param tlc valid and initialized access to the TLC1543
- * @param channel which channel on the ADC to use (0 through 11)
- * @return negative value on error, otherwise the value acquired from the ADC 
- * @warning This function will call "sleep" as it needs to wait for the TLC1543 to sample
+ * @param tlc Valid and initialized access to the TLC1543
+ * @param wait TLC1543_WAIT_SLEEP, TLC1543_WAIT_DELAY, TLC1543_WAIT_EOC_SPIN or TLC1543_WAIT_EOC_EDGE
+ * @return 0 on success, negative value on error
+ * @note The EOC methods need the EOC pin, see @ref tlc1543_set_eoc.
+ * @note If the EOC line cannot be requested again it is dropped and the driver goes back to
+ *       TLC1543_WAIT_DELAY.
  */
-int tlc1543_get_sample(struct tlc1543 *tlc, uint8_t channel)
+int tlc1543_set_wait(struct tlc1543 *tlc, int wait)
+{
+	if (!tlc || !tlc->chip)
+		return TLC1543_ERR_NOINIT;
+	if (wait < TLC1543_WAIT_SLEEP || wait > TLC1543_WAIT_EOC_EDGE)
+		return TLC1543_ERR_ARG;
+	if (wait >= TLC1543_WAIT_EOC_SPIN && !tlc->eoc)
+		return TLC1543_ERR_NOINIT;
+
+	/* Spinning and edge detection need the line requested differently */
+	if (tlc->eoc && wait >= TLC1543_WAIT_EOC_SPIN && wait != tlc->wait) {
+		gpiod_line_release(tlc->eoc);
+		if ((wait == TLC1543_WAIT_EOC_EDGE ?
+			     gpiod_line_request_rising_edge_events(tlc->eoc,
+								   "tlc1543") :
+			     gpiod_line_request_input(tlc->eoc, "tlc1543")) < 0) {
+			tlc->eoc = NULL;
+			tlc->wait = TLC1543_WAIT_DELAY;
+			return TLC1543_ERR_OPEN_LINE;
+		}
+	}
+
+	tlc->wait = wait;
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Use the EOC (End Of Conversion) pin to know when a conversion is done
+ * 
+ * @param tlc Valid and initialized access to the TLC1543
+ * @param gpio_eoc GPIO pin where the EOC pin is connected
+ * @param wait TLC1543_WAIT_EOC_SPIN or TLC1543_WAIT_EOC_EDGE
+ * @return 0 on success, negative value on error
+ * @note The EOC line is reserved until @ref tlc1543_delete.
+ * @note Spinning gives the shortest latency, waiting for the edge lets the CPU sleep
+ *       but a wakeup takes some tens of micro seconds.
+ * @note On failure the previous EOC line is released and the driver goes back to TLC1543_WAIT_DELAY
+ *       if it was waiting on it.
+ */
+int tlc1543_set_eoc(struct tlc1543 *tlc, const int gpio_eoc, int wait)
+{
+	if (!tlc || !tlc->chip)
+		return TLC1543_ERR_NOINIT;
+	if (wait != TLC1543_WAIT_EOC_SPIN && wait != TLC1543_WAIT_EOC_EDGE)
+		return TLC1543_ERR_ARG;
+
+	if (tlc->eoc)
+		gpiod_line_release(tlc->eoc);
+	tlc->eoc = gpiod_chip_get_line(tlc->chip, gpio_eoc);
+	if (!tlc->eoc ||
+	    (wait == TLC1543_WAIT_EOC_EDGE ?
+		     gpiod_line_request_rising_edge_events(tlc->eoc,
+							   "tlc1543") :
+		     gpiod_line_request_input(tlc->eoc, "tlc1543")) < 0) {
+		tlc->eoc = NULL;
+		if (tlc->wait >= TLC1543_WAIT_EOC_SPIN)
+			tlc->wait = TLC1543_WAIT_DELAY;
+		return TLC1543_ERR_OPEN_LINE;
+	}
+
+	tlc->wait = wait;
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Wait for the end of the conversion, see @ref tlc1543_wait_conversion
+ */
+static int _tlc1543_wait_conversion(struct tlc1543 *tlc)
+{
+	struct timespec timeout = { 0, TLC1543_EOC_TIMEOUT * 1000L };
+	struct timespec poll = { 0, 0 };
+	struct timespec now, deadline;
+	struct gpiod_line_event event;
+	int value;
+
+	switch (tlc->wait) {
+	case TLC1543_WAIT_SLEEP:
+		usleep(TLC1543_SAMPLING_TIME);
+		return TLC1543_SUCCESS;
+	case TLC1543_WAIT_EOC_SPIN:
+		/* EOC goes low on the last clock and back high once converted */
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += TLC1543_EOC_TIMEOUT * 1000L;
+		while (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_nsec -= 1000000000L;
+			++deadline.tv_sec;
+		}
+		do {
+			value = gpiod_line_get_value(tlc->eoc);
+			if (value < 0)
+				return TLC1543_ERR_READ;
+			if (value)
+				return TLC1543_SUCCESS;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		} while (now.tv_sec < deadline.tv_sec ||
+			 (now.tv_sec == deadline.tv_sec &&
+			  now.tv_nsec < deadline.tv_nsec));
+		return TLC1543_ERR_TIMEOUT;
+	case TLC1543_WAIT_EOC_EDGE:
+		/* The conversion may already be over */
+		value = gpiod_line_get_value(tlc->eoc);
+		if (value < 0)
+			return TLC1543_ERR_READ;
+		if (!value) {
+			if (gpiod_line_event_wait(tlc->eoc, &timeout) != 1)
+				return TLC1543_ERR_TIMEOUT;
+		}
+		/* Drain the edge so the next wait does not see it */
+		while (gpiod_line_event_wait(tlc->eoc, &poll) == 1)
+			if (gpiod_line_event_read(tlc->eoc, &event) < 0)
+				return TLC1543_ERR_READ;
+		return TLC1543_SUCCESS;
+	default:
+		tlc1543_delay_us(TLC1543_SAMPLING_TIME);
+		return TLC1543_SUCCESS;
+	}
+}
+
+/**
+ * @brief Wait for the end of the conversion started by the last 10 clocks
+ * 
+ * @param tlc Valid and initialized access to the TLC1543
+ * @return 0 on success, negative value on error
+ * @note Probes `tlc1543:wait_start(tlc, wait mode)` and `tlc1543:wait_end(tlc, ret)`.
+ */
+int tlc1543_wait_conversion(struct tlc1543 *tlc)
+{
+	RPI_PROBE2(tlc1543, wait_start, tlc, tlc->wait);
+	const int ret = _tlc1543_wait_conversion(tlc);
+	RPI_PROBE2(tlc1543, wait_end, tlc, ret);
+
+	return ret;
+}
+
+/**
+ * @brief Clock the channel address, see @ref tlc1543_send_address
+ */
+static int _tlc1543_send_address(struct tlc1543 *tlc, uint8_t channel)
 {
 	if (!tlc || !tlc->chip)
 		return TLC1543_ERR_NOINIT;
@@ -298,8 +568,34 @@ int tlc1543_get_sample(struct tlc1543 *tlc, uint8_t channel)
 			return TLC1543_ERR_WRITE;
 	}
 
-	/* Sleep for sample acquisition */
-	usleep(TLC1543_SAMPLING_TIME);
+	return TLC1543_SUCCESS;
+}
+
+/**
+ * @brief Send the channel address to the ADC, this starts the sampling of the channel
+ * 
+ * @param tlc valid and initialized access to the TLC1543
+ * @param channel which channel on the ADC to use (0 through 13)
+ * @return 0 on success, negative value on error
+ * @note The result can be read with @ref tlc1543_read_result once @ref TLC1543_SAMPLING_TIME has elapsed.
+ * @note Probes `tlc1543:address_start(tlc, channel)` and `tlc1543:address_end(tlc, ret)`.
+ */
+int tlc1543_send_address(struct tlc1543 *tlc, uint8_t channel)
+{
+	RPI_PROBE2(tlc1543, address_start, tlc, channel);
+	const int ret = _tlc1543_send_address(tlc, channel);
+	RPI_PROBE2(tlc1543, address_end, tlc, ret);
+
+	return ret;
+}
+
+/**
+ * @brief Clock the result out, see @ref tlc1543_read_result
+ */
+static int _tlc1543_read_result(struct tlc1543 *tlc)
+{
+	if (!tlc || !tlc->chip)
+		return TLC1543_ERR_NOINIT;
 
 	uint16_t sample = 0;
 	int value = 0;
@@ -327,25 +623,114 @@ int tlc1543_get_sample(struct tlc1543 *tlc, uint8_t channel)
 		gpiod_line_release(tlc->data);
 	}
 
+	return (int)sample;
+}
+
+/**
+ * @brief Read the result of the conversion started by @ref tlc1543_send_address
+ * 
+ * @param tlc valid and initialized access to the TLC1543
+ * @return negative value on error, otherwise the value acquired from the ADC
+ * @note Reading the result also starts a new conversion, wait @ref TLC1543_SAMPLING_TIME before 
+ *       sending a new address.
+ * @note Probes `tlc1543:read_start(tlc)` and `tlc1543:read_end(tlc, ret)`.
+ */
+int tlc1543_read_result(struct tlc1543 *tlc)
+{
+	RPI_PROBE1(tlc1543, read_start, tlc);
+	const int ret = _tlc1543_read_result(tlc);
+	RPI_PROBE2(tlc1543, read_end, tlc, ret);
+
+	return ret;
+}
+
+/**
+ * @brief Acquire a sample from the ADC
+ * 
+ * @param tlc valid and initialized access to the TLC1543
+ * @param channel which channel on the ADC to use (0 through 11)
+ * @return negative value on error, otherwise the value acquired from the ADC 
+ * @warning This function waits twice for a conversion, see @ref tlc1543_set_wait
+ * @note Probes `tlc1543:sample_start(tlc, channel)` and `tlc1543:sample_end(tlc, channel, ret)`.
+ */
+int tlc1543_get_sample(struct tlc1543 *tlc, uint8_t channel)
+{
+	RPI_PROBE2(tlc1543, sample_start, tlc, channel);
+
+	int ret = tlc1543_send_address(tlc, channel);
+
+	/* Wait for sample acquisition */
+	if (ret >= 0)
+		ret = tlc1543_wait_conversion(tlc);
+
+	if (ret >= 0)
+		ret = tlc1543_read_result(tlc);
+
 	/* Let the ADC have enough time to finish last conversion */
 	/* This is necessary as reading the ADC also triggers a new conversion */
-	usleep(TLC1543_SAMPLING_TIME);
+	if (ret >= 0) {
+		int err = tlc1543_wait_conversion(tlc);
+		if (err < 0)
+			ret = err;
+	}
 
-	return (int)sample;
+	RPI_PROBE3(tlc1543, sample_end, tlc, channel, ret);
+	return ret;
+}
+
+/**
+ * @brief Convert a channel for the sampling front-end
+ */
+static int _tlc1543_fetch(void *data, unsigned int key, double *values)
+{
+	const int ret = tlc1543_get_sample((struct tlc1543 *)data, key);
+	if (ret < 0)
+		return ret;
+
+	values[key] = ret;
+	return 1 << key;
+}
+
+/**
+ * @brief Acquire a sample from the ADC from any thread, sharing conversions
+ * 
+ * @param tlc valid and initialized access to the TLC1543
+ * @param channel which channel on the ADC to use (0 through 13)
+ * @param max_age_us oldest sample accepted in micro seconds (us), 0 for a new conversion (or the one running)
+ * @return negative value on error, otherwise the value acquired from the ADC
+ * @warning Do not mix with @ref tlc1543_get_sample from other threads, only this function is serialized
+ */
+int tlc1543_get_sample_cached(struct tlc1543 *tlc, uint8_t channel,
+			      unsigned int max_age_us)
+{
+	if (!tlc || !tlc->chip || !tlc->sf)
+		return TLC1543_ERR_NOINIT;
+	if (channel >= TLC1543_NUM_CHANNELS)
+		return TLC1543_ERR_ARG;
+
+	double values[TLC1543_NUM_CHANNELS];
+	const int ret =
+		single_flight_get(tlc->sf, channel, max_age_us, values);
+	if (ret < 0)
+		return ret;
+
+	return (int)values[channel];
 }
 
 /**
  * @brief Acquire a sample from the ADC but open and close access to the chip with default value 
  * 
  * @return int negative value on error, otherwise the value acquired from the ADC
- * @note This is a helper function that simplifies some code, however as it opens and close 
- *       everytime it is called, it is slower. 
+ * @note This is a helper function that simplifies some code, however as it requests and releases
+ *       the lines everytime it is called, it is slower. The GPIO chip stays open in the registry
+ *       (see gpiod-registry.h) between calls and no sampling front-end is created.
  */
 int tlc1543_get_sample_standalone(uint8_t channel)
 {
 	struct tlc1543 tlc;
 
-	int value = tlc1543_init(&tlc, 0);
+	int value = _tlc1543_open(&tlc, TLC1543_GPIO_CHIP_DEV, TLC1543_PIN_IOCLK,
+				  TLC1543_PIN_ADDR, TLC1543_PIN_DATA, 0);
 	if (value < 0)
 		return value;
 	value = tlc1543_get_sample(&tlc, channel);
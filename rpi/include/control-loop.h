@@ -0,0 +1,719 @@
+/**
+ * @brief Fixed-rate control loops: read a sensor, run a controller, drive an actuator
+ *
+ * @file control-loop.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-07
+ *
+ * @details
+ * A control loop reads a measurement (e.g. a TLC1543 channel), computes an output with a PID controller
+ * and writes it to an actuator (e.g. a gpiod-pwm.h duty cycle), at a fixed period.
+ * A `while` loop with `usleep` drifts (the period is the sleep plus the work) and nobody knows when it is late.
+ *
+ * A runtime runs every loop registered to it from a single thread:
+ * - Each loop has a `timerfd` armed on an absolute grid (TFD_TIMER_ABSTIME with an interval), the period never drifts.
+ *   The thread sleeps in `poll` on every timer at once.
+ * - Sensor reads are pipelined with the computation: the input has a `start` callback called at the end of a tick
+ *   (e.g. `lps25h_request_conversion()`), the conversion runs while the thread sleeps and the next tick only collects
+ *   the result with `read`. Without `start`, `read` does the whole conversion inside the tick.
+ * - Each loop has its own filter and PID block (@ref control_filter, @ref control_pid): low-pass on the measurement,
+ *   derivative on the measurement, integral clamped while the output saturates. A custom controller can replace the PID.
+ * - The wakeup latency and the time spent in each tick are recorded in log2 histograms, along with the ticks
+ *   finishing after the next deadline (misses) and the deadlines never served (skipped).
+ *
+ * Inputs and outputs are plain callbacks, a loop can run end to end on simulated backends (see the control_loop.c example).
+ * @ref control_loop_tick runs a single tick without any timer, e.g. to step a simulation.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct control_loop loop;
+ * struct control_loop_input adc = { .read = read_adc, .data = &tlc };
+ * struct control_loop_output heater = { .write = write_pwm, .data = &pwm };
+ * control_loop_init(&loop, "heater", 1000, &adc, &heater); // 1 kHz
+ * control_pid_init(&loop.pid, 2.0, 0.5, 0.0, 0.0, 1000.0);
+ * control_filter_init(&loop.filter, 50.0, 1000.0);     // 50 Hz low-pass
+ * control_loop_set_setpoint(&loop, 512.0);
+ *
+ * struct control_runtime rt;
+ * control_runtime_init(&rt);
+ * control_runtime_add(&rt, &loop);
+ * control_runtime_start(&rt);
+ * // ...
+ * control_runtime_destroy(&rt);
+ * control_loop_destroy(&loop);
+ * ```
+ *
+ * @note For a steadier period, run the program with a real-time priority (e.g. `chrt -f 50`).
+ * @warning This uses pthread, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+/* clock_gettime() and CLOCK_MONOTONIC are hidden by -std=c11, the GNU modes already have them */
+#if defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <pthread.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/* Not part of ISO C, missing with -std=c11 */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of loops of a runtime. */
+#define CONTROL_RUNTIME_MAX_LOOPS 8
+/** @brief Number of buckets of the histograms, bucket i > 0 counts [2^(i-1), 2^i) us, the last one everything above. */
+#define CONTROL_LOOP_HIST_BUCKETS 16
+
+/**
+ * @brief Sensor of a loop.
+ */
+struct control_loop_input {
+	int (*start)(void *data);
+	///< Start a conversion, NULL if read does the whole conversion. Returns a negative value on failure.
+	int (*read)(void *data, double *value);
+	///< Get the measurement (of the conversion started if any). Returns a negative value on failure.
+	void *data;
+	///< Given to the callbacks
+};
+
+/**
+ * @brief Actuator of a loop.
+ */
+struct control_loop_output {
+	int (*write)(void *data, double value);
+	///< Apply the output. Returns a negative value on failure.
+	void *data;
+	///< Given to the callback
+};
+
+/**
+ * @brief Custom controller replacing the PID.
+ * @param data Data given to @ref control_loop_set_compute.
+ * @param setpoint Setpoint.
+ * @param measurement Filtered measurement.
+ * @param dt Period (s).
+ * @return Output.
+ */
+typedef double (*control_loop_compute)(void *data, double setpoint,
+				       double measurement, double dt);
+
+/**
+ * @brief First-order low-pass filter.
+ */
+struct control_filter {
+	double alpha;
+	///< Weight of a new measurement, 1 to let everything through
+	double state;
+	///< Filtered value
+	int primed;
+	///< Whether state holds a value
+};
+
+/**
+ * @brief PID controller.
+ */
+struct control_pid {
+	double kp;
+	///< Proportional gain
+	double ki;
+	///< Integral gain (per second)
+	double kd;
+	///< Derivative gain (seconds)
+	double out_min;
+	///< Lowest output
+	double out_max;
+	///< Highest output
+	double integral;
+	///< Integral term
+	double prev;
+	///< Previous measurement
+	int primed;
+	///< Whether prev holds a value
+};
+
+/**
+ * @brief Statistics of a loop.
+ */
+struct control_loop_stats {
+	unsigned long ticks;
+	///< Number of ticks run
+	unsigned long misses;
+	///< Ticks finished after the next deadline
+	unsigned long skipped;
+	///< Deadlines never served because the thread was too late
+	unsigned long errors;
+	///< Ticks where the input or the output failed
+	int64_t late_max_ns;
+	///< Highest wakeup latency
+	int64_t loop_max_ns;
+	///< Longest tick
+	unsigned long late_hist[CONTROL_LOOP_HIST_BUCKETS];
+	///< Wakeup latencies (time from the deadline to the start of the tick)
+	unsigned long loop_hist[CONTROL_LOOP_HIST_BUCKETS];
+	///< Time spent in each tick
+};
+
+/**
+ * @brief Control loop.
+ */
+struct control_loop {
+	const char *name;
+	///< Name, for the user
+	int64_t period_ns;
+	///< Period
+	struct control_loop_input in;
+	///< Sensor
+	struct control_loop_output out;
+	///< Actuator
+	struct control_filter filter;
+	///< Filter of the measurement
+	struct control_pid pid;
+	///< Controller, unless compute is set
+	control_loop_compute compute;
+	///< Custom controller, NULL for the PID
+	void *compute_data;
+	///< Given to compute
+	double setpoint;
+	///< Setpoint
+	double measurement;
+	///< Last filtered measurement
+	double output;
+	///< Last output
+	int pending;
+	///< Whether a conversion was started for the next tick
+	int timer_fd;
+	///< Timer of the loop, -1 when not running
+	int64_t deadline_ns;
+	///< Next deadline (CLOCK_MONOTONIC)
+	struct control_loop_stats stats;
+	///< Statistics
+	pthread_mutex_t lock;
+	///< Protects the setpoint, the last values and the statistics
+};
+
+/**
+ * @brief Runtime running loops from a single thread.
+ */
+struct control_runtime {
+	struct control_loop *loops[CONTROL_RUNTIME_MAX_LOOPS];
+	///< Loops registered
+	unsigned int num_loops;
+	///< Number of loops
+	int stop_fd;
+	///< eventfd waking the thread up to stop
+	int running;
+	///< Whether the thread runs
+	pthread_t thread;
+	///< Thread running the loops
+};
+
+/**
+ * @brief Get the time of CLOCK_MONOTONIC.
+ * @return Time (ns).
+ */
+static inline int64_t _control_loop_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Get the histogram bucket of a duration.
+ * @param ns Duration (ns).
+ * @return Bucket, 0 below 1 us.
+ */
+static inline unsigned int _control_loop_bucket(int64_t ns)
+{
+	const int64_t us = ns / 1000;
+	if (us <= 0)
+		return 0;
+
+	const unsigned int bucket = 64 - __builtin_clzll((uint64_t)us);
+	return bucket < CONTROL_LOOP_HIST_BUCKETS ?
+		       bucket :
+		       CONTROL_LOOP_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Initialize a low-pass filter.
+ * @param filter Filter.
+ * @param cutoff_hz Cutoff frequency (Hz), 0 to let everything through.
+ * @param rate_hz Rate of the measurements (Hz).
+ */
+void control_filter_init(struct control_filter *filter, double cutoff_hz,
+			 double rate_hz)
+{
+	const double dt = 1.0 / rate_hz;
+	const double rc = cutoff_hz > 0.0 ? 1.0 / (2.0 * M_PI * cutoff_hz) :
+					    0.0;
+
+	filter->alpha = dt / (rc + dt);
+	filter->state = 0.0;
+	filter->primed = 0;
+}
+
+/**
+ * @brief Filter a measurement.
+ * @param filter Filter.
+ * @param value Measurement.
+ * @return Filtered value, the first measurement goes through as is.
+ */
+static inline double control_filter_update(struct control_filter *filter,
+					   double value)
+{
+	if (!filter->primed) {
+		filter->state = value;
+		filter->primed = 1;
+	} else {
+		filter->state += filter->alpha * (value - filter->state);
+	}
+	return filter->state;
+}
+
+/**
+ * @brief Initialize a PID controller.
+ * @param pid Controller.
+ * @param kp Proportional gain.
+ * @param ki Integral gain (per second).
+ * @param kd Derivative gain (seconds).
+ * @param out_min Lowest output.
+ * @param out_max Highest output.
+ */
+void control_pid_init(struct control_pid *pid, double kp, double ki,
+		      double kd, double out_min, double out_max)
+{
+	memset(pid, 0, sizeof(*pid));
+	pid->kp = kp;
+	pid->ki = ki;
+	pid->kd = kd;
+	pid->out_min = out_min;
+	pid->out_max = out_max;
+}
+
+/**
+ * @brief Compute the output of a PID controller.
+ * @param pid Controller.
+ * @param setpoint Setpoint.
+ * @param measurement Measurement.
+ * @param dt Time since the previous update (s).
+ * @return Output, between out_min and out_max.
+ *
+ * The derivative acts on the measurement, a change of setpoint does not kick the output.
+ * The integral only grows while the output is not saturated in the same direction (anti-windup).
+ */
+double control_pid_update(struct control_pid *pid, double setpoint,
+			  double measurement, double dt)
+{
+	const double error = setpoint - measurement;
+	const double derivative =
+		pid->primed ? (pid->prev - measurement) / dt : 0.0;
+	pid->prev = measurement;
+	pid->primed = 1;
+
+	const double unclamped =
+		pid->kp * error + pid->integral + pid->kd * derivative;
+	if ((unclamped < pid->out_max || error < 0.0) &&
+	    (unclamped > pid->out_min || error > 0.0))
+		pid->integral += pid->ki * error * dt;
+
+	const double output =
+		pid->kp * error + pid->integral + pid->kd * derivative;
+	if (output > pid->out_max)
+		return pid->out_max;
+	if (output < pid->out_min)
+		return pid->out_min;
+	return output;
+}
+
+/**
+ * @brief Initialize a loop, the filter lets everything through and the PID outputs 0.
+ * @param loop Loop.
+ * @param name Name, kept as is.
+ * @param period_us Period (us).
+ * @param in Sensor, copied.
+ * @param out Actuator, copied.
+ * @return 0 on success, -1 on failure.
+ */
+int control_loop_init(struct control_loop *loop, const char *name,
+		      unsigned int period_us,
+		      const struct control_loop_input *in,
+		      const struct control_loop_output *out)
+{
+	if (!loop || period_us == 0 || !in || !in->read || !out ||
+	    !out->write) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(loop, 0, sizeof(*loop));
+	loop->name = name;
+	loop->period_ns = period_us * 1000LL;
+	loop->in = *in;
+	loop->out = *out;
+	loop->timer_fd = -1;
+	control_filter_init(&loop->filter, 0.0, 1e6 / period_us);
+	control_pid_init(&loop->pid, 0.0, 0.0, 0.0, 0.0, 0.0);
+
+	int err = pthread_mutex_init(&loop->lock, NULL);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Destroy a loop, it must not be running.
+ * @param loop Loop.
+ */
+void control_loop_destroy(struct control_loop *loop)
+{
+	if (loop)
+		pthread_mutex_destroy(&loop->lock);
+}
+
+/**
+ * @brief Replace the PID with a custom controller, before the loop runs.
+ * @param loop Loop.
+ * @param compute Controller, NULL for the PID.
+ * @param data Given to compute.
+ */
+void control_loop_set_compute(struct control_loop *loop,
+			      control_loop_compute compute, void *data)
+{
+	loop->compute = compute;
+	loop->compute_data = data;
+}
+
+/**
+ * @brief Change the setpoint, from any thread.
+ * @param loop Loop.
+ * @param setpoint Setpoint, used from the next tick.
+ */
+void control_loop_set_setpoint(struct control_loop *loop, double setpoint)
+{
+	pthread_mutex_lock(&loop->lock);
+	loop->setpoint = setpoint;
+	pthread_mutex_unlock(&loop->lock);
+}
+
+/**
+ * @brief Get the last filtered measurement and output, from any thread.
+ * @param loop Loop.
+ * @param measurement Measurement, can be NULL.
+ * @param output Output, can be NULL.
+ */
+void control_loop_get(struct control_loop *loop, double *measurement,
+		      double *output)
+{
+	pthread_mutex_lock(&loop->lock);
+	if (measurement)
+		*measurement = loop->measurement;
+	if (output)
+		*output = loop->output;
+	pthread_mutex_unlock(&loop->lock);
+}
+
+/**
+ * @brief Get the statistics of a loop, from any thread.
+ * @param loop Loop.
+ * @param stats Filled with the statistics.
+ */
+void control_loop_stats(struct control_loop *loop,
+			struct control_loop_stats *stats)
+{
+	pthread_mutex_lock(&loop->lock);
+	*stats = loop->stats;
+	pthread_mutex_unlock(&loop->lock);
+}
+
+/**
+ * @brief Run one tick: collect the measurement, compute and write the output, start the next conversion.
+ * @param loop Loop.
+ * @return 0 on success, negative value returned by the input or the output on failure (the output is held).
+ * @note Called by the runtime at every deadline, call it directly to step a loop without timer.
+ */
+int control_loop_tick(struct control_loop *loop)
+{
+	const double dt = loop->period_ns / 1e9;
+	double value, output = 0.0;
+	int ret = 0;
+
+	/* Conversion started by the previous tick, or started now if it failed */
+	if (!loop->pending && loop->in.start)
+		ret = loop->in.start(loop->in.data);
+	if (ret >= 0)
+		ret = loop->in.read(loop->in.data, &value);
+	loop->pending = 0;
+
+	pthread_mutex_lock(&loop->lock);
+	const double setpoint = loop->setpoint;
+	pthread_mutex_unlock(&loop->lock);
+
+	if (ret >= 0) {
+		value = control_filter_update(&loop->filter, value);
+		output = loop->compute ? loop->compute(loop->compute_data,
+						       setpoint, value, dt) :
+					 control_pid_update(&loop->pid,
+							    setpoint, value,
+							    dt);
+		ret = loop->out.write(loop->out.data, output);
+	}
+
+	/* Converts while the thread sleeps until the next deadline */
+	if (loop->in.start && loop->in.start(loop->in.data) >= 0)
+		loop->pending = 1;
+
+	pthread_mutex_lock(&loop->lock);
+	++loop->stats.ticks;
+	if (ret < 0) {
+		++loop->stats.errors;
+	} else {
+		loop->measurement = value;
+		loop->output = output;
+	}
+	pthread_mutex_unlock(&loop->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Serve the expired timer of a loop and record its timings.
+ * @param loop Loop.
+ */
+static void _control_loop_run(struct control_loop *loop)
+{
+	uint64_t expirations;
+
+	if (read(loop->timer_fd, &expirations, sizeof(expirations)) !=
+		    sizeof(expirations) ||
+	    expirations == 0)
+		return;
+
+	/* Deadlines missed entirely are skipped, the tick serves the last one */
+	const int64_t deadline =
+		loop->deadline_ns + (int64_t)(expirations - 1) * loop->period_ns;
+	loop->deadline_ns = deadline + loop->period_ns;
+
+	const int64_t start = _control_loop_now_ns();
+	control_loop_tick(loop);
+	const int64_t end = _control_loop_now_ns();
+
+	const int64_t late = start - deadline;
+	const int64_t elapsed = end - start;
+	pthread_mutex_lock(&loop->lock);
+	loop->stats.skipped += expirations - 1;
+	if (end > loop->deadline_ns)
+		++loop->stats.misses;
+	if (late > loop->stats.late_max_ns)
+		loop->stats.late_max_ns = late;
+	if (elapsed > loop->stats.loop_max_ns)
+		loop->stats.loop_max_ns = elapsed;
+	++loop->stats.late_hist[_control_loop_bucket(late)];
+	++loop->stats.loop_hist[_control_loop_bucket(elapsed)];
+	pthread_mutex_unlock(&loop->lock);
+}
+
+/**
+ * @brief Pthread routine running the loops of a runtime.
+ * @param _rt Pointer to a control_runtime structure.
+ * @return Nothing.
+ */
+static void *_control_runtime_thread(void *_rt)
+{
+	struct control_runtime *rt = (struct control_runtime *)_rt;
+	struct pollfd fds[CONTROL_RUNTIME_MAX_LOOPS + 1];
+
+	for (unsigned int i = 0; i < rt->num_loops; ++i) {
+		fds[i].fd = rt->loops[i]->timer_fd;
+		fds[i].events = POLLIN;
+	}
+	fds[rt->num_loops].fd = rt->stop_fd;
+	fds[rt->num_loops].events = POLLIN;
+
+	for (;;) {
+		if (poll(fds, rt->num_loops + 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[rt->num_loops].revents)
+			break;
+		for (unsigned int i = 0; i < rt->num_loops; ++i)
+			if (fds[i].revents & POLLIN)
+				_control_loop_run(rt->loops[i]);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Initialize a runtime without any loop.
+ * @param rt Runtime.
+ * @return 0 on success, -1 on failure.
+ */
+int control_runtime_init(struct control_runtime *rt)
+{
+	if (!rt) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(rt, 0, sizeof(*rt));
+	rt->stop_fd = eventfd(0, EFD_CLOEXEC);
+	return rt->stop_fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Register a loop, before the runtime is started.
+ * @param rt Runtime.
+ * @param loop Initialized loop.
+ * @return 0 on success, -1 on failure.
+ */
+int control_runtime_add(struct control_runtime *rt, struct control_loop *loop)
+{
+	if (!rt || !loop || rt->running ||
+	    rt->num_loops >= CONTROL_RUNTIME_MAX_LOOPS) {
+		errno = rt && rt->num_loops >= CONTROL_RUNTIME_MAX_LOOPS ?
+				ENOMEM :
+				EINVAL;
+		return -1;
+	}
+
+	rt->loops[rt->num_loops++] = loop;
+	return 0;
+}
+
+/**
+ * @brief Close the timers of the loops, from the first one.
+ * @param rt Runtime.
+ * @param count Number of loops with a timer.
+ */
+static void _control_runtime_close_timers(struct control_runtime *rt,
+					  unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		close(rt->loops[i]->timer_fd);
+		rt->loops[i]->timer_fd = -1;
+	}
+}
+
+/**
+ * @brief Arm the timers and start the thread, the first tick of every loop is one period away.
+ * @param rt Runtime.
+ * @return 0 on success, -1 on failure.
+ */
+int control_runtime_start(struct control_runtime *rt)
+{
+	if (!rt || rt->running || rt->num_loops == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const int64_t now = _control_loop_now_ns();
+	for (unsigned int i = 0; i < rt->num_loops; ++i) {
+		struct control_loop *loop = rt->loops[i];
+		loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (loop->timer_fd < 0) {
+			_control_runtime_close_timers(rt, i);
+			return -1;
+		}
+
+		/* Absolute grid, the kernel keeps the period without drift */
+		loop->deadline_ns = now + loop->period_ns;
+		struct itimerspec spec;
+		spec.it_value.tv_sec = loop->deadline_ns / 1000000000LL;
+		spec.it_value.tv_nsec = loop->deadline_ns % 1000000000LL;
+		spec.it_interval.tv_sec = loop->period_ns / 1000000000LL;
+		spec.it_interval.tv_nsec = loop->period_ns % 1000000000LL;
+		if (timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec,
+				    NULL) < 0) {
+			_control_runtime_close_timers(rt, i + 1);
+			return -1;
+		}
+
+		/* The first measurement converts during the first period */
+		if (loop->in.start && !loop->pending &&
+		    loop->in.start(loop->in.data) >= 0)
+			loop->pending = 1;
+	}
+
+	int err = pthread_create(&rt->thread, NULL, _control_runtime_thread,
+				 (void *)rt);
+	if (err != 0) {
+		_control_runtime_close_timers(rt, rt->num_loops);
+		errno = err;
+		return -1;
+	}
+
+	rt->running = 1;
+	return 0;
+}
+
+/**
+ * @brief Stop the thread and close the timers, the outputs keep their last value.
+ * @param rt Runtime.
+ * @return 0 on success, -1 on failure.
+ */
+int control_runtime_stop(struct control_runtime *rt)
+{
+	if (!rt || !rt->running) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const uint64_t one = 1;
+	if (write(rt->stop_fd, &one, sizeof(one)) != sizeof(one))
+		return -1;
+	pthread_join(rt->thread, NULL);
+	rt->running = 0;
+
+	/* Consume the stop request, the runtime can be started again */
+	uint64_t count;
+	if (read(rt->stop_fd, &count, sizeof(count)) != sizeof(count))
+		return -1;
+
+	_control_runtime_close_timers(rt, rt->num_loops);
+	return 0;
+}
+
+/**
+ * @brief Stop the runtime if needed and close its resources, the loops are not destroyed.
+ * @param rt Runtime.
+ */
+void control_runtime_destroy(struct control_runtime *rt)
+{
+	if (!rt)
+		return;
+
+	if (rt->running)
+		control_runtime_stop(rt);
+	close(rt->stop_fd);
+	rt->stop_fd = -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONTROL_LOOP_H
@@ -0,0 +1,763 @@
+/**
+ * @brief Single-threaded event loop with C++20 coroutines for GPIO edges, ADC samples, pressure readings and timers
+ *
+ * @file event-loop.hpp
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-16
+ *
+ * @details
+ * Instead of starting one thread per GPIO line (as gpiod-isr.h does) or spinning while a sensor is converting,
+ * control sequences are written as coroutines that `co_await` what they need.
+ * Every coroutine runs on the thread calling @ref rpi::event_loop::run, which sleeps in `epoll_wait` until
+ * one of the awaited file descriptors is readable or the next deadline expired.
+ * Hundreds of sequences can then run on a single core, each one costing only its coroutine frame.
+ *
+ * Available awaitables:
+ * 	- `loop.sleep_for(duration)` / `loop.sleep_until(time_point)`: all deadlines share a single timerfd.
+ * 	- `loop.edge(line, event)`: next event on a GPIO line requested for events.
+ * 	- `rpi::ticker`: periodic timerfd, `co_await tick.next()` returns the number of expirations.
+ * 	- `rpi::tlc1543_sample(loop, tlc, channel)`: TLC1543 conversion, sleeps during the sampling time.
+ * 	- `rpi::lps25h_pressure(loop, lps)`: LPS25H one-shot conversion, polled at a given interval.
+ * 	- `loop.lock_device(device)`: exclusive use of a device across suspension points, granted in FIFO order.
+ *
+ * The TLC1543 and LPS25H awaitables lock their device for the whole conversion (address, wait, result),
+ * so any number of coroutines can sample the same device: their conversions are queued, never interleaved.
+ *
+ * ## Usage
+ *
+ * ```cpp
+ * rpi::task<void> watch_button(rpi::event_loop &loop, gpiod_line *button)
+ * {
+ * 	gpiod_line_event event;
+ * 	for (;;) {
+ * 		if (co_await loop.edge(button, event) < 0)
+ * 			co_return;
+ * 		printf("Button pressed\n");
+ * 	}
+ * }
+ *
+ * rpi::task<void> read_adc(rpi::event_loop &loop, tlc1543 &tlc)
+ * {
+ * 	rpi::ticker tick(loop, std::chrono::milliseconds(10));
+ * 	for (;;) {
+ * 		co_await tick.next();
+ * 		int value = co_await rpi::tlc1543_sample(loop, tlc, 0);
+ * 	}
+ * }
+ *
+ * rpi::event_loop loop;
+ * loop.spawn(watch_button(loop, line));
+ * loop.spawn(read_adc(loop, tlc));
+ * loop.run();
+ * ```
+ *
+ * ## Compilation
+ *
+ * ```sh
+ * g++ -std=c++20 test.cpp -I./rpi/include -Wall -lgpiod -o test
+ * ```
+ *
+ * @warning Only one coroutine at a time can await a given file descriptor (a line or a ticker).
+ * @warning Nothing here is thread-safe, every coroutine must be spawned and resumed from the loop thread.
+ */
+
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <gpiod.h>
+
+#include "arpi600/tlc1543.h"
+#include "sense-hat/lps25h.h"
+
+namespace rpi
+{
+/** @brief Clock used for every deadline (CLOCK_MONOTONIC). */
+using clock_type = std::chrono::steady_clock;
+
+template <typename T> class task;
+
+namespace detail
+{
+/**
+ * @brief Awaiter run when a task finishes, resumes the coroutine awaiting it (if any).
+ */
+struct final_awaiter {
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+	template <typename P>
+	std::coroutine_handle<>
+	await_suspend(std::coroutine_handle<P> h) const noexcept
+	{
+		if (h.promise().continuation)
+			return h.promise().continuation;
+		return std::noop_coroutine();
+	}
+	void await_resume() const noexcept
+	{
+	}
+};
+
+/**
+ * @brief Part of the promise common to every task.
+ */
+struct promise_base {
+	std::coroutine_handle<> continuation;
+	///< Coroutine awaiting this task.
+	std::exception_ptr exception;
+	///< Exception thrown by the task.
+
+	std::suspend_always initial_suspend() const noexcept
+	{
+		return {};
+	}
+	final_awaiter final_suspend() const noexcept
+	{
+		return {};
+	}
+	void unhandled_exception() noexcept
+	{
+		exception = std::current_exception();
+	}
+};
+
+template <typename T> struct promise : promise_base {
+	T value{};
+	///< Value given by co_return.
+
+	task<T> get_return_object() noexcept;
+	void return_value(T v) noexcept(std::is_nothrow_move_assignable_v<T>)
+	{
+		value = std::move(v);
+	}
+	T result()
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+		return std::move(value);
+	}
+};
+
+template <> struct promise<void> : promise_base {
+	task<void> get_return_object() noexcept;
+	void return_void() const noexcept
+	{
+	}
+	void result()
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+};
+
+/**
+ * @brief Coroutine owning nothing, used to start a task from the loop.
+ */
+struct detached {
+	struct promise_type {
+		detached get_return_object() const noexcept
+		{
+			return {};
+		}
+		std::suspend_never initial_suspend() const noexcept
+		{
+			return {};
+		}
+		std::suspend_never final_suspend() const noexcept
+		{
+			return {};
+		}
+		void return_void() const noexcept
+		{
+		}
+		void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+} // namespace detail
+
+/**
+ * @brief Lazy coroutine, starts when awaited and resumes its caller when finished.
+ * @tparam T Type given by co_return.
+ */
+template <typename T = void> class task {
+    public:
+	using promise_type = detail::promise<T>;
+
+	explicit task(std::coroutine_handle<promise_type> h) noexcept
+		: handle(h)
+	{
+	}
+	task(task &&other) noexcept
+		: handle(std::exchange(other.handle, nullptr))
+	{
+	}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool await_ready() const noexcept
+	{
+		return !handle || handle.done();
+	}
+	std::coroutine_handle<>
+	await_suspend(std::coroutine_handle<> caller) noexcept
+	{
+		handle.promise().continuation = caller;
+		return handle;
+	}
+	T await_resume()
+	{
+		return handle.promise().result();
+	}
+
+    private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail
+{
+template <typename T> task<T> promise<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<promise<T> >::from_promise(*this));
+}
+inline task<void> promise<void>::get_return_object() noexcept
+{
+	return task<void>(
+		std::coroutine_handle<promise<void> >::from_promise(*this));
+}
+} // namespace detail
+
+/**
+ * @brief Single-threaded executor based on epoll and a timerfd.
+ */
+class event_loop {
+    public:
+	event_loop()
+	{
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = tfd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+	}
+	event_loop(const event_loop &) = delete;
+	event_loop &operator=(const event_loop &) = delete;
+	~event_loop()
+	{
+		close(tfd);
+		close(epfd);
+	}
+
+	/**
+	 * @brief Check whether the loop could be created.
+	 * @return true if usable.
+	 */
+	bool valid() const noexcept
+	{
+		return epfd >= 0 && tfd >= 0;
+	}
+
+	/**
+	 * @brief Start a task, it runs until its first suspension point.
+	 * @param t Task to start, the loop keeps it alive until it finishes.
+	 */
+	void spawn(task<void> t)
+	{
+		[](task<void> t) -> detail::detached { co_await t; }(std::move(t));
+	}
+
+	/**
+	 * @brief Run every spawned task until stop() is called or nothing is left to wait for.
+	 * @return 0 on success, -1 on failure (see errno).
+	 */
+	int run()
+	{
+		struct epoll_event events[16];
+
+		stopped = false;
+		while (!stopped) {
+			while (!ready.empty()) {
+				std::coroutine_handle<> h = ready.front();
+				ready.pop_front();
+				h.resume();
+				if (stopped)
+					return 0;
+			}
+
+			/* End of the tick, every ready coroutine ran */
+			for (auto &fn : idle)
+				fn();
+
+			if (timers.empty() && waiters.empty())
+				return 0;
+
+			arm_timer();
+			int n = epoll_wait(epfd, events, 16, -1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+
+			for (int i = 0; i < n; ++i) {
+				if (events[i].data.fd == tfd) {
+					uint64_t expirations;
+					(void)read(tfd, &expirations,
+						   sizeof(expirations));
+					continue;
+				}
+				auto it = waiters.find(events[i].data.fd);
+				if (it != waiters.end()) {
+					ready.push_back(it->second);
+					waiters.erase(it);
+				}
+			}
+
+			/* Timers are checked after every wakeup, not only when the timerfd fired */
+			const int64_t now = now_ns();
+			while (!timers.empty() && timers.top().deadline <= now) {
+				ready.push_back(timers.top().handle);
+				timers.pop();
+			}
+		}
+
+		return 0;
+	}
+
+	/**
+	 * @brief Call a function at the end of every tick, once all ready coroutines ran and before waiting again.
+	 * @param fn Function to call, for instance flushing a gpiod_output_group so that
+	 * every output changed during the tick is written at once.
+	 */
+	void on_idle(std::function<void()> fn)
+	{
+		idle.push_back(std::move(fn));
+	}
+
+	/**
+	 * @brief Make run() return after the current coroutine suspends.
+	 */
+	void stop() noexcept
+	{
+		stopped = true;
+	}
+
+	/**
+	 * @brief Awaitable resuming the coroutine once the deadline is reached.
+	 */
+	struct timer_awaiter {
+		event_loop &loop;
+		int64_t deadline;
+
+		bool await_ready() const noexcept
+		{
+			return deadline <= now_ns();
+		}
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			loop.timers.push({ deadline, loop.timer_seq++, h });
+		}
+		void await_resume() const noexcept
+		{
+		}
+	};
+
+	/**
+	 * @brief Suspend the coroutine until a point in time.
+	 * @param tp Deadline.
+	 */
+	timer_awaiter sleep_until(clock_type::time_point tp) noexcept
+	{
+		return { *this,
+			 std::chrono::duration_cast<std::chrono::nanoseconds>(
+				 tp.time_since_epoch())
+				 .count() };
+	}
+
+	/**
+	 * @brief Suspend the coroutine for a duration.
+	 * @param d Duration.
+	 */
+	template <typename Rep, typename Period>
+	timer_awaiter sleep_for(std::chrono::duration<Rep, Period> d) noexcept
+	{
+		return sleep_until(clock_type::now() +
+				   std::chrono::duration_cast<clock_type::duration>(d));
+	}
+
+	/**
+	 * @brief Awaitable resuming the coroutine when a file descriptor is readable.
+	 * Gives 0 on success or -1 if the file descriptor cannot be watched.
+	 */
+	struct fd_awaiter {
+		event_loop &loop;
+		int fd;
+		int ret;
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			ret = loop.watch(fd, h);
+			return ret == 0;
+		}
+		int await_resume() const noexcept
+		{
+			return ret;
+		}
+	};
+
+	/**
+	 * @brief Suspend the coroutine until a file descriptor is readable.
+	 * @param fd File descriptor.
+	 */
+	fd_awaiter readable(int fd) noexcept
+	{
+		return { *this, fd, 0 };
+	}
+
+	/**
+	 * @brief Awaitable giving the next event on a GPIO line.
+	 * Gives 0 on success, -1 on failure.
+	 */
+	struct edge_awaiter {
+		event_loop &loop;
+		struct gpiod_line *line;
+		struct gpiod_line_event &event;
+		int ret;
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			ret = loop.watch(line_fd(line), h);
+			return ret == 0;
+		}
+		int await_resume()
+		{
+			if (ret < 0)
+				return ret;
+			return read_line_event(line, event);
+		}
+	};
+
+	/**
+	 * @brief Suspend the coroutine until an event happens on a line.
+	 * @param line Line already requested for events (e.g. gpiod_line_request_falling_edge_events).
+	 * @param event Filled with the event.
+	 */
+	edge_awaiter edge(struct gpiod_line *line,
+			  struct gpiod_line_event &event) noexcept
+	{
+		return { *this, line, event, 0 };
+	}
+
+	/**
+	 * @brief Awaitable rescheduling the coroutine after every other ready one.
+	 */
+	struct yield_awaiter {
+		event_loop &loop;
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			loop.ready.push_back(h);
+		}
+		void await_resume() const noexcept
+		{
+		}
+	};
+
+	/**
+	 * @brief Let the other ready coroutines run.
+	 */
+	yield_awaiter yield() noexcept
+	{
+		return { *this };
+	}
+
+	/**
+	 * @brief Owner and waiters of a device.
+	 */
+	struct device_lock {
+		bool locked = false;
+		std::deque<std::coroutine_handle<> > waiters;
+	};
+
+	/**
+	 * @brief Awaitable resuming the coroutine once it owns the device.
+	 */
+	struct device_awaiter {
+		device_lock &dev;
+
+		bool await_ready() const noexcept
+		{
+			if (dev.locked)
+				return false;
+			dev.locked = true;
+			return true;
+		}
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			dev.waiters.push_back(h);
+		}
+		void await_resume() const noexcept
+		{
+		}
+	};
+
+	/**
+	 * @brief Take the exclusive use of a device, e.g. for a transfer spanning several suspension points.
+	 * @param device Address identifying the device (e.g. its driver structure).
+	 * @return Awaitable resuming the coroutine once every earlier owner called unlock_device().
+	 */
+	device_awaiter lock_device(const void *device)
+	{
+		return { devices[device] };
+	}
+
+	/**
+	 * @brief Give up the use of a device, the next waiter (if any) owns it and is resumed in this tick.
+	 * @param device Address given to lock_device().
+	 */
+	void unlock_device(const void *device)
+	{
+		device_lock &dev = devices[device];
+		if (dev.waiters.empty()) {
+			dev.locked = false;
+			return;
+		}
+		ready.push_back(dev.waiters.front());
+		dev.waiters.pop_front();
+	}
+
+    private:
+	struct timer_entry {
+		int64_t deadline;
+		uint64_t seq;
+		std::coroutine_handle<> handle;
+
+		bool operator>(const timer_entry &other) const noexcept
+		{
+			return deadline != other.deadline ?
+				       deadline > other.deadline :
+				       seq > other.seq;
+		}
+	};
+
+	static int64_t now_ns() noexcept
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			       clock_type::now().time_since_epoch())
+			.count();
+	}
+
+	static int line_fd(struct gpiod_line *line) noexcept
+	{
+		return gpiod_line_event_get_fd(line);
+	}
+
+	static int read_line_event(struct gpiod_line *line,
+				   struct gpiod_line_event &event) noexcept
+	{
+		return gpiod_line_event_read(line, &event);
+	}
+
+	/**
+	 * @brief Register a coroutine waiting for a file descriptor to be readable.
+	 * @return 0 on success, -1 on failure.
+	 */
+	int watch(int fd, std::coroutine_handle<> h)
+	{
+		if (fd < 0 || waiters.count(fd)) {
+			errno = fd < 0 ? EBADF : EBUSY;
+			return -1;
+		}
+
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN | EPOLLONESHOT;
+		ev.data.fd = fd;
+		/* A oneshot fd stays registered but disabled after firing, re-arm it */
+		if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+		    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+			return -1;
+
+		waiters.emplace(fd, h);
+		return 0;
+	}
+
+	/**
+	 * @brief Program the timerfd for the earliest deadline.
+	 */
+	void arm_timer()
+	{
+		struct itimerspec its = {};
+		if (!timers.empty()) {
+			int64_t deadline = timers.top().deadline;
+			/* A zero value disarms the timer, make sure it fires */
+			if (deadline <= 0)
+				deadline = 1;
+			its.it_value.tv_sec = deadline / 1000000000;
+			its.it_value.tv_nsec = deadline % 1000000000;
+		}
+		timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+	}
+
+	int epfd = -1;
+	int tfd = -1;
+	bool stopped = false;
+	uint64_t timer_seq = 0;
+	std::deque<std::coroutine_handle<> > ready;
+	std::priority_queue<timer_entry, std::vector<timer_entry>,
+			    std::greater<timer_entry> >
+		timers;
+	std::unordered_map<int, std::coroutine_handle<> > waiters;
+	std::vector<std::function<void()> > idle;
+	std::unordered_map<const void *, device_lock> devices;
+};
+
+/**
+ * @brief Periodic timer backed by its own timerfd.
+ *
+ * Unlike sleep_for, ticks do not drift when the coroutine is late: missed periods are
+ * reported by the number of expirations.
+ */
+class ticker {
+    public:
+	/**
+	 * @brief Start a periodic timer.
+	 * @param loop Event loop.
+	 * @param period Period of the timer.
+	 */
+	template <typename Rep, typename Period>
+	ticker(event_loop &loop, std::chrono::duration<Rep, Period> period)
+		: loop(loop)
+	{
+		const int64_t ns =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(
+				period)
+				.count();
+		struct itimerspec its = {};
+		its.it_interval.tv_sec = ns / 1000000000;
+		its.it_interval.tv_nsec = ns % 1000000000;
+		its.it_value = its.it_interval;
+
+		fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd >= 0)
+			timerfd_settime(fd, 0, &its, NULL);
+	}
+	ticker(const ticker &) = delete;
+	ticker &operator=(const ticker &) = delete;
+	~ticker()
+	{
+		if (fd >= 0)
+			close(fd);
+	}
+
+	/**
+	 * @brief Wait for the next tick.
+	 * @return Awaitable giving the number of periods elapsed since the last tick, 0 on failure.
+	 */
+	task<uint64_t> next()
+	{
+		uint64_t expirations = 0;
+		if (read(fd, &expirations, sizeof(expirations)) > 0)
+			co_return expirations;
+		if (co_await loop.readable(fd) < 0)
+			co_return 0;
+		if (read(fd, &expirations, sizeof(expirations)) < 0)
+			co_return 0;
+		co_return expirations;
+	}
+
+    private:
+	event_loop &loop;
+	int fd = -1;
+};
+
+/**
+ * @brief Acquire a sample from the TLC1543 without blocking the loop during the sampling time.
+ * @param loop Event loop.
+ * @param tlc Valid and initialized access to the TLC1543.
+ * @param channel Channel on the ADC (0 through 13).
+ * @return Awaitable giving the sample, or a negative value on error.
+ * @note The ADC is locked from the address to the end of the conversion, concurrent samples are queued.
+ */
+inline task<int> tlc1543_sample(event_loop &loop, struct tlc1543 &tlc,
+				uint8_t channel)
+{
+	const auto sampling = std::chrono::microseconds(TLC1543_SAMPLING_TIME);
+
+	co_await loop.lock_device(&tlc);
+	int ret = tlc1543_send_address(&tlc, channel);
+	if (ret < 0) {
+		loop.unlock_device(&tlc);
+		co_return ret;
+	}
+
+	co_await loop.sleep_for(sampling);
+	ret = tlc1543_read_result(&tlc);
+
+	/* Reading triggered a new conversion, let it finish before the next request */
+	co_await loop.sleep_for(sampling);
+	loop.unlock_device(&tlc);
+	co_return ret;
+}
+
+/**
+ * @brief Acquire a pressure value from the LPS25H with a one-shot conversion.
+ * @param loop Event loop.
+ * @param lps Connection to the LPS25H.
+ * @param poll Interval between two checks of the conversion status.
+ * @return Awaitable giving the pressure in hPa, or a negative value on error.
+ * @note The sensor is locked from the request to the read, concurrent conversions are queued.
+ */
+inline task<double>
+lps25h_pressure(event_loop &loop, const struct lps25h &lps,
+		std::chrono::microseconds poll = std::chrono::milliseconds(1))
+{
+	co_await loop.lock_device(&lps);
+	int ret = lps25h_request_conversion(&lps);
+	while (ret == 0 && (ret = lps25h_conversion_done(&lps)) == 0)
+		co_await loop.sleep_for(poll);
+
+	const double pressure = ret < 0 ? ret : lps25h_read_pressure(&lps);
+	loop.unlock_device(&lps);
+	co_return pressure;
+}
+
+} // namespace rpi
+
+#endif // EVENT_LOOP_HPP
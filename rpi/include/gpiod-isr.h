@@ -86,6 +86,58 @@
  * 
  * This wrapper also provides a way to change the event type or the interrupt handler with functions beginning with `gpiod_isr_change`.
  * There is also support for `bulk` lines object.
+ *
+ * ## Dispatch pool
+ *
+ * By default the handler is called from the watcher thread, while it runs no other event is read.
+ * A pool of workers can execute the handlers instead, the watcher then only queues events.
+ * Events of a line stay in order while different lines are handled in parallel.
+ *
+ * ```c
+ * struct gpiod_isr_pool *pool = gpiod_isr_pool_create(4);
+ * struct gpiod_isr_bulk *isr = gpiod_isr_request_bulk_both_edges_events(&lines, "consumer", slow_handler);
+ * gpiod_isr_bulk_set_pool(isr, pool);
+ *
+ * // Queue depth and handler time of a line, to size the pool
+ * struct gpiod_isr_line_stats stats;
+ * gpiod_isr_bulk_line_stats(isr, lines.lines[0], &stats);
+ *
+ * gpiod_isr_release_bulk(isr);
+ * gpiod_isr_pool_destroy(pool);
+ * ```
+ *
+ * ## Inactivity timeouts
+ *
+ * A timeout handler can be called when a line had no edge for some time, to tell a dead sensor from a quiet one.
+ * Every timeout of the process is kept in a single timer wheel served by one thread.
+ *
+ * ```c
+ * void sensor_lost(struct gpiod_line *line, unsigned int periods)
+ * {
+ * 	printf("No pulse on %s for %u s\n", gpiod_line_name(line), periods);
+ * }
+ *
+ * gpiod_isr_set_timeout(isr, 1000, sensor_lost);
+ * ```
+ *
+ * ## Decoders
+ *
+ * Instead of a handler, a `struct gpiod_isr_decoder` can be given with `gpiod_isr_request_decoder` or
+ * `gpiod_isr_request_bulk_decoder`. Its `decode` callback is called by the watcher for every edge with
+ * the index of the line, so protocols and encoders are decoded without leaving the watcher thread
+ * (see gpiod-quadrature.h). With v1 the pending events of a set of lines are merged by timestamp first.
+ *
+ * ## libgpiod v2
+ *
+ * Define `LIBGPIOD_V2` when compiling against libgpiod 2.x, the same entry points are kept through the
+ * small compatibility layer found in gpiod-v1-compat.h.
+ * With this backend every set of lines is reserved with a single `gpiod_line_request`, meaning one file
+ * descriptor for the whole set, and the watcher reads up to @ref GPIOD_ISR_EVENT_BUFFER_SIZE events per
+ * `read` call into a `gpiod_edge_event_buffer` instead of polling and reading each line separately.
+ *
+ * ```sh
+ * cc test.c -I./rpi/include -DLIBGPIOD_V2 -Wall -lgpiod -pthread -o test
+ * ```
  */
 
 #ifndef GPIO_ISR_H
@@ -94,12 +146,853 @@
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include <gpiod.h>
 
+#ifdef LIBGPIOD_V2
+#include "gpiod-v1-compat.h"
+#endif
+
+#include "rpi-probes.h"
+
+#ifndef GPIOD_ISR_EVENT_BUFFER_SIZE
+/** @brief Number of events read at once by the libgpiod v2 watcher. */
+#define GPIOD_ISR_EVENT_BUFFER_SIZE 64
+#endif
+
+#ifndef GPIOD_ISR_BACKOFF_MAX_US
+/** @brief Longest pause of a watcher between retries after failed waits or reads (us). */
+#define GPIOD_ISR_BACKOFF_MAX_US 1000000
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Decoder run by the watcher thread in place of the interrupt handler.
+ *
+ * A decoder consumes the raw edge stream of the watched lines without leaving the watcher thread,
+ * it keeps its own state (quadrature position, pulse widths, etc.) and only reports what it decoded.
+ * Embed this structure as the first member of the decoder state so the callbacks can cast it back.
+ */
+struct gpiod_isr_decoder {
+	void (*start)(struct gpiod_isr_decoder *decoder,
+		      struct gpiod_line **lines, unsigned int num_lines);
+	///< Called by the watcher before waiting for events (also after a restart), can be NULL
+	void (*decode)(struct gpiod_isr_decoder *decoder, unsigned int index,
+		       const struct gpiod_line_event *event);
+	///< Called by the watcher for every event, index is the position of the line in the watched set
+};
+
+/**
+ * @name Dispatch pool
+ * @{
+ */
+
+#ifndef GPIOD_ISR_POOL_QUEUE_SIZE
+/** @brief Number of events that can be queued for a single line, newer events are dropped when full. */
+#define GPIOD_ISR_POOL_QUEUE_SIZE 64
+#endif
+#ifndef GPIOD_ISR_POOL_MAX_LINES
+/** @brief Maximum number of lines a pool can serve. */
+#define GPIOD_ISR_POOL_MAX_LINES 256
+#endif
+#ifndef GPIOD_ISR_POOL_BATCH
+/** @brief Number of events handled for a line before letting other lines run. */
+#define GPIOD_ISR_POOL_BATCH 8
+#endif
+
+/**
+ * @}
+ */
+
+/**
+ * @brief Statistics of a line served by a dispatch pool, useful to size the pool.
+ */
+struct gpiod_isr_line_stats {
+	unsigned int depth;
+	///< Number of events currently queued
+	unsigned int max_depth;
+	///< Highest number of events queued at once
+	unsigned long handled;
+	///< Number of events handled
+	unsigned long dropped;
+	///< Number of events dropped because the queue was full
+	unsigned long long handler_ns;
+	///< Total time spent in the handler (ns)
+	unsigned long long handler_max_ns;
+	///< Longest time spent in the handler (ns)
+};
+
+/**
+ * @brief Queue of events waiting to be handled for a single line.
+ */
+struct gpiod_isr_line_queue {
+	struct gpiod_line *line;
+	///< Line the events happened on
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *);
+	///< Interrupt handler
+	struct gpiod_line_event events[GPIOD_ISR_POOL_QUEUE_SIZE];
+	///< Ring of pending events
+	unsigned int head;
+	///< Index of the oldest pending event
+	unsigned int count;
+	///< Number of pending events
+	int scheduled;
+	///< 1 when the line is in a run queue or being handled by a worker
+	unsigned int home;
+	///< Worker the line is pushed to when it becomes ready
+	struct gpiod_isr_line_stats stats;
+	///< Statistics of the line
+	pthread_mutex_t lock;
+	///< Protects everything above
+	pthread_cond_t idle;
+	///< Signaled when the line is no longer scheduled
+};
+
+/**
+ * @brief Run queue of a worker, lines are taken from the front by the owner and stolen from the back.
+ */
+struct gpiod_isr_run_queue {
+	struct gpiod_isr_line_queue *lines[GPIOD_ISR_POOL_MAX_LINES];
+	///< Ring of lines ready to be handled
+	unsigned int head;
+	///< Index of the first line
+	unsigned int count;
+	///< Number of lines in the ring
+	pthread_mutex_t lock;
+	///< Protects the ring, taken before the lock of the pool
+	struct gpiod_isr_pool *pool;
+	///< Pool the run queue belongs to
+	unsigned int worker;
+	///< Index of the worker owning the run queue
+};
+
+/**
+ * @brief Fixed set of workers executing interrupt handlers on behalf of the watchers.
+ *
+ * Events of a line are always handled in order and by one worker at a time,
+ * different lines are handled in parallel.
+ */
+struct gpiod_isr_pool {
+	unsigned int num_workers;
+	///< Number of workers
+	pthread_t *workers;
+	///< Worker threads
+	struct gpiod_isr_run_queue *run_queues;
+	///< One run queue per worker
+	unsigned int num_lines;
+	///< Number of lines attached since the creation
+	unsigned int ready;
+	///< Number of lines waiting in the run queues
+	unsigned long steals;
+	///< Number of lines taken from the run queue of another worker
+	int stop;
+	///< Set to stop the workers
+	pthread_mutex_t lock;
+	///< Protects ready, steals and stop
+	pthread_cond_t wakeup;
+	///< Signaled when a line becomes ready
+};
+
+/**
+ * @brief Push a ready line at the back of a run queue and wake up a worker.
+ * @param pool Dispatch pool.
+ * @param worker Index of the worker owning the run queue.
+ * @param queue Line ready to be handled.
+ */
+static void _gpiod_isr_pool_push(struct gpiod_isr_pool *pool,
+				 unsigned int worker,
+				 struct gpiod_isr_line_queue *queue)
+{
+	struct gpiod_isr_run_queue *rq = &pool->run_queues[worker];
+
+	/* Cannot overflow, a line is in at most one run queue at a time */
+	pthread_mutex_lock(&rq->lock);
+	rq->lines[(rq->head + rq->count) % GPIOD_ISR_POOL_MAX_LINES] = queue;
+	++rq->count;
+
+	/* Counted before the line can be taken, ready never goes below zero */
+	pthread_mutex_lock(&pool->lock);
+	++pool->ready;
+	pthread_cond_signal(&pool->wakeup);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&rq->lock);
+}
+
+/**
+ * @brief Take a ready line, from the worker's own run queue first, otherwise steal one.
+ * @param pool Dispatch pool.
+ * @param worker Index of the worker.
+ * @return A line to handle, NULL if every run queue is empty.
+ */
+static struct gpiod_isr_line_queue *
+_gpiod_isr_pool_take(struct gpiod_isr_pool *pool, unsigned int worker)
+{
+	struct gpiod_isr_line_queue *queue = NULL;
+
+	for (unsigned int i = 0; i < pool->num_workers && !queue; ++i) {
+		struct gpiod_isr_run_queue *rq =
+			&pool->run_queues[(worker + i) % pool->num_workers];
+
+		pthread_mutex_lock(&rq->lock);
+		if (rq->count > 0) {
+			if (i == 0) {
+				queue = rq->lines[rq->head];
+				rq->head = (rq->head + 1) %
+					   GPIOD_ISR_POOL_MAX_LINES;
+			} else {
+				/* Steal the line that has waited the least */
+				queue = rq->lines[(rq->head + rq->count - 1) %
+						  GPIOD_ISR_POOL_MAX_LINES];
+			}
+			--rq->count;
+
+			pthread_mutex_lock(&pool->lock);
+			--pool->ready;
+			if (i != 0)
+				++pool->steals;
+			pthread_mutex_unlock(&pool->lock);
+		}
+		pthread_mutex_unlock(&rq->lock);
+	}
+
+	return queue;
+}
+
+/**
+ * @brief Call an interrupt handler.
+ * @param handler Interrupt handler.
+ * @param line Line the event happened on.
+ * @param event Event.
+ *
+ * Probes `gpiod_isr:handler_start(line, event type)` and `gpiod_isr:handler_end(line)`.
+ */
+static inline void _gpiod_isr_call(
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *),
+	struct gpiod_line *line, struct gpiod_line_event *event)
+{
+	RPI_PROBE2(gpiod_isr, handler_start, line, event->event_type);
+	handler(line, event);
+	RPI_PROBE1(gpiod_isr, handler_end, line);
+}
+
+/**
+ * @brief Time of an event.
+ * @param event Event.
+ * @return Timestamp of the edge (ns).
+ */
+static inline int64_t _gpiod_isr_event_ns(const struct gpiod_line_event *event)
+{
+	return event->ts.tv_sec * 1000000000LL + event->ts.tv_nsec;
+}
+
+/**
+ * @brief Handle at most GPIOD_ISR_POOL_BATCH events of a line.
+ * @param queue Line to handle.
+ * @return 1 if events are left, 0 if the line is now idle.
+ */
+static int _gpiod_isr_pool_handle(struct gpiod_isr_line_queue *queue)
+{
+	struct gpiod_line_event event;
+	struct timespec start, end;
+
+	for (int i = 0; i < GPIOD_ISR_POOL_BATCH; ++i) {
+		pthread_mutex_lock(&queue->lock);
+		if (queue->count == 0) {
+			queue->scheduled = 0;
+			pthread_cond_broadcast(&queue->idle);
+			pthread_mutex_unlock(&queue->lock);
+			return 0;
+		}
+		event = queue->events[queue->head];
+		queue->head = (queue->head + 1) % GPIOD_ISR_POOL_QUEUE_SIZE;
+		--queue->count;
+		pthread_mutex_unlock(&queue->lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		_gpiod_isr_call(queue->handler, queue->line, &event);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		unsigned long long ns =
+			(end.tv_sec - start.tv_sec) * 1000000000ULL +
+			end.tv_nsec - start.tv_nsec;
+
+		pthread_mutex_lock(&queue->lock);
+		++queue->stats.handled;
+		queue->stats.handler_ns += ns;
+		if (ns > queue->stats.handler_max_ns)
+			queue->stats.handler_max_ns = ns;
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Pthread routine of a pool worker.
+ * @param _rq Pointer to the run queue owned by the worker.
+ * @return Nothing.
+ */
+static void *_gpiod_isr_pool_worker(void *_rq)
+{
+	struct gpiod_isr_run_queue *rq = (struct gpiod_isr_run_queue *)_rq;
+	struct gpiod_isr_pool *pool = rq->pool;
+	const unsigned int self = rq->worker;
+
+	for (;;) {
+		struct gpiod_isr_line_queue *queue =
+			_gpiod_isr_pool_take(pool, self);
+
+		if (!queue) {
+			pthread_mutex_lock(&pool->lock);
+			while (pool->ready == 0 && !pool->stop)
+				pthread_cond_wait(&pool->wakeup, &pool->lock);
+			if (pool->ready == 0 && pool->stop) {
+				pthread_mutex_unlock(&pool->lock);
+				break;
+			}
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+
+		/* Busy lines go to the back of the queue so they do not starve the others */
+		if (_gpiod_isr_pool_handle(queue))
+			_gpiod_isr_pool_push(pool, self, queue);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Queue an event for a line served by a pool.
+ * @param pool Dispatch pool.
+ * @param queue Queue of the line.
+ * @param event Event to queue.
+ *
+ * Called from a watcher thread, cancellation is disabled while locks are held.
+ */
+static void _gpiod_isr_pool_enqueue(struct gpiod_isr_pool *pool,
+				    struct gpiod_isr_line_queue *queue,
+				    const struct gpiod_line_event *event)
+{
+	int cancel_state;
+	int schedule = 0;
+
+	(void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->count == GPIOD_ISR_POOL_QUEUE_SIZE) {
+		++queue->stats.dropped;
+	} else {
+		queue->events[(queue->head + queue->count) %
+			      GPIOD_ISR_POOL_QUEUE_SIZE] = *event;
+		++queue->count;
+		if (queue->count > queue->stats.max_depth)
+			queue->stats.max_depth = queue->count;
+		schedule = !queue->scheduled;
+		queue->scheduled = 1;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	if (schedule)
+		_gpiod_isr_pool_push(pool, queue->home, queue);
+
+	(void)pthread_setcancelstate(cancel_state, NULL);
+}
+
+/**
+ * @name Inactivity timeouts
+ * @{
+ */
+
+#ifndef GPIOD_ISR_TIMEOUT_TICK_MS
+/** @brief Resolution of the inactivity timeouts (ms). */
+#define GPIOD_ISR_TIMEOUT_TICK_MS 10
+#endif
+/** @brief Number of slots of the timer wheel, a turn of the wheel lasts this many ticks. */
+#define GPIOD_ISR_TIMEOUT_SLOTS 256
+
+/**
+ * @}
+ */
+
+/**
+ * @brief Inactivity timeout of a single line.
+ *
+ * The watcher only stores the time of the last edge, the timer wheel notices it when the deadline
+ * comes and pushes the deadline back instead of firing (lazy rescheduling), an edge never takes a lock.
+ */
+struct gpiod_isr_timeout {
+	struct gpiod_line *line;
+	///< Line watched
+	void (*handler)(struct gpiod_line *, unsigned int);
+	///< Timeout handler, gets the number of consecutive periods without any edge
+	int64_t timeout_ns;
+	///< Time allowed without any edge
+	int64_t last_ns;
+	///< Time of the last edge (or of the arming), written by the watcher
+	int64_t deadline;
+	///< Tick at which the timeout is checked
+	unsigned int periods;
+	///< Number of consecutive timeouts
+	struct gpiod_isr_timeout *prev;
+	///< Previous timeout in the same slot
+	struct gpiod_isr_timeout *next;
+	///< Next timeout in the same slot
+};
+
+/**
+ * @brief Timer wheel shared by every line of the process, served by a single thread.
+ *
+ * The thread only exists while at least one timeout is armed and sleeps until the next
+ * non-empty slot, quiet lines do not cause periodic wakeups.
+ */
+static struct {
+	struct gpiod_isr_timeout *slots[GPIOD_ISR_TIMEOUT_SLOTS];
+	///< Timeouts hashed by deadline
+	unsigned int count;
+	///< Number of armed timeouts
+	int64_t tick;
+	///< Last tick processed
+	int running;
+	///< Non-zero while the wheel thread exists
+	pthread_mutex_t lock;
+	///< Protects the wheel, held while calling the timeout handlers
+	pthread_cond_t wakeup;
+	///< Signaled when a timeout is armed
+	pthread_once_t once;
+	///< Initializes the condition with the monotonic clock
+} _gpiod_isr_wheel = { .lock = PTHREAD_MUTEX_INITIALIZER,
+		       .once = PTHREAD_ONCE_INIT };
+
+/**
+ * @brief Get the current time.
+ * @return CLOCK_MONOTONIC time (ns).
+ */
+static inline int64_t _gpiod_isr_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Initialize the wheel condition, the wheel waits on CLOCK_MONOTONIC deadlines.
+ */
+static void _gpiod_isr_wheel_init(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&_gpiod_isr_wheel.wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief Insert a timeout in the slot of its deadline, the wheel must be locked.
+ * @param timeout Timeout.
+ */
+static void _gpiod_isr_wheel_insert(struct gpiod_isr_timeout *timeout)
+{
+	struct gpiod_isr_timeout **slot =
+		&_gpiod_isr_wheel
+			 .slots[timeout->deadline % GPIOD_ISR_TIMEOUT_SLOTS];
+
+	timeout->prev = NULL;
+	timeout->next = *slot;
+	if (*slot)
+		(*slot)->prev = timeout;
+	*slot = timeout;
+}
+
+/**
+ * @brief Remove a timeout from its slot, the wheel must be locked.
+ * @param timeout Timeout.
+ */
+static void _gpiod_isr_wheel_remove(struct gpiod_isr_timeout *timeout)
+{
+	if (timeout->prev)
+		timeout->prev->next = timeout->next;
+	else
+		_gpiod_isr_wheel
+			.slots[timeout->deadline % GPIOD_ISR_TIMEOUT_SLOTS] =
+			timeout->next;
+	if (timeout->next)
+		timeout->next->prev = timeout->prev;
+}
+
+/**
+ * @brief Check every timeout of the slot of a tick, the wheel must be locked.
+ * @param tick Tick processed.
+ */
+static void _gpiod_isr_wheel_expire(int64_t tick)
+{
+	const int64_t tick_ns = GPIOD_ISR_TIMEOUT_TICK_MS * 1000000LL;
+	struct gpiod_isr_timeout *timeout =
+		_gpiod_isr_wheel.slots[tick % GPIOD_ISR_TIMEOUT_SLOTS];
+
+	/* Detach the slot first, timeouts can go back into it */
+	_gpiod_isr_wheel.slots[tick % GPIOD_ISR_TIMEOUT_SLOTS] = NULL;
+
+	while (timeout) {
+		struct gpiod_isr_timeout *next = timeout->next;
+
+		if (timeout->deadline <= tick) {
+			const int64_t last = __atomic_load_n(&timeout->last_ns,
+							     __ATOMIC_RELAXED);
+			const int64_t expiry = last + timeout->timeout_ns;
+
+			if (expiry > tick * tick_ns) {
+				/* An edge happened, wait from it */
+				timeout->periods = 0;
+				timeout->deadline =
+					(expiry + tick_ns - 1) / tick_ns;
+			} else {
+				RPI_PROBE2(gpiod_isr, timeout, timeout->line,
+					   timeout->periods + 1);
+				timeout->handler(timeout->line,
+						 ++timeout->periods);
+				timeout->deadline = tick + (timeout->timeout_ns +
+							    tick_ns - 1) /
+								   tick_ns;
+			}
+		}
+
+		_gpiod_isr_wheel_insert(timeout);
+		timeout = next;
+	}
+}
+
+/**
+ * @brief Pthread routine turning the timer wheel.
+ * @param _unused Nothing.
+ * @return Nothing.
+ */
+static void *_gpiod_isr_wheel_thread(void *_unused)
+{
+	(void)_unused;
+	const int64_t tick_ns = GPIOD_ISR_TIMEOUT_TICK_MS * 1000000LL;
+
+	pthread_mutex_lock(&_gpiod_isr_wheel.lock);
+	while (_gpiod_isr_wheel.count > 0) {
+		const int64_t now = _gpiod_isr_now_ns() / tick_ns;
+
+		/* A whole turn covers every slot once */
+		if (now - _gpiod_isr_wheel.tick > GPIOD_ISR_TIMEOUT_SLOTS)
+			_gpiod_isr_wheel.tick = now - GPIOD_ISR_TIMEOUT_SLOTS;
+		while (_gpiod_isr_wheel.tick < now)
+			_gpiod_isr_wheel_expire(++_gpiod_isr_wheel.tick);
+
+		/* Sleep until the next slot holding a timeout */
+		int64_t next = now + GPIOD_ISR_TIMEOUT_SLOTS;
+		for (int64_t t = now + 1; t <= now + GPIOD_ISR_TIMEOUT_SLOTS;
+		     ++t) {
+			if (_gpiod_isr_wheel.slots[t % GPIOD_ISR_TIMEOUT_SLOTS]) {
+				next = t;
+				break;
+			}
+		}
+
+		struct timespec deadline = {
+			.tv_sec = next * tick_ns / 1000000000LL,
+			.tv_nsec = next * tick_ns % 1000000000LL,
+		};
+		pthread_cond_timedwait(&_gpiod_isr_wheel.wakeup,
+				       &_gpiod_isr_wheel.lock, &deadline);
+	}
+	_gpiod_isr_wheel.running = 0;
+	pthread_mutex_unlock(&_gpiod_isr_wheel.lock);
+
+	return NULL;
+}
+
+/**
+ * @brief Arm a timeout on the shared wheel, starting the wheel thread if needed.
+ * @param timeout Timeout to arm.
+ * @return 0 on success, -1 on failure.
+ */
+static int _gpiod_isr_wheel_add(struct gpiod_isr_timeout *timeout)
+{
+	const int64_t tick_ns = GPIOD_ISR_TIMEOUT_TICK_MS * 1000000LL;
+	int ret = 0;
+
+	pthread_once(&_gpiod_isr_wheel.once, _gpiod_isr_wheel_init);
+
+	pthread_mutex_lock(&_gpiod_isr_wheel.lock);
+	timeout->last_ns = _gpiod_isr_now_ns();
+	timeout->periods = 0;
+	timeout->deadline = (timeout->last_ns + timeout->timeout_ns +
+			     tick_ns - 1) /
+			    tick_ns;
+	if (!_gpiod_isr_wheel.running) {
+		pthread_t thread;
+		_gpiod_isr_wheel.tick = timeout->last_ns / tick_ns;
+		if (pthread_create(&thread, NULL, _gpiod_isr_wheel_thread,
+				   NULL) != 0) {
+			ret = -1;
+			goto out;
+		}
+		pthread_detach(thread);
+		_gpiod_isr_wheel.running = 1;
+	}
+	_gpiod_isr_wheel_insert(timeout);
+	++_gpiod_isr_wheel.count;
+	pthread_cond_signal(&_gpiod_isr_wheel.wakeup);
+
+out:
+	pthread_mutex_unlock(&_gpiod_isr_wheel.lock);
+	return ret;
+}
+
+/**
+ * @brief Disarm a timeout, once this returns its handler is not running and will not be called.
+ * @param timeout Timeout to disarm.
+ */
+static void _gpiod_isr_wheel_del(struct gpiod_isr_timeout *timeout)
+{
+	pthread_mutex_lock(&_gpiod_isr_wheel.lock);
+	_gpiod_isr_wheel_remove(timeout);
+	/* The wheel thread exits by itself once empty */
+	if (--_gpiod_isr_wheel.count == 0)
+		pthread_cond_signal(&_gpiod_isr_wheel.wakeup);
+	pthread_mutex_unlock(&_gpiod_isr_wheel.lock);
+}
+
+/**
+ * @brief Arm, change or disarm the timeout of some lines, the watcher must not be running.
+ * @param timeouts Array of timeouts of the ISR, allocated when needed.
+ * @param lines Lines of the ISR.
+ * @param num_lines Number of lines.
+ * @param line Line to change, NULL for every line.
+ * @param timeout_ms Time allowed without any edge, 0 to disarm.
+ * @param handler Timeout handler.
+ * @return 0 on success, -1 on failure.
+ */
+static int _gpiod_isr_timeout_set(struct gpiod_isr_timeout ***timeouts,
+				  struct gpiod_line **lines,
+				  unsigned int num_lines,
+				  struct gpiod_line *line,
+				  unsigned int timeout_ms,
+				  void (*handler)(struct gpiod_line *,
+						  unsigned int))
+{
+	if (timeout_ms && !handler) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!*timeouts) {
+		if (!timeout_ms)
+			return 0;
+		*timeouts = calloc(num_lines, sizeof(**timeouts));
+		if (!*timeouts)
+			return -1;
+	}
+
+	int found = 0;
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		if (line && lines[i] != line)
+			continue;
+		found = 1;
+
+		struct gpiod_isr_timeout *timeout = (*timeouts)[i];
+		if (timeout) {
+			_gpiod_isr_wheel_del(timeout);
+			free(timeout);
+			(*timeouts)[i] = NULL;
+		}
+		if (!timeout_ms)
+			continue;
+
+		timeout = malloc(sizeof(*timeout));
+		if (!timeout)
+			return -1;
+		timeout->line = lines[i];
+		timeout->handler = handler;
+		timeout->timeout_ns = timeout_ms * 1000000LL;
+		if (_gpiod_isr_wheel_add(timeout) < 0) {
+			free(timeout);
+			return -1;
+		}
+		(*timeouts)[i] = timeout;
+	}
+
+	if (!found) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Disarm every timeout of an ISR and free them, the watcher must not be running.
+ * @param timeouts Array of timeouts of the ISR, can be NULL.
+ * @param num_lines Number of lines.
+ */
+static void _gpiod_isr_timeout_detach(struct gpiod_isr_timeout **timeouts,
+				      unsigned int num_lines)
+{
+	if (!timeouts)
+		return;
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		if (timeouts[i]) {
+			_gpiod_isr_wheel_del(timeouts[i]);
+			free(timeouts[i]);
+		}
+	}
+	free(timeouts);
+}
+
+/**
+ * @brief Call the decoder or the handler of a line, directly or through its pool queue.
+ * @param pool Dispatch pool, NULL when no pool is used.
+ * @param queues Pool queues of the lines, NULL when no pool is used.
+ * @param decoder Decoder replacing the handler, NULL when no decoder is used.
+ * @param timeouts Inactivity timeouts of the lines, NULL when none is armed.
+ * @param lines Lines watched.
+ * @param num_lines Number of lines watched.
+ * @param line Line the event happened on.
+ * @param handler Interrupt handler.
+ * @param event Event.
+ *
+ * Probe `gpiod_isr:event(line, event type, edge timestamp in ns)`, its distance to `handler_start`
+ * is the time spent queued (with a pool) or waiting for the watcher.
+ */
+static void _gpiod_isr_dispatch(
+	struct gpiod_isr_pool *pool, struct gpiod_isr_line_queue **queues,
+	struct gpiod_isr_decoder *decoder, struct gpiod_isr_timeout **timeouts,
+	struct gpiod_line **lines, unsigned int num_lines,
+	struct gpiod_line *line,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *),
+	struct gpiod_line_event *event)
+{
+	RPI_PROBE3(gpiod_isr, event, line, event->event_type,
+		   _gpiod_isr_event_ns(event));
+
+	if (!pool && !decoder && !timeouts) {
+		/* WARNING: While in the handler the thread is not watching for other interrupts */
+		_gpiod_isr_call(handler, line, event);
+		return;
+	}
+
+	unsigned int i = 0;
+	while (i < num_lines && lines[i] != line)
+		++i;
+	if (i == num_lines)
+		return;
+
+	if (timeouts && timeouts[i])
+		__atomic_store_n(&timeouts[i]->last_ns, _gpiod_isr_now_ns(),
+				 __ATOMIC_RELAXED);
+
+	if (decoder)
+		decoder->decode(decoder, i, event);
+	else if (pool)
+		_gpiod_isr_pool_enqueue(pool, queues[i], event);
+	else
+		_gpiod_isr_call(handler, line, event);
+}
+
+/**
+ * @brief Create the queues of a set of lines in a pool.
+ * @param pool Dispatch pool.
+ * @param lines Lines to attach.
+ * @param num_lines Number of lines.
+ * @param handler Interrupt handler.
+ * @return Array of queues, NULL on failure.
+ */
+static struct gpiod_isr_line_queue **_gpiod_isr_pool_attach(
+	struct gpiod_isr_pool *pool, struct gpiod_line **lines,
+	unsigned int num_lines,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *))
+{
+	pthread_mutex_lock(&pool->lock);
+	if (pool->num_lines + num_lines > GPIOD_ISR_POOL_MAX_LINES) {
+		pthread_mutex_unlock(&pool->lock);
+		errno = ENOSPC;
+		return NULL;
+	}
+	unsigned int first = pool->num_lines;
+	pool->num_lines += num_lines;
+	pthread_mutex_unlock(&pool->lock);
+
+	struct gpiod_isr_line_queue **queues =
+		calloc(num_lines, sizeof(*queues));
+	if (!queues)
+		return NULL;
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		queues[i] = calloc(1, sizeof(**queues));
+		if (!queues[i]) {
+			while (i--)
+				free(queues[i]);
+			free(queues);
+			return NULL;
+		}
+		queues[i]->line = lines[i];
+		queues[i]->handler = handler;
+		queues[i]->home = (first + i) % pool->num_workers;
+		pthread_mutex_init(&queues[i]->lock, NULL);
+		pthread_cond_init(&queues[i]->idle, NULL);
+	}
+
+	return queues;
+}
+
+/**
+ * @brief Drop pending events, wait for the workers to be done with the lines and free the queues.
+ * @param queues Array of queues.
+ * @param num_lines Number of lines.
+ */
+static void _gpiod_isr_pool_detach(struct gpiod_isr_line_queue **queues,
+				   unsigned int num_lines)
+{
+	if (!queues)
+		return;
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		pthread_mutex_lock(&queues[i]->lock);
+		queues[i]->count = 0;
+		while (queues[i]->scheduled)
+			pthread_cond_wait(&queues[i]->idle, &queues[i]->lock);
+		pthread_mutex_unlock(&queues[i]->lock);
+
+		pthread_cond_destroy(&queues[i]->idle);
+		pthread_mutex_destroy(&queues[i]->lock);
+		free(queues[i]);
+	}
+	free(queues);
+}
+
+/**
+ * @brief Update the handler of every queue.
+ * @param queues Array of queues, can be NULL.
+ * @param num_lines Number of lines.
+ * @param handler New interrupt handler.
+ */
+static void _gpiod_isr_pool_set_handler(
+	struct gpiod_isr_line_queue **queues, unsigned int num_lines,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *))
+{
+	if (!queues)
+		return;
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		pthread_mutex_lock(&queues[i]->lock);
+		queues[i]->handler = handler;
+		pthread_mutex_unlock(&queues[i]->lock);
+	}
+}
+
 /**
  * @brief Structure holding ISR configuration for a single line.
  */
@@ -112,6 +1005,24 @@ struct gpiod_isr {
 	///< Event type (rising, falling, both)
 	pthread_t thread;
 	///< Associated thread
+	unsigned long events;
+	///< Number of events handled since the request (atomic, read with __atomic_load_n)
+	unsigned long syscalls;
+	///< Number of wait/read calls made by the watcher since the request (atomic)
+	unsigned long errors;
+	///< Number of failed wait/read calls, each followed by a pause (atomic)
+	struct gpiod_isr_pool *pool;
+	///< Pool executing the handler, NULL to call it from the watcher
+	struct gpiod_isr_line_queue **queues;
+	///< Queues of the lines in the pool
+	struct gpiod_isr_decoder *decoder;
+	///< Decoder consuming the events instead of the handler, can be NULL
+	struct gpiod_isr_timeout **timeouts;
+	///< Inactivity timeouts of the lines, NULL when none was armed
+#ifdef LIBGPIOD_V2
+	struct gpiod_edge_event_buffer *buffer;
+	///< Buffer the events are read into
+#endif
 };
 
 /**
@@ -126,17 +1037,63 @@ struct gpiod_isr_bulk {
 	///< Event type (rising, falling, both)
 	pthread_t thread;
 	///< Associated thread
+	unsigned long events;
+	///< Number of events handled since the request (atomic, read with __atomic_load_n)
+	unsigned long syscalls;
+	///< Number of wait/read calls made by the watcher since the request (atomic)
+	unsigned long errors;
+	///< Number of failed wait/read calls, each followed by a pause (atomic)
+	struct gpiod_isr_pool *pool;
+	///< Pool executing the handler, NULL to call it from the watcher
+	struct gpiod_isr_line_queue **queues;
+	///< Queues of the lines in the pool
+	struct gpiod_isr_decoder *decoder;
+	///< Decoder consuming the events instead of the handler, can be NULL
+	struct gpiod_isr_timeout **timeouts;
+	///< Inactivity timeouts of the lines, NULL when none was armed
+#ifdef LIBGPIOD_V2
+	struct gpiod_edge_event_buffer *buffer;
+	///< Buffer the events are read into
+#endif
 };
 
+/**
+ * @brief Add to a counter of a watcher, read from other threads.
+ * @param counter Counter.
+ * @param n Amount added.
+ */
+static inline void _gpiod_isr_count(unsigned long *counter, unsigned long n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Count a failed wait or read of a watcher and pause before retrying.
+ * @param errors Error counter of the watcher.
+ * @param backoff_us Current pause (us), doubled up to GPIOD_ISR_BACKOFF_MAX_US, set to 0 after a success.
+ *
+ * A request that keeps failing (e.g. the chip is gone) no longer keeps the watcher spinning.
+ */
+static void _gpiod_isr_backoff(unsigned long *errors, unsigned int *backoff_us)
+{
+	_gpiod_isr_count(errors, 1);
+	*backoff_us = *backoff_us ? *backoff_us * 2 : 1000;
+	if (*backoff_us > GPIOD_ISR_BACKOFF_MAX_US)
+		*backoff_us = GPIOD_ISR_BACKOFF_MAX_US;
+	usleep(*backoff_us);
+}
+
+#ifndef LIBGPIOD_V2
+
 /**
  * @brief Pthread routine that will watch events on a given line and call the interrupt handler.
  * @param _isr Pointer to a gpiod_isr structure.
  * @return Nothing.
- * @warning This thread will override any error happend while waiting for events.
+ * @note Failed waits or reads are counted in errors and retried after a growing pause.
  */
 static void *_gpiod_event_watcher(void *_isr)
 {
-	const struct gpiod_isr *isr = (struct gpiod_isr *)_isr;
+	struct gpiod_isr *isr = (struct gpiod_isr *)_isr;
 
 	/* Allow pthread_cancel to stop this thread at any time
          * This should be safe and pretty clean as we do not have anything to clean
@@ -147,31 +1104,119 @@ static void *_gpiod_event_watcher(void *_isr)
 
 	struct gpiod_line_event event;
 
+	if (isr->decoder && isr->decoder->start)
+		isr->decoder->start(isr->decoder, &isr->line, 1);
+
+	unsigned int backoff_us = 0;
 	for (;;) {
 		/* Wait for an event to happen */
-		/* NOTE: This overrides error! */
-		while (gpiod_line_event_wait(isr->line, NULL) != 1)
-			;
-
-		if (gpiod_line_event_read(isr->line, &event) == 0) {
-			/* Call provided handler */
-			/* WARNING: While in the handler the thread is not watching for other interrupts */
-			isr->handler(isr->line, &event);
+		_gpiod_isr_count(&isr->syscalls, 2);
+		if (gpiod_line_event_wait(isr->line, NULL) != 1 ||
+		    gpiod_line_event_read(isr->line, &event) < 0) {
+			_gpiod_isr_backoff(&isr->errors, &backoff_us);
+			continue;
 		}
+		backoff_us = 0;
+
+		_gpiod_isr_count(&isr->events, 1);
+		/* Call provided handler */
+		_gpiod_isr_dispatch(isr->pool, isr->queues, isr->decoder,
+				    isr->timeouts, &isr->line, 1, isr->line,
+				    isr->handler, &event);
 	}
 
 	return NULL;
 }
 
+/**
+ * @brief Read the pending events of a set of lines and give them to a decoder in time order.
+ * @param isr Pointer to a gpiod_isr_bulk structure using a decoder.
+ * @param event_bulk Lines with pending events.
+ *
+ * With v1 every line has its own file descriptor, reading them one after the other would give
+ * the events of the first line before those of the second one even if they happened later.
+ * Decoders depend on the order between lines (e.g. quadrature) so the events are merged by timestamp:
+ * every line gets a share of the buffer, the oldest buffered event is always decoded first and a line
+ * is only read again once its share is used, until none of them has pending events left.
+ */
+static void _gpiod_event_decode_bulk(struct gpiod_isr_bulk *isr,
+				     struct gpiod_line_bulk *event_bulk)
+{
+	struct gpiod_line_event
+		events[GPIOD_ISR_EVENT_BUFFER_SIZE < GPIOD_LINE_BULK_MAX_LINES ?
+			       GPIOD_LINE_BULK_MAX_LINES :
+			       GPIOD_ISR_EVENT_BUFFER_SIZE];
+	unsigned int index[GPIOD_LINE_BULK_MAX_LINES];
+	unsigned int head[GPIOD_LINE_BULK_MAX_LINES];
+	unsigned int len[GPIOD_LINE_BULK_MAX_LINES];
+	int pending[GPIOD_LINE_BULK_MAX_LINES];
+	const unsigned int num_lines = event_bulk->num_lines;
+	const unsigned int per_line =
+		sizeof(events) / sizeof(*events) / num_lines;
+	const struct timespec no_wait = { 0, 0 };
+	unsigned long count = 0;
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		index[i] = 0;
+		while (isr->lines->lines[index[i]] != event_bulk->lines[i])
+			++index[i];
+		head[i] = len[i] = 0;
+		pending[i] = 1;
+	}
+
+	for (;;) {
+		unsigned int next = num_lines;
+		int64_t oldest = 0;
+		for (unsigned int i = 0; i < num_lines; ++i) {
+			struct gpiod_line *line = event_bulk->lines[i];
+			struct gpiod_line_event *share = events + i * per_line;
+			if (head[i] == len[i] && pending[i]) {
+				_gpiod_isr_count(&isr->syscalls, 1);
+				const int n = gpiod_line_event_read_multiple(
+					line, share, per_line);
+				head[i] = 0;
+				len[i] = n < 0 ? 0 : n;
+				/* A short read emptied the line */
+				pending[i] = len[i] == per_line;
+				if (pending[i]) {
+					_gpiod_isr_count(&isr->syscalls, 1);
+					pending[i] = gpiod_line_event_wait(
+						line, &no_wait) == 1;
+				}
+			}
+			if (head[i] == len[i])
+				continue;
+			const int64_t ns = _gpiod_isr_event_ns(&share[head[i]]);
+			if (next == num_lines || ns < oldest) {
+				next = i;
+				oldest = ns;
+			}
+		}
+		if (next == num_lines)
+			break;
+
+		struct gpiod_line_event *event =
+			&events[next * per_line + head[next]++];
+		++count;
+		RPI_PROBE3(gpiod_isr, event, event_bulk->lines[next],
+			   event->event_type, _gpiod_isr_event_ns(event));
+		if (isr->timeouts && isr->timeouts[index[next]])
+			__atomic_store_n(&isr->timeouts[index[next]]->last_ns,
+					 _gpiod_isr_now_ns(), __ATOMIC_RELAXED);
+		isr->decoder->decode(isr->decoder, index[next], event);
+	}
+	_gpiod_isr_count(&isr->events, count);
+}
+
 /**
  * @brief Pthread routing that will watch events on a set of line.
  * @param _isr Pointer to a gpiod_isr_bulk structure.
  * @return  Nothing.
- * @warning This thread will override any error happend while waiting for events.
+ * @note Failed waits or reads are counted in errors and retried after a growing pause.
  */
 static void *_gpiod_event_watcher_bulk(void *_isr)
 {
-	const struct gpiod_isr_bulk *isr = (struct gpiod_isr_bulk *)_isr;
+	struct gpiod_isr_bulk *isr = (struct gpiod_isr_bulk *)_isr;
 
 	/* Allow pthread_cancel to stop this thread at any time
          * This should be safe and pretty clean as we do not have anything to clean
@@ -183,17 +1228,45 @@ static void *_gpiod_event_watcher_bulk(void *_isr)
 	struct gpiod_line_bulk event_bulk;
 	struct gpiod_line_event event;
 
+	if (isr->decoder && isr->decoder->start)
+		isr->decoder->start(isr->decoder, isr->lines->lines,
+				    isr->lines->num_lines);
+
+	unsigned int backoff_us = 0;
 	for (;;) {
 		/* Wait for events on all lines */
-		while (gpiod_line_event_wait_bulk(isr->lines, NULL,
-						  &event_bulk) != 1)
-			;
+		_gpiod_isr_count(&isr->syscalls, 1);
+		if (gpiod_line_event_wait_bulk(isr->lines, NULL,
+					       &event_bulk) != 1) {
+			_gpiod_isr_backoff(&isr->errors, &backoff_us);
+			continue;
+		}
+		if (isr->decoder) {
+			_gpiod_event_decode_bulk(isr, &event_bulk);
+			backoff_us = 0;
+			continue;
+		}
 		/* Call handler for every event on each line */
+		int failed = 0;
 		for (unsigned int i = 0; i < event_bulk.num_lines; ++i) {
+			_gpiod_isr_count(&isr->syscalls, 1);
 			if (gpiod_line_event_read(event_bulk.lines[i],
-						  &event) == 0)
-				isr->handler(event_bulk.lines[i], &event);
+						  &event) < 0) {
+				failed = 1;
+				continue;
+			}
+			_gpiod_isr_count(&isr->events, 1);
+			_gpiod_isr_dispatch(isr->pool, isr->queues,
+					    isr->decoder, isr->timeouts,
+					    isr->lines->lines,
+					    isr->lines->num_lines,
+					    event_bulk.lines[i], isr->handler,
+					    &event);
 		}
+		if (failed)
+			_gpiod_isr_backoff(&isr->errors, &backoff_us);
+		else
+			backoff_us = 0;
 	}
 
 	return NULL;
@@ -254,6 +1327,173 @@ static int _gpiod_request_bulk_event(struct gpiod_line_bulk *bulk,
 	}
 }
 
+#else // LIBGPIOD_V2
+
+/**
+ * @brief Read events from a v2 request and call the interrupt handler for each of them.
+ * @param request Line request holding every watched line.
+ * @param buffer Buffer the events are read into.
+ * @param lines Line handles of the request.
+ * @param num_lines Number of line handles.
+ * @param handler Interrupt handler.
+ * @param pool Dispatch pool, can be NULL.
+ * @param queues Queues of the lines in the pool.
+ * @param decoder Decoder replacing the handler, can be NULL.
+ * @param timeouts Inactivity timeouts of the lines, can be NULL.
+ * @param events Counter of handled events.
+ * @param syscalls Counter of read calls.
+ * @param errors Counter of failed reads, each one is followed by a growing pause.
+ *
+ * A single blocking `read` on the request file descriptor returns every pending event of every line,
+ * there is no need to poll first.
+ * The watcher can only be cancelled in that `read` (or the pause after a failure): every event read into
+ * the buffer is dispatched before the watcher stops, restarting it does not lose any.
+ */
+static void _gpiod_event_watch_request(
+	struct gpiod_line_request *request,
+	struct gpiod_edge_event_buffer *buffer, struct gpiod_line **lines,
+	unsigned int num_lines,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *),
+	struct gpiod_isr_pool *pool, struct gpiod_isr_line_queue **queues,
+	struct gpiod_isr_decoder *decoder, struct gpiod_isr_timeout **timeouts,
+	unsigned long *events, unsigned long *syscalls, unsigned long *errors)
+{
+	struct gpiod_line_event event;
+	unsigned int backoff_us = 0;
+	int cancel_state;
+
+	if (decoder && decoder->start)
+		decoder->start(decoder, lines, num_lines);
+
+	for (;;) {
+		_gpiod_isr_count(syscalls, 1);
+		int num_events = gpiod_line_request_read_edge_events(
+			request, buffer, GPIOD_ISR_EVENT_BUFFER_SIZE);
+		if (num_events <= 0) {
+			_gpiod_isr_backoff(errors, &backoff_us);
+			continue;
+		}
+		backoff_us = 0;
+
+		(void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE,
+					     &cancel_state);
+		for (int i = 0; i < num_events; ++i) {
+			struct gpiod_edge_event *edge =
+				gpiod_edge_event_buffer_get_event(buffer, i);
+			unsigned int offset =
+				gpiod_edge_event_get_line_offset(edge);
+			uint64_t ts = gpiod_edge_event_get_timestamp_ns(edge);
+
+			event.ts.tv_sec = ts / 1000000000ULL;
+			event.ts.tv_nsec = ts % 1000000000ULL;
+			event.event_type =
+				gpiod_edge_event_get_event_type(edge) ==
+						GPIOD_EDGE_EVENT_RISING_EDGE ?
+					GPIOD_LINE_EVENT_RISING_EDGE :
+					GPIOD_LINE_EVENT_FALLING_EDGE;
+
+			for (unsigned int j = 0; j < num_lines; ++j) {
+				if (lines[j]->offset == offset) {
+					_gpiod_isr_count(events, 1);
+					_gpiod_isr_dispatch(pool, queues,
+							    decoder, timeouts,
+							    lines,
+							    num_lines, lines[j],
+							    handler, &event);
+					break;
+				}
+			}
+		}
+		(void)pthread_setcancelstate(cancel_state, NULL);
+	}
+}
+
+/**
+ * @brief Pthread routine that will watch events on a given line and call the interrupt handler.
+ * @param _isr Pointer to a gpiod_isr structure.
+ * @return Nothing.
+ */
+static void *_gpiod_event_watcher(void *_isr)
+{
+	struct gpiod_isr *isr = (struct gpiod_isr *)_isr;
+
+	/* Deferred cancellation, see _gpiod_event_watch_request() */
+	_gpiod_event_watch_request(isr->line->request, isr->buffer, &isr->line,
+				   1, isr->handler, isr->pool, isr->queues,
+				   isr->decoder, isr->timeouts, &isr->events,
+				   &isr->syscalls, &isr->errors);
+
+	return NULL;
+}
+
+/**
+ * @brief Pthread routine that will watch events on a set of lines.
+ * @param _isr Pointer to a gpiod_isr_bulk structure.
+ * @return Nothing.
+ */
+static void *_gpiod_event_watcher_bulk(void *_isr)
+{
+	struct gpiod_isr_bulk *isr = (struct gpiod_isr_bulk *)_isr;
+
+	/* Deferred cancellation, see _gpiod_event_watch_request() */
+	_gpiod_event_watch_request(isr->lines->lines[0]->request, isr->buffer,
+				   isr->lines->lines, isr->lines->num_lines,
+				   isr->handler, isr->pool, isr->queues,
+				   isr->decoder, isr->timeouts, &isr->events,
+				   &isr->syscalls, &isr->errors);
+
+	return NULL;
+}
+
+/**
+ * @brief Reserve a set of lines for event detection with a single v2 request.
+ * @param bulk GPIO bulk line object, all lines must belong to the same chip.
+ * @param consumer Name of the consumer.
+ * @param event_type Event request type.
+ * @return 0 on success, -1 on failure
+ */
+static int _gpiod_request_bulk_event(struct gpiod_line_bulk *bulk,
+				     const char *consumer, int event_type)
+{
+	enum gpiod_line_edge edge;
+
+	switch (event_type) {
+	case GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE:
+		edge = GPIOD_LINE_EDGE_FALLING;
+		break;
+	case GPIOD_LINE_REQUEST_EVENT_RISING_EDGE:
+		edge = GPIOD_LINE_EDGE_RISING;
+		break;
+	case GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES:
+		edge = GPIOD_LINE_EDGE_BOTH;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	return _gpiod_compat_request(bulk, consumer, GPIOD_LINE_DIRECTION_INPUT,
+				     edge, NULL);
+}
+
+/**
+ * @brief Reserve a single line for event detection.
+ * @param line GPIO line object.
+ * @param consumer Name of the consumer.
+ * @param event_type Event request type.
+ * @return 0 on success, -1 on failure
+ */
+static int _gpiod_request_event(struct gpiod_line *line, const char *consumer,
+				int event_type)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+
+	gpiod_line_bulk_add(&bulk, line);
+	return _gpiod_request_bulk_event(&bulk, consumer, event_type);
+}
+
+#endif // LIBGPIOD_V2
+
 /**
  * @brief Release a previously registered ISR event.
  * @param isr GPIO ISR object.
@@ -269,7 +1509,12 @@ int gpiod_isr_release(struct gpiod_isr *isr)
 		return -1;
 	pthread_join(isr->thread, NULL);
 
+	_gpiod_isr_pool_detach(isr->queues, 1);
+	_gpiod_isr_timeout_detach(isr->timeouts, 1);
 	gpiod_line_release(isr->line);
+#ifdef LIBGPIOD_V2
+	gpiod_edge_event_buffer_free(isr->buffer);
+#endif
 
 	free(isr);
 	return 0;
@@ -285,14 +1530,132 @@ int gpiod_isr_release_bulk(struct gpiod_isr_bulk *isr)
 	if (!isr)
 		return -1;
 
-	/* Wait for thread to be completely finished so it frees all resources */
-	if (pthread_cancel(isr->thread) != 0)
-		return -1;
-	pthread_join(isr->thread, NULL);
+	/* Wait for thread to be completely finished so it frees all resources */
+	if (pthread_cancel(isr->thread) != 0)
+		return -1;
+	pthread_join(isr->thread, NULL);
+
+	_gpiod_isr_pool_detach(isr->queues, isr->lines->num_lines);
+	_gpiod_isr_timeout_detach(isr->timeouts, isr->lines->num_lines);
+	gpiod_line_release_bulk(isr->lines);
+#ifdef LIBGPIOD_V2
+	gpiod_edge_event_buffer_free(isr->buffer);
+#endif
+	free(isr);
+	return 0;
+}
+
+/**
+ * @brief Reserve a line and start its watcher.
+ * @param line GPIO line object.
+ * @param consumer Name of the consumer.
+ * @param event_type Event type (type of request).
+ * @param handler Interrupt handling function, NULL when a decoder is used.
+ * @param decoder Decoder consuming the events, NULL when a handler is used.
+ * @return Pointer to the GPIO ISR handler or NULL on failure.
+ */
+static struct gpiod_isr *_gpiod_isr_request_events(
+	struct gpiod_line *line, const char *consumer, const int event_type,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *),
+	struct gpiod_isr_decoder *decoder)
+{
+	if (_gpiod_request_event(line, consumer, event_type) < 0)
+		return NULL;
+
+	struct gpiod_isr *isr = malloc(sizeof(*isr));
+	if (!isr) {
+		gpiod_line_release(line);
+		return NULL;
+	}
+
+	isr->line = line;
+	isr->handler = handler;
+	isr->event_type = event_type;
+	isr->events = 0;
+	isr->syscalls = 0;
+	isr->errors = 0;
+	isr->pool = NULL;
+	isr->queues = NULL;
+	isr->decoder = decoder;
+	isr->timeouts = NULL;
+
+#ifdef LIBGPIOD_V2
+	isr->buffer = gpiod_edge_event_buffer_new(GPIOD_ISR_EVENT_BUFFER_SIZE);
+	if (!isr->buffer) {
+		free(isr);
+		gpiod_line_release(line);
+		return NULL;
+	}
+#endif
+
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher,
+			   (void *)isr) != 0) {
+#ifdef LIBGPIOD_V2
+		gpiod_edge_event_buffer_free(isr->buffer);
+#endif
+		free(isr);
+		gpiod_line_release(line);
+		return NULL;
+	}
+
+	return isr;
+}
+
+/**
+ * @brief Reserve a set of lines and start their watcher.
+ * @param bulk Set of GPIO lines to watch event on.
+ * @param consumer Name of the consumer.
+ * @param event_type Event type (type of request).
+ * @param handler Interrupt handling function, NULL when a decoder is used.
+ * @param decoder Decoder consuming the events, NULL when a handler is used.
+ * @return Pointer to the GPIO ISR handler or NULL on failure.
+ */
+static struct gpiod_isr_bulk *_gpiod_isr_request_bulk_events(
+	struct gpiod_line_bulk *bulk, const char *consumer,
+	const int event_type,
+	void (*handler)(struct gpiod_line *, struct gpiod_line_event *),
+	struct gpiod_isr_decoder *decoder)
+{
+	if (_gpiod_request_bulk_event(bulk, consumer, event_type) < 0)
+		return NULL;
+
+	struct gpiod_isr_bulk *isr = malloc(sizeof(*isr));
+	if (!isr) {
+		gpiod_line_release_bulk(bulk);
+		return NULL;
+	}
+
+	isr->lines = bulk;
+	isr->handler = handler;
+	isr->event_type = event_type;
+	isr->events = 0;
+	isr->syscalls = 0;
+	isr->errors = 0;
+	isr->pool = NULL;
+	isr->queues = NULL;
+	isr->decoder = decoder;
+	isr->timeouts = NULL;
+
+#ifdef LIBGPIOD_V2
+	isr->buffer = gpiod_edge_event_buffer_new(GPIOD_ISR_EVENT_BUFFER_SIZE);
+	if (!isr->buffer) {
+		free(isr);
+		gpiod_line_release_bulk(bulk);
+		return NULL;
+	}
+#endif
 
-	gpiod_line_release_bulk(isr->lines);
-	free(isr);
-	return 0;
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher_bulk,
+			   (void *)isr) != 0) {
+#ifdef LIBGPIOD_V2
+		gpiod_edge_event_buffer_free(isr->buffer);
+#endif
+		free(isr);
+		gpiod_line_release_bulk(bulk);
+		return NULL;
+	}
+
+	return isr;
 }
 
 /**
@@ -317,27 +1680,8 @@ struct gpiod_isr *gpiod_isr_request_events(
 		return NULL;
 	}
 
-	if (_gpiod_request_event(line, consumer, event_type) < 0)
-		return NULL;
-
-	struct gpiod_isr *isr = malloc(sizeof(*isr));
-	if (!isr) {
-		gpiod_line_release(line);
-		return NULL;
-	}
-
-	isr->line = line;
-	isr->handler = handler;
-	isr->event_type = event_type;
-
-	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher,
-			   (void *)isr) != 0) {
-		free(isr);
-		gpiod_line_release(line);
-		return NULL;
-	}
-
-	return isr;
+	return _gpiod_isr_request_events(line, consumer, event_type, handler,
+					 NULL);
 }
 
 /**
@@ -363,27 +1707,54 @@ struct gpiod_isr_bulk *gpiod_isr_request_bulk_events(
 		return NULL;
 	}
 
-	if (_gpiod_request_bulk_event(bulk, consumer, event_type) < 0)
-		return NULL;
+	return _gpiod_isr_request_bulk_events(bulk, consumer, event_type,
+					      handler, NULL);
+}
 
-	struct gpiod_isr_bulk *isr = malloc(sizeof(*isr));
-	if (!isr) {
-		gpiod_line_release_bulk(bulk);
+/**
+ * @brief Request event detection on a single line, events are consumed by a decoder inside the watcher.
+ * @param line GPIO line object.
+ * @param consumer Name of the consumer.
+ * @param event_type Event type (type of request).
+ * @param decoder Decoder, must stay valid until the ISR is released.
+ * @return Pointer to the GPIO ISR handler or NULL on failure.
+ */
+struct gpiod_isr *
+gpiod_isr_request_decoder(struct gpiod_line *line, const char *consumer,
+			  const int event_type,
+			  struct gpiod_isr_decoder *decoder)
+{
+	if (!line || !decoder || !decoder->decode) {
+		errno = EINVAL;
 		return NULL;
 	}
 
-	isr->lines = bulk;
-	isr->handler = handler;
-	isr->event_type = event_type;
+	return _gpiod_isr_request_events(line, consumer, event_type, NULL,
+					 decoder);
+}
 
-	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher_bulk,
-			   (void *)isr) != 0) {
-		free(isr);
-		gpiod_line_release_bulk(bulk);
+/**
+ * @brief Request event detection on a set of lines, events are consumed by a decoder inside the watcher.
+ * @param bulk Set of GPIO lines to watch event on.
+ * @param consumer Name of the consumer.
+ * @param event_type Event type (type of request).
+ * @param decoder Decoder, must stay valid until the ISR is released.
+ * @return Pointer to the GPIO ISR handler or NULL on failure.
+ *
+ * The index given to the decoder is the position of the line in the bulk.
+ */
+struct gpiod_isr_bulk *
+gpiod_isr_request_bulk_decoder(struct gpiod_line_bulk *bulk,
+			       const char *consumer, const int event_type,
+			       struct gpiod_isr_decoder *decoder)
+{
+	if (!bulk || !decoder || !decoder->decode) {
+		errno = EINVAL;
 		return NULL;
 	}
 
-	return isr;
+	return _gpiod_isr_request_bulk_events(bulk, consumer, event_type, NULL,
+					      decoder);
 }
 
 /**
@@ -480,7 +1851,7 @@ struct gpiod_isr_bulk *gpiod_isr_request_bulk_both_edges_events(
  * @brief Change an existing GPIOD ISR, this can change the event or the handler.
  * @param isr Pointer to an existing GPIOD_ISR.
  * @param event_type Event type (type of request), or -1 to keep the same.
- * @param handler Interrupt handling function, or NULL to keep the same.
+ * @param handler Interrupt handling function, or NULL to keep the same, a new handler replaces the decoder.
  * @return 0 on success, -1 on failure.
  * 
  * The parameter event_type can be:
@@ -521,6 +1892,8 @@ int gpiod_isr_change_event(struct gpiod_isr *isr, const int event_type,
 	/* Change handler */
 	if (handler && isr->handler != handler) {
 		isr->handler = handler;
+		isr->decoder = NULL;
+		_gpiod_isr_pool_set_handler(isr->queues, 1, handler);
 	}
 
 	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher,
@@ -578,7 +1951,7 @@ int gpiod_isr_change_both_edges_events(
  * @brief Change an existing bulk GPIOD ISR, this can change the event or the handler.
  * @param isr Pointer to an existing gpiod_isr_bulk object.
  * @param event_type Event type (type of request), or -1 to keep the same.
- * @param handler Interrupt handling function, or NULL to keep the same.
+ * @param handler Interrupt handling function, or NULL to keep the same, a new handler replaces the decoder.
  * @return 0 on success, -1 on failure.
  * 
  * The parameter event_type can be:
@@ -621,6 +1994,9 @@ int gpiod_isr_change_bulk_event(struct gpiod_isr_bulk *isr,
 	/* Change handler */
 	if (handler && isr->handler != handler) {
 		isr->handler = handler;
+		isr->decoder = NULL;
+		_gpiod_isr_pool_set_handler(isr->queues, isr->lines->num_lines,
+					    handler);
 	}
 
 	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher_bulk,
@@ -674,6 +2050,343 @@ int gpiod_isr_change_bulk_both_edges_events(
 		isr, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES, handler);
 }
 
+/**
+ * @brief Create a pool of workers that will execute interrupt handlers.
+ * @param num_workers Number of worker threads.
+ * @return Pointer to the pool or NULL on failure.
+ *
+ * Once attached to an ISR with @ref gpiod_isr_set_pool or @ref gpiod_isr_bulk_set_pool, the watcher only queues
+ * events and goes back to reading, a slow handler does not delay the other lines anymore.
+ * Events of a line are handled in order, different lines are handled in parallel.
+ * Idle workers steal ready lines from busy ones.
+ */
+struct gpiod_isr_pool *gpiod_isr_pool_create(unsigned int num_workers)
+{
+	if (num_workers == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct gpiod_isr_pool *pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->workers = calloc(num_workers, sizeof(*pool->workers));
+	pool->run_queues = calloc(num_workers, sizeof(*pool->run_queues));
+	if (!pool->workers || !pool->run_queues)
+		goto cleanup;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wakeup, NULL);
+
+	for (unsigned int i = 0; i < num_workers; ++i) {
+		pthread_mutex_init(&pool->run_queues[i].lock, NULL);
+		pool->run_queues[i].pool = pool;
+		pool->run_queues[i].worker = i;
+	}
+
+	/* Workers steal from each other, they must all be known before starting */
+	pool->num_workers = num_workers;
+	for (unsigned int started = 0; started < num_workers; ++started) {
+		if (pthread_create(&pool->workers[started], NULL,
+				   _gpiod_isr_pool_worker,
+				   &pool->run_queues[started]) != 0) {
+			int err = errno;
+			pthread_mutex_lock(&pool->lock);
+			pool->stop = 1;
+			pthread_cond_broadcast(&pool->wakeup);
+			pthread_mutex_unlock(&pool->lock);
+			for (unsigned int i = 0; i < started; ++i)
+				pthread_join(pool->workers[i], NULL);
+			errno = err;
+			goto cleanup;
+		}
+	}
+
+	return pool;
+
+cleanup:
+	free(pool->run_queues);
+	free(pool->workers);
+	free(pool);
+	return NULL;
+}
+
+/**
+ * @brief Stop the workers and free the pool.
+ * @param pool Pointer to a pool.
+ * @return 0 on success, -1 on failure.
+ * @warning Every ISR using the pool needs to be released (or detached) first.
+ */
+int gpiod_isr_pool_destroy(struct gpiod_isr_pool *pool)
+{
+	if (!pool) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wakeup);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 0; i < pool->num_workers; ++i) {
+		pthread_join(pool->workers[i], NULL);
+		pthread_mutex_destroy(&pool->run_queues[i].lock);
+	}
+
+	pthread_cond_destroy(&pool->wakeup);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->run_queues);
+	free(pool->workers);
+	free(pool);
+	return 0;
+}
+
+/**
+ * @brief Execute the handler of an ISR in a pool instead of the watcher thread.
+ * @param isr Pointer to an existing gpiod_isr.
+ * @param pool Pointer to a pool, or NULL to call the handler from the watcher again.
+ * @return 0 on success, -1 on failure.
+ * @note Events still queued when detaching are dropped.
+ * @note Decoders always run in the watcher thread, they cannot use a pool.
+ */
+int gpiod_isr_set_pool(struct gpiod_isr *isr, struct gpiod_isr_pool *pool)
+{
+	if (!isr || isr->decoder) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pool == isr->pool)
+		return 0;
+
+	struct gpiod_isr_line_queue **queues = NULL;
+	if (pool) {
+		queues = _gpiod_isr_pool_attach(pool, &isr->line, 1,
+						isr->handler);
+		if (!queues)
+			return -1;
+	}
+
+	/* Terminate watcher */
+	if (pthread_cancel(isr->thread) != 0) {
+		_gpiod_isr_pool_detach(queues, 1);
+		return -1;
+	}
+	pthread_join(isr->thread, NULL);
+
+	_gpiod_isr_pool_detach(isr->queues, 1);
+	isr->pool = pool;
+	isr->queues = queues;
+
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher,
+			   (void *)isr) != 0) {
+		gpiod_line_release(isr->line);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Execute the handler of a bulk ISR in a pool instead of the watcher thread.
+ * @param isr Pointer to an existing gpiod_isr_bulk.
+ * @param pool Pointer to a pool, or NULL to call the handler from the watcher again.
+ * @return 0 on success, -1 on failure.
+ * @note Events still queued when detaching are dropped.
+ * @note Decoders always run in the watcher thread, they cannot use a pool.
+ */
+int gpiod_isr_bulk_set_pool(struct gpiod_isr_bulk *isr,
+			    struct gpiod_isr_pool *pool)
+{
+	if (!isr || isr->decoder) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pool == isr->pool)
+		return 0;
+
+	struct gpiod_isr_line_queue **queues = NULL;
+	if (pool) {
+		queues = _gpiod_isr_pool_attach(pool, isr->lines->lines,
+						isr->lines->num_lines,
+						isr->handler);
+		if (!queues)
+			return -1;
+	}
+
+	/* Terminate watcher */
+	if (pthread_cancel(isr->thread) != 0) {
+		_gpiod_isr_pool_detach(queues, isr->lines->num_lines);
+		return -1;
+	}
+	pthread_join(isr->thread, NULL);
+
+	_gpiod_isr_pool_detach(isr->queues, isr->lines->num_lines);
+	isr->pool = pool;
+	isr->queues = queues;
+
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher_bulk,
+			   (void *)isr) != 0) {
+		gpiod_line_release_bulk(isr->lines);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the queue statistics of a line whose handler runs in a pool.
+ * @param queues Queues of the ISR.
+ * @param lines Lines of the ISR.
+ * @param num_lines Number of lines.
+ * @param line Line to look for.
+ * @param stats Filled with the statistics.
+ * @return 0 on success, -1 on failure.
+ */
+static int _gpiod_isr_pool_line_stats(struct gpiod_isr_line_queue **queues,
+				      struct gpiod_line **lines,
+				      unsigned int num_lines,
+				      struct gpiod_line *line,
+				      struct gpiod_isr_line_stats *stats)
+{
+	if (!queues || !stats) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < num_lines; ++i) {
+		if (lines[i] != line)
+			continue;
+		pthread_mutex_lock(&queues[i]->lock);
+		*stats = queues[i]->stats;
+		stats->depth = queues[i]->count;
+		pthread_mutex_unlock(&queues[i]->lock);
+		return 0;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+/**
+ * @brief Get the queue depth and handler time of the line of an ISR using a pool.
+ * @param isr Pointer to an existing gpiod_isr attached to a pool.
+ * @param stats Filled with the statistics.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_isr_line_stats(struct gpiod_isr *isr,
+			 struct gpiod_isr_line_stats *stats)
+{
+	if (!isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return _gpiod_isr_pool_line_stats(isr->queues, &isr->line, 1,
+					  isr->line, stats);
+}
+
+/**
+ * @brief Get the queue depth and handler time of a line of a bulk ISR using a pool.
+ * @param isr Pointer to an existing gpiod_isr_bulk attached to a pool.
+ * @param line Line of the bulk.
+ * @param stats Filled with the statistics.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_isr_bulk_line_stats(struct gpiod_isr_bulk *isr,
+			      struct gpiod_line *line,
+			      struct gpiod_isr_line_stats *stats)
+{
+	if (!isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return _gpiod_isr_pool_line_stats(isr->queues, isr->lines->lines,
+					  isr->lines->num_lines, line, stats);
+}
+
+/**
+ * @brief Call a handler when no edge happened on the line for some time.
+ * @param isr Pointer to an existing gpiod_isr.
+ * @param timeout_ms Time allowed without any edge (ms), 0 to disarm.
+ * @param handler Timeout handler, gets the line and the number of consecutive timeouts.
+ * @return 0 on success, -1 on failure.
+ *
+ * The handler is called every `timeout_ms` for as long as the line stays quiet, the count starts
+ * again from 1 after the next edge. This tells a dead sensor from a quiet one without a polling thread,
+ * every timeout of the process is served by a single timer wheel thread.
+ *
+ * @warning The handler is called with the timer wheel locked, it must be short and must not arm or disarm timeouts.
+ */
+int gpiod_isr_set_timeout(struct gpiod_isr *isr, unsigned int timeout_ms,
+			  void (*handler)(struct gpiod_line *, unsigned int))
+{
+	if (!isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The watcher touches the timeouts, stop it while changing them */
+	if (pthread_cancel(isr->thread) != 0)
+		return -1;
+	pthread_join(isr->thread, NULL);
+
+	int ret = _gpiod_isr_timeout_set(&isr->timeouts, &isr->line, 1,
+					 isr->line, timeout_ms, handler);
+
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher,
+			   (void *)isr) != 0) {
+		gpiod_line_release(isr->line);
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Call a handler when no edge happened on a line of a set for some time.
+ * @param isr Pointer to an existing gpiod_isr_bulk.
+ * @param line Line of the set, or NULL for every line.
+ * @param timeout_ms Time allowed without any edge (ms), 0 to disarm.
+ * @param handler Timeout handler, gets the line and the number of consecutive timeouts.
+ * @return 0 on success, -1 on failure.
+ *
+ * See @ref gpiod_isr_set_timeout, each line has its own timeout.
+ * @warning The handler is called with the timer wheel locked, it must be short and must not arm or disarm timeouts.
+ */
+int gpiod_isr_bulk_set_timeout(struct gpiod_isr_bulk *isr,
+			       struct gpiod_line *line,
+			       unsigned int timeout_ms,
+			       void (*handler)(struct gpiod_line *,
+					       unsigned int))
+{
+	if (!isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The watcher touches the timeouts, stop it while changing them */
+	if (pthread_cancel(isr->thread) != 0)
+		return -1;
+	pthread_join(isr->thread, NULL);
+
+	int ret = _gpiod_isr_timeout_set(&isr->timeouts, isr->lines->lines,
+					 isr->lines->num_lines, line,
+					 timeout_ms, handler);
+
+	if (pthread_create(&isr->thread, NULL, _gpiod_event_watcher_bulk,
+			   (void *)isr) != 0) {
+		gpiod_line_release_bulk(isr->lines);
+		return -1;
+	}
+
+	return ret;
+}
+
 #ifdef __cplusplus
 }
 #endif
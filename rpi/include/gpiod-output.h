@@ -0,0 +1,231 @@
+/**
+ * @brief Group of output lines updated with a single bulk write
+ *
+ * @file gpiod-output.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-21
+ *
+ * @details
+ * Setting outputs one by one with `gpiod_line_set_value` costs one ioctl per change.
+ * An output group keeps a shadow bitmap of the values of up to 64 lines: setting a line only changes the shadow,
+ * and a flush writes every line at once with a single ioctl, and only if something changed since the previous flush.
+ *
+ * Setting values never blocks and can be done from any thread, the flush can be called explicitly or at the end
+ * of each tick of a scheduler (see `rpi::event_loop::on_idle` in event-loop.hpp).
+ *
+ * With libgpiod v1 the bulk write sets every line of the group (unchanged lines get the same value again),
+ * with libgpiod v2 (`-DLIBGPIOD_V2`) only the lines that changed are written.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct gpiod_output_group leds;
+ * gpiod_output_group_init(&leds, &bulk, "leds", NULL);
+ *
+ * gpiod_output_group_set(&leds, 0, 1);
+ * gpiod_output_group_set(&leds, 3, 1);
+ * gpiod_output_group_flush(&leds); // One ioctl for both LEDs
+ *
+ * gpiod_output_group_release(&leds);
+ * ```
+ */
+
+#ifndef GPIOD_OUTPUT_H
+#define GPIOD_OUTPUT_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <gpiod.h>
+
+#ifdef LIBGPIOD_V2
+#include "gpiod-v1-compat.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of lines in a group. */
+#define GPIOD_OUTPUT_GROUP_MAX_LINES 64
+
+/**
+ * @brief Group of output lines.
+ */
+struct gpiod_output_group {
+	struct gpiod_line_bulk lines;
+	///< Lines of the group, requested as outputs
+	uint64_t shadow;
+	///< Values to write, bit i is the value of line i
+	uint64_t applied;
+	///< Values written by the last flush
+	pthread_mutex_t lock;
+	///< Serializes the flushes
+	unsigned long flushes;
+	///< Number of flushes that wrote something
+	unsigned long skipped;
+	///< Number of flushes that had nothing to write
+};
+
+/**
+ * @brief Request a set of lines as outputs and create the group.
+ * @param grp Group to initialize.
+ * @param bulk Lines of the group, all on the same chip (copied).
+ * @param consumer Name of the consumer.
+ * @param defaults Initial values (one per line), NULL for all low.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_output_group_init(struct gpiod_output_group *grp,
+			    struct gpiod_line_bulk *bulk, const char *consumer,
+			    const int *defaults)
+{
+	if (!grp || !bulk || bulk->num_lines == 0 ||
+	    bulk->num_lines > GPIOD_OUTPUT_GROUP_MAX_LINES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	grp->lines = *bulk;
+	grp->shadow = 0;
+	for (unsigned int i = 0; i < bulk->num_lines; ++i)
+		if (defaults && defaults[i])
+			grp->shadow |= 1ULL << i;
+	grp->applied = grp->shadow;
+	grp->flushes = 0;
+	grp->skipped = 0;
+
+	/* With libgpiod v2 the shim reserves the whole group with one request */
+	if (gpiod_line_request_bulk_output(&grp->lines, consumer, defaults) < 0)
+		return -1;
+
+	pthread_mutex_init(&grp->lock, NULL);
+	return 0;
+}
+
+/**
+ * @brief Release the lines of a group, pending changes are not written.
+ * @param grp Group.
+ */
+void gpiod_output_group_release(struct gpiod_output_group *grp)
+{
+	if (!grp)
+		return;
+
+	gpiod_line_release_bulk(&grp->lines);
+	pthread_mutex_destroy(&grp->lock);
+}
+
+/**
+ * @brief Set the value of a line of the group, nothing is written until the next flush.
+ * @param grp Group.
+ * @param index Position of the line in the group.
+ * @param value 0 for low, anything else for high.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_output_group_set(struct gpiod_output_group *grp,
+					 unsigned int index, int value)
+{
+	if (index >= grp->lines.num_lines) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (value)
+		__atomic_fetch_or(&grp->shadow, 1ULL << index,
+				  __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&grp->shadow, ~(1ULL << index),
+				   __ATOMIC_RELAXED);
+	return 0;
+}
+
+/**
+ * @brief Set the value of several lines of the group, nothing is written until the next flush.
+ * @param grp Group.
+ * @param mask Lines to change, bit i for line i.
+ * @param values New values, bit i for line i, bits outside of mask are ignored.
+ */
+static inline void gpiod_output_group_set_mask(struct gpiod_output_group *grp,
+					       uint64_t mask, uint64_t values)
+{
+	uint64_t old = __atomic_load_n(&grp->shadow, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&grp->shadow, &old,
+					    (old & ~mask) | (values & mask),
+					    1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * @brief Get the value a line will have after the next flush.
+ * @param grp Group.
+ * @param index Position of the line in the group.
+ * @return 0 or 1, -1 on failure.
+ */
+static inline int gpiod_output_group_get(struct gpiod_output_group *grp,
+					 unsigned int index)
+{
+	if (index >= grp->lines.num_lines) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return (__atomic_load_n(&grp->shadow, __ATOMIC_RELAXED) >> index) & 1;
+}
+
+/**
+ * @brief Write the changes made since the last flush with a single ioctl.
+ * @param grp Group.
+ * @return 1 if something was written, 0 if nothing changed, -1 on failure.
+ */
+int gpiod_output_group_flush(struct gpiod_output_group *grp)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&grp->lock);
+
+	const uint64_t shadow = __atomic_load_n(&grp->shadow, __ATOMIC_RELAXED);
+	const uint64_t changed = shadow ^ grp->applied;
+	if (!changed) {
+		++grp->skipped;
+		goto out;
+	}
+
+#ifndef LIBGPIOD_V2
+	int values[GPIOD_OUTPUT_GROUP_MAX_LINES];
+	for (unsigned int i = 0; i < grp->lines.num_lines; ++i)
+		values[i] = (shadow >> i) & 1;
+	ret = gpiod_line_set_value_bulk(&grp->lines, values);
+#else
+	unsigned int offsets[GPIOD_OUTPUT_GROUP_MAX_LINES];
+	enum gpiod_line_value values[GPIOD_OUTPUT_GROUP_MAX_LINES];
+	size_t num_values = 0;
+	for (unsigned int i = 0; i < grp->lines.num_lines; ++i) {
+		if (!((changed >> i) & 1))
+			continue;
+		offsets[num_values] = grp->lines.lines[i]->offset;
+		values[num_values++] = (shadow >> i) & 1 ?
+					       GPIOD_LINE_VALUE_ACTIVE :
+					       GPIOD_LINE_VALUE_INACTIVE;
+	}
+	ret = gpiod_line_request_set_values_subset(
+		grp->lines.lines[0]->request, num_values, offsets, values);
+#endif
+
+	if (ret == 0) {
+		grp->applied = shadow;
+		++grp->flushes;
+		ret = 1;
+	}
+
+out:
+	pthread_mutex_unlock(&grp->lock);
+	return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_OUTPUT_H
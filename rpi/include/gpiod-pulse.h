@@ -0,0 +1,522 @@
+/**
+ * @brief Pulse-width protocol decoders (DHT22, IR NEC, 433 MHz remotes) running inside the gpiod-isr watcher
+ *
+ * @file gpiod-pulse.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-19
+ *
+ * @details
+ * Some devices send their data as a sequence of pulses whose width encodes the bits.
+ * Each decoder is a small state machine fed with the timestamps of the edges of a single line, directly
+ * from the watcher thread of gpiod-isr, nothing is allocated while decoding.
+ * The handler is only called once a complete frame was received.
+ *
+ * Supported protocols:
+ * 	- DHT22 (AM2302) humidity and temperature sensor, 40 bits, checksum verified.
+ * 	- NEC infrared remotes, through an active-low demodulating receiver (TSOP38238, VS1838B...), 32 bits and repeat codes.
+ * 	- 433 MHz remotes and sockets using PT2262/EV1527 style encoding (rc-switch protocol 1), 12 to 64 bits.
+ *
+ * Decoders can also be fed by hand with @ref gpiod_pulse_feed, for instance to replay recorded edges.
+ *
+ * ## Usage
+ *
+ * ```c
+ * void on_key(struct gpiod_pulse_decoder *dec, const struct gpiod_pulse_frame *frame)
+ * {
+ * 	if (!frame->repeat)
+ * 		printf("Address %#x, command %#x\n", frame->data[0], frame->data[2]);
+ * }
+ *
+ * struct gpiod_pulse_decoder ir;
+ * gpiod_pulse_init(&ir, GPIOD_PULSE_NEC, on_key, NULL);
+ * gpiod_pulse_request(&ir, gpiod_chip_get_line(chip, 17), "ir");
+ * // ...
+ * gpiod_pulse_release(&ir);
+ * ```
+ *
+ * @note The DHT22 start signal (line held low for at least 1 ms) is not generated by the decoder,
+ * the line being reserved for events it has to come from another GPIO, for instance through an open-drain transistor.
+ * @warning This uses gpiod-isr, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef GPIOD_PULSE_H
+#define GPIOD_PULSE_H
+
+#include <gpiod-isr.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @name Protocols
+ * @{
+ */
+#define GPIOD_PULSE_DHT22 1
+#define GPIOD_PULSE_NEC 2
+#define GPIOD_PULSE_RC433 3
+/**
+ * @}
+ */
+
+/** @brief Maximum number of bits in a frame. */
+#define GPIOD_PULSE_MAX_BITS 64
+
+/**
+ * @name Decoder states
+ * @{
+ */
+#define _GPIOD_PULSE_IDLE 0
+#define _GPIOD_PULSE_PREAMBLE 1
+#define _GPIOD_PULSE_BITS 2
+/**
+ * @}
+ */
+
+/**
+ * @brief Decoded frame.
+ */
+struct gpiod_pulse_frame {
+	int protocol;
+	///< Protocol of the frame
+	struct timespec ts;
+	///< Time of the first edge of the frame
+	uint8_t data[GPIOD_PULSE_MAX_BITS / 8];
+	///< Bits received, in the order of the protocol (see each protocol)
+	unsigned int bits;
+	///< Number of bits received
+	unsigned int repeat;
+	///< Number of identical frames received just before this one (NEC repeat codes or 433 MHz retransmissions)
+	unsigned int pulse_us;
+	///< Base pulse width measured (433 MHz only)
+};
+
+/**
+ * @brief Decoder of a single line.
+ */
+struct gpiod_pulse_decoder {
+	struct gpiod_isr_decoder decoder;
+	///< Decoder registered in the watcher, must be the first member
+	int protocol;
+	///< Protocol decoded
+	void (*handler)(struct gpiod_pulse_decoder *,
+			const struct gpiod_pulse_frame *);
+	///< Called from the watcher for each frame
+	void *data;
+	///< User data, not used by the decoder
+	struct gpiod_isr *isr;
+	///< Watcher of the line, NULL when fed by hand
+	int state;
+	///< State of the protocol state machine
+	int64_t last_ns;
+	///< Time of the previous edge, 0 before the first one
+	int64_t high_ns;
+	///< Width of the last high pulse (433 MHz)
+	int64_t last_frame_ns;
+	///< Time of the last frame emitted, used to count repeats
+	struct gpiod_pulse_frame frame;
+	///< Frame being received
+	struct gpiod_pulse_frame previous;
+	///< Last frame emitted
+	unsigned long frames;
+	///< Number of frames emitted
+	unsigned long errors;
+	///< Number of frames abandoned (bad timing or checksum)
+};
+
+/**
+ * @brief Check that a duration is within a range.
+ * @param ns Duration in nanoseconds.
+ * @param min_us Minimum in microseconds.
+ * @param max_us Maximum in microseconds.
+ * @return 1 if within, 0 otherwise.
+ */
+static inline int _gpiod_pulse_within(int64_t ns, int64_t min_us,
+				      int64_t max_us)
+{
+	return ns >= min_us * 1000 && ns <= max_us * 1000;
+}
+
+/**
+ * @brief Start a new frame.
+ * @param dec Decoder.
+ * @param state State to go to.
+ * @param ns Time of the first edge of the frame.
+ */
+static void _gpiod_pulse_begin(struct gpiod_pulse_decoder *dec, int state,
+			       int64_t ns)
+{
+	dec->state = state;
+	memset(dec->frame.data, 0, sizeof(dec->frame.data));
+	dec->frame.bits = 0;
+	dec->frame.pulse_us = 0;
+	dec->frame.ts.tv_sec = ns / 1000000000LL;
+	dec->frame.ts.tv_nsec = ns % 1000000000LL;
+}
+
+/**
+ * @brief Abandon the current frame.
+ * @param dec Decoder.
+ */
+static void _gpiod_pulse_error(struct gpiod_pulse_decoder *dec)
+{
+	if (dec->state != _GPIOD_PULSE_IDLE)
+		++dec->errors;
+	dec->state = _GPIOD_PULSE_IDLE;
+}
+
+/**
+ * @brief Add a bit to the current frame.
+ * @param dec Decoder.
+ * @param bit Bit value.
+ * @param lsb_first Non-zero if the protocol sends the least significant bit of each byte first.
+ */
+static void _gpiod_pulse_push(struct gpiod_pulse_decoder *dec, int bit,
+			      int lsb_first)
+{
+	const unsigned int n = dec->frame.bits++;
+
+	if (bit)
+		dec->frame.data[n / 8] |= lsb_first ? 1 << (n % 8) :
+						      0x80 >> (n % 8);
+}
+
+/**
+ * @brief Give the current frame to the handler.
+ * @param dec Decoder.
+ * @param ns Time of the end of the frame.
+ * @param repeat_ns Identical frames closer than this are counted as repeats.
+ */
+static void _gpiod_pulse_emit(struct gpiod_pulse_decoder *dec, int64_t ns,
+			      int64_t repeat_ns)
+{
+	if (dec->frames && ns - dec->last_frame_ns < repeat_ns &&
+	    dec->frame.bits == dec->previous.bits &&
+	    memcmp(dec->frame.data, dec->previous.data,
+		   sizeof(dec->frame.data)) == 0)
+		dec->frame.repeat = dec->previous.repeat + 1;
+	else
+		dec->frame.repeat = 0;
+
+	dec->frame.protocol = dec->protocol;
+	dec->previous = dec->frame;
+	dec->last_frame_ns = ns;
+	dec->state = _GPIOD_PULSE_IDLE;
+	++dec->frames;
+
+	if (dec->handler)
+		dec->handler(dec, &dec->frame);
+}
+
+/**
+ * @brief DHT22 state machine.
+ * @param dec Decoder.
+ * @param level Level of the pulse that just ended.
+ * @param width Width of the pulse (ns).
+ * @param ns Time of the edge ending the pulse.
+ *
+ * After the start signal the sensor answers with 80 us low and 80 us high,
+ * then sends 40 bits, each one is 50 us low followed by 26-28 us high for 0 or 70 us high for 1.
+ * Bytes are sent most significant bit first: humidity (16 bits), temperature (16 bits), checksum.
+ */
+static void _gpiod_pulse_dht22(struct gpiod_pulse_decoder *dec, int level,
+			       int64_t width, int64_t ns)
+{
+	switch (dec->state) {
+	case _GPIOD_PULSE_IDLE:
+		/* Response low, longer than the low part of a bit */
+		if (!level && _gpiod_pulse_within(width, 65, 100))
+			_gpiod_pulse_begin(dec, _GPIOD_PULSE_PREAMBLE,
+					   ns - width);
+		break;
+	case _GPIOD_PULSE_PREAMBLE:
+		if (level && _gpiod_pulse_within(width, 65, 100))
+			dec->state = _GPIOD_PULSE_BITS;
+		else
+			_gpiod_pulse_error(dec);
+		break;
+	case _GPIOD_PULSE_BITS:
+		if (!level) {
+			if (!_gpiod_pulse_within(width, 30, 70))
+				_gpiod_pulse_error(dec);
+			break;
+		}
+		if (!_gpiod_pulse_within(width, 15, 95)) {
+			_gpiod_pulse_error(dec);
+			break;
+		}
+		_gpiod_pulse_push(dec, width > 48000, 0);
+		if (dec->frame.bits == 40) {
+			const uint8_t *d = dec->frame.data;
+			if ((uint8_t)(d[0] + d[1] + d[2] + d[3]) == d[4])
+				_gpiod_pulse_emit(dec, ns, 0);
+			else
+				_gpiod_pulse_error(dec);
+		}
+		break;
+	}
+}
+
+/**
+ * @brief NEC state machine.
+ * @param dec Decoder.
+ * @param level Level of the pulse that just ended (receiver output, active low).
+ * @param width Width of the pulse (ns).
+ * @param ns Time of the edge ending the pulse.
+ *
+ * A frame is a 9 ms burst, a 4.5 ms space, then 32 bits: a 562.5 us burst followed by
+ * a 562.5 us space for 0 or a 1687.5 us space for 1, least significant bit first.
+ * A repeat code (key held) is a 9 ms burst followed by a 2.25 ms space, the last frame is emitted again
+ * with its repeat counter incremented.
+ */
+static void _gpiod_pulse_nec(struct gpiod_pulse_decoder *dec, int level,
+			     int64_t width, int64_t ns)
+{
+	switch (dec->state) {
+	case _GPIOD_PULSE_IDLE:
+		if (!level && _gpiod_pulse_within(width, 8000, 10000))
+			_gpiod_pulse_begin(dec, _GPIOD_PULSE_PREAMBLE,
+					   ns - width);
+		break;
+	case _GPIOD_PULSE_PREAMBLE:
+		if (level && _gpiod_pulse_within(width, 4000, 5000)) {
+			dec->state = _GPIOD_PULSE_BITS;
+		} else if (level && _gpiod_pulse_within(width, 1900, 2600) &&
+			   dec->frames &&
+			   ns - dec->last_frame_ns < 150000000LL) {
+			/* Repeat code, resend the last frame */
+			memcpy(dec->frame.data, dec->previous.data,
+			       sizeof(dec->frame.data));
+			dec->frame.bits = dec->previous.bits;
+			_gpiod_pulse_emit(dec, ns, 150000000LL);
+		} else {
+			_gpiod_pulse_error(dec);
+		}
+		break;
+	case _GPIOD_PULSE_BITS:
+		if (!level) {
+			if (!_gpiod_pulse_within(width, 350, 800))
+				_gpiod_pulse_error(dec);
+			break;
+		}
+		if (_gpiod_pulse_within(width, 350, 800)) {
+			_gpiod_pulse_push(dec, 0, 1);
+		} else if (_gpiod_pulse_within(width, 1400, 1950)) {
+			_gpiod_pulse_push(dec, 1, 1);
+		} else {
+			_gpiod_pulse_error(dec);
+			break;
+		}
+		if (dec->frame.bits == 32) {
+			/* The command is always followed by its inverse */
+			if ((dec->frame.data[2] ^ dec->frame.data[3]) == 0xff)
+				_gpiod_pulse_emit(dec, ns, 0);
+			else
+				_gpiod_pulse_error(dec);
+		}
+		break;
+	}
+}
+
+/**
+ * @brief 433 MHz state machine (rc-switch protocol 1).
+ * @param dec Decoder.
+ * @param level Level of the pulse that just ended.
+ * @param width Width of the pulse (ns).
+ * @param ns Time of the edge ending the pulse.
+ *
+ * Frames are separated by a sync: 1 T high then 31 T low, T being around 350 us.
+ * Bits are 1 T high then 3 T low for 0, 3 T high then 1 T low for 1, most significant bit first.
+ * The base pulse T is measured on the sync, so transmitters a bit off still decode.
+ * Remotes send the same frame several times, retransmissions are reported through the repeat counter.
+ */
+static void _gpiod_pulse_rc433(struct gpiod_pulse_decoder *dec, int level,
+			       int64_t width, int64_t ns)
+{
+	if (level) {
+		dec->high_ns = width;
+		return;
+	}
+
+	/* Sync: low of about 31 times the high before it */
+	const int is_sync = dec->high_ns > 0 && width > 20 * dec->high_ns &&
+			    width < 40 * dec->high_ns &&
+			    _gpiod_pulse_within(width / 31, 100, 1000);
+
+	if (is_sync) {
+		/* The sync also ends the previous frame */
+		if (dec->state == _GPIOD_PULSE_BITS && dec->frame.bits >= 12)
+			_gpiod_pulse_emit(dec, ns - width, 200000000LL);
+		_gpiod_pulse_begin(dec, _GPIOD_PULSE_BITS, ns);
+		dec->frame.pulse_us = width / 31 / 1000;
+		return;
+	}
+
+	if (dec->state != _GPIOD_PULSE_BITS)
+		return;
+
+	/* Compare both halves to the measured base pulse, 50% tolerance */
+	const int64_t t = dec->frame.pulse_us * 1000LL;
+	const int64_t high = dec->high_ns, low = width;
+	if (high > t / 2 && high < t * 3 / 2 && low > t * 2 && low < t * 4)
+		_gpiod_pulse_push(dec, 0, 0);
+	else if (high > t * 2 && high < t * 4 && low > t / 2 &&
+		 low < t * 3 / 2)
+		_gpiod_pulse_push(dec, 1, 0);
+	else if (dec->frame.bits >= 12)
+		/* End of transmission without a sync after it */
+		_gpiod_pulse_emit(dec, ns, 200000000LL);
+	else
+		_gpiod_pulse_error(dec);
+
+	if (dec->state == _GPIOD_PULSE_BITS &&
+	    dec->frame.bits == GPIOD_PULSE_MAX_BITS)
+		_gpiod_pulse_emit(dec, ns, 200000000LL);
+}
+
+/**
+ * @brief Feed an edge to a decoder.
+ * @param dec Decoder.
+ * @param event Edge event, events must be given in order.
+ *
+ * The width of the pulse that just ended is the time since the previous edge,
+ * its level is the opposite of the edge (a rising edge ends a low pulse).
+ */
+void gpiod_pulse_feed(struct gpiod_pulse_decoder *dec,
+		      const struct gpiod_line_event *event)
+{
+	const int64_t ns = (int64_t)event->ts.tv_sec * 1000000000LL +
+			   event->ts.tv_nsec;
+	const int level = event->event_type != GPIOD_LINE_EVENT_RISING_EDGE;
+
+	if (dec->last_ns) {
+		const int64_t width = ns - dec->last_ns;
+		switch (dec->protocol) {
+		case GPIOD_PULSE_DHT22:
+			_gpiod_pulse_dht22(dec, level, width, ns);
+			break;
+		case GPIOD_PULSE_NEC:
+			_gpiod_pulse_nec(dec, level, width, ns);
+			break;
+		case GPIOD_PULSE_RC433:
+			_gpiod_pulse_rc433(dec, level, width, ns);
+			break;
+		}
+	}
+	dec->last_ns = ns;
+}
+
+/**
+ * @brief Watcher callback, feeds the decoder.
+ * @param decoder Decoder of a gpiod_pulse_decoder.
+ * @param index Index of the line (always 0).
+ * @param event Edge event.
+ */
+static void _gpiod_pulse_decode(struct gpiod_isr_decoder *decoder,
+				unsigned int index,
+				const struct gpiod_line_event *event)
+{
+	(void)index;
+	gpiod_pulse_feed((struct gpiod_pulse_decoder *)decoder, event);
+}
+
+/**
+ * @brief Initialize a decoder.
+ * @param dec Decoder.
+ * @param protocol GPIOD_PULSE_DHT22, GPIOD_PULSE_NEC or GPIOD_PULSE_RC433.
+ * @param handler Called for each frame, can be NULL.
+ * @param data User data stored in the decoder.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pulse_init(struct gpiod_pulse_decoder *dec, int protocol,
+		     void (*handler)(struct gpiod_pulse_decoder *,
+				     const struct gpiod_pulse_frame *),
+		     void *data)
+{
+	if (!dec || protocol < GPIOD_PULSE_DHT22 ||
+	    protocol > GPIOD_PULSE_RC433) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(dec, 0, sizeof(*dec));
+	dec->decoder.decode = _gpiod_pulse_decode;
+	dec->protocol = protocol;
+	dec->handler = handler;
+	dec->data = data;
+	dec->state = _GPIOD_PULSE_IDLE;
+
+	return 0;
+}
+
+/**
+ * @brief Start decoding the edges of a line.
+ * @param dec Initialized decoder.
+ * @param line GPIO line object.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pulse_request(struct gpiod_pulse_decoder *dec,
+			struct gpiod_line *line, const char *consumer)
+{
+	if (!dec || !line || dec->isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	dec->last_ns = 0;
+	dec->isr = gpiod_isr_request_decoder(
+		line, consumer, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES,
+		&dec->decoder);
+
+	return dec->isr ? 0 : -1;
+}
+
+/**
+ * @brief Stop decoding and release the line.
+ * @param dec Decoder.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pulse_release(struct gpiod_pulse_decoder *dec)
+{
+	if (!dec || !dec->isr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = gpiod_isr_release(dec->isr);
+	dec->isr = NULL;
+	return ret;
+}
+
+/**
+ * @brief Get the relative humidity from a DHT22 frame.
+ * @param frame DHT22 frame.
+ * @return Relative humidity (%).
+ */
+static inline double
+gpiod_pulse_dht22_humidity(const struct gpiod_pulse_frame *frame)
+{
+	return ((frame->data[0] << 8) | frame->data[1]) / 10.0;
+}
+
+/**
+ * @brief Get the temperature from a DHT22 frame.
+ * @param frame DHT22 frame.
+ * @return Temperature (°C).
+ */
+static inline double
+gpiod_pulse_dht22_temperature(const struct gpiod_pulse_frame *frame)
+{
+	const double t = (((frame->data[2] & 0x7f) << 8) | frame->data[3]) /
+			 10.0;
+	return frame->data[2] & 0x80 ? -t : t;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_PULSE_H
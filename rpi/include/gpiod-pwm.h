@@ -0,0 +1,565 @@
+/**
+ * @brief Software PWM on up to 32 ordinary GPIO lines driven by a single thread
+ *
+ * @file gpiod-pwm.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-22
+ *
+ * @details
+ * The Raspberry Pi only has two hardware PWM channels (see pwm.h), this drives LEDs (or anything slow enough)
+ * on any output line instead.
+ *
+ * Every channel shares the same period. When the duty cycles change, the toggles of a period are computed once
+ * and sorted by time, channels that switch off at the same time are merged in a single step.
+ * A single thread then sleeps until each step with absolute deadlines and writes every line of the step at once
+ * through an output group (gpiod-output.h), so a period costs one write to switch on plus one write per distinct duty cycle.
+ *
+ * Channels can also fade from a duty cycle to another (dimming), the duty cycle is updated at every period.
+ * The wakeup latency (jitter) of the thread and its CPU usage are measured to check that the frequency is sustainable.
+ *
+ * The thread is gated with runtime PM (see runtime-pm.h): once every channel has been off for
+ * @ref GPIOD_PWM_AUTOSUSPEND_MS, it stops waking up every period and sleeps until a channel is switched on again.
+ * Short off times do not pay the restart, an idle PWM does not use any CPU.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct gpiod_pwm pwm;
+ * // 200 Hz, lines are active low (bit i set for channel i)
+ * gpiod_pwm_init(&pwm, &bulk, "leds", 200, 0xf);
+ *
+ * gpiod_pwm_set(&pwm, 0, GPIOD_PWM_RESOLUTION / 4); // 25 %
+ * gpiod_pwm_fade(&pwm, 1, GPIOD_PWM_RESOLUTION, 2000); // Fade in over 2 s
+ *
+ * struct gpiod_pwm_stats stats;
+ * gpiod_pwm_stats(&pwm, &stats);
+ *
+ * gpiod_pwm_release(&pwm);
+ * ```
+ *
+ * @note For a steadier output, run the program with a real-time priority (e.g. `chrt -f 50`).
+ * @warning This uses pthread, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef GPIOD_PWM_H
+#define GPIOD_PWM_H
+
+#include <gpiod-output.h>
+#include <runtime-pm.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of channels. */
+#define GPIOD_PWM_MAX_CHANNELS 32
+/** @brief Duty cycle of a channel always on. */
+#define GPIOD_PWM_RESOLUTION 1000
+#ifndef GPIOD_PWM_AUTOSUSPEND_MS
+/** @brief Default time with every channel off before the thread stops (ms). */
+#define GPIOD_PWM_AUTOSUSPEND_MS 100
+#endif
+
+/**
+ * @brief Step of the toggle schedule.
+ */
+struct gpiod_pwm_step {
+	int64_t offset_ns;
+	///< Time since the start of the period
+	uint32_t mask;
+	///< Channels switching off at this time
+};
+
+/**
+ * @brief Statistics of the PWM thread.
+ */
+struct gpiod_pwm_stats {
+	unsigned long periods;
+	///< Number of periods generated
+	unsigned long writes;
+	///< Number of writes to the lines
+	int64_t jitter_max_ns;
+	///< Highest wakeup latency
+	int64_t jitter_mean_ns;
+	///< Mean wakeup latency
+	double cpu_usage;
+	///< CPU time used by the thread over wall time (0 to 1)
+};
+
+/**
+ * @brief Software PWM.
+ */
+struct gpiod_pwm {
+	struct gpiod_output_group out;
+	///< Lines driven, one per channel
+	unsigned int num_channels;
+	///< Number of channels
+	int64_t period_ns;
+	///< Period shared by every channel
+	uint32_t inverted;
+	///< Channels driven active low
+	double duty[GPIOD_PWM_MAX_CHANNELS];
+	///< Current duty cycle of each channel
+	double target[GPIOD_PWM_MAX_CHANNELS];
+	///< Duty cycle each channel fades to
+	double fade_step[GPIOD_PWM_MAX_CHANNELS];
+	///< Change of the duty cycle at each period while fading
+	uint32_t fading;
+	///< Channels fading
+	int dirty;
+	///< Duty cycles changed, the schedule has to be computed again
+	uint32_t on_mask;
+	///< Channels switched on at the start of the period
+	struct gpiod_pwm_step steps[GPIOD_PWM_MAX_CHANNELS];
+	///< Toggle schedule, sorted by time
+	unsigned int num_steps;
+	///< Number of steps in the schedule
+	int run;
+	///< Cleared to stop the thread
+	pthread_t thread;
+	///< PWM thread
+	pthread_mutex_t lock;
+	///< Protects the duty cycles and the statistics
+	struct runtime_pm pm;
+	///< Gates the thread while every channel is off
+	int held;
+	///< Whether a channel is on, holding the thread active
+	int gated;
+	///< Set while the thread is stopped
+	pthread_cond_t wakeup;
+	///< Signaled when the thread is ungated
+	struct gpiod_pwm_stats stats;
+	///< Statistics, cpu_usage is computed on request
+	int64_t jitter_sum_ns;
+	///< Sum of the wakeup latencies
+	unsigned long wakeups;
+	///< Number of wakeups measured
+	int64_t start_ns;
+	///< Start of the thread (CLOCK_MONOTONIC)
+	int64_t cpu_ns;
+	///< CPU time of the thread at the last period
+	int64_t wall_ns;
+	///< Time of the last period since the start
+};
+
+/**
+ * @brief Get the time of a clock.
+ * @param clock Clock.
+ * @return Time (ns).
+ */
+static inline int64_t _gpiod_pwm_clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Sleep until an absolute deadline and measure how late the thread woke up.
+ * @param deadline CLOCK_MONOTONIC deadline (ns).
+ * @return Wakeup latency (ns).
+ */
+static int64_t _gpiod_pwm_sleep_until(int64_t deadline)
+{
+	struct timespec ts = { .tv_sec = deadline / 1000000000LL,
+			       .tv_nsec = deadline % 1000000000LL };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+
+	return _gpiod_pwm_clock_ns(CLOCK_MONOTONIC) - deadline;
+}
+
+/**
+ * @brief Advance the fades and compute the schedule of the next period, the PWM must be locked.
+ * @param pwm PWM.
+ */
+static void _gpiod_pwm_schedule(struct gpiod_pwm *pwm)
+{
+	for (unsigned int i = 0; i < pwm->num_channels; ++i) {
+		if (!(pwm->fading & (1U << i)))
+			continue;
+		pwm->duty[i] += pwm->fade_step[i];
+		if ((pwm->fade_step[i] > 0 && pwm->duty[i] >= pwm->target[i]) ||
+		    (pwm->fade_step[i] <= 0 && pwm->duty[i] <= pwm->target[i])) {
+			pwm->duty[i] = pwm->target[i];
+			pwm->fading &= ~(1U << i);
+		}
+		pwm->dirty = 1;
+	}
+
+	if (!pwm->dirty)
+		return;
+
+	pwm->on_mask = 0;
+	pwm->num_steps = 0;
+	for (unsigned int i = 0; i < pwm->num_channels; ++i) {
+		const int64_t offset = (int64_t)(pwm->duty[i] * pwm->period_ns /
+						 GPIOD_PWM_RESOLUTION);
+		if (offset <= 0)
+			continue;
+		pwm->on_mask |= 1U << i;
+		if (offset >= pwm->period_ns)
+			continue;
+
+		/* Insert sorted, channels switching off together share a step */
+		unsigned int j = 0;
+		while (j < pwm->num_steps && pwm->steps[j].offset_ns < offset)
+			++j;
+		if (j < pwm->num_steps && pwm->steps[j].offset_ns == offset) {
+			pwm->steps[j].mask |= 1U << i;
+			continue;
+		}
+		memmove(&pwm->steps[j + 1], &pwm->steps[j],
+			(pwm->num_steps - j) * sizeof(*pwm->steps));
+		pwm->steps[j].offset_ns = offset;
+		pwm->steps[j].mask = 1U << i;
+		++pwm->num_steps;
+	}
+	pwm->dirty = 0;
+}
+
+/**
+ * @brief Stop the thread at the start of its next period, runtime PM suspend callback.
+ * @param _pwm PWM.
+ * @return 0.
+ */
+static int _gpiod_pwm_suspend(void *_pwm)
+{
+	struct gpiod_pwm *pwm = (struct gpiod_pwm *)_pwm;
+
+	pthread_mutex_lock(&pwm->lock);
+	pwm->gated = 1;
+	pthread_mutex_unlock(&pwm->lock);
+	return 0;
+}
+
+/**
+ * @brief Restart the thread, runtime PM resume callback.
+ * @param _pwm PWM.
+ * @return 0.
+ */
+static int _gpiod_pwm_resume(void *_pwm)
+{
+	struct gpiod_pwm *pwm = (struct gpiod_pwm *)_pwm;
+
+	pthread_mutex_lock(&pwm->lock);
+	pwm->gated = 0;
+	pthread_cond_signal(&pwm->wakeup);
+	pthread_mutex_unlock(&pwm->lock);
+	return 0;
+}
+
+/**
+ * @brief Check whether a channel is on or fading, the PWM must be locked.
+ * @param pwm PWM.
+ * @return Non-zero if the thread has work to do.
+ */
+static inline int _gpiod_pwm_busy(const struct gpiod_pwm *pwm)
+{
+	if (pwm->fading)
+		return 1;
+	for (unsigned int i = 0; i < pwm->num_channels; ++i)
+		if (pwm->duty[i] > 0)
+			return 1;
+	return 0;
+}
+
+/**
+ * @brief Hold the thread active if a channel was just switched on, the PWM must be locked.
+ * @param pwm PWM.
+ * @return Non-zero if the caller has to call runtime_pm_get once unlocked.
+ */
+static inline int _gpiod_pwm_hold(struct gpiod_pwm *pwm)
+{
+	if (pwm->held || !_gpiod_pwm_busy(pwm))
+		return 0;
+	pwm->held = 1;
+	return 1;
+}
+
+/**
+ * @brief Write the lines of some channels with a single ioctl.
+ * @param pwm PWM.
+ * @param mask Channels to write.
+ * @param on Channels to switch on among them, the others are switched off.
+ * @return 1 if the lines were written, 0 otherwise.
+ */
+static int _gpiod_pwm_write(struct gpiod_pwm *pwm, uint32_t mask, uint32_t on)
+{
+	gpiod_output_group_set_mask(&pwm->out, mask, on ^ pwm->inverted);
+	return gpiod_output_group_flush(&pwm->out) > 0;
+}
+
+/**
+ * @brief Pthread routine generating the PWM.
+ * @param _pwm Pointer to a gpiod_pwm structure.
+ * @return Nothing.
+ */
+static void *_gpiod_pwm_thread(void *_pwm)
+{
+	struct gpiod_pwm *pwm = (struct gpiod_pwm *)_pwm;
+	const uint32_t all = pwm->num_channels == 32 ?
+				     0xffffffffU :
+				     (1U << pwm->num_channels) - 1;
+	int64_t period_start = _gpiod_pwm_clock_ns(CLOCK_MONOTONIC);
+
+	pwm->start_ns = period_start;
+
+	while (__atomic_load_n(&pwm->run, __ATOMIC_RELAXED)) {
+		int64_t late, jitter_max = 0, jitter_sum = 0;
+		unsigned long writes = 0;
+
+		pthread_mutex_lock(&pwm->lock);
+		if (pwm->gated) {
+			/* Every line was switched off by the last period */
+			while (pwm->gated &&
+			       __atomic_load_n(&pwm->run, __ATOMIC_RELAXED))
+				pthread_cond_wait(&pwm->wakeup, &pwm->lock);
+			period_start = _gpiod_pwm_clock_ns(CLOCK_MONOTONIC);
+		}
+		_gpiod_pwm_schedule(pwm);
+		/* Every channel is off, release the thread: it stops after the autosuspend delay */
+		const int release = pwm->held && !_gpiod_pwm_busy(pwm);
+		if (release)
+			pwm->held = 0;
+		pthread_mutex_unlock(&pwm->lock);
+		if (release)
+			runtime_pm_put(&pwm->pm);
+
+		/* The schedule is only changed by this thread, no lock needed to read it */
+		late = _gpiod_pwm_sleep_until(period_start);
+		jitter_sum += late;
+		jitter_max = late > jitter_max ? late : jitter_max;
+		writes += _gpiod_pwm_write(pwm, all, pwm->on_mask);
+
+		for (unsigned int i = 0; i < pwm->num_steps; ++i) {
+			late = _gpiod_pwm_sleep_until(period_start +
+						      pwm->steps[i].offset_ns);
+			jitter_sum += late;
+			jitter_max = late > jitter_max ? late : jitter_max;
+			writes += _gpiod_pwm_write(pwm, pwm->steps[i].mask, 0);
+		}
+
+		period_start += pwm->period_ns;
+		/* Too late for a whole period (thread preempted), skip instead of catching up */
+		const int64_t now = _gpiod_pwm_clock_ns(CLOCK_MONOTONIC);
+		if (now - period_start > pwm->period_ns)
+			period_start = now;
+
+		pthread_mutex_lock(&pwm->lock);
+		++pwm->stats.periods;
+		pwm->stats.writes += writes;
+		if (jitter_max > pwm->stats.jitter_max_ns)
+			pwm->stats.jitter_max_ns = jitter_max;
+		pwm->jitter_sum_ns += jitter_sum;
+		pwm->wakeups += pwm->num_steps + 1;
+		pwm->stats.jitter_mean_ns = pwm->jitter_sum_ns / pwm->wakeups;
+		pwm->cpu_ns = _gpiod_pwm_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+		pwm->wall_ns = now - pwm->start_ns;
+		pthread_mutex_unlock(&pwm->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Request the lines and start the PWM thread, every channel starts off.
+ * @param pwm PWM to initialize.
+ * @param bulk Lines, one per channel (up to 32, same chip).
+ * @param consumer Name of the consumer.
+ * @param frequency Frequency of every channel (Hz).
+ * @param inverted Channels driven active low, bit i for channel i.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pwm_init(struct gpiod_pwm *pwm, struct gpiod_line_bulk *bulk,
+		   const char *consumer, unsigned int frequency,
+		   uint32_t inverted)
+{
+	if (!pwm || !bulk || bulk->num_lines == 0 ||
+	    bulk->num_lines > GPIOD_PWM_MAX_CHANNELS || frequency == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int defaults[GPIOD_PWM_MAX_CHANNELS];
+	for (unsigned int i = 0; i < bulk->num_lines; ++i)
+		defaults[i] = (inverted >> i) & 1;
+
+	memset(pwm, 0, sizeof(*pwm));
+	if (gpiod_output_group_init(&pwm->out, bulk, consumer, defaults) < 0)
+		return -1;
+
+	pwm->num_channels = bulk->num_lines;
+	pwm->period_ns = 1000000000LL / frequency;
+	pwm->inverted = inverted;
+	pwm->run = 1;
+	pthread_mutex_init(&pwm->lock, NULL);
+	pthread_cond_init(&pwm->wakeup, NULL);
+
+	/* Every channel starts off, the thread stops if none is switched on in time */
+	if (runtime_pm_init(&pwm->pm, _gpiod_pwm_suspend, _gpiod_pwm_resume,
+			    pwm, GPIOD_PWM_AUTOSUSPEND_MS, 1) < 0)
+		goto err_pm;
+
+	if (pthread_create(&pwm->thread, NULL, _gpiod_pwm_thread,
+			   (void *)pwm) != 0)
+		goto err_thread;
+
+	return 0;
+
+err_thread:
+	runtime_pm_remove(&pwm->pm);
+err_pm:
+	pthread_cond_destroy(&pwm->wakeup);
+	pthread_mutex_destroy(&pwm->lock);
+	gpiod_output_group_release(&pwm->out);
+	return -1;
+}
+
+/**
+ * @brief Stop the PWM thread, switch every channel off and release the lines.
+ * @param pwm PWM.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pwm_release(struct gpiod_pwm *pwm)
+{
+	if (!pwm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	runtime_pm_remove(&pwm->pm);
+	pthread_mutex_lock(&pwm->lock);
+	__atomic_store_n(&pwm->run, 0, __ATOMIC_RELAXED);
+	pthread_cond_signal(&pwm->wakeup);
+	pthread_mutex_unlock(&pwm->lock);
+	pthread_join(pwm->thread, NULL);
+
+	gpiod_output_group_set_mask(&pwm->out, 0xffffffffU, pwm->inverted);
+	gpiod_output_group_flush(&pwm->out);
+	gpiod_output_group_release(&pwm->out);
+	pthread_cond_destroy(&pwm->wakeup);
+	pthread_mutex_destroy(&pwm->lock);
+	return 0;
+}
+
+/**
+ * @brief Change the time with every channel off before the thread stops.
+ * @param pwm PWM.
+ * @param delay_ms Delay (ms), 0 to stop as soon as every channel is off, negative to never stop.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pwm_set_autosuspend(struct gpiod_pwm *pwm, int delay_ms)
+{
+	if (!pwm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return runtime_pm_set_autosuspend(&pwm->pm, delay_ms);
+}
+
+/**
+ * @brief Set the duty cycle of a channel, applied from the next period.
+ * @param pwm PWM.
+ * @param channel Channel.
+ * @param duty Duty cycle, from 0 to @ref GPIOD_PWM_RESOLUTION.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pwm_set(struct gpiod_pwm *pwm, unsigned int channel,
+		  unsigned int duty)
+{
+	if (!pwm || channel >= pwm->num_channels ||
+	    duty > GPIOD_PWM_RESOLUTION) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&pwm->lock);
+	pwm->duty[channel] = pwm->target[channel] = duty;
+	pwm->fading &= ~(1U << channel);
+	pwm->dirty = 1;
+	const int hold = _gpiod_pwm_hold(pwm);
+	pthread_mutex_unlock(&pwm->lock);
+
+	return hold ? runtime_pm_get(&pwm->pm) : 0;
+}
+
+/**
+ * @brief Fade a channel from its current duty cycle to another one.
+ * @param pwm PWM.
+ * @param channel Channel.
+ * @param duty Final duty cycle, from 0 to @ref GPIOD_PWM_RESOLUTION.
+ * @param duration_ms Duration of the fade (ms).
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_pwm_fade(struct gpiod_pwm *pwm, unsigned int channel,
+		   unsigned int duty, unsigned int duration_ms)
+{
+	if (!pwm || channel >= pwm->num_channels ||
+	    duty > GPIOD_PWM_RESOLUTION) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const double periods = duration_ms * 1000000.0 / pwm->period_ns;
+	if (periods < 1.0)
+		return gpiod_pwm_set(pwm, channel, duty);
+
+	pthread_mutex_lock(&pwm->lock);
+	pwm->target[channel] = duty;
+	pwm->fade_step[channel] = (duty - pwm->duty[channel]) / periods;
+	pwm->fading |= 1U << channel;
+	const int hold = _gpiod_pwm_hold(pwm);
+	pthread_mutex_unlock(&pwm->lock);
+
+	return hold ? runtime_pm_get(&pwm->pm) : 0;
+}
+
+/**
+ * @brief Get the current duty cycle of a channel (changes while fading).
+ * @param pwm PWM.
+ * @param channel Channel.
+ * @return Duty cycle, from 0 to @ref GPIOD_PWM_RESOLUTION, -1 on failure.
+ */
+int gpiod_pwm_get(struct gpiod_pwm *pwm, unsigned int channel)
+{
+	if (!pwm || channel >= pwm->num_channels) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&pwm->lock);
+	const int duty = (int)(pwm->duty[channel] + 0.5);
+	pthread_mutex_unlock(&pwm->lock);
+
+	return duty;
+}
+
+/**
+ * @brief Get the statistics of the PWM thread.
+ * @param pwm PWM.
+ * @param stats Filled with the statistics.
+ */
+void gpiod_pwm_stats(struct gpiod_pwm *pwm, struct gpiod_pwm_stats *stats)
+{
+	pthread_mutex_lock(&pwm->lock);
+	*stats = pwm->stats;
+	stats->cpu_usage = pwm->wall_ns ? (double)pwm->cpu_ns / pwm->wall_ns :
+					  0.0;
+	pthread_mutex_unlock(&pwm->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_PWM_H
@@ -0,0 +1,295 @@
+/**
+ * @brief Quadrature encoder decoding inside the gpiod-isr watcher
+ *
+ * @file gpiod-quadrature.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-18
+ *
+ * @details
+ * Decodes the A/B signals of a rotary encoder directly in the watcher thread of gpiod-isr.
+ * Both lines are watched for both edges, the level of the line that changed is given by the type of
+ * the event and the level of the other line is remembered from its last edge, so no extra
+ * `gpiod_line_get_value` call is needed per edge (the lines are only read once when the watcher starts).
+ *
+ * Every edge is counted (x4 decoding) using a state-transition table.
+ * An edge that does not change the state means at least one edge was missed, it is counted as an error
+ * and the decoder resynchronizes on the level given by the event.
+ *
+ * Position, velocity and error counters are written by the watcher only and can be read from any thread
+ * without locking.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct gpiod_quadrature enc;
+ * gpiod_quadrature_init(&enc, gpiod_chip_get_line(chip, 23), gpiod_chip_get_line(chip, 24), "encoder");
+ *
+ * printf("Position: %ld (%.1f counts/s)\n", gpiod_quadrature_position(&enc), gpiod_quadrature_velocity(&enc));
+ *
+ * gpiod_quadrature_release(&enc);
+ * ```
+ *
+ * @warning This uses gpiod-isr, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef GPIOD_QUADRATURE_H
+#define GPIOD_QUADRATURE_H
+
+#include <gpiod-isr.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GPIOD_QUADRATURE_STOP_NS
+/** @brief Time without any count after which the encoder is considered stopped (ns). */
+#define GPIOD_QUADRATURE_STOP_NS 500000000LL
+#endif
+
+/** @brief The A/B state did not change, at least one edge was missed. */
+#define GPIOD_QUADRATURE_SKIP 2
+
+/**
+ * @brief Quadrature state-transition table.
+ *
+ * Indexed by `(old_state << 2) | new_state` where a state is `(A << 1) | B`.
+ * Gives +1 or -1 for a valid transition, 0 when both lines changed at once (impossible with edges)
+ * and @ref GPIOD_QUADRATURE_SKIP when nothing changed.
+ */
+static const int8_t _gpiod_quadrature_table[16] = {
+	GPIOD_QUADRATURE_SKIP, +1, -1, 0,
+	-1, GPIOD_QUADRATURE_SKIP, 0, +1,
+	+1, 0, GPIOD_QUADRATURE_SKIP, -1,
+	0, -1, +1, GPIOD_QUADRATURE_SKIP,
+};
+
+/**
+ * @brief Quadrature encoder decoder.
+ */
+struct gpiod_quadrature {
+	struct gpiod_isr_decoder decoder;
+	///< Decoder registered in the watcher, must be the first member
+	struct gpiod_line_bulk lines;
+	///< A and B lines
+	struct gpiod_isr_bulk *isr;
+	///< Watcher of both lines
+	unsigned int state;
+	///< Current (A << 1) | B state, only used by the watcher
+	int64_t sync_ns;
+	///< Events older than this were already seen when reading the initial state
+	long position;
+	///< Position in counts (4 per cycle)
+	unsigned long edges;
+	///< Number of edges decoded
+	unsigned long errors;
+	///< Number of missed edges detected
+	int64_t last_ns;
+	///< Timestamp of the last count
+	int64_t period_ns;
+	///< Time between the last two counts, negative when going backward
+};
+
+/**
+ * @brief Convert an event timestamp to nanoseconds.
+ * @param ts Timestamp.
+ * @return Nanoseconds.
+ */
+static inline int64_t _gpiod_quadrature_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+/**
+ * @brief Read the initial state of the lines, called by the watcher before waiting for events.
+ * @param decoder Decoder of a gpiod_quadrature.
+ * @param lines A and B lines.
+ * @param num_lines Number of lines (2).
+ */
+static void _gpiod_quadrature_start(struct gpiod_isr_decoder *decoder,
+				    struct gpiod_line **lines,
+				    unsigned int num_lines)
+{
+	struct gpiod_quadrature *enc = (struct gpiod_quadrature *)decoder;
+	struct timespec now;
+	(void)num_lines;
+
+	int a = gpiod_line_get_value(lines[0]);
+	int b = gpiod_line_get_value(lines[1]);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	enc->state = ((a > 0) << 1) | (b > 0);
+	enc->sync_ns = _gpiod_quadrature_ns(&now);
+}
+
+/**
+ * @brief Decode a single edge, called by the watcher.
+ * @param decoder Decoder of a gpiod_quadrature.
+ * @param index 0 for A, 1 for B.
+ * @param event Edge event.
+ */
+static void _gpiod_quadrature_decode(struct gpiod_isr_decoder *decoder,
+				     unsigned int index,
+				     const struct gpiod_line_event *event)
+{
+	struct gpiod_quadrature *enc = (struct gpiod_quadrature *)decoder;
+	const int64_t ns = _gpiod_quadrature_ns(&event->ts);
+
+	/* Already part of the initial state */
+	if (ns <= enc->sync_ns)
+		return;
+
+	const unsigned int mask = index == 0 ? 2 : 1;
+	const unsigned int state =
+		event->event_type == GPIOD_LINE_EVENT_RISING_EDGE ?
+			enc->state | mask :
+			enc->state & ~mask;
+	const int step = _gpiod_quadrature_table[(enc->state << 2) | state];
+
+	enc->state = state;
+	__atomic_store_n(&enc->edges, enc->edges + 1, __ATOMIC_RELAXED);
+
+	if (step == GPIOD_QUADRATURE_SKIP || step == 0) {
+		__atomic_store_n(&enc->errors, enc->errors + 1,
+				 __ATOMIC_RELAXED);
+		return;
+	}
+
+	__atomic_fetch_add(&enc->position, step, __ATOMIC_RELAXED);
+	if (enc->last_ns)
+		__atomic_store_n(&enc->period_ns, (ns - enc->last_ns) * step,
+				 __ATOMIC_RELAXED);
+	__atomic_store_n(&enc->last_ns, ns, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Start decoding a quadrature encoder.
+ * @param enc Encoder to initialize.
+ * @param a Line of the A signal.
+ * @param b Line of the B signal, must be on the same chip as A.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_quadrature_init(struct gpiod_quadrature *enc, struct gpiod_line *a,
+			  struct gpiod_line *b, const char *consumer)
+{
+	if (!enc || !a || !b) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	enc->decoder.start = _gpiod_quadrature_start;
+	enc->decoder.decode = _gpiod_quadrature_decode;
+	gpiod_line_bulk_init(&enc->lines);
+	gpiod_line_bulk_add(&enc->lines, a);
+	gpiod_line_bulk_add(&enc->lines, b);
+	enc->state = 0;
+	enc->sync_ns = INT64_MAX;
+	enc->position = 0;
+	enc->edges = 0;
+	enc->errors = 0;
+	enc->last_ns = 0;
+	enc->period_ns = 0;
+
+	enc->isr = gpiod_isr_request_bulk_decoder(
+		&enc->lines, consumer, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES,
+		&enc->decoder);
+
+	return enc->isr ? 0 : -1;
+}
+
+/**
+ * @brief Stop decoding and release the lines.
+ * @param enc Encoder.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_quadrature_release(struct gpiod_quadrature *enc)
+{
+	if (!enc) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = gpiod_isr_release_bulk(enc->isr);
+	enc->isr = NULL;
+	return ret;
+}
+
+/**
+ * @brief Get the current position.
+ * @param enc Encoder.
+ * @return Position in counts (4 per cycle).
+ */
+static inline long gpiod_quadrature_position(struct gpiod_quadrature *enc)
+{
+	return __atomic_load_n(&enc->position, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Set the position back to 0.
+ * @param enc Encoder.
+ * @return Position before the reset.
+ */
+static inline long gpiod_quadrature_reset(struct gpiod_quadrature *enc)
+{
+	return __atomic_exchange_n(&enc->position, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the number of missed edges detected.
+ * @param enc Encoder.
+ * @return Number of errors.
+ */
+static inline unsigned long
+gpiod_quadrature_errors(struct gpiod_quadrature *enc)
+{
+	return __atomic_load_n(&enc->errors, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the number of edges decoded.
+ * @param enc Encoder.
+ * @return Number of edges.
+ */
+static inline unsigned long gpiod_quadrature_edges(struct gpiod_quadrature *enc)
+{
+	return __atomic_load_n(&enc->edges, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the current velocity.
+ * @param enc Encoder.
+ * @return Velocity in counts per second, negative when going backward.
+ *
+ * The velocity comes from the time between the last two counts.
+ * When no count happened for longer than that, the time since the last count is used instead
+ * so the velocity decays toward 0, and it is 0 after @ref GPIOD_QUADRATURE_STOP_NS.
+ */
+double gpiod_quadrature_velocity(struct gpiod_quadrature *enc)
+{
+	struct timespec now;
+
+	const int64_t last = __atomic_load_n(&enc->last_ns, __ATOMIC_ACQUIRE);
+	const int64_t period = __atomic_load_n(&enc->period_ns,
+					       __ATOMIC_RELAXED);
+	if (!last || !period)
+		return 0.0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const int64_t elapsed = _gpiod_quadrature_ns(&now) - last;
+	if (elapsed > GPIOD_QUADRATURE_STOP_NS)
+		return 0.0;
+
+	const int64_t abs_period = period < 0 ? -period : period;
+	if (elapsed > abs_period)
+		return (period < 0 ? -1e9 : 1e9) / elapsed;
+
+	return 1e9 / period;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_QUADRATURE_H
@@ -0,0 +1,360 @@
+/**
+ * @brief Process-wide registry of GPIO chips and lines shared by the drivers
+ *
+ * @file gpiod-registry.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-06
+ *
+ * @details
+ * Every driver opening `/dev/gpiochip0` on its own costs one open() and one chip info ioctl each time,
+ * and finding a line by name with `gpiod_chip_find_line` asks the kernel for the info of every line of the chip.
+ * The registry keeps one handle per chip for the whole process:
+ * - @ref gpiod_registry_chip_get opens the chip the first time and counts references afterwards.
+ * - @ref gpiod_registry_chip_put drops a reference, the chip stays open so that the next user
+ *   (e.g. `tlc1543_get_sample_standalone()` called in a loop) does not reopen it.
+ *   @ref gpiod_registry_trim closes the chips nobody uses anymore.
+ * - The names of the lines of a chip are read once, at the first lookup by name, into a hash table:
+ *   @ref gpiod_registry_find_line is then a few string compares, without any system call.
+ *
+ * Lines are taken and given back with @ref gpiod_registry_line_get (or @ref gpiod_registry_line_find by name)
+ * and @ref gpiod_registry_line_put, which hold a reference on their chip.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct gpiod_line *led = gpiod_registry_line_find("/dev/gpiochip0", "GPIO17");
+ * gpiod_line_request_output(led, "led", 0);
+ *
+ * gpiod_registry_line_put(led); // Released, the chip stays open
+ * gpiod_registry_trim();        // Close the chips left unused
+ * ```
+ *
+ * @note Every function is thread-safe.
+ * @warning Chips from the registry must not be closed with `gpiod_chip_close`.
+ */
+
+#ifndef GPIOD_REGISTRY_H
+#define GPIOD_REGISTRY_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <gpiod.h>
+
+#ifdef LIBGPIOD_V2
+#include "gpiod-v1-compat.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GPIOD_REGISTRY_MAX_CHIPS
+/** @brief Maximum number of chips opened at the same time. */
+#define GPIOD_REGISTRY_MAX_CHIPS 4
+#endif
+
+/** @brief Maximum number of lines of a chip indexed by name. */
+#define GPIOD_REGISTRY_MAX_LINES 64
+/** @brief Number of slots of the name index, a power of 2 at least twice the number of lines. */
+#define GPIOD_REGISTRY_NAME_SLOTS 128
+/** @brief Maximum length of a chip path or line name, including the terminating null byte. */
+#define GPIOD_REGISTRY_NAME_LEN 32
+
+/**
+ * @brief Chip opened through the registry.
+ */
+struct gpiod_registry_chip {
+	struct gpiod_chip *chip;
+	///< Chip handle, NULL if the entry is unused
+	char path[GPIOD_REGISTRY_NAME_LEN];
+	///< Path the chip was opened with
+	unsigned int refs;
+	///< Number of users, the chip stays open at 0 until trimmed
+	int indexed;
+	///< Whether the names of the lines were read
+	unsigned int num_lines;
+	///< Number of lines indexed
+	char names[GPIOD_REGISTRY_MAX_LINES][GPIOD_REGISTRY_NAME_LEN];
+	///< Name of each line, by offset
+	uint8_t slots[GPIOD_REGISTRY_NAME_SLOTS];
+	///< Name index, offset + 1 of the line, 0 when the slot is free
+};
+
+/** @brief Chips of the process. */
+static struct gpiod_registry_chip _gpiod_registry[GPIOD_REGISTRY_MAX_CHIPS];
+/** @brief Protects the registry. */
+static pthread_mutex_t _gpiod_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Hash a line name (FNV-1a).
+ * @param name Line name.
+ * @return First slot of the name in the index.
+ */
+static inline unsigned int _gpiod_registry_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return hash & (GPIOD_REGISTRY_NAME_SLOTS - 1);
+}
+
+/**
+ * @brief Find the entry of a chip handle, lock held.
+ * @param chip Chip handle.
+ * @return Entry, NULL if the chip was not opened through the registry.
+ */
+static struct gpiod_registry_chip *_gpiod_registry_entry(struct gpiod_chip *chip)
+{
+	for (int i = 0; chip && i < GPIOD_REGISTRY_MAX_CHIPS; ++i)
+		if (_gpiod_registry[i].chip == chip)
+			return &_gpiod_registry[i];
+	return NULL;
+}
+
+/**
+ * @brief Read the names of every line of a chip into the index, lock held.
+ * @param entry Chip.
+ * @return 0 on success, -1 on failure.
+ */
+static int _gpiod_registry_index(struct gpiod_registry_chip *entry)
+{
+#ifdef LIBGPIOD_V2
+	struct gpiod_chip_info *info = gpiod_chip_get_info(entry->chip);
+	if (!info)
+		return -1;
+	unsigned int num_lines = gpiod_chip_info_get_num_lines(info);
+	gpiod_chip_info_free(info);
+#else
+	unsigned int num_lines = gpiod_chip_num_lines(entry->chip);
+#endif
+	if (num_lines > GPIOD_REGISTRY_MAX_LINES)
+		num_lines = GPIOD_REGISTRY_MAX_LINES;
+
+	memset(entry->slots, 0, sizeof(entry->slots));
+	for (unsigned int offset = 0; offset < num_lines; ++offset) {
+		const char *name = NULL;
+#ifdef LIBGPIOD_V2
+		/* Line info only, no handle is kept for lines nobody uses */
+		struct gpiod_line_info *line_info =
+			gpiod_chip_get_line_info(entry->chip, offset);
+		if (!line_info)
+			return -1;
+		name = gpiod_line_info_get_name(line_info);
+#else
+		struct gpiod_line *line =
+			gpiod_chip_get_line(entry->chip, offset);
+		if (!line)
+			return -1;
+		name = gpiod_line_name(line);
+#endif
+		entry->names[offset][0] = '\0';
+		if (name)
+			strncat(entry->names[offset], name,
+				GPIOD_REGISTRY_NAME_LEN - 1);
+#ifdef LIBGPIOD_V2
+		gpiod_line_info_free(line_info);
+#endif
+		if (!entry->names[offset][0])
+			continue;
+
+		/* Linear probing, the first line wins when names are repeated */
+		unsigned int slot = _gpiod_registry_hash(entry->names[offset]);
+		while (entry->slots[slot]) {
+			if (strcmp(entry->names[entry->slots[slot] - 1],
+				   entry->names[offset]) == 0)
+				break;
+			slot = (slot + 1) & (GPIOD_REGISTRY_NAME_SLOTS - 1);
+		}
+		if (!entry->slots[slot])
+			entry->slots[slot] = offset + 1;
+	}
+
+	entry->num_lines = num_lines;
+	entry->indexed = 1;
+	return 0;
+}
+
+/**
+ * @brief Get a chip, opened the first time it is asked for.
+ * @param path GPIO chip device path (e.g. "/dev/gpiochip0").
+ * @return Chip handle, NULL on failure.
+ * @note Give it back with @ref gpiod_registry_chip_put.
+ */
+struct gpiod_chip *gpiod_registry_chip_get(const char *path)
+{
+	if (!path || strlen(path) >= GPIOD_REGISTRY_NAME_LEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct gpiod_registry_chip *entry = NULL;
+	struct gpiod_chip *chip = NULL;
+
+	pthread_mutex_lock(&_gpiod_registry_lock);
+	for (int i = 0; i < GPIOD_REGISTRY_MAX_CHIPS; ++i) {
+		if (_gpiod_registry[i].chip &&
+		    strcmp(_gpiod_registry[i].path, path) == 0) {
+			entry = &_gpiod_registry[i];
+			break;
+		}
+		if (!entry && !_gpiod_registry[i].chip)
+			entry = &_gpiod_registry[i];
+	}
+
+	if (!entry) {
+		errno = ENOMEM;
+	} else if (entry->chip) {
+		++entry->refs;
+		chip = entry->chip;
+	} else {
+		chip = gpiod_chip_open(path);
+		if (chip) {
+			memset(entry, 0, sizeof(*entry));
+			entry->chip = chip;
+			strcpy(entry->path, path);
+			entry->refs = 1;
+		}
+	}
+	pthread_mutex_unlock(&_gpiod_registry_lock);
+
+	return chip;
+}
+
+/**
+ * @brief Give back a chip, it stays open until @ref gpiod_registry_trim.
+ * @param chip Chip handle from @ref gpiod_registry_chip_get.
+ */
+void gpiod_registry_chip_put(struct gpiod_chip *chip)
+{
+	pthread_mutex_lock(&_gpiod_registry_lock);
+	struct gpiod_registry_chip *entry = _gpiod_registry_entry(chip);
+	if (entry && entry->refs > 0)
+		--entry->refs;
+	pthread_mutex_unlock(&_gpiod_registry_lock);
+}
+
+/**
+ * @brief Close the chips nobody uses anymore.
+ * @return Number of chips closed.
+ */
+int gpiod_registry_trim(void)
+{
+	int closed = 0;
+
+	pthread_mutex_lock(&_gpiod_registry_lock);
+	for (int i = 0; i < GPIOD_REGISTRY_MAX_CHIPS; ++i) {
+		if (!_gpiod_registry[i].chip || _gpiod_registry[i].refs > 0)
+			continue;
+		gpiod_chip_close(_gpiod_registry[i].chip);
+		_gpiod_registry[i].chip = NULL;
+		++closed;
+	}
+	pthread_mutex_unlock(&_gpiod_registry_lock);
+
+	return closed;
+}
+
+/**
+ * @brief Find the offset of a line by name.
+ * @param chip Chip handle from @ref gpiod_registry_chip_get.
+ * @param name Line name (e.g. "GPIO17").
+ * @return Offset of the line, -1 on failure (errno ENOENT if no line has this name).
+ * @note The names are read from the kernel at the first call for a chip, never after.
+ */
+int gpiod_registry_find_line(struct gpiod_chip *chip, const char *name)
+{
+	if (!name) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int offset = -1;
+
+	pthread_mutex_lock(&_gpiod_registry_lock);
+	struct gpiod_registry_chip *entry = _gpiod_registry_entry(chip);
+	if (!entry) {
+		errno = EINVAL;
+	} else if (entry->indexed || _gpiod_registry_index(entry) == 0) {
+		unsigned int slot = _gpiod_registry_hash(name);
+		while (entry->slots[slot]) {
+			if (strcmp(entry->names[entry->slots[slot] - 1],
+				   name) == 0) {
+				offset = entry->slots[slot] - 1;
+				break;
+			}
+			slot = (slot + 1) & (GPIOD_REGISTRY_NAME_SLOTS - 1);
+		}
+		if (offset < 0)
+			errno = ENOENT;
+	}
+	pthread_mutex_unlock(&_gpiod_registry_lock);
+
+	return offset;
+}
+
+/**
+ * @brief Get a line, holding a reference on its chip.
+ * @param path GPIO chip device path (e.g. "/dev/gpiochip0").
+ * @param offset Offset of the line on the chip.
+ * @return Line handle, NULL on failure.
+ * @note Give it back with @ref gpiod_registry_line_put.
+ */
+struct gpiod_line *gpiod_registry_line_get(const char *path,
+					   unsigned int offset)
+{
+	struct gpiod_chip *chip = gpiod_registry_chip_get(path);
+	if (!chip)
+		return NULL;
+
+	struct gpiod_line *line = gpiod_chip_get_line(chip, offset);
+	if (!line)
+		gpiod_registry_chip_put(chip);
+
+	return line;
+}
+
+/**
+ * @brief Get a line by name, holding a reference on its chip.
+ * @param path GPIO chip device path (e.g. "/dev/gpiochip0").
+ * @param name Line name (e.g. "GPIO17").
+ * @return Line handle, NULL on failure (errno ENOENT if no line has this name).
+ * @note Give it back with @ref gpiod_registry_line_put.
+ */
+struct gpiod_line *gpiod_registry_line_find(const char *path,
+					    const char *name)
+{
+	struct gpiod_chip *chip = gpiod_registry_chip_get(path);
+	if (!chip)
+		return NULL;
+
+	const int offset = gpiod_registry_find_line(chip, name);
+	struct gpiod_line *line =
+		offset < 0 ? NULL : gpiod_chip_get_line(chip, offset);
+	if (!line)
+		gpiod_registry_chip_put(chip);
+
+	return line;
+}
+
+/**
+ * @brief Release a line and give back its chip.
+ * @param line Line handle from @ref gpiod_registry_line_get or @ref gpiod_registry_line_find.
+ */
+void gpiod_registry_line_put(struct gpiod_line *line)
+{
+	if (!line)
+		return;
+
+	gpiod_line_release(line);
+	gpiod_registry_chip_put(gpiod_line_get_chip(line));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_REGISTRY_H
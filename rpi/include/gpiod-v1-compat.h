@@ -0,0 +1,733 @@
+/**
+ * @brief Minimal libgpiod v1 line API on top of libgpiod v2
+ *
+ * @file gpiod-v1-compat.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-14
+ *
+ * @details
+ * libgpiod v2 removed the `gpiod_line` and `gpiod_line_bulk` objects, lines are now only reachable
+ * through a `gpiod_line_request` that can hold several lines behind a single file descriptor.
+ *
+ * This header provides the small subset of the v1 line API used by the libraries of this project
+ * (mostly gpiod-isr.h) so that code written against v1 keeps working when compiled with `-DLIBGPIOD_V2`.
+ * A `gpiod_line` is only a handle (chip, offset) onto which a request is attached when the line is reserved.
+ *
+ * Supported functions:
+ * 	- gpiod_chip_get_line(), gpiod_chip_get_lines()
+ * 	- gpiod_line_offset(), gpiod_line_name(), gpiod_line_get_chip(), gpiod_line_is_free()
+ * 	- gpiod_line_request_input(), gpiod_line_request_output(), gpiod_line_request_bulk_input(),
+ * 	  gpiod_line_request_bulk_output(), gpiod_line_request_rising_edge_events(),
+ * 	  gpiod_line_request_falling_edge_events(), gpiod_line_request_both_edges_events()
+ * 	- gpiod_line_get_value(), gpiod_line_set_value(), gpiod_line_get_value_bulk(), gpiod_line_set_value_bulk()
+ * 	- gpiod_line_event_wait(), gpiod_line_event_read(), gpiod_line_event_get_fd()
+ * 	- gpiod_line_release(), gpiod_line_release_bulk()
+ * 	- gpiod_line_bulk_init(), gpiod_line_bulk_add()
+ *
+ * This covers the drivers built on line handles (arpi600/tlc1543.h, arpi600/tlc1543-group.h, gpiod-registry.h)
+ * and the edge awaitable of event-loop.hpp.
+ * A bulk request holds every line of the set behind one v2 request, so reading or writing the set is a single ioctl.
+ *
+ * @note Line handles are kept in a static table (@ref GPIOD_COMPAT_MAX_LINES entries) and are owned by their chip,
+ * exactly like v1: closing the chip with gpiod_chip_close() releases its lines and frees their slots.
+ * @warning Only include this header when compiling against libgpiod v2.
+ */
+
+#ifndef GPIOD_V1_COMPAT_H
+#define GPIOD_V1_COMPAT_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <gpiod.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GPIOD_COMPAT_MAX_LINES
+/** @brief Maximum number of distinct line handles that can be retrieved. */
+#define GPIOD_COMPAT_MAX_LINES 128
+#endif
+
+/** @brief Maximum number of lines in a bulk object (same as v1). */
+#define GPIOD_LINE_BULK_MAX_LINES 64
+
+/**
+ * @name Request and event types (same values as v1)
+ * @{
+ */
+#define GPIOD_LINE_REQUEST_DIRECTION_AS_IS 1
+#define GPIOD_LINE_REQUEST_DIRECTION_INPUT 2
+#define GPIOD_LINE_REQUEST_DIRECTION_OUTPUT 3
+#define GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE 4
+#define GPIOD_LINE_REQUEST_EVENT_RISING_EDGE 5
+#define GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES 6
+
+#define GPIOD_LINE_EVENT_RISING_EDGE 1
+#define GPIOD_LINE_EVENT_FALLING_EDGE 2
+/**
+ * @}
+ */
+
+/**
+ * @brief Handle to a GPIO line, equivalent of the v1 object.
+ */
+struct gpiod_line {
+	struct gpiod_chip *chip;
+	///< Chip the line belongs to.
+	unsigned int offset;
+	///< Offset of the line on the chip.
+	struct gpiod_line_request *request;
+	///< Request holding the line, NULL if not reserved.
+	char name[32];
+	///< Cached line name.
+	struct gpiod_edge_event_buffer *events;
+	///< Buffer of gpiod_line_event_read(), allocated on first use.
+};
+
+/**
+ * @brief Set of lines, equivalent of the v1 object.
+ */
+struct gpiod_line_bulk {
+	struct gpiod_line *lines[GPIOD_LINE_BULK_MAX_LINES];
+	///< Lines in the set.
+	unsigned int num_lines;
+	///< Number of lines in the set.
+};
+
+/** @brief Static initializer for a gpiod_line_bulk. */
+#define GPIOD_LINE_BULK_INITIALIZER \
+	{                           \
+		{ NULL }, 0         \
+	}
+
+/**
+ * @brief Event read on a line, equivalent of the v1 object.
+ */
+struct gpiod_line_event {
+	struct timespec ts;
+	///< Time of the event (CLOCK_MONOTONIC).
+	int event_type;
+	///< GPIOD_LINE_EVENT_RISING_EDGE or GPIOD_LINE_EVENT_FALLING_EDGE.
+};
+
+/** @brief Table of every line handle given out. */
+static struct gpiod_line _gpiod_compat_lines[GPIOD_COMPAT_MAX_LINES];
+/** @brief Number of slots used in the table, free slots below it have no chip. */
+static unsigned int _gpiod_compat_num_lines = 0;
+/** @brief Protects the table of line handles. */
+static pthread_mutex_t _gpiod_compat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Initialize a set of lines.
+ * @param bulk Set of lines.
+ */
+static inline void gpiod_line_bulk_init(struct gpiod_line_bulk *bulk)
+{
+	bulk->num_lines = 0;
+}
+
+/**
+ * @brief Add a line to a set of lines.
+ * @param bulk Set of lines.
+ * @param line Line to add.
+ */
+static inline void gpiod_line_bulk_add(struct gpiod_line_bulk *bulk,
+				       struct gpiod_line *line)
+{
+	if (bulk->num_lines < GPIOD_LINE_BULK_MAX_LINES)
+		bulk->lines[bulk->num_lines++] = line;
+}
+
+/**
+ * @brief Retrieve a line handle from a chip.
+ * @param chip GPIO chip.
+ * @param offset Offset of the line on the chip.
+ * @return Line handle, NULL on failure.
+ *
+ * Calling this function twice with the same arguments returns the same handle.
+ */
+struct gpiod_line *gpiod_chip_get_line(struct gpiod_chip *chip,
+				       unsigned int offset)
+{
+	if (!chip) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct gpiod_line *line = NULL;
+	struct gpiod_line *slot = NULL;
+	struct gpiod_line_info *info;
+
+	pthread_mutex_lock(&_gpiod_compat_lock);
+	for (unsigned int i = 0; i < _gpiod_compat_num_lines; ++i) {
+		if (_gpiod_compat_lines[i].chip == chip &&
+		    _gpiod_compat_lines[i].offset == offset) {
+			line = &_gpiod_compat_lines[i];
+			goto out;
+		}
+		if (!slot && !_gpiod_compat_lines[i].chip)
+			slot = &_gpiod_compat_lines[i];
+	}
+
+	if (!slot && _gpiod_compat_num_lines >= GPIOD_COMPAT_MAX_LINES) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	/* Querying the line info also checks that the offset exists */
+	info = gpiod_chip_get_line_info(chip, offset);
+	if (!info)
+		goto out;
+
+	line = slot ? slot : &_gpiod_compat_lines[_gpiod_compat_num_lines++];
+	line->chip = chip;
+	line->offset = offset;
+	line->request = NULL;
+	line->events = NULL;
+	line->name[0] = '\0';
+	if (gpiod_line_info_get_name(info))
+		strncpy(line->name, gpiod_line_info_get_name(info),
+			sizeof(line->name) - 1);
+	gpiod_line_info_free(info);
+
+out:
+	pthread_mutex_unlock(&_gpiod_compat_lock);
+	return line;
+}
+
+/**
+ * @brief Retrieve a set of line handles from a chip.
+ * @param chip GPIO chip.
+ * @param offsets Offsets of the lines.
+ * @param num_offsets Number of offsets.
+ * @param bulk Set of lines to fill.
+ * @return 0 on success, -1 on failure.
+ */
+int gpiod_chip_get_lines(struct gpiod_chip *chip, unsigned int *offsets,
+			 unsigned int num_offsets, struct gpiod_line_bulk *bulk)
+{
+	if (!bulk || !offsets || num_offsets > GPIOD_LINE_BULK_MAX_LINES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	gpiod_line_bulk_init(bulk);
+	for (unsigned int i = 0; i < num_offsets; ++i) {
+		struct gpiod_line *line = gpiod_chip_get_line(chip, offsets[i]);
+		if (!line)
+			return -1;
+		gpiod_line_bulk_add(bulk, line);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the offset of a line.
+ * @param line Line handle.
+ * @return Offset of the line.
+ */
+static inline unsigned int gpiod_line_offset(struct gpiod_line *line)
+{
+	return line->offset;
+}
+
+/**
+ * @brief Get the name of a line.
+ * @param line Line handle.
+ * @return Name of the line, NULL if unnamed.
+ */
+static inline const char *gpiod_line_name(struct gpiod_line *line)
+{
+	return line->name[0] ? line->name : NULL;
+}
+
+/**
+ * @brief Get the chip of a line.
+ * @param line Line handle.
+ * @return Chip the line belongs to.
+ */
+static inline struct gpiod_chip *gpiod_line_get_chip(struct gpiod_line *line)
+{
+	return line->chip;
+}
+
+/**
+ * @brief Whether a line is not reserved by this process.
+ * @param line Line handle.
+ * @return true if the line can be requested.
+ */
+static inline bool gpiod_line_is_free(struct gpiod_line *line)
+{
+	return !line->request;
+}
+
+/**
+ * @brief Reserve a set of lines with a single v2 request.
+ * @param bulk Set of lines, all from the same chip.
+ * @param consumer Name of the consumer.
+ * @param direction Direction of the lines.
+ * @param edge Edge detection of the lines.
+ * @param default_vals Initial values of output lines, NULL for 0.
+ * @return 0 on success, -1 on failure.
+ */
+static int _gpiod_compat_request(struct gpiod_line_bulk *bulk,
+				 const char *consumer,
+				 enum gpiod_line_direction direction,
+				 enum gpiod_line_edge edge,
+				 const int *default_vals)
+{
+	unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+	struct gpiod_line_settings *settings = NULL;
+	struct gpiod_line_config *line_cfg = NULL;
+	struct gpiod_request_config *req_cfg = NULL;
+	struct gpiod_line_request *request = NULL;
+	int ret = -1;
+
+	if (!bulk || bulk->num_lines == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (unsigned int i = 0; i < bulk->num_lines; ++i) {
+		if (bulk->lines[i]->chip != bulk->lines[0]->chip ||
+		    bulk->lines[i]->request) {
+			errno = bulk->lines[i]->request ? EBUSY : EINVAL;
+			return -1;
+		}
+		offsets[i] = bulk->lines[i]->offset;
+	}
+
+	settings = gpiod_line_settings_new();
+	line_cfg = gpiod_line_config_new();
+	req_cfg = gpiod_request_config_new();
+	if (!settings || !line_cfg || !req_cfg)
+		goto cleanup;
+
+	if (gpiod_line_settings_set_direction(settings, direction) < 0 ||
+	    gpiod_line_settings_set_edge_detection(settings, edge) < 0 ||
+	    gpiod_line_settings_set_event_clock(
+		    settings, GPIOD_LINE_CLOCK_MONOTONIC) < 0)
+		goto cleanup;
+
+	if (direction != GPIOD_LINE_DIRECTION_OUTPUT) {
+		if (gpiod_line_config_add_line_settings(
+			    line_cfg, offsets, bulk->num_lines, settings) < 0)
+			goto cleanup;
+	}
+
+	/* Output lines are added one by one, each with its initial value */
+	for (unsigned int i = 0;
+	     direction == GPIOD_LINE_DIRECTION_OUTPUT && i < bulk->num_lines;
+	     ++i) {
+		const int value = default_vals ? default_vals[i] : 0;
+		if (gpiod_line_settings_set_output_value(
+			    settings, value ? GPIOD_LINE_VALUE_ACTIVE :
+					      GPIOD_LINE_VALUE_INACTIVE) < 0 ||
+		    gpiod_line_config_add_line_settings(line_cfg, &offsets[i],
+							1, settings) < 0)
+			goto cleanup;
+	}
+
+	gpiod_request_config_set_consumer(req_cfg, consumer);
+
+	request = gpiod_chip_request_lines(bulk->lines[0]->chip, req_cfg,
+					   line_cfg);
+	if (!request)
+		goto cleanup;
+
+	for (unsigned int i = 0; i < bulk->num_lines; ++i)
+		bulk->lines[i]->request = request;
+	ret = 0;
+
+cleanup:
+	gpiod_request_config_free(req_cfg);
+	gpiod_line_config_free(line_cfg);
+	gpiod_line_settings_free(settings);
+	return ret;
+}
+
+/**
+ * @brief Reserve a single line with a v2 request.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @param direction Direction of the line.
+ * @param edge Edge detection of the line.
+ * @param default_val Initial value of an output line.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int _gpiod_compat_request_line(struct gpiod_line *line,
+					     const char *consumer,
+					     enum gpiod_line_direction direction,
+					     enum gpiod_line_edge edge,
+					     int default_val)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+
+	gpiod_line_bulk_add(&bulk, line);
+	return _gpiod_compat_request(&bulk, consumer, direction, edge,
+				     &default_val);
+}
+
+/**
+ * @brief Reserve a line as an input.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_input(struct gpiod_line *line,
+					   const char *consumer)
+{
+	return _gpiod_compat_request_line(line, consumer,
+					  GPIOD_LINE_DIRECTION_INPUT,
+					  GPIOD_LINE_EDGE_NONE, 0);
+}
+
+/**
+ * @brief Reserve a line as an output.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @param default_val Initial value of the line.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_output(struct gpiod_line *line,
+					    const char *consumer,
+					    int default_val)
+{
+	return _gpiod_compat_request_line(line, consumer,
+					  GPIOD_LINE_DIRECTION_OUTPUT,
+					  GPIOD_LINE_EDGE_NONE, default_val);
+}
+
+/**
+ * @brief Reserve a line for rising edge events.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_rising_edge_events(struct gpiod_line *line,
+							const char *consumer)
+{
+	return _gpiod_compat_request_line(line, consumer,
+					  GPIOD_LINE_DIRECTION_INPUT,
+					  GPIOD_LINE_EDGE_RISING, 0);
+}
+
+/**
+ * @brief Reserve a line for falling edge events.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int
+gpiod_line_request_falling_edge_events(struct gpiod_line *line,
+				       const char *consumer)
+{
+	return _gpiod_compat_request_line(line, consumer,
+					  GPIOD_LINE_DIRECTION_INPUT,
+					  GPIOD_LINE_EDGE_FALLING, 0);
+}
+
+/**
+ * @brief Reserve a line for rising and falling edge events.
+ * @param line Line handle.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_both_edges_events(struct gpiod_line *line,
+						       const char *consumer)
+{
+	return _gpiod_compat_request_line(line, consumer,
+					  GPIOD_LINE_DIRECTION_INPUT,
+					  GPIOD_LINE_EDGE_BOTH, 0);
+}
+
+/**
+ * @brief Reserve a set of lines as inputs, with a single request.
+ * @param bulk Set of lines, all from the same chip.
+ * @param consumer Name of the consumer.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_bulk_input(struct gpiod_line_bulk *bulk,
+						const char *consumer)
+{
+	return _gpiod_compat_request(bulk, consumer, GPIOD_LINE_DIRECTION_INPUT,
+				     GPIOD_LINE_EDGE_NONE, NULL);
+}
+
+/**
+ * @brief Reserve a set of lines as outputs, with a single request.
+ * @param bulk Set of lines, all from the same chip.
+ * @param consumer Name of the consumer.
+ * @param default_vals Initial values of the lines, NULL for 0.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_request_bulk_output(struct gpiod_line_bulk *bulk,
+						 const char *consumer,
+						 const int *default_vals)
+{
+	return _gpiod_compat_request(bulk, consumer,
+				     GPIOD_LINE_DIRECTION_OUTPUT,
+				     GPIOD_LINE_EDGE_NONE, default_vals);
+}
+
+/**
+ * @brief Read the value of a reserved line.
+ * @param line Line handle.
+ * @return 0 or 1, -1 on failure.
+ */
+static inline int gpiod_line_get_value(struct gpiod_line *line)
+{
+	if (!line->request) {
+		errno = EPERM;
+		return -1;
+	}
+	return (int)gpiod_line_request_get_value(line->request, line->offset);
+}
+
+/**
+ * @brief Set the value of a line reserved as an output.
+ * @param line Line handle.
+ * @param value 0 or 1.
+ * @return 0 on success, -1 on failure.
+ */
+static inline int gpiod_line_set_value(struct gpiod_line *line, int value)
+{
+	if (!line->request) {
+		errno = EPERM;
+		return -1;
+	}
+	return gpiod_line_request_set_value(line->request, line->offset,
+					    value ? GPIOD_LINE_VALUE_ACTIVE :
+						    GPIOD_LINE_VALUE_INACTIVE);
+}
+
+/**
+ * @brief Whether every line of a set is held by the same request.
+ * @param bulk Set of lines.
+ * @param offsets Offsets of the lines, filled.
+ * @return 1 if so, 0 otherwise.
+ */
+static inline int _gpiod_compat_same_request(struct gpiod_line_bulk *bulk,
+					     unsigned int *offsets)
+{
+	for (unsigned int i = 0; i < bulk->num_lines; ++i) {
+		if (bulk->lines[i]->request != bulk->lines[0]->request)
+			return 0;
+		offsets[i] = bulk->lines[i]->offset;
+	}
+	return bulk->num_lines > 0 && bulk->lines[0]->request;
+}
+
+/**
+ * @brief Read the values of a set of reserved lines.
+ * @param bulk Set of lines.
+ * @param values Values, one per line.
+ * @return 0 on success, -1 on failure.
+ *
+ * Lines reserved together are read with a single ioctl, otherwise one line at a time.
+ */
+int gpiod_line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values)
+{
+	unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+	enum gpiod_line_value vals[GPIOD_LINE_BULK_MAX_LINES];
+
+	if (_gpiod_compat_same_request(bulk, offsets)) {
+		if (gpiod_line_request_get_values_subset(
+			    bulk->lines[0]->request, bulk->num_lines, offsets,
+			    vals) < 0)
+			return -1;
+		for (unsigned int i = 0; i < bulk->num_lines; ++i)
+			values[i] = vals[i] == GPIOD_LINE_VALUE_ACTIVE;
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < bulk->num_lines; ++i) {
+		values[i] = gpiod_line_get_value(bulk->lines[i]);
+		if (values[i] < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Set the values of a set of lines reserved as outputs.
+ * @param bulk Set of lines.
+ * @param values Values, one per line.
+ * @return 0 on success, -1 on failure.
+ *
+ * Lines reserved together are written with a single ioctl, otherwise one line at a time.
+ */
+int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk, const int *values)
+{
+	unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+	enum gpiod_line_value vals[GPIOD_LINE_BULK_MAX_LINES];
+
+	if (_gpiod_compat_same_request(bulk, offsets)) {
+		for (unsigned int i = 0; i < bulk->num_lines; ++i)
+			vals[i] = values[i] ? GPIOD_LINE_VALUE_ACTIVE :
+					      GPIOD_LINE_VALUE_INACTIVE;
+		return gpiod_line_request_set_values_subset(
+			bulk->lines[0]->request, bulk->num_lines, offsets,
+			vals);
+	}
+
+	for (unsigned int i = 0; i < bulk->num_lines; ++i)
+		if (gpiod_line_set_value(bulk->lines[i], values[i]) < 0)
+			return -1;
+	return 0;
+}
+
+/**
+ * @brief Wait for an event on a line reserved for events.
+ * @param line Line handle.
+ * @param timeout Maximum time to wait, NULL to wait forever.
+ * @return 1 if an event is pending, 0 on timeout, -1 on failure.
+ * @note Events of every line of the request are reported, as they share the same file descriptor.
+ */
+static inline int gpiod_line_event_wait(struct gpiod_line *line,
+					const struct timespec *timeout)
+{
+	if (!line->request) {
+		errno = EPERM;
+		return -1;
+	}
+	const int64_t timeout_ns =
+		timeout ? timeout->tv_sec * 1000000000LL + timeout->tv_nsec :
+			  -1;
+	return gpiod_line_request_wait_edge_events(line->request, timeout_ns);
+}
+
+/**
+ * @brief File descriptor to poll for the events of a line.
+ * @param line Line handle, reserved for events.
+ * @return File descriptor of the request, -1 on failure.
+ */
+static inline int gpiod_line_event_get_fd(struct gpiod_line *line)
+{
+	if (!line->request) {
+		errno = EPERM;
+		return -1;
+	}
+	return gpiod_line_request_get_fd(line->request);
+}
+
+/**
+ * @brief Read the next event of a line reserved for events, blocks if none is pending.
+ * @param line Line handle.
+ * @param event Event read.
+ * @return 0 on success, -1 on failure.
+ * @note The next event of the request is read, which may belong to another line of the same request.
+ */
+int gpiod_line_event_read(struct gpiod_line *line,
+			  struct gpiod_line_event *event)
+{
+	if (!line->request) {
+		errno = EPERM;
+		return -1;
+	}
+	if (!line->events) {
+		line->events = gpiod_edge_event_buffer_new(1);
+		if (!line->events)
+			return -1;
+	}
+	if (gpiod_line_request_read_edge_events(line->request, line->events,
+						1) != 1)
+		return -1;
+
+	struct gpiod_edge_event *edge =
+		gpiod_edge_event_buffer_get_event(line->events, 0);
+	const uint64_t ts = gpiod_edge_event_get_timestamp_ns(edge);
+	event->ts.tv_sec = ts / 1000000000ULL;
+	event->ts.tv_nsec = ts % 1000000000ULL;
+	event->event_type = gpiod_edge_event_get_event_type(edge) ==
+					    GPIOD_EDGE_EVENT_RISING_EDGE ?
+				    GPIOD_LINE_EVENT_RISING_EDGE :
+				    GPIOD_LINE_EVENT_FALLING_EDGE;
+	return 0;
+}
+
+/**
+ * @brief Release every line of a set, the underlying request is released once.
+ * @param bulk Set of lines.
+ */
+void gpiod_line_release_bulk(struct gpiod_line_bulk *bulk)
+{
+	struct gpiod_line_request *request = NULL;
+
+	for (unsigned int i = 0; i < bulk->num_lines; ++i) {
+		struct gpiod_line *line = bulk->lines[i];
+		if (!line->request)
+			continue;
+		if (line->request != request) {
+			request = line->request;
+			gpiod_line_request_release(request);
+		}
+		/* Detach every other line sharing this request */
+		pthread_mutex_lock(&_gpiod_compat_lock);
+		for (unsigned int j = 0; j < _gpiod_compat_num_lines; ++j)
+			if (_gpiod_compat_lines[j].request == request)
+				_gpiod_compat_lines[j].request = NULL;
+		pthread_mutex_unlock(&_gpiod_compat_lock);
+	}
+}
+
+/**
+ * @brief Release a line, this releases the whole request it belongs to.
+ * @param line Line handle.
+ */
+void gpiod_line_release(struct gpiod_line *line)
+{
+	struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
+
+	gpiod_line_bulk_add(&bulk, line);
+	gpiod_line_release_bulk(&bulk);
+}
+
+/**
+ * @brief Close a chip, releasing its lines and freeing their handles.
+ * @param chip GPIO chip.
+ * @note Handles of the lines of the chip must not be used afterwards, like with v1.
+ */
+void gpiod_compat_chip_close(struct gpiod_chip *chip)
+{
+	if (!chip)
+		return;
+
+	pthread_mutex_lock(&_gpiod_compat_lock);
+	for (unsigned int i = 0; i < _gpiod_compat_num_lines; ++i) {
+		struct gpiod_line *line = &_gpiod_compat_lines[i];
+		if (line->chip != chip)
+			continue;
+		if (line->request) {
+			struct gpiod_line_request *request = line->request;
+			gpiod_line_request_release(request);
+			for (unsigned int j = i; j < _gpiod_compat_num_lines;
+			     ++j)
+				if (_gpiod_compat_lines[j].request == request)
+					_gpiod_compat_lines[j].request = NULL;
+		}
+		if (line->events)
+			gpiod_edge_event_buffer_free(line->events);
+		memset(line, 0, sizeof(*line));
+	}
+	/* Give back the free slots at the end of the table */
+	while (_gpiod_compat_num_lines > 0 &&
+	       !_gpiod_compat_lines[_gpiod_compat_num_lines - 1].chip)
+		--_gpiod_compat_num_lines;
+	pthread_mutex_unlock(&_gpiod_compat_lock);
+
+	gpiod_chip_close(chip);
+}
+
+/** @brief Closing a chip also drops its line handles from the table. */
+#define gpiod_chip_close(chip) gpiod_compat_chip_close(chip)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOD_V1_COMPAT_H
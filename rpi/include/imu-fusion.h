@@ -0,0 +1,406 @@
+/**
+ * @brief Fixed-step Madgwick and Mahony orientation filters for IMU batches
+ *
+ * @file imu-fusion.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-04
+ *
+ * @details
+ * Fuses gyroscope and accelerometer samples (and optionally a magnetometer) into an orientation quaternion.
+ * Samples come in batches, e.g. straight from the FIFO of an IMU (see sense-hat/lsm9ds1.h), all spaced by the same
+ * fixed step (1 / output data rate), so no timestamp is needed and the step is computed once.
+ *
+ * Two filters are available:
+ * - Madgwick: gradient descent step towards the measured gravity (and magnetic field), gain `beta`.
+ * - Mahony: proportional-integral feedback of the error between measured and estimated directions, gains `kp` and `ki`.
+ *
+ * The quaternion derivative, the Madgwick gradient and the integration work on the 4 components of the quaternion
+ * at once using GCC vector extensions (NEON on the Raspberry Pi, SSE on x86),
+ * each sample costs a few dozen vector operations and one or two square roots.
+ *
+ * Conventions: gyroscope in rad/s, accelerometer and magnetometer in any unit (they are normalized),
+ * quaternion `q = { w, x, y, z }` rotating the sensor frame to the earth frame.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct imu_fusion fusion;
+ * imu_fusion_init(&fusion, IMU_FUSION_MADGWICK, 476.0f); // Samples at 476 Hz
+ *
+ * struct imu_sample samples[32];
+ * // ... fill samples from the FIFO ...
+ * imu_fusion_update_batch(&fusion, samples, n, NULL); // NULL: no magnetometer
+ *
+ * float roll, pitch, yaw;
+ * imu_fusion_euler(&fusion, &roll, &pitch, &yaw);
+ * ```
+ *
+ * @warning This uses libm, do not forget to add `-lm` when compiling!
+ */
+
+#ifndef IMU_FUSION_H
+#define IMU_FUSION_H
+
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+/* Not part of ISO C, missing with -std=c11 */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_PI_2
+#define M_PI_2 1.57079632679489661923
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Madgwick gradient descent filter. */
+#define IMU_FUSION_MADGWICK 0
+/** @brief Mahony complementary filter. */
+#define IMU_FUSION_MAHONY 1
+
+/** @brief Default Madgwick gain. */
+#define IMU_FUSION_BETA 0.1f
+/** @brief Default Mahony proportional gain. */
+#define IMU_FUSION_KP 0.5f
+/** @brief Default Mahony integral gain. */
+#define IMU_FUSION_KI 0.0f
+
+/** @brief 4 floats processed at once. */
+typedef float _imu_fusion_v4 __attribute__((vector_size(16)));
+
+/**
+ * @brief Sample of an IMU.
+ */
+struct imu_sample {
+	float gyro[3];
+	///< Angular rate around x, y and z (rad/s)
+	float accel[3];
+	///< Acceleration along x, y and z (any unit)
+};
+
+/**
+ * @brief Orientation filter.
+ */
+struct imu_fusion {
+	int algorithm;
+	///< IMU_FUSION_MADGWICK or IMU_FUSION_MAHONY
+	float q[4];
+	///< Orientation quaternion (w, x, y, z)
+	float dt;
+	///< Time between two samples (s)
+	float beta;
+	///< Madgwick gain
+	float kp;
+	///< Mahony proportional gain
+	float ki;
+	///< Mahony integral gain
+	float integral[3];
+	///< Mahony integral of the error (rad/s)
+	unsigned long updates;
+	///< Number of samples fused
+};
+
+/**
+ * @brief Initialize a filter with the default gains, the orientation starts level.
+ * @param fusion Filter to initialize.
+ * @param algorithm IMU_FUSION_MADGWICK or IMU_FUSION_MAHONY.
+ * @param rate_hz Sample rate (Hz).
+ * @return 0 on success, -1 on failure.
+ * @note A rate of 0 (e.g. an LSM9DS1 set to LSM9DS1_ODR_POWER_DOWN) fails with EINVAL.
+ */
+int imu_fusion_init(struct imu_fusion *fusion, int algorithm, float rate_hz)
+{
+	if (!fusion || rate_hz <= 0.0f ||
+	    (algorithm != IMU_FUSION_MADGWICK &&
+	     algorithm != IMU_FUSION_MAHONY)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(fusion, 0, sizeof(*fusion));
+	fusion->algorithm = algorithm;
+	fusion->q[0] = 1.0f;
+	fusion->dt = 1.0f / rate_hz;
+	fusion->beta = IMU_FUSION_BETA;
+	fusion->kp = IMU_FUSION_KP;
+	fusion->ki = IMU_FUSION_KI;
+
+	return 0;
+}
+
+/**
+ * @brief Normalize a 3D vector.
+ * @param v Vector, left as is if null.
+ * @return 0 if the vector was null, 1 otherwise.
+ */
+static inline int _imu_fusion_normalize3(float v[3])
+{
+	const float norm = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+
+	if (norm == 0.0f)
+		return 0;
+
+	const float inv = 1.0f / sqrtf(norm);
+	v[0] *= inv;
+	v[1] *= inv;
+	v[2] *= inv;
+	return 1;
+}
+
+/**
+ * @brief Normalize a quaternion.
+ * @param q Quaternion.
+ * @return Normalized quaternion, q itself if null.
+ */
+static inline _imu_fusion_v4 _imu_fusion_normalize4(_imu_fusion_v4 q)
+{
+	const _imu_fusion_v4 sq = q * q;
+	const float norm = sq[0] + sq[1] + sq[2] + sq[3];
+
+	return norm > 0.0f ? q * (1.0f / sqrtf(norm)) : q;
+}
+
+/**
+ * @brief Derivative of the quaternion for an angular rate: 0.5 * q ⊗ (0, g).
+ * @param q Quaternion (w, x, y, z).
+ * @param g Angular rate (rad/s).
+ * @return Derivative.
+ */
+static inline _imu_fusion_v4 _imu_fusion_rate(_imu_fusion_v4 q, const float g[3])
+{
+	const _imu_fusion_v4 gw = { 0.0f, g[0], g[1], g[2] };
+	const _imu_fusion_v4 gx = { -g[0], 0.0f, -g[2], g[1] };
+	const _imu_fusion_v4 gy = { -g[1], g[2], 0.0f, -g[0] };
+	const _imu_fusion_v4 gz = { -g[2], -g[1], g[0], 0.0f };
+
+	return 0.5f * (q[0] * gw + q[1] * gx + q[2] * gy + q[3] * gz);
+}
+
+/**
+ * @brief Madgwick step of one sample.
+ * @param fusion Filter.
+ * @param q Current quaternion.
+ * @param gyro Angular rate (rad/s).
+ * @param a Normalized acceleration, NULL to only integrate the gyroscope.
+ * @param m Normalized magnetic field, NULL if none.
+ * @return New quaternion.
+ */
+static _imu_fusion_v4 _imu_fusion_madgwick(const struct imu_fusion *fusion,
+					   _imu_fusion_v4 q, const float gyro[3],
+					   const float *a, const float *m)
+{
+	_imu_fusion_v4 dq = _imu_fusion_rate(q, gyro);
+
+	if (a) {
+		const float w = q[0], x = q[1], y = q[2], z = q[3];
+
+		/* Gradient of the gravity error: J_g^T * f_g */
+		const float fg0 = 2.0f * (x * z - w * y) - a[0];
+		const float fg1 = 2.0f * (w * x + y * z) - a[1];
+		const float fg2 = 2.0f * (0.5f - x * x - y * y) - a[2];
+		const _imu_fusion_v4 jg0 = { -2.0f * y, 2.0f * z, -2.0f * w,
+					     2.0f * x };
+		const _imu_fusion_v4 jg1 = { 2.0f * x, 2.0f * w, 2.0f * z,
+					     2.0f * y };
+		const _imu_fusion_v4 jg2 = { 0.0f, -4.0f * x, -4.0f * y, 0.0f };
+		_imu_fusion_v4 s = fg0 * jg0 + fg1 * jg1 + fg2 * jg2;
+
+		if (m) {
+			/* Earth field in the earth frame, only horizontal (bx) and vertical (bz) parts */
+			const float hx =
+				m[0] * (w * w + x * x - y * y - z * z) +
+				2.0f * m[1] * (x * y - w * z) +
+				2.0f * m[2] * (x * z + w * y);
+			const float hy =
+				2.0f * m[0] * (w * z + x * y) +
+				m[1] * (w * w - x * x + y * y - z * z) +
+				2.0f * m[2] * (y * z - w * x);
+			const float bx = sqrtf(hx * hx + hy * hy);
+			const float bz = 2.0f * m[0] * (x * z - w * y) +
+					 2.0f * m[1] * (w * x + y * z) +
+					 m[2] * (w * w - x * x - y * y + z * z);
+
+			/* Gradient of the magnetic error: J_b^T * f_b */
+			const float fb0 = 2.0f * bx * (0.5f - y * y - z * z) +
+					  2.0f * bz * (x * z - w * y) - m[0];
+			const float fb1 = 2.0f * bx * (x * y - w * z) +
+					  2.0f * bz * (w * x + y * z) - m[1];
+			const float fb2 = 2.0f * bx * (w * y + x * z) +
+					  2.0f * bz * (0.5f - x * x - y * y) -
+					  m[2];
+			const _imu_fusion_v4 jb0 = {
+				-2.0f * bz * y, 2.0f * bz * z,
+				-4.0f * bx * y - 2.0f * bz * w,
+				-4.0f * bx * z + 2.0f * bz * x
+			};
+			const _imu_fusion_v4 jb1 = {
+				-2.0f * bx * z + 2.0f * bz * x,
+				2.0f * bx * y + 2.0f * bz * w,
+				2.0f * bx * x + 2.0f * bz * z,
+				-2.0f * bx * w + 2.0f * bz * y
+			};
+			const _imu_fusion_v4 jb2 = { 2.0f * bx * y,
+						     2.0f * bx * z - 4.0f * bz * x,
+						     2.0f * bx * w - 4.0f * bz * y,
+						     2.0f * bx * x };
+			s += fb0 * jb0 + fb1 * jb1 + fb2 * jb2;
+		}
+
+		dq -= fusion->beta * _imu_fusion_normalize4(s);
+	}
+
+	return _imu_fusion_normalize4(q + dq * fusion->dt);
+}
+
+/**
+ * @brief Mahony step of one sample.
+ * @param fusion Filter, its integral is updated.
+ * @param q Current quaternion.
+ * @param gyro Angular rate (rad/s).
+ * @param a Normalized acceleration, NULL to only integrate the gyroscope.
+ * @param m Normalized magnetic field, NULL if none.
+ * @return New quaternion.
+ */
+static _imu_fusion_v4 _imu_fusion_mahony(struct imu_fusion *fusion,
+					 _imu_fusion_v4 q, const float gyro[3],
+					 const float *a, const float *m)
+{
+	float g[3] = { gyro[0], gyro[1], gyro[2] };
+
+	if (a) {
+		const float w = q[0], x = q[1], y = q[2], z = q[3];
+
+		/* Gravity direction estimated from the quaternion */
+		const float vx = 2.0f * (x * z - w * y);
+		const float vy = 2.0f * (w * x + y * z);
+		const float vz = w * w - x * x - y * y + z * z;
+		float e[3] = { a[1] * vz - a[2] * vy, a[2] * vx - a[0] * vz,
+			       a[0] * vy - a[1] * vx };
+
+		if (m) {
+			/* Earth field in the earth frame, then back in the sensor frame */
+			const float hx =
+				2.0f * (m[0] * (0.5f - y * y - z * z) +
+					m[1] * (x * y - w * z) +
+					m[2] * (x * z + w * y));
+			const float hy =
+				2.0f * (m[0] * (x * y + w * z) +
+					m[1] * (0.5f - x * x - z * z) +
+					m[2] * (y * z - w * x));
+			const float bx = sqrtf(hx * hx + hy * hy);
+			const float bz =
+				2.0f * (m[0] * (x * z - w * y) +
+					m[1] * (y * z + w * x) +
+					m[2] * (0.5f - x * x - y * y));
+			const float wx = 2.0f * (bx * (0.5f - y * y - z * z) +
+						 bz * (x * z - w * y));
+			const float wy = 2.0f * (bx * (x * y - w * z) +
+						 bz * (w * x + y * z));
+			const float wz = 2.0f * (bx * (w * y + x * z) +
+						 bz * (0.5f - x * x - y * y));
+
+			e[0] += m[1] * wz - m[2] * wy;
+			e[1] += m[2] * wx - m[0] * wz;
+			e[2] += m[0] * wy - m[1] * wx;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			if (fusion->ki > 0.0f) {
+				fusion->integral[i] +=
+					fusion->ki * e[i] * fusion->dt;
+				g[i] += fusion->integral[i];
+			}
+			g[i] += fusion->kp * e[i];
+		}
+	}
+
+	return _imu_fusion_normalize4(q + _imu_fusion_rate(q, g) * fusion->dt);
+}
+
+/**
+ * @brief Fuse a batch of samples, all spaced by the step of the filter.
+ * @param fusion Filter.
+ * @param samples Samples, oldest first.
+ * @param num_samples Number of samples.
+ * @param mag Magnetic field used for the whole batch (any unit), NULL to only use gravity.
+ */
+void imu_fusion_update_batch(struct imu_fusion *fusion,
+			     const struct imu_sample *samples,
+			     unsigned int num_samples, const float *mag)
+{
+	float m[3];
+	const float *pm = NULL;
+
+	if (mag) {
+		memcpy(m, mag, sizeof(m));
+		pm = _imu_fusion_normalize3(m) ? m : NULL;
+	}
+
+	_imu_fusion_v4 q = { fusion->q[0], fusion->q[1], fusion->q[2],
+			     fusion->q[3] };
+	for (unsigned int i = 0; i < num_samples; ++i) {
+		float a[3] = { samples[i].accel[0], samples[i].accel[1],
+			       samples[i].accel[2] };
+		/* Free fall (null acceleration): only the gyroscope can be trusted */
+		const float *pa = _imu_fusion_normalize3(a) ? a : NULL;
+
+		if (fusion->algorithm == IMU_FUSION_MADGWICK)
+			q = _imu_fusion_madgwick(fusion, q, samples[i].gyro, pa,
+						 pa ? pm : NULL);
+		else
+			q = _imu_fusion_mahony(fusion, q, samples[i].gyro, pa,
+					       pa ? pm : NULL);
+	}
+	for (int i = 0; i < 4; ++i)
+		fusion->q[i] = q[i];
+	fusion->updates += num_samples;
+}
+
+/**
+ * @brief Fuse a single sample.
+ * @param fusion Filter.
+ * @param sample Sample.
+ * @param mag Magnetic field (any unit), NULL to only use gravity.
+ */
+static inline void imu_fusion_update(struct imu_fusion *fusion,
+				     const struct imu_sample *sample,
+				     const float *mag)
+{
+	imu_fusion_update_batch(fusion, sample, 1, mag);
+}
+
+/**
+ * @brief Get the orientation as Euler angles (aerospace sequence, z-y-x).
+ * @param fusion Filter.
+ * @param roll Rotation around x (rad), can be NULL.
+ * @param pitch Rotation around y (rad), can be NULL.
+ * @param yaw Rotation around z (rad), can be NULL.
+ */
+void imu_fusion_euler(const struct imu_fusion *fusion, float *roll,
+		      float *pitch, float *yaw)
+{
+	const float w = fusion->q[0], x = fusion->q[1], y = fusion->q[2],
+		    z = fusion->q[3];
+
+	if (roll)
+		*roll = atan2f(2.0f * (w * x + y * z),
+			       1.0f - 2.0f * (x * x + y * y));
+	if (pitch) {
+		const float s = 2.0f * (w * y - z * x);
+		*pitch = s >= 1.0f ? (float)M_PI_2 :
+			 s <= -1.0f ? -(float)M_PI_2 : asinf(s);
+	}
+	if (yaw)
+		*yaw = atan2f(2.0f * (w * z + x * y),
+			      1.0f - 2.0f * (y * y + z * z));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMU_FUSION_H
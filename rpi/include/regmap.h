@@ -0,0 +1,520 @@
+/**
+ * @brief Cached register map for I2C devices
+ *
+ * @file regmap.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-02-28
+ *
+ * @details
+ * Keeps a copy of the 8-bit registers of an I2C device, in the spirit of the Linux kernel regmap:
+ * - Writes go to the device and to the cache (write-through).
+ * - Reads of non-volatile registers come from the cache once the register is known, no bus transfer.
+ * - Writing the value a non-volatile register already holds is skipped.
+ * - Registers that change on their own (status, output data, self-clearing bits) are flagged volatile
+ *   with @ref regmap_set_volatile and always go to the device.
+ * - Several consecutive registers are read or written in a single transfer (@ref regmap_bulk_read,
+ *   @ref regmap_bulk_write), @ref regmap_sync loads a whole range into the cache at once.
+ *
+ * Maps are kept in a small table indexed by the I2C file descriptor, so drivers that only hand out
+ * a file descriptor (e.g. pcf8563.h) can use them without changing their API.
+ *
+ * Transfers use plain read()/write() on the I2C device. Adapters that only speak SMBus (e.g. the i2c-stub
+ * test module) are detected when the map is opened and get SMBus byte and I2C block transfers instead,
+ * limited to 32 registers.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct regmap *map = regmap_open(fd, 0x80); // 0x80: auto-increment bit of the register address
+ * regmap_set_volatile(map, 0x27, 0x2C);
+ *
+ * regmap_update_bits(map, 0x20, 0x80, 0x80); // Read from the device once, then from the cache
+ * regmap_update_bits(map, 0x20, 0x80, 0x80); // Nothing changed, nothing written
+ *
+ * regmap_close(fd);
+ * ```
+ *
+ * Every access holds the lock of the map for the whole transfer and the update of the cache, so callbacks
+ * running in another thread (e.g. runtime PM, see runtime-pm.h) never move the register pointer of the
+ * device between the address and the data of a read, and read-modify-write updates are never interleaved.
+ *
+ * @note The cache assumes nothing else writes to the device, call @ref regmap_invalidate after a reset.
+ * @warning Opening and closing maps is not thread-safe.
+ */
+
+#ifndef REGMAP_H
+#define REGMAP_H
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "rpi-probes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef REGMAP_MAX_DEVICES
+/** @brief Maximum number of maps opened at the same time. */
+#define REGMAP_MAX_DEVICES 8
+#endif
+
+/** @brief Number of registers of a map (8-bit addresses). */
+#define REGMAP_NUM_REGS 256
+
+/**
+ * @brief Cached register map of a device.
+ */
+struct regmap {
+	int fd;
+	///< I2C file descriptor (slave address already set)
+	int in_use;
+	///< Whether the entry of the table is used
+	uint8_t burst;
+	///< Bits added to the register address for multi-register transfers (e.g. 0x80)
+	int smbus;
+	///< Whether the adapter only supports SMBus transfers
+	uint8_t values[REGMAP_NUM_REGS];
+	///< Cached values
+	uint8_t cached[REGMAP_NUM_REGS / 8];
+	///< Bit set when the cached value is known
+	uint8_t volatiles[REGMAP_NUM_REGS / 8];
+	///< Bit set when the register is never cached
+	unsigned long reads;
+	///< Number of read transfers
+	unsigned long writes;
+	///< Number of write transfers
+	unsigned long hits;
+	///< Number of reads served by the cache
+	unsigned long skipped;
+	///< Number of writes skipped because nothing changed
+	pthread_mutex_t lock;
+	///< Held during every transfer and cache update
+};
+
+/** @brief Maps of the opened devices. */
+static struct regmap _regmap_table[REGMAP_MAX_DEVICES];
+
+/**
+ * @brief Test a bit of a register bitmap.
+ * @param bitmap Bitmap.
+ * @param reg Register.
+ * @return Non-zero if set.
+ */
+static inline int _regmap_test(const uint8_t *bitmap, uint8_t reg)
+{
+	return bitmap[reg >> 3] & (1 << (reg & 7));
+}
+
+/**
+ * @brief Get the map of a device.
+ * @param fd I2C file descriptor.
+ * @return Map, NULL if none was opened for this file descriptor.
+ */
+static inline struct regmap *regmap_get(int fd)
+{
+	if (fd < 0)
+		return NULL;
+
+	for (int i = 0; i < REGMAP_MAX_DEVICES; ++i)
+		if (_regmap_table[i].in_use && _regmap_table[i].fd == fd)
+			return &_regmap_table[i];
+
+	return NULL;
+}
+
+/**
+ * @brief Create the map of a device, nothing is cached and no register is volatile.
+ * @param fd I2C file descriptor, the slave address must already be set.
+ * @param burst Bits added to the register address for multi-register transfers, 0 if the device always auto-increments.
+ * @return Map, NULL on failure.
+ */
+struct regmap *regmap_open(int fd, uint8_t burst)
+{
+	struct regmap *map = regmap_get(fd);
+
+	if (fd < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Reuse the entry if the descriptor was closed without regmap_close */
+	for (int i = 0; !map && i < REGMAP_MAX_DEVICES; ++i)
+		if (!_regmap_table[i].in_use)
+			map = &_regmap_table[i];
+	if (!map) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (map->in_use)
+		pthread_mutex_destroy(&map->lock);
+	memset(map, 0, sizeof(*map));
+	map->fd = fd;
+	map->in_use = 1;
+	map->burst = burst;
+	pthread_mutex_init(&map->lock, NULL);
+
+	unsigned long funcs = 0;
+	if (ioctl(fd, I2C_FUNCS, &funcs) == 0)
+		map->smbus = !(funcs & I2C_FUNC_I2C) &&
+			     (funcs & I2C_FUNC_SMBUS_I2C_BLOCK);
+
+	return map;
+}
+
+/**
+ * @brief Forget the map of a device, the file descriptor is not closed.
+ * @param fd I2C file descriptor.
+ */
+void regmap_close(int fd)
+{
+	struct regmap *map = regmap_get(fd);
+
+	if (map) {
+		map->in_use = 0;
+		pthread_mutex_destroy(&map->lock);
+	}
+}
+
+/**
+ * @brief Flag registers as volatile, they are never cached.
+ * @param map Map.
+ * @param first First register.
+ * @param last Last register (included).
+ */
+void regmap_set_volatile(struct regmap *map, uint8_t first, uint8_t last)
+{
+	pthread_mutex_lock(&map->lock);
+	for (unsigned int reg = first; reg <= last; ++reg) {
+		map->volatiles[reg >> 3] |= 1 << (reg & 7);
+		map->cached[reg >> 3] &= ~(1 << (reg & 7));
+	}
+	pthread_mutex_unlock(&map->lock);
+}
+
+/**
+ * @brief Forget every cached value, e.g. after a reset of the device.
+ * @param map Map.
+ */
+void regmap_invalidate(struct regmap *map)
+{
+	pthread_mutex_lock(&map->lock);
+	memset(map->cached, 0, sizeof(map->cached));
+	pthread_mutex_unlock(&map->lock);
+}
+
+/**
+ * @brief Store values read from or written to the device in the cache.
+ * @param map Map.
+ * @param reg First register.
+ * @param values Values.
+ * @param count Number of registers.
+ */
+static void _regmap_store(struct regmap *map, uint8_t reg,
+			  const uint8_t *values, size_t count)
+{
+	for (size_t i = 0; i < count && reg + i < REGMAP_NUM_REGS; ++i) {
+		const unsigned int r = reg + i;
+		if (_regmap_test(map->volatiles, r))
+			continue;
+		map->values[r] = values[i];
+		map->cached[r >> 3] |= 1 << (r & 7);
+	}
+}
+
+/**
+ * @brief Run an SMBus transfer.
+ * @param fd I2C file descriptor.
+ * @param read_write I2C_SMBUS_READ or I2C_SMBUS_WRITE.
+ * @param command Register address.
+ * @param size Transfer type (e.g. I2C_SMBUS_I2C_BLOCK_DATA).
+ * @param data Data, block[0] holds the length of block transfers.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_smbus(int fd, char read_write, uint8_t command, int size,
+			 union i2c_smbus_data *data)
+{
+	struct i2c_smbus_ioctl_data args;
+
+	args.read_write = read_write;
+	args.command = command;
+	args.size = size;
+	args.data = data;
+	return ioctl(fd, I2C_SMBUS, &args) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Read consecutive registers from the device, nothing is cached.
+ * @param map Map.
+ * @param addr Address sent to the device (register and burst bits).
+ * @param values Values read.
+ * @param count Number of registers.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_bus_read(struct regmap *map, uint8_t addr, uint8_t *values,
+			    size_t count)
+{
+	if (map->smbus) {
+		union i2c_smbus_data data;
+		if (count > I2C_SMBUS_BLOCK_MAX) {
+			errno = EINVAL;
+			return -1;
+		}
+		data.block[0] = count;
+		if (_regmap_smbus(map->fd, I2C_SMBUS_READ, addr,
+				  count > 1 ? I2C_SMBUS_I2C_BLOCK_DATA :
+					      I2C_SMBUS_BYTE_DATA,
+				  &data) < 0)
+			return -1;
+		if (count > 1)
+			memcpy(values, data.block + 1, count);
+		else
+			values[0] = data.byte;
+		return 0;
+	}
+
+	if (write(map->fd, &addr, 1) != 1)
+		return -1;
+	if (read(map->fd, values, count) != (ssize_t)count)
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief Write consecutive registers to the device, nothing is cached.
+ * @param map Map.
+ * @param buf Address sent to the device (register and burst bits) followed by the values.
+ * @param count Number of registers, at most 32.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_bus_write(struct regmap *map, const uint8_t *buf,
+			     size_t count)
+{
+	if (map->smbus) {
+		union i2c_smbus_data data;
+		data.block[0] = count;
+		memcpy(data.block + 1, buf + 1, count);
+		if (count == 1)
+			data.byte = buf[1];
+		return _regmap_smbus(map->fd, I2C_SMBUS_WRITE, buf[0],
+				     count > 1 ? I2C_SMBUS_I2C_BLOCK_DATA :
+						 I2C_SMBUS_BYTE_DATA,
+				     &data);
+	}
+
+	return write(map->fd, buf, count + 1) == (ssize_t)(count + 1) ? 0 : -1;
+}
+
+/**
+ * @brief Read consecutive registers and update the cache, the lock must be held.
+ * @param map Map.
+ * @param reg First register.
+ * @param values Values read.
+ * @param count Number of registers.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_bulk_read(struct regmap *map, uint8_t reg, uint8_t *values,
+			     size_t count)
+{
+	++map->reads;
+	RPI_PROBE3(regmap, read_start, map->fd, reg, count);
+	const int ret = _regmap_bus_read(
+		map, count > 1 ? reg | map->burst : reg, values, count);
+	RPI_PROBE3(regmap, read_end, map->fd, reg, ret);
+	if (ret < 0)
+		return -1;
+
+	_regmap_store(map, reg, values, count);
+	return 0;
+}
+
+/**
+ * @brief Write consecutive registers and update the cache, the lock must be held.
+ * @param map Map.
+ * @param reg First register.
+ * @param values Values to write.
+ * @param count Number of registers, at most 32.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_bulk_write(struct regmap *map, uint8_t reg,
+			      const uint8_t *values, size_t count)
+{
+	uint8_t buf[33];
+
+	if (count == 0 || count > sizeof(buf) - 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	buf[0] = count > 1 ? reg | map->burst : reg;
+	memcpy(buf + 1, values, count);
+
+	++map->writes;
+	RPI_PROBE3(regmap, write_start, map->fd, reg, count);
+	const int ret = _regmap_bus_write(map, buf, count);
+	RPI_PROBE3(regmap, write_end, map->fd, reg, ret);
+	if (ret < 0)
+		return -1;
+
+	_regmap_store(map, reg, values, count);
+	return 0;
+}
+
+/**
+ * @brief Read a register, from the cache when possible, the lock must be held.
+ * @param map Map.
+ * @param reg Register.
+ * @param value Value read.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_read(struct regmap *map, uint8_t reg, uint8_t *value)
+{
+	if (_regmap_test(map->cached, reg)) {
+		++map->hits;
+		RPI_PROBE2(regmap, hit, map->fd, reg);
+		*value = map->values[reg];
+		return 0;
+	}
+
+	return _regmap_bulk_read(map, reg, value, 1);
+}
+
+/**
+ * @brief Write a register unless it already holds the value, the lock must be held.
+ * @param map Map.
+ * @param reg Register.
+ * @param value Value.
+ * @return 0 on success, -1 on failure.
+ */
+static int _regmap_write(struct regmap *map, uint8_t reg, uint8_t value)
+{
+	if (_regmap_test(map->cached, reg) && map->values[reg] == value) {
+		++map->skipped;
+		return 0;
+	}
+
+	return _regmap_bulk_write(map, reg, &value, 1);
+}
+
+/**
+ * @brief Read consecutive registers from the device in a single transfer, the cache is updated.
+ * @param map Map.
+ * @param reg First register.
+ * @param values Values read.
+ * @param count Number of registers.
+ * @return 0 on success, -1 on failure.
+ */
+int regmap_bulk_read(struct regmap *map, uint8_t reg, uint8_t *values,
+		     size_t count)
+{
+	pthread_mutex_lock(&map->lock);
+	const int ret = _regmap_bulk_read(map, reg, values, count);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Write consecutive registers in a single transfer, the cache is updated.
+ * @param map Map.
+ * @param reg First register.
+ * @param values Values to write.
+ * @param count Number of registers, at most 32.
+ * @return 0 on success, -1 on failure.
+ */
+int regmap_bulk_write(struct regmap *map, uint8_t reg, const uint8_t *values,
+		      size_t count)
+{
+	pthread_mutex_lock(&map->lock);
+	const int ret = _regmap_bulk_write(map, reg, values, count);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Read a register, from the cache when possible.
+ * @param map Map.
+ * @param reg Register.
+ * @param value Value read.
+ * @return 0 on success, -1 on failure.
+ */
+int regmap_read(struct regmap *map, uint8_t reg, uint8_t *value)
+{
+	pthread_mutex_lock(&map->lock);
+	const int ret = _regmap_read(map, reg, value);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Write a register, skipped if it is known to already hold the value.
+ * @param map Map.
+ * @param reg Register.
+ * @param value Value.
+ * @return 0 on success, -1 on failure.
+ */
+int regmap_write(struct regmap *map, uint8_t reg, uint8_t value)
+{
+	pthread_mutex_lock(&map->lock);
+	const int ret = _regmap_write(map, reg, value);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Change some bits of a register.
+ * @param map Map.
+ * @param reg Register.
+ * @param mask Bits to change.
+ * @param value New value of the bits, bits outside of mask are ignored.
+ * @return 0 on success, -1 on failure.
+ * @note The register cannot be changed by another thread between the read and the write.
+ */
+int regmap_update_bits(struct regmap *map, uint8_t reg, uint8_t mask,
+		       uint8_t value)
+{
+	uint8_t old;
+
+	pthread_mutex_lock(&map->lock);
+	int ret = _regmap_read(map, reg, &old);
+	if (ret == 0)
+		ret = _regmap_write(map, reg, (old & ~mask) | (value & mask));
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/**
+ * @brief Load a range of registers into the cache with a single transfer.
+ * @param map Map.
+ * @param first First register.
+ * @param count Number of registers, at most 32.
+ * @return 0 on success, -1 on failure.
+ */
+int regmap_sync(struct regmap *map, uint8_t first, size_t count)
+{
+	uint8_t buf[32];
+
+	if (count == 0 || count > sizeof(buf)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return regmap_bulk_read(map, first, buf, count);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REGMAP_H
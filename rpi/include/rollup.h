@@ -0,0 +1,463 @@
+/**
+ * @brief Multi-resolution rollup of a sensor history (1 s, 1 min and 1 h aggregates)
+ *
+ * @file rollup.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-09
+ *
+ * @details
+ * Answering "minimum, maximum and mean over the last 24 hours" from raw samples means keeping and scanning
+ * every sample of the day. A rollup keeps aggregates (minimum, maximum, sum and count) instead,
+ * in three tiers of fixed-size rings of buckets:
+ *
+ * | Tier | Bucket | Buckets by default | History            |
+ * | ---- | ------ | ------------------ | ------------------ |
+ * | 0    | 1 s    | 3660               | 1 hour and 1 min   |
+ * | 1    | 1 min  | 1500               | 1 day and 1 hour   |
+ * | 2    | 1 h    | 744                | 31 days            |
+ *
+ * Each tier holds one more bucket of the next tier than its round history, so that both edges
+ * of a query over the last hour (or day) are still held by the finer tier.
+ *
+ * Adding a sample updates one bucket per tier, O(1). A bucket is cleared when the ring moves over it,
+ * after a gap without samples the clearing costs one step per elapsed bucket (at most the size of the tier).
+ * Memory is fixed at init (about 185 kB with the default sizes).
+ *
+ * A query over a range takes the whole buckets of the coarsest tier inside it, and the edges from the finer tiers:
+ * the last 24 hours are at most 24 hours, 2 * 59 minutes and 2 * 59 seconds worth of buckets, whatever the sample rate.
+ * Edges are exact to the second while the 1 s tier still holds them, then to the minute, then to the hour
+ * (the bucket overlapping the edge is taken whole).
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct rollup rollup;
+ * rollup_init(&rollup, 0, 0, 0); // Default sizes
+ *
+ * // From the sampling thread
+ * rollup_add(&rollup, pressure);
+ *
+ * // From the dashboard
+ * struct rollup_bucket day;
+ * rollup_last(&rollup, 24 * 3600, &day);
+ * printf("%f %f %f\n", day.min, day.max, rollup_mean(&day));
+ *
+ * rollup_delete(&rollup);
+ * ```
+ *
+ * @note Times are CLOCK_REALTIME (ns since the epoch) to match the clock of a dashboard,
+ *       @ref rollup_add_at takes the time of the sample for batches or recorded data.
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of tiers. */
+#define ROLLUP_TIERS 3
+/** @brief Default number of 1 s buckets (1 hour and 1 minute). */
+#define ROLLUP_SECONDS 3660
+/** @brief Default number of 1 min buckets (1 day and 1 hour). */
+#define ROLLUP_MINUTES 1500
+/** @brief Default number of 1 h buckets (31 days). */
+#define ROLLUP_HOURS 744
+
+/** @brief Period of the buckets of each tier (ns). */
+static const int64_t _rollup_periods_ns[ROLLUP_TIERS] = {
+	1000000000LL,
+	60 * 1000000000LL,
+	3600 * 1000000000LL,
+};
+
+/**
+ * @brief Aggregate of the samples of a period.
+ */
+struct rollup_bucket {
+	double min;
+	///< Lowest sample
+	double max;
+	///< Highest sample
+	double sum;
+	///< Sum of the samples
+	unsigned long count;
+	///< Number of samples, the other fields are meaningless when 0
+};
+
+/**
+ * @brief Ring of buckets of a period.
+ */
+struct rollup_tier {
+	struct rollup_bucket *buckets;
+	///< Buckets, bucket i is in buckets[i % size]
+	size_t size;
+	///< Number of buckets
+	int64_t period_ns;
+	///< Period of a bucket (ns)
+	int64_t head;
+	///< Index (time / period) of the newest bucket, -1 before the first sample
+};
+
+/**
+ * @brief Rollup of a sensor.
+ */
+struct rollup {
+	struct rollup_tier tiers[ROLLUP_TIERS];
+	///< From the finest to the coarsest
+	unsigned long samples;
+	///< Number of samples added
+	unsigned long dropped;
+	///< Number of samples older than every tier, not added
+	pthread_mutex_t lock;
+	///< Samples can be added and queried from different threads
+};
+
+/**
+ * @brief Current time.
+ * @return CLOCK_REALTIME time (ns).
+ */
+static inline int64_t _rollup_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Free a rollup.
+ * @param r Rollup.
+ */
+void rollup_delete(struct rollup *r)
+{
+	if (!r)
+		return;
+
+	for (int k = 0; k < ROLLUP_TIERS; ++k) {
+		free(r->tiers[k].buckets);
+		r->tiers[k].buckets = NULL;
+	}
+	pthread_mutex_destroy(&r->lock);
+}
+
+/**
+ * @brief Allocate a rollup, empty.
+ * @param r Rollup.
+ * @param seconds Number of 1 s buckets, 0 for ROLLUP_SECONDS.
+ * @param minutes Number of 1 min buckets, 0 for ROLLUP_MINUTES.
+ * @param hours Number of 1 h buckets, 0 for ROLLUP_HOURS.
+ * @return 0 on success, -1 on failure.
+ * @note A tier should hold at least one bucket of the next tier (60 seconds, 60 minutes),
+ *       otherwise the edges of the queries fall back to the coarser tier sooner.
+ */
+int rollup_init(struct rollup *r, size_t seconds, size_t minutes,
+		size_t hours)
+{
+	if (!r) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const size_t sizes[ROLLUP_TIERS] = {
+		seconds ? seconds : ROLLUP_SECONDS,
+		minutes ? minutes : ROLLUP_MINUTES,
+		hours ? hours : ROLLUP_HOURS,
+	};
+
+	memset(r, 0, sizeof(*r));
+	const int err = pthread_mutex_init(&r->lock, NULL);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	for (int k = 0; k < ROLLUP_TIERS; ++k) {
+		struct rollup_tier *tier = &r->tiers[k];
+		tier->buckets = (struct rollup_bucket *)calloc(
+			sizes[k], sizeof(*tier->buckets));
+		if (!tier->buckets) {
+			rollup_delete(r);
+			return -1;
+		}
+		tier->size = sizes[k];
+		tier->period_ns = _rollup_periods_ns[k];
+		tier->head = -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Merge a bucket into another.
+ * @param dst Bucket updated.
+ * @param src Bucket merged, may be empty.
+ */
+static inline void _rollup_merge(struct rollup_bucket *dst,
+				 const struct rollup_bucket *src)
+{
+	if (src->count == 0)
+		return;
+
+	if (dst->count == 0) {
+		*dst = *src;
+		return;
+	}
+	dst->min = src->min < dst->min ? src->min : dst->min;
+	dst->max = src->max > dst->max ? src->max : dst->max;
+	dst->sum += src->sum;
+	dst->count += src->count;
+}
+
+/**
+ * @brief Whether a bucket is still in a tier, lock held.
+ * @param tier Tier.
+ * @param index Index of the bucket (time / period).
+ */
+static inline int _rollup_holds(const struct rollup_tier *tier, int64_t index)
+{
+	return tier->head >= 0 && index <= tier->head &&
+	       index > tier->head - (int64_t)tier->size;
+}
+
+/**
+ * @brief Add a sample taken at a given time.
+ * @param r Rollup.
+ * @param time_ns Time of the sample, CLOCK_REALTIME (ns).
+ * @param value Sample.
+ * @return 0 on success, -1 on failure (ERANGE: older than every tier).
+ * @note Samples may come out of order, each goes to the buckets of its time that are still held.
+ */
+int rollup_add_at(struct rollup *r, int64_t time_ns, double value)
+{
+	if (!r || time_ns < 0 || isnan(value)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int added = 0;
+	pthread_mutex_lock(&r->lock);
+	for (int k = 0; k < ROLLUP_TIERS; ++k) {
+		struct rollup_tier *tier = &r->tiers[k];
+		const int64_t index = time_ns / tier->period_ns;
+
+		/* Clear the buckets the ring moves over */
+		if (index > tier->head) {
+			if (tier->head < 0 ||
+			    index - tier->head >= (int64_t)tier->size) {
+				memset(tier->buckets, 0,
+				       tier->size * sizeof(*tier->buckets));
+			} else {
+				for (int64_t i = tier->head + 1; i <= index; ++i)
+					tier->buckets[i % tier->size].count = 0;
+			}
+			tier->head = index;
+		} else if (!_rollup_holds(tier, index)) {
+			continue;
+		}
+
+		struct rollup_bucket *b = &tier->buckets[index % tier->size];
+		if (b->count == 0) {
+			b->min = b->max = b->sum = value;
+		} else {
+			b->min = value < b->min ? value : b->min;
+			b->max = value > b->max ? value : b->max;
+			b->sum += value;
+		}
+		++b->count;
+		added = 1;
+	}
+	if (added)
+		++r->samples;
+	else
+		++r->dropped;
+	pthread_mutex_unlock(&r->lock);
+
+	if (!added) {
+		errno = ERANGE;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Add a sample taken now.
+ * @param r Rollup.
+ * @param value Sample.
+ * @return 0 on success, -1 on failure.
+ */
+int rollup_add(struct rollup *r, double value)
+{
+	return rollup_add_at(r, _rollup_now_ns(), value);
+}
+
+/**
+ * @brief Merge the buckets of a tier from first to last (included), lock held.
+ * @param tier Tier.
+ * @param first Index of the first bucket.
+ * @param last Index of the last bucket.
+ * @param result Aggregate updated.
+ */
+static void _rollup_merge_range(const struct rollup_tier *tier, int64_t first,
+				int64_t last, struct rollup_bucket *result)
+{
+	/* Only the buckets still held */
+	if (first <= tier->head - (int64_t)tier->size)
+		first = tier->head - (int64_t)tier->size + 1;
+	if (last > tier->head)
+		last = tier->head;
+
+	for (int64_t i = first; i <= last; ++i)
+		_rollup_merge(result, &tier->buckets[i % tier->size]);
+}
+
+/**
+ * @brief Aggregate a range from a tier and the finer ones, lock held.
+ * @param r Rollup.
+ * @param k Tier.
+ * @param from_ns Start of the range (included).
+ * @param to_ns End of the range (excluded).
+ * @param result Aggregate updated.
+ */
+static void _rollup_query(const struct rollup *r, int k, int64_t from_ns,
+			  int64_t to_ns, struct rollup_bucket *result)
+{
+	if (from_ns >= to_ns)
+		return;
+
+	const struct rollup_tier *tier = &r->tiers[k];
+	const int64_t period = tier->period_ns;
+	if (k == 0) {
+		_rollup_merge_range(tier, from_ns / period,
+				    (to_ns - 1) / period, result);
+		return;
+	}
+
+	/* Whole buckets of this tier in the range */
+	const int64_t first = (from_ns + period - 1) / period;
+	const int64_t end = to_ns / period;
+	if (first >= end) {
+		const struct rollup_tier *finer = &r->tiers[k - 1];
+		if (_rollup_holds(finer, from_ns / finer->period_ns))
+			_rollup_query(r, k - 1, from_ns, to_ns, result);
+		else
+			_rollup_merge_range(tier, from_ns / period,
+					    (to_ns - 1) / period, result);
+		return;
+	}
+	_rollup_merge_range(tier, first, end - 1, result);
+
+	/* Edges from the finer tier, or the overlapping bucket once it is gone */
+	const struct rollup_tier *finer = &r->tiers[k - 1];
+	if (from_ns < first * period) {
+		if (_rollup_holds(finer, from_ns / finer->period_ns))
+			_rollup_query(r, k - 1, from_ns, first * period,
+				      result);
+		else
+			_rollup_merge_range(tier, first - 1, first - 1,
+					    result);
+	}
+	if (end * period < to_ns) {
+		if (_rollup_holds(finer, end * period / finer->period_ns) ||
+		    finer->head < end * period / finer->period_ns)
+			_rollup_query(r, k - 1, end * period, to_ns, result);
+		else
+			_rollup_merge_range(tier, end, end, result);
+	}
+}
+
+/**
+ * @brief Aggregate the samples of a range of time.
+ * @param r Rollup.
+ * @param from_ns Start of the range, CLOCK_REALTIME (ns, included).
+ * @param to_ns End of the range, CLOCK_REALTIME (ns, excluded).
+ * @param result Aggregate, count is 0 if there is no sample in the range.
+ * @return 0 on success, -1 on failure.
+ * @note The edges are rounded outward to the finest bucket still held (see @ref rollup.h).
+ */
+int rollup_query(struct rollup *r, int64_t from_ns, int64_t to_ns,
+		 struct rollup_bucket *result)
+{
+	if (!r || !result || from_ns < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(result, 0, sizeof(*result));
+	pthread_mutex_lock(&r->lock);
+	_rollup_query(r, ROLLUP_TIERS - 1, from_ns, to_ns, result);
+	pthread_mutex_unlock(&r->lock);
+
+	return 0;
+}
+
+/**
+ * @brief Aggregate the samples of the last seconds.
+ * @param r Rollup.
+ * @param seconds Length of the range (s).
+ * @param result Aggregate, count is 0 if there is no sample in the range.
+ * @return 0 on success, -1 on failure.
+ */
+int rollup_last(struct rollup *r, unsigned int seconds,
+		struct rollup_bucket *result)
+{
+	const int64_t now = _rollup_now_ns();
+	const int64_t from = now - (int64_t)seconds * 1000000000LL;
+	return rollup_query(r, from > 0 ? from : 0, now + 1, result);
+}
+
+/**
+ * @brief Copy the buckets of a tier, e.g. to plot a history.
+ * @param r Rollup.
+ * @param tier Tier (0: 1 s, 1: 1 min, 2: 1 h).
+ * @param from_ns Time in the first bucket, CLOCK_REALTIME (ns).
+ * @param buckets Buckets, those not held (too old or not reached yet) have a count of 0.
+ * @param n Number of buckets.
+ * @return 0 on success, -1 on failure.
+ */
+int rollup_series(struct rollup *r, int tier, int64_t from_ns,
+		  struct rollup_bucket *buckets, size_t n)
+{
+	if (!r || tier < 0 || tier >= ROLLUP_TIERS || from_ns < 0 ||
+	    (!buckets && n)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const struct rollup_tier *t = &r->tiers[tier];
+	const int64_t first = from_ns / t->period_ns;
+	pthread_mutex_lock(&r->lock);
+	for (size_t i = 0; i < n; ++i) {
+		const int64_t index = first + (int64_t)i;
+		if (_rollup_holds(t, index))
+			buckets[i] = t->buckets[index % t->size];
+		else
+			memset(&buckets[i], 0, sizeof(buckets[i]));
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	return 0;
+}
+
+/**
+ * @brief Mean of an aggregate.
+ * @param b Aggregate.
+ * @return Mean, NAN without samples.
+ */
+static inline double rollup_mean(const struct rollup_bucket *b)
+{
+	return b->count ? b->sum / b->count : NAN;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ROLLUP_H
@@ -0,0 +1,53 @@
+/**
+ * @brief Static tracepoints (USDT) for the drivers
+ *
+ * @file rpi-probes.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-05
+ *
+ * @details
+ * The drivers mark their transaction boundaries (bus transfers, conversion waits, events, handlers)
+ * with USDT probes from systemtap's `<sys/sdt.h>`, so they can be traced in production without printf
+ * or rebuilding, e.g. with bpftrace (see the scripts in `utils/rpi/trace`).
+ *
+ * A probe that nobody traces is a single `nop` and a note in the ELF file, the arguments are only
+ * read once a tracer attaches. When `<sys/sdt.h>` is missing (package `systemtap-sdt-dev` on Debian)
+ * or `RPI_NO_PROBES` is defined, the probes compile to nothing.
+ *
+ * Probes are named `provider:name`, the provider being the driver (e.g. `regmap:read_start`, `tlc1543:wait_end`).
+ * List the probes of a program with `bpftrace -l 'usdt:./program:*'`.
+ *
+ * Probes ending with `_start` and `_end` come in pairs on the same thread, the difference of their timestamps
+ * is the latency of the step. Every probe is documented next to its call in the driver.
+ */
+
+#ifndef RPI_PROBES_H
+#define RPI_PROBES_H
+
+#if !defined(RPI_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+/** @brief Defined when the probes are compiled in. */
+#define RPI_PROBES 1
+#endif
+#endif
+
+#ifdef RPI_PROBES
+#define RPI_PROBE0(provider, name) DTRACE_PROBE(provider, name)
+#define RPI_PROBE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define RPI_PROBE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define RPI_PROBE3(provider, name, a1, a2, a3)                                 \
+	DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define RPI_PROBE4(provider, name, a1, a2, a3, a4)                             \
+	DTRACE_PROBE4(provider, name, a1, a2, a3, a4)
+#else
+#define RPI_PROBE0(provider, name)                                             \
+	do {                                                                   \
+	} while (0)
+#define RPI_PROBE1(provider, name, a1) RPI_PROBE0(provider, name)
+#define RPI_PROBE2(provider, name, a1, a2) RPI_PROBE0(provider, name)
+#define RPI_PROBE3(provider, name, a1, a2, a3) RPI_PROBE0(provider, name)
+#define RPI_PROBE4(provider, name, a1, a2, a3, a4) RPI_PROBE0(provider, name)
+#endif
+
+#endif // RPI_PROBES_H
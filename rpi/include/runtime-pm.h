@@ -0,0 +1,406 @@
+/**
+ * @brief Runtime power management with autosuspend for drivers
+ *
+ * @file runtime-pm.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-01
+ *
+ * @details
+ * In the spirit of the Linux kernel runtime PM, a driver describes how to power its device
+ * down (suspend) and up (resume), and its users only say when they need the device:
+ * - @ref runtime_pm_get wakes the device on first use and holds it active.
+ * - @ref runtime_pm_put releases it, once nobody holds it the device stays active for the autosuspend delay,
+ *   and is only powered down if no new request came in the meantime.
+ *
+ * Bursts of requests therefore only pay the wakeup once, while an idle device still ends up powered down.
+ *
+ * Devices waiting for their delay are watched by a single thread shared by the whole process.
+ * The thread only exists while at least one device waits and sleeps until the nearest deadline,
+ * so idle devices do not cause periodic wakeups.
+ *
+ * ## Usage
+ *
+ * ```c
+ * int sensor_suspend(void *data) { ... }  // Power down, 0 on success
+ * int sensor_resume(void *data) { ... }   // Power up, 0 on success
+ *
+ * struct runtime_pm pm;
+ * runtime_pm_init(&pm, sensor_suspend, sensor_resume, sensor, 100, 0); // 100 ms delay, starts suspended
+ *
+ * runtime_pm_get(&pm);    // Resumes the sensor
+ * // ... use the sensor ...
+ * runtime_pm_put(&pm);    // Suspended 100 ms later if nobody gets it again
+ *
+ * runtime_pm_remove(&pm); // Suspended now
+ * ```
+ *
+ * @note The callbacks are called with the lock of the framework held (from the caller or from the autosuspend thread),
+ *       they must be short and must not call runtime_pm functions.
+ * @warning This uses pthread, do not forget to add `-pthread` when compiling!
+ */
+
+#ifndef RUNTIME_PM_H
+#define RUNTIME_PM_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Suspend or resume callback of a device.
+ * @param data User data given to @ref runtime_pm_init.
+ * @return 0 on success, negative value on failure.
+ */
+typedef int (*runtime_pm_callback)(void *data);
+
+/**
+ * @brief Power state of a device.
+ */
+struct runtime_pm {
+	runtime_pm_callback suspend;
+	///< Powers the device down
+	runtime_pm_callback resume;
+	///< Powers the device up
+	void *data;
+	///< User data given to the callbacks
+	int delay_ms;
+	///< Autosuspend delay, 0 to suspend on the last put, negative to never autosuspend
+	int usage;
+	///< Number of users holding the device active
+	int active;
+	///< Whether the device is powered up
+	int armed;
+	///< Whether the device waits for its autosuspend delay
+	int64_t last_busy_ns;
+	///< Last time the device was released (CLOCK_MONOTONIC)
+	unsigned long resumes;
+	///< Number of wakeups
+	unsigned long suspends;
+	///< Number of power downs
+	struct runtime_pm *next;
+	///< Next device waiting for its autosuspend delay
+};
+
+/**
+ * @brief Devices waiting for their autosuspend delay, watched by a single thread.
+ */
+static struct {
+	struct runtime_pm *armed;
+	///< Devices waiting for their delay
+	int running;
+	///< Non-zero while the autosuspend thread exists
+	pthread_mutex_t lock;
+	///< Protects every device, held while calling the callbacks
+	pthread_cond_t wakeup;
+	///< Signaled when a device starts waiting
+	pthread_once_t once;
+	///< Initializes the condition with the monotonic clock
+} _runtime_pm = { .armed = NULL,
+		  .running = 0,
+		  .lock = PTHREAD_MUTEX_INITIALIZER,
+		  .wakeup = PTHREAD_COND_INITIALIZER,
+		  .once = PTHREAD_ONCE_INIT };
+
+/**
+ * @brief Get the current time.
+ * @return CLOCK_MONOTONIC time (ns).
+ */
+static inline int64_t _runtime_pm_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Initialize the condition, the thread waits on CLOCK_MONOTONIC deadlines.
+ */
+static void _runtime_pm_once(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&_runtime_pm.wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief Power a device down, the framework must be locked.
+ * @param pm Device.
+ * @return 0 on success, negative value from the callback on failure.
+ */
+static int _runtime_pm_suspend(struct runtime_pm *pm)
+{
+	const int ret = pm->suspend(pm->data);
+
+	if (ret == 0) {
+		pm->active = 0;
+		++pm->suspends;
+	}
+	return ret;
+}
+
+/**
+ * @brief Stop waiting for the autosuspend delay of a device, the framework must be locked.
+ * @param pm Device.
+ */
+static void _runtime_pm_disarm(struct runtime_pm *pm)
+{
+	if (!pm->armed)
+		return;
+
+	for (struct runtime_pm **it = &_runtime_pm.armed; *it;
+	     it = &(*it)->next) {
+		if (*it == pm) {
+			*it = pm->next;
+			break;
+		}
+	}
+	pm->armed = 0;
+}
+
+/**
+ * @brief Pthread routine suspending the devices whose delay expired.
+ * @param _unused Nothing.
+ * @return Nothing.
+ */
+static void *_runtime_pm_thread(void *_unused)
+{
+	(void)_unused;
+
+	pthread_mutex_lock(&_runtime_pm.lock);
+	while (_runtime_pm.armed) {
+		const int64_t now = _runtime_pm_now_ns();
+		int64_t next = INT64_MAX;
+
+		for (struct runtime_pm **it = &_runtime_pm.armed; *it;) {
+			struct runtime_pm *pm = *it;
+			const int64_t deadline = pm->last_busy_ns +
+						 pm->delay_ms * 1000000LL;
+
+			if (deadline > now) {
+				next = deadline < next ? deadline : next;
+				it = &pm->next;
+				continue;
+			}
+
+			/* A failed suspend leaves the device active until its next put */
+			*it = pm->next;
+			pm->armed = 0;
+			_runtime_pm_suspend(pm);
+		}
+		if (!_runtime_pm.armed)
+			break;
+
+		struct timespec deadline = {
+			.tv_sec = next / 1000000000LL,
+			.tv_nsec = next % 1000000000LL,
+		};
+		pthread_cond_timedwait(&_runtime_pm.wakeup, &_runtime_pm.lock,
+				       &deadline);
+	}
+	_runtime_pm.running = 0;
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return NULL;
+}
+
+/**
+ * @brief Handle a device nobody holds anymore, the framework must be locked.
+ * @param pm Active device with no user.
+ * @return 0 on success, negative value on failure.
+ *
+ * The device is suspended now with a delay of 0, or waits for its delay, starting the thread if needed.
+ */
+static int _runtime_pm_idle(struct runtime_pm *pm)
+{
+	if (pm->delay_ms == 0)
+		return _runtime_pm_suspend(pm);
+	if (pm->delay_ms < 0 || pm->armed)
+		return 0;
+
+	if (!_runtime_pm.running) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, _runtime_pm_thread, NULL) !=
+		    0)
+			return -1;
+		pthread_detach(thread);
+		_runtime_pm.running = 1;
+	}
+	pm->next = _runtime_pm.armed;
+	_runtime_pm.armed = pm;
+	pm->armed = 1;
+	pthread_cond_signal(&_runtime_pm.wakeup);
+
+	return 0;
+}
+
+/**
+ * @brief Start managing the power of a device.
+ * @param pm Device to initialize.
+ * @param suspend Powers the device down.
+ * @param resume Powers the device up.
+ * @param data User data given to the callbacks.
+ * @param delay_ms Autosuspend delay (ms), 0 to suspend on the last put, negative to never autosuspend.
+ * @param active Whether the device is already powered up, it then waits for its delay as if it was just released.
+ * @return 0 on success, -1 on failure.
+ */
+int runtime_pm_init(struct runtime_pm *pm, runtime_pm_callback suspend,
+		    runtime_pm_callback resume, void *data, int delay_ms,
+		    int active)
+{
+	if (!pm || !suspend || !resume) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_once(&_runtime_pm.once, _runtime_pm_once);
+
+	pm->suspend = suspend;
+	pm->resume = resume;
+	pm->data = data;
+	pm->delay_ms = delay_ms;
+	pm->usage = 0;
+	pm->active = active;
+	pm->armed = 0;
+	pm->last_busy_ns = _runtime_pm_now_ns();
+	pm->resumes = 0;
+	pm->suspends = 0;
+	pm->next = NULL;
+
+	int ret = 0;
+	pthread_mutex_lock(&_runtime_pm.lock);
+	if (active)
+		ret = _runtime_pm_idle(pm);
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Stop managing the power of a device, it is suspended if active.
+ * @param pm Device.
+ * @return 0 on success, -1 on failure.
+ */
+int runtime_pm_remove(struct runtime_pm *pm)
+{
+	if (!pm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&_runtime_pm.lock);
+	_runtime_pm_disarm(pm);
+	if (pm->active)
+		ret = _runtime_pm_suspend(pm);
+	pm->usage = 0;
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Hold a device active, it is resumed if suspended.
+ * @param pm Device.
+ * @return 0 on success, -1 on failure (the device is not held).
+ */
+int runtime_pm_get(struct runtime_pm *pm)
+{
+	if (!pm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&_runtime_pm.lock);
+	_runtime_pm_disarm(pm);
+	if (!pm->active) {
+		ret = pm->resume(pm->data);
+		if (ret == 0) {
+			pm->active = 1;
+			++pm->resumes;
+		}
+	}
+	if (ret == 0)
+		++pm->usage;
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Release a device, it is suspended after the autosuspend delay if nobody gets it again.
+ * @param pm Device.
+ * @return 0 on success, -1 on failure.
+ * @note Releasing a device nobody holds only restarts its delay.
+ */
+int runtime_pm_put(struct runtime_pm *pm)
+{
+	if (!pm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&_runtime_pm.lock);
+	if (pm->usage > 0)
+		--pm->usage;
+	pm->last_busy_ns = _runtime_pm_now_ns();
+	if (pm->usage == 0 && pm->active)
+		ret = _runtime_pm_idle(pm);
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Change the autosuspend delay of a device.
+ * @param pm Device.
+ * @param delay_ms Autosuspend delay (ms), 0 to suspend on the last put, negative to never autosuspend.
+ * @return 0 on success, -1 on failure.
+ */
+int runtime_pm_set_autosuspend(struct runtime_pm *pm, int delay_ms)
+{
+	if (!pm) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&_runtime_pm.lock);
+	pm->delay_ms = delay_ms;
+	_runtime_pm_disarm(pm);
+	if (pm->usage == 0 && pm->active)
+		ret = _runtime_pm_idle(pm);
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Check whether a device is powered up.
+ * @param pm Device.
+ * @return 1 if active, 0 if suspended.
+ */
+int runtime_pm_is_active(struct runtime_pm *pm)
+{
+	pthread_mutex_lock(&_runtime_pm.lock);
+	const int active = pm->active;
+	pthread_mutex_unlock(&_runtime_pm.lock);
+
+	return active;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RUNTIME_PM_H
@@ -0,0 +1,436 @@
+/**
+ * @brief Library for the HTS221, a relative humidity and temperature sensor from STM
+ * @file hts221.h
+ * @ingroup Sense-Hat
+ * @date 2022-03-03
+ *
+ * @copyright (c) Pierre Boisselier
+ *
+ * @details
+ * More information about the sensor itself can be found here: https://www.st.com/en/mems-and-sensors/hts221.html
+ * More information about the I2C device driver: https://www.kernel.org/doc/html/v5.4/i2c/dev-interface.html
+ *
+ * 16-bits humidity and temperature sensor, each chip is factory calibrated.
+ *
+ * ## Calibration
+ *
+ * The calibration registers hold two reference points for each measure (e.g. H0_rH at H0_T0_OUT and H1_rH at H1_T0_OUT).
+ * They are read once at init and folded into a slope and an offset, a sample then only costs
+ * a multiply-add instead of the interpolation done with every reading in the application note.
+ * Humidity and temperature (and the status register) are read in a single auto-increment transfer.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct hts221 hts;
+ * hts221_init(&hts);
+ *
+ * // One-shot
+ * double humidity, temperature;
+ * hts221_get(&hts, &humidity, &temperature);
+ *
+ * // Continuous, read whenever needed (the status tells whether the values are new)
+ * hts221_set_rate(&hts, HTS221_ODR_12_5HZ);
+ * hts221_read(&hts, &humidity, &temperature);
+ *
+ * hts221_close(&hts);
+ * ```
+ *
+ * ## Specifics to the Sense-Hat
+ *
+ * - The DRDY pin is not wired.
+ */
+
+#ifndef HTS221_H
+#define HTS221_H
+
+/**
+ * @name I2C default settings
+ * @{
+ */
+
+#ifndef HTS221_I2C_ADDR
+/** @brief Default I2C slave address on the Sense-Hat */
+#define HTS221_I2C_ADDR 0x5F
+#endif
+#ifndef RPI_I2C_DEVICE
+/** @brief Default I2C device for the Raspberry Pi */
+#define RPI_I2C_DEVICE "/dev/i2c-1"
+#endif
+
+/**
+ * @}
+ * @name HTS221 register addresses
+ * @{
+ */
+
+#define HTS221_REG_WHOAMI 0x0F
+#define HTS221_REG_AV_CONF 0x10
+#define HTS221_REG_CTRL_REG1 0x20
+#define HTS221_REG_CTRL_REG2 0x21
+#define HTS221_REG_CTRL_REG3 0x22
+#define HTS221_REG_STATUS 0x27
+#define HTS221_REG_HUMIDITY_OUTL 0x28
+#define HTS221_REG_HUMIDITY_OUTH 0x29
+#define HTS221_REG_TEMP_OUTL 0x2A
+#define HTS221_REG_TEMP_OUTH 0x2B
+/** @brief First calibration register (H0_rH_x2), 16 registers up to T1_OUT */
+#define HTS221_REG_CALIB 0x30
+
+/**
+ * @}
+ * @name HTS221 register values
+ * @{
+ */
+
+/** @brief Content of WHO_AM_I */
+#define HTS221_WHOAMI 0xBC
+/** @brief Register address bit for auto-increment */
+#define HTS221_AUTO_INCREMENT 0x80
+
+#define HTS221_CTRL1_PD 0x80
+#define HTS221_CTRL1_BDU 0x04
+#define HTS221_CTRL1_ODR 0x03
+#define HTS221_CTRL2_ONESHOT 0x01
+#define HTS221_STATUS_H_DA 0x02
+#define HTS221_STATUS_T_DA 0x01
+
+/**
+ * @}
+ * @name Output data rates.
+ * @{
+ */
+
+/** @brief Only convert on request. */
+#define HTS221_ODR_ONESHOT 0x00
+#define HTS221_ODR_1HZ 0x01
+#define HTS221_ODR_7HZ 0x02
+#define HTS221_ODR_12_5HZ 0x03
+
+/**
+ * @}
+ * @name Error returned by functions
+ * @{
+ */
+
+/** @brief Generic error. */
+#define HTS221_ERR -1
+/** @brief Bad argument provided to function. */
+#define HTS221_ERR_ARG -10
+/** @brief I2C device not opened. */
+#define HTS221_ERR_NOPEN -11
+/** @brief Cannot read from I2C device. */
+#define HTS221_ERR_READ -20
+/** @brief Connot write to I2C device. */
+#define HTS221_ERR_WRITE -21
+/** @brief The device is not an HTS221 or its calibration is invalid. */
+#define HTS221_ERR_DEVICE -30
+/** @brief A one-shot conversion did not finish in time. */
+#define HTS221_ERR_TIMEOUT -40
+
+/**
+ * @}
+ */
+
+/** @brief Time after which a one-shot conversion is considered stuck (ms). */
+#define HTS221_CONVERSION_TIMEOUT 100
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <linux/i2c-dev.h>
+
+#include "../regmap.h"
+#include "../rpi-probes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hts221 {
+	int i2c_fd;
+	///< I2C device file descriptor.
+	double h_slope;
+	///< Relative humidity per LSB (%rH).
+	double h_offset;
+	///< Relative humidity at 0 LSB (%rH).
+	double t_slope;
+	///< Temperature per LSB (°C).
+	double t_offset;
+	///< Temperature at 0 LSB (°C).
+};
+
+/**
+ * @brief Fold the calibration registers into slopes and offsets.
+ * @param hts Access to the HTS221.
+ * @param cal Calibration registers, 0x30 to 0x3F.
+ * @return 0 on success, negative value if the calibration is invalid.
+ */
+static int _hts221_calibrate(struct hts221 *hts, const uint8_t cal[16])
+{
+	const double h0 = cal[0] / 2.0;
+	const double h1 = cal[1] / 2.0;
+	/* T0 and T1 are 10-bit, their MSB are in 0x35 */
+	const double t0 = (((cal[5] & 0x03) << 8) | cal[2]) / 8.0;
+	const double t1 = (((cal[5] & 0x0C) << 6) | cal[3]) / 8.0;
+	const int16_t h0_out = (int16_t)(cal[7] << 8 | cal[6]);
+	const int16_t h1_out = (int16_t)(cal[11] << 8 | cal[10]);
+	const int16_t t0_out = (int16_t)(cal[13] << 8 | cal[12]);
+	const int16_t t1_out = (int16_t)(cal[15] << 8 | cal[14]);
+
+	if (h1_out == h0_out || t1_out == t0_out)
+		return HTS221_ERR_DEVICE;
+
+	hts->h_slope = (h1 - h0) / (h1_out - h0_out);
+	hts->h_offset = h0 - hts->h_slope * h0_out;
+	hts->t_slope = (t1 - t0) / (t1_out - t0_out);
+	hts->t_offset = t0 - hts->t_slope * t0_out;
+
+	return 0;
+}
+
+/**
+ * @brief Open connection to the HTS221 and read its calibration, the sensor is powered on in one-shot mode.
+ * @param hts Allocated structure that will serve as access.
+ * @param i2c_device I2C device path.
+ * @param slave_addr HTS221 slave address.
+ * @return 0 on success, negative value on failure.
+ */
+int hts221_init_c_l(struct hts221 *hts, const char *i2c_device,
+		    const long slave_addr)
+{
+	if (!hts || !i2c_device)
+		return HTS221_ERR_ARG;
+
+	hts->i2c_fd = -1;
+
+	int fd = open(i2c_device, O_RDWR);
+	if (fd < 0)
+		return HTS221_ERR_NOPEN;
+
+	if (ioctl(fd, I2C_SLAVE, slave_addr) < 0) {
+		(void)close(fd);
+		return HTS221_ERR_NOPEN;
+	}
+
+	struct regmap *map = regmap_open(fd, HTS221_AUTO_INCREMENT);
+	if (!map) {
+		(void)close(fd);
+		return HTS221_ERR;
+	}
+	/* CTRL_REG2 bits clear themselves, STATUS to TEMP_OUT_H are outputs */
+	regmap_set_volatile(map, HTS221_REG_CTRL_REG2, HTS221_REG_CTRL_REG2);
+	regmap_set_volatile(map, HTS221_REG_STATUS, HTS221_REG_TEMP_OUTH);
+
+	int ret = HTS221_ERR_READ;
+	uint8_t whoami;
+	uint8_t cal[16];
+	if (regmap_read(map, HTS221_REG_WHOAMI, &whoami) < 0)
+		goto err;
+	ret = HTS221_ERR_DEVICE;
+	if (whoami != HTS221_WHOAMI)
+		goto err;
+
+	/* The whole calibration in a single transfer, once */
+	ret = HTS221_ERR_READ;
+	if (regmap_bulk_read(map, HTS221_REG_CALIB, cal, sizeof(cal)) < 0)
+		goto err;
+	ret = _hts221_calibrate(hts, cal);
+	if (ret < 0)
+		goto err;
+
+	ret = HTS221_ERR_WRITE;
+	if (regmap_write(map, HTS221_REG_CTRL_REG1,
+			 HTS221_CTRL1_PD | HTS221_CTRL1_BDU) < 0)
+		goto err;
+
+	hts->i2c_fd = fd;
+	return 0;
+
+err:
+	regmap_close(fd);
+	(void)close(fd);
+	return ret;
+}
+
+/**
+ * @brief Open connection to the HTS221 with default values.
+ * @param hts Allocated structure that will serve as access.
+ * @return 0 on success, negative value on failure.
+ */
+int hts221_init(struct hts221 *hts)
+{
+	return hts221_init_c_l(hts, RPI_I2C_DEVICE, HTS221_I2C_ADDR);
+}
+
+/**
+ * @brief Power the sensor down and close the connection.
+ * @param hts Connection to the HTS221.
+ * @return 0 on success, negative value on failure.
+ */
+int hts221_close(struct hts221 *hts)
+{
+	if (!hts)
+		return HTS221_ERR_ARG;
+	if (hts->i2c_fd < 0)
+		return HTS221_ERR_NOPEN;
+
+	regmap_update_bits(regmap_get(hts->i2c_fd), HTS221_REG_CTRL_REG1,
+			   HTS221_CTRL1_PD, 0);
+	regmap_close(hts->i2c_fd);
+	if (close(hts->i2c_fd) < 0)
+		return HTS221_ERR;
+	hts->i2c_fd = -1;
+
+	return 0;
+}
+
+/**
+ * @brief Set the output data rate, the sensor converts continuously at this rate.
+ * @param hts Connection to the HTS221.
+ * @param odr Output data rate (e.g. HTS221_ODR_1HZ), HTS221_ODR_ONESHOT to stop.
+ * @return 0 on success, negative value on failure.
+ */
+int hts221_set_rate(const struct hts221 *hts, int odr)
+{
+	if (!hts || hts->i2c_fd < 0)
+		return HTS221_ERR_NOPEN;
+	if (odr & ~HTS221_CTRL1_ODR)
+		return HTS221_ERR_ARG;
+
+	if (regmap_update_bits(regmap_get(hts->i2c_fd), HTS221_REG_CTRL_REG1,
+			       HTS221_CTRL1_ODR, (uint8_t)odr) < 0)
+		return HTS221_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Request a one-shot conversion of humidity and temperature.
+ * @param hts Connection to the HTS221.
+ * @return 0 on success, negative value on failure.
+ * @note Use @ref hts221_conversion_done to know when the results are available.
+ * @note Probe `hts221:conversion_start(hts)`.
+ */
+int hts221_request_conversion(const struct hts221 *hts)
+{
+	if (!hts || hts->i2c_fd < 0)
+		return HTS221_ERR_NOPEN;
+
+	RPI_PROBE1(hts221, conversion_start, hts);
+
+	if (regmap_write(regmap_get(hts->i2c_fd), HTS221_REG_CTRL_REG2,
+			 HTS221_CTRL2_ONESHOT) < 0)
+		return HTS221_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Check whether new humidity and temperature values are available.
+ * @param hts Connection to the HTS221.
+ * @return 1 if both are available, 0 otherwise, negative value on failure.
+ * @note Probe `hts221:conversion_end(hts)` once both are available.
+ */
+int hts221_conversion_done(const struct hts221 *hts)
+{
+	if (!hts || hts->i2c_fd < 0)
+		return HTS221_ERR_NOPEN;
+
+	uint8_t status;
+	if (regmap_read(regmap_get(hts->i2c_fd), HTS221_REG_STATUS, &status) <
+	    0)
+		return HTS221_ERR_READ;
+
+	if ((status & (HTS221_STATUS_H_DA | HTS221_STATUS_T_DA)) !=
+	    (HTS221_STATUS_H_DA | HTS221_STATUS_T_DA))
+		return 0;
+
+	RPI_PROBE1(hts221, conversion_end, hts);
+	return 1;
+}
+
+/**
+ * @brief Read the last humidity and temperature, status and outputs in a single transfer.
+ * @param hts Connection to the HTS221.
+ * @param humidity Relative humidity (%rH), can be NULL.
+ * @param temperature Temperature (°C), can be NULL.
+ * @return HTS221_STATUS_H_DA and/or HTS221_STATUS_T_DA when the values are new, negative value on failure.
+ */
+int hts221_read(const struct hts221 *hts, double *humidity,
+		double *temperature)
+{
+	if (!hts || hts->i2c_fd < 0)
+		return HTS221_ERR_NOPEN;
+
+	uint8_t raw[5];
+	if (regmap_bulk_read(regmap_get(hts->i2c_fd), HTS221_REG_STATUS, raw,
+			     sizeof(raw)) < 0)
+		return HTS221_ERR_READ;
+
+	if (humidity) {
+		const double h =
+			hts->h_offset +
+			hts->h_slope * (int16_t)(raw[2] << 8 | raw[1]);
+		/* Out of the calibrated range, see TN1218 */
+		*humidity = h < 0.0 ? 0.0 : h > 100.0 ? 100.0 : h;
+	}
+	if (temperature)
+		*temperature = hts->t_offset +
+			       hts->t_slope * (int16_t)(raw[4] << 8 | raw[3]);
+
+	return raw[0] & (HTS221_STATUS_H_DA | HTS221_STATUS_T_DA);
+}
+
+/**
+ * @brief Run a one-shot conversion and read humidity and temperature.
+ * @param hts Connection to the HTS221.
+ * @param humidity Relative humidity (%rH), can be NULL.
+ * @param temperature Temperature (°C), can be NULL.
+ * @return 0 on success, negative value on failure.
+ * @note HTS221_ERR_TIMEOUT is returned if the conversion is not done after
+ *       @ref HTS221_CONVERSION_TIMEOUT ms.
+ */
+int hts221_get(const struct hts221 *hts, double *humidity,
+	       double *temperature)
+{
+	struct timespec now, deadline;
+
+	int ret = hts221_request_conversion(hts);
+	if (ret < 0)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += HTS221_CONVERSION_TIMEOUT / 1000;
+	deadline.tv_nsec += HTS221_CONVERSION_TIMEOUT % 1000 * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		++deadline.tv_sec;
+	}
+
+	/*
+	 * Wait for the conversion to be finished.
+	 * WARNING: This way spams the I2C bus.
+	 */
+	while ((ret = hts221_conversion_done(hts)) == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > deadline.tv_sec ||
+		    (now.tv_sec == deadline.tv_sec &&
+		     now.tv_nsec >= deadline.tv_nsec))
+			return HTS221_ERR_TIMEOUT;
+	}
+	if (ret < 0)
+		return ret;
+
+	ret = hts221_read(hts, humidity, temperature);
+	return ret < 0 ? ret : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HTS221_H
@@ -0,0 +1,535 @@
+/**
+ * @brief Library for the 5-button joystick on the Sense-Hat
+ *
+ * @file joystick.h
+ * @ingroup Sense-Hat
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-02
+ *
+ * @details
+ * The joystick is driven by the `rpisense-js` kernel module and shows up as an evdev node (`/dev/input/eventX`)
+ * named "Raspberry Pi Sense HAT Joystick", each direction and the middle button being a key
+ * (KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT and KEY_ENTER).
+ *
+ * This works like gpiod-isr.h: a thread sleeps in epoll_wait() on the node and calls a handler for every key event,
+ * nothing is polled. Events are read from the non-blocking node in batches of up to @ref JOYSTICK_BATCH
+ * `struct input_event`, a single read() delivers every event queued since the last wakeup.
+ *
+ * - Key repeats generated by the kernel while a key is held are filtered out unless @ref JOYSTICK_OPT_REPEAT is given,
+ *   so is a press of a key already held (or a release of a key already released).
+ * - The keys currently held are kept in a bitmap (@ref joystick_state), built from the events and loaded
+ *   from the kernel at start.
+ * - When the kernel queue overflows (SYN_DROPPED), events are discarded up to the next SYN_REPORT and the state is
+ *   loaded again from the kernel, the handler gets one event per key that changed meanwhile.
+ *
+ * @warning This uses pthread, do not forget to add `-pthread` when compiling!
+ * @warning If your handler is too slow the kernel queue can overflow, the state is resynchronized but presses are lost.
+ *
+ * ## Usage
+ *
+ * ```c
+ * void on_key(struct joystick *js, const struct input_event *event)
+ * {
+ * 	printf("Key %u %s\n", event->code, event->value ? "pressed" : "released");
+ * }
+ *
+ * struct joystick *js = joystick_request_events(NULL, 0, on_key, NULL); // NULL: find the Sense-Hat node
+ * joystick_grab(js, 1);                                                 // Keep the keys out of the console
+ *
+ * if (joystick_state(js) & JOYSTICK_ENTER)
+ * 	puts("Middle button held");
+ *
+ * joystick_release(js);
+ * ```
+ *
+ * Without a handler no thread is started, the node (@ref joystick_fd) can then be watched by another loop
+ * that calls @ref joystick_dispatch when it is readable.
+ *
+ * ## Testing without a Sense-Hat
+ *
+ * Any evdev node works, e.g. a virtual device created through `/dev/uinput` with the same name and keys,
+ * see the joystick.c example (`./joystick.out --uinput`).
+ */
+
+#ifndef JOYSTICK_H
+#define JOYSTICK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/input.h>
+
+#include "../rpi-probes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Name of the evdev device of the Sense-Hat joystick */
+#define JOYSTICK_NAME "Raspberry Pi Sense HAT Joystick"
+/** @brief Number of evdev nodes checked when looking for the joystick */
+#define JOYSTICK_MAX_NODES 32
+/** @brief Maximum number of events read at once */
+#define JOYSTICK_BATCH 64
+
+/**
+ * @name Keys, bits of the state bitmap
+ * @{
+ */
+#define JOYSTICK_UP 0x01
+#define JOYSTICK_DOWN 0x02
+#define JOYSTICK_LEFT 0x04
+#define JOYSTICK_RIGHT 0x08
+#define JOYSTICK_ENTER 0x10
+/**
+ * @}
+ * @name Optional flags
+ * @{
+ */
+/** @brief Deliver the key repeats (value 2) the kernel sends while a key is held */
+#define JOYSTICK_OPT_REPEAT 0x01
+/** @} */
+
+/** @brief Value of a key event for a release */
+#define JOYSTICK_RELEASE 0
+/** @brief Value of a key event for a press */
+#define JOYSTICK_PRESS 1
+/** @brief Value of a key event for a repeat */
+#define JOYSTICK_REPEAT 2
+
+struct joystick;
+
+/**
+ * @brief Handler called for every key event.
+ * @param js Joystick the event comes from.
+ * @param event Key event (type EV_KEY, code KEY_UP..., value JOYSTICK_PRESS...).
+ */
+typedef void (*joystick_handler)(struct joystick *js,
+				 const struct input_event *event);
+
+/**
+ * @brief Access to the joystick.
+ */
+struct joystick {
+	int fd;
+	///< Evdev node, non-blocking
+	int epfd;
+	///< Epoll instance watching the node and stopfd
+	int stopfd;
+	///< Eventfd written to stop the thread
+	int options;
+	///< Optional flags used
+	joystick_handler handler;
+	///< Handler provided, NULL when no thread was started
+	void *data;
+	///< User data, free for the handler to use
+	uint32_t state;
+	///< Bitmap of the keys held (e.g. JOYSTICK_UP)
+	int dropped;
+	///< Set after a SYN_DROPPED, events are discarded until the next SYN_REPORT
+	pthread_t thread;
+	///< Thread calling the handler
+	unsigned long events;
+	///< Number of events delivered
+	unsigned long filtered;
+	///< Number of repeats and duplicate events filtered out
+	unsigned long syscalls;
+	///< Number of wait/read calls made
+	unsigned long resyncs;
+	///< Number of times the state was loaded again after an overflow
+};
+
+/**
+ * @brief Get the state bit of a key code.
+ * @param code Key code (e.g. KEY_UP).
+ * @return Bit (e.g. JOYSTICK_UP), 0 if the code is not a joystick key.
+ */
+static inline uint32_t joystick_key_bit(unsigned int code)
+{
+	switch (code) {
+	case KEY_UP:
+		return JOYSTICK_UP;
+	case KEY_DOWN:
+		return JOYSTICK_DOWN;
+	case KEY_LEFT:
+		return JOYSTICK_LEFT;
+	case KEY_RIGHT:
+		return JOYSTICK_RIGHT;
+	case KEY_ENTER:
+		return JOYSTICK_ENTER;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Find the evdev node of the joystick.
+ * @param path Filled with the path of the node (e.g. "/dev/input/event0").
+ * @param size Size of path.
+ * @return 0 on success, -1 if not found.
+ */
+int joystick_find(char *path, size_t size)
+{
+	char name[64];
+
+	for (int i = 0; i < JOYSTICK_MAX_NODES; ++i) {
+		snprintf(path, size, "/dev/input/event%d", i);
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		const int ret = ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+		close(fd);
+		if (ret > 0 && strncmp(name, JOYSTICK_NAME, sizeof(name)) == 0)
+			return 0;
+	}
+
+	errno = ENODEV;
+	return -1;
+}
+
+/**
+ * @brief Load the keys held from the kernel.
+ * @param fd Evdev node.
+ * @param state Filled with the bitmap of the keys held.
+ * @return 0 on success, -1 on failure.
+ */
+static int _joystick_load_state(int fd, uint32_t *state)
+{
+	uint8_t keys[KEY_MAX / 8 + 1];
+	static const unsigned int codes[] = { KEY_UP, KEY_DOWN, KEY_LEFT,
+					      KEY_RIGHT, KEY_ENTER };
+
+	memset(keys, 0, sizeof(keys));
+	if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0)
+		return -1;
+
+	*state = 0;
+	for (unsigned int i = 0; i < sizeof(codes) / sizeof(*codes); ++i)
+		if (keys[codes[i] / 8] & (1 << (codes[i] % 8)))
+			*state |= joystick_key_bit(codes[i]);
+
+	return 0;
+}
+
+/**
+ * @brief Call the handler.
+ * @param js Joystick.
+ * @param event Key event.
+ *
+ * Probes `joystick:handler_start(js, key code, value)` and `joystick:handler_end(js)`.
+ */
+static inline void _joystick_call(struct joystick *js,
+				  const struct input_event *event)
+{
+	RPI_PROBE3(joystick, handler_start, js, event->code, event->value);
+	js->handler(js, event);
+	RPI_PROBE1(joystick, handler_end, js);
+}
+
+/**
+ * @brief Load the state again after an overflow, the handler gets an event for each key that changed.
+ * @param js Joystick.
+ * @param report SYN_REPORT that ended the discarded events, its time is used for the events.
+ */
+static void _joystick_resync(struct joystick *js,
+			     const struct input_event *report)
+{
+	static const unsigned int codes[] = { KEY_UP, KEY_DOWN, KEY_LEFT,
+					      KEY_RIGHT, KEY_ENTER };
+	uint32_t state;
+
+	++js->resyncs;
+	if (_joystick_load_state(js->fd, &state) < 0)
+		return;
+
+	const uint32_t changed = state ^ js->state;
+	__atomic_store_n(&js->state, state, __ATOMIC_RELEASE);
+
+	for (unsigned int i = 0; js->handler && i < sizeof(codes) / sizeof(*codes);
+	     ++i) {
+		const uint32_t bit = joystick_key_bit(codes[i]);
+		if (!(changed & bit))
+			continue;
+
+		struct input_event event = *report;
+		event.type = EV_KEY;
+		event.code = codes[i];
+		event.value = state & bit ? JOYSTICK_PRESS : JOYSTICK_RELEASE;
+		++js->events;
+		_joystick_call(js, &event);
+	}
+}
+
+/**
+ * @brief Handle an event read from the node.
+ * @param js Joystick.
+ * @param event Event.
+ * @return 1 if delivered to the handler, 0 otherwise.
+ */
+static int _joystick_handle(struct joystick *js,
+			    const struct input_event *event)
+{
+	if (event->type == EV_SYN) {
+		if (event->code == SYN_DROPPED) {
+			RPI_PROBE1(joystick, dropped, js);
+			js->dropped = 1;
+		} else if (event->code == SYN_REPORT && js->dropped) {
+			js->dropped = 0;
+			_joystick_resync(js, event);
+		}
+		return 0;
+	}
+
+	const uint32_t bit = joystick_key_bit(event->code);
+	if (js->dropped || event->type != EV_KEY || !bit)
+		return 0;
+
+	const uint32_t state = js->state;
+	switch (event->value) {
+	case JOYSTICK_PRESS:
+		if (state & bit)
+			goto filtered;
+		__atomic_store_n(&js->state, state | bit, __ATOMIC_RELEASE);
+		break;
+	case JOYSTICK_RELEASE:
+		if (!(state & bit))
+			goto filtered;
+		__atomic_store_n(&js->state, state & ~bit, __ATOMIC_RELEASE);
+		break;
+	default:
+		if (!(js->options & JOYSTICK_OPT_REPEAT))
+			goto filtered;
+		break;
+	}
+
+	++js->events;
+	if (js->handler)
+		_joystick_call(js, event);
+	return 1;
+
+filtered:
+	++js->filtered;
+	return 0;
+}
+
+/**
+ * @brief Read every event queued on the node and deliver them, does not block.
+ * @param js Joystick.
+ * @return Number of events delivered, -1 on failure.
+ * @note Probe `joystick:read(js, number of events)` for every read of the node.
+ * @note Only call this yourself when no handler was given to @ref joystick_request_events,
+ *       the thread calls it otherwise.
+ */
+int joystick_dispatch(struct joystick *js)
+{
+	struct input_event events[JOYSTICK_BATCH];
+	int delivered = 0;
+
+	if (!js) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (;;) {
+		++js->syscalls;
+		const ssize_t ret = read(js->fd, events, sizeof(events));
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		if (ret == 0)
+			break;
+
+		const size_t num_events = ret / sizeof(*events);
+		RPI_PROBE2(joystick, read, js, num_events);
+		for (size_t i = 0; i < num_events; ++i)
+			delivered += _joystick_handle(js, &events[i]);
+
+		/* A short read means the queue is empty, no need to get EAGAIN */
+		if (num_events < JOYSTICK_BATCH)
+			break;
+	}
+
+	return delivered;
+}
+
+/**
+ * @brief Pthread routine waiting for the events of the joystick.
+ * @param _js Pointer to a joystick structure.
+ * @return Nothing.
+ */
+static void *_joystick_watcher(void *_js)
+{
+	struct joystick *js = (struct joystick *)_js;
+	struct epoll_event events[2];
+
+	for (;;) {
+		++js->syscalls;
+		const int ret = epoll_wait(js->epfd, events, 2, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		int stop = 0;
+		for (int i = 0; i < ret; ++i)
+			stop |= events[i].data.fd == js->stopfd;
+		if (stop)
+			break;
+		if (joystick_dispatch(js) < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Open the joystick and call a handler for each of its key events.
+ * @param path Evdev node, NULL to find the Sense-Hat joystick.
+ * @param options Optional flags (e.g. JOYSTICK_OPT_REPEAT).
+ * @param handler Called from a thread for every key event, NULL to start no thread (see @ref joystick_dispatch).
+ * @param data User data stored in the joystick structure.
+ * @return Joystick, NULL on failure.
+ */
+struct joystick *joystick_request_events(const char *path, int options,
+					 joystick_handler handler, void *data)
+{
+	char found[32];
+
+	if (!path) {
+		if (joystick_find(found, sizeof(found)) < 0)
+			return NULL;
+		path = found;
+	}
+
+	struct joystick *js = (struct joystick *)calloc(1, sizeof(*js));
+	if (!js)
+		return NULL;
+	js->options = options;
+	js->handler = handler;
+	js->data = data;
+	js->stopfd = -1;
+	js->epfd = -1;
+
+	js->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (js->fd < 0)
+		goto err_free;
+
+	/* Keys held before opening do not generate events */
+	if (_joystick_load_state(js->fd, &js->state) < 0)
+		js->state = 0;
+
+	if (!handler)
+		return js;
+
+	js->epfd = epoll_create1(EPOLL_CLOEXEC);
+	js->stopfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (js->epfd < 0 || js->stopfd < 0)
+		goto err_close;
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = js->fd;
+	if (epoll_ctl(js->epfd, EPOLL_CTL_ADD, js->fd, &event) < 0)
+		goto err_close;
+	event.data.fd = js->stopfd;
+	if (epoll_ctl(js->epfd, EPOLL_CTL_ADD, js->stopfd, &event) < 0)
+		goto err_close;
+
+	if (pthread_create(&js->thread, NULL, _joystick_watcher, js) != 0)
+		goto err_close;
+
+	return js;
+
+err_close:
+	if (js->stopfd >= 0)
+		close(js->stopfd);
+	if (js->epfd >= 0)
+		close(js->epfd);
+	close(js->fd);
+err_free:
+	free(js);
+	return NULL;
+}
+
+/**
+ * @brief Stop the thread and close the joystick.
+ * @param js Joystick.
+ * @return 0 on success, -1 on failure.
+ */
+int joystick_release(struct joystick *js)
+{
+	if (!js) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (js->handler) {
+		const uint64_t one = 1;
+		if (write(js->stopfd, &one, sizeof(one)) != sizeof(one))
+			return -1;
+		pthread_join(js->thread, NULL);
+		close(js->stopfd);
+		close(js->epfd);
+	}
+
+	close(js->fd);
+	free(js);
+	return 0;
+}
+
+/**
+ * @brief Get the node of the joystick, e.g. to watch it from another loop.
+ * @param js Joystick.
+ * @return File descriptor, non-blocking.
+ */
+static inline int joystick_fd(const struct joystick *js)
+{
+	return js->fd;
+}
+
+/**
+ * @brief Get the keys held.
+ * @param js Joystick.
+ * @return Bitmap of the keys held (e.g. JOYSTICK_UP | JOYSTICK_ENTER).
+ */
+static inline uint32_t joystick_state(const struct joystick *js)
+{
+	return __atomic_load_n(&js->state, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Grab the joystick, its keys are not sent to the console or other programs anymore.
+ * @param js Joystick.
+ * @param grab 1 to grab, 0 to release the grab.
+ * @return 0 on success, -1 on failure.
+ */
+int joystick_grab(struct joystick *js, int grab)
+{
+	if (!js) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return ioctl(js->fd, EVIOCGRAB, grab ? 1 : 0) < 0 ? -1 : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOYSTICK_H
@@ -15,6 +15,51 @@
  * 
  * - Pin SDO/SA0 is tied to 0V, the LSB of the I2C slave address is 0.
  * - Pin INT is tied to a pad, not wired to a pin
+ *
+ * ## Register cache
+ *
+ * Registers go through a cached register map (see regmap.h): configuration registers are only read once
+ * and writing a value they already hold costs nothing, so the power-down/wakeup of @ref LPS25H_OPT_WAKEUP
+ * only touches the bus when the power state actually changes.
+ * Output, status and self-clearing registers are volatile and always read from the sensor.
+ *
+ * ## Power management
+ *
+ * With @ref LPS25H_OPT_WAKEUP the power state goes through runtime-pm.h: a conversion request wakes the sensor,
+ * and it is only powered down once no reading happened for @ref LPS25H_AUTOSUSPEND_MS
+ * (see @ref lps25h_set_autosuspend). Back-to-back readings do not pay the power-down/wakeup writes anymore,
+ * while a sensor read now and then still spends most of its time powered down.
+ * The autosuspend thread needs `-pthread`.
+ *
+ * ## Threshold interrupts
+ *
+ * The sensor can compare each conversion to a reference pressure and raise its INT pin when the difference
+ * goes over a threshold, so the host does not need to poll the pressure:
+ *
+ * ```c
+ * lps25h_set_int_pin(&lps, 0, 0);                          // Active high, push-pull
+ * lps25h_set_reference(&lps, 1013.25);                     // Or lps25h_autozero(&lps)
+ * lps25h_set_threshold(&lps, 2.0, LPS25H_INT_HIGH | LPS25H_INT_LOW);
+ * lps25h_set_rate(&lps, LPS25H_ODR_1HZ);                   // Compare once per second
+ *
+ * // Wire INT to a GPIO and watch its rising edge with gpiod-isr,
+ * // then call lps25h_interrupt_source() from the handler to know which event happened.
+ * ```
+ *
+ * See the lps25h_threshold.c example.
+ *
+ * ## Shared between threads
+ *
+ * Conversions must not overlap: two threads calling @ref lps25h_get_pressure at the same time
+ * break each other's one-shot wait. @ref lps25h_get_cached goes through a single-flight front-end
+ * (see single-flight.h): one conversion at a time, threads asking at the same time share it,
+ * and a value younger than the age given by the caller is served without any transfer.
+ * Pressure and temperature come from the same conversion, read in a single burst.
+ *
+ * ```c
+ * double hpa;
+ * lps25h_get_cached(&lps, 200000, &hpa, NULL); // Any value from the last 200 ms is fine
+ * ```
  */
 
 #ifndef LPS25H_H
@@ -53,7 +98,7 @@
 #define LPS25H_REG_INT_SRC 0x25
 #define LPS25H_REG_STATUS 0x27
 /** @brief Pressure value, first 8bits */
-#define LPS25H_REG_PRESS_OUTXL 0x27
+#define LPS25H_REG_PRESS_OUTXL 0x28
 /** @brief Pressure value, second 8bits */
 #define LPS25H_REG_PRESS_OUTL 0x29
 /** @brief Pressure value, last 8bits */
@@ -67,9 +112,9 @@
 /** @brief Threshold for pressure interrupt (LOW part) */
 #define LPS25H_REG_THS_PL 0x30
 /** @brief Threshold for pressure interrupt (HIGH part) */
-#define LPS25H_REG_THS_PH 0x30
+#define LPS25H_REG_THS_PH 0x31
 #define LPS25H_REG_RPDSL 0x39
-#define LPS25H_REG_RPDSH 0x39
+#define LPS25H_REG_RPDSH 0x3A
 
 /**
  * @}
@@ -125,6 +170,48 @@
 /** @brief Type of interrupt, see Table 19 in official datasheet. */
 #define LPS25H_CTRL3_INT1S1 0x01
 
+/** @brief Latch the interrupt request until INT_SOURCE is read. */
+#define LPS25H_INTCFG_LIR 0x04
+/** @brief Enable interrupt on differential pressure low event. */
+#define LPS25H_INTCFG_PLE 0x02
+/** @brief Enable interrupt on differential pressure high event. */
+#define LPS25H_INTCFG_PHE 0x01
+
+/** @brief One or more interrupt events have been generated. */
+#define LPS25H_INTSRC_IA 0x04
+/** @brief Differential pressure low event. */
+#define LPS25H_INTSRC_PL 0x02
+/** @brief Differential pressure high event. */
+#define LPS25H_INTSRC_PH 0x01
+
+/**
+ * @}
+ * @name Threshold interrupt events.
+ * @{
+ */
+
+/** @brief Pressure went over the reference by more than the threshold. */
+#define LPS25H_INT_HIGH 0x01
+/** @brief Pressure went under the reference by more than the threshold. */
+#define LPS25H_INT_LOW 0x02
+
+/**
+ * @}
+ * @name Output data rates, for continuous conversions.
+ * @{
+ */
+
+/** @brief No continuous conversion, one-shot only (default). */
+#define LPS25H_ODR_ONESHOT 0x00
+/** @brief 1 Hz. */
+#define LPS25H_ODR_1HZ 0x10
+/** @brief 7 Hz. */
+#define LPS25H_ODR_7HZ 0x20
+/** @brief 12.5 Hz. */
+#define LPS25H_ODR_12_5HZ 0x30
+/** @brief 25 Hz. */
+#define LPS25H_ODR_25HZ 0x40
+
 /**
  * @}
  */
@@ -162,8 +249,21 @@
  * @{
  */
 
-/** @brief Shutdown and wakeup only when reading the pressure. */
+/** @brief Wakeup when reading, shutdown after LPS25H_AUTOSUSPEND_MS without reading. */
 #define LPS25H_OPT_WAKEUP 0x01
+#ifndef LPS25H_AUTOSUSPEND_MS
+/** @brief Default time without reading before powering down with LPS25H_OPT_WAKEUP (ms). */
+#define LPS25H_AUTOSUSPEND_MS 100
+#endif
+
+/**
+ * @}
+ * @name Quantities of the sampling front-end.
+ * @{
+ */
+
+#define LPS25H_KEY_PRESSURE 0
+#define LPS25H_KEY_TEMPERATURE 1
 ///** @brief Enable FIFO mode, read 32 values at one time. */
 //#define LPS25H_OPT_FIFO 0x10
 ///** @brief Enable FIFO mode, read mean value of 32 values. */
@@ -180,8 +280,14 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <linux/i2c-dev.h>
 
+#include "../regmap.h"
+#include "../runtime-pm.h"
+#include "../rpi-probes.h"
+#include "../single-flight.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -196,12 +302,10 @@ struct lps25h {
 	///< I2C device file descriptor.
 	int options;
 	///< Optional flags used.
-	uint8_t ctrl_r1;
-	///< Configuration register 1.
-	uint8_t ctrl_r2;
-	///< Configuration register 2.
-	uint8_t ctrl_r3;
-	///< Configuration register 3.
+	struct runtime_pm *pm;
+	///< Power state with LPS25H_OPT_WAKEUP, NULL otherwise.
+	struct single_flight *sf;
+	///< Sampling front-end shared by the threads.
 	//int32_t fifo_pressure[32];
 	//int32_t fifo_temperature[32];
 };
@@ -249,21 +353,45 @@ static inline int32_t complement_2s(const int32_t value, const int32_t nbits)
 /**
  * @brief Change current power regime, ON or OFF.
  * @param fd I2C file descriptor.
- * @param ctrl_r1 Current value of the control register R1, prevents overwriting other settings.
  * @param power_on 1 = power on device, 0 = power off device.
  * @return 0 on success, negative value on error. 
+ * @note Nothing is written when the sensor already is in the requested state.
  */
-static int change_power_status(int fd, uint8_t ctrl_r1, int power_on)
+static int change_power_status(int fd, int power_on)
 {
-	if (power_on) {
-		ctrl_r1 |= LPS25H_CTRL1_PD;
-	} else {
-		ctrl_r1 ^= LPS25H_CTRL1_PD;
-	}
+	struct regmap *map = regmap_get(fd);
+	if (!map)
+		return LPS25H_ERR_NOPEN;
+
+	if (regmap_update_bits(map, LPS25H_REG_CTRL_R1, LPS25H_CTRL1_PD,
+			       power_on ? LPS25H_CTRL1_PD : 0) < 0)
+		return LPS25H_ERR_WRITE;
+
+	return 0;
+}
 
-	return write_byte(fd, LPS25H_REG_CTRL_R1, LPS25H_CTRL1_PD | ctrl_r1);
+/**
+ * @brief Power down the sensor, runtime PM suspend callback.
+ * @param data I2C file descriptor.
+ * @return 0 on success, negative value on error.
+ */
+static int _lps25h_suspend(void *data)
+{
+	return change_power_status((int)(intptr_t)data, 0);
 }
 
+/**
+ * @brief Power up the sensor, runtime PM resume callback.
+ * @param data I2C file descriptor.
+ * @return 0 on success, negative value on error.
+ */
+static int _lps25h_resume(void *data)
+{
+	return change_power_status((int)(intptr_t)data, 1);
+}
+
+static int _lps25h_fetch(void *data, unsigned int key, double *values);
+
 /**
  * @brief Open connection to the LPS25H pressure sensor.
  * @param lps Allocated structure that will serve as access.
@@ -281,6 +409,8 @@ int lps25h_init_c_l(struct lps25h *lps, const char *i2c_device,
 
 	lps->options = options;
 	lps->i2c_fd = -1;
+	lps->pm = NULL;
+	lps->sf = NULL;
 
 	int fd = open(i2c_device, O_RDWR);
 	if (fd < 0)
@@ -291,6 +421,19 @@ int lps25h_init_c_l(struct lps25h *lps, const char *i2c_device,
 		return LPS25H_ERR_NOPEN;
 	}
 
+	struct regmap *map = regmap_open(fd, 0x80);
+	if (!map) {
+		(void)close(fd);
+		return LPS25H_ERR;
+	}
+	/* CTRL_R2 bits clear themselves, INT_SRC to TEMP_OUTH are outputs and status */
+	regmap_set_volatile(map, LPS25H_REG_CTRL_R2, LPS25H_REG_CTRL_R2);
+	regmap_set_volatile(map, LPS25H_REG_INT_SRC, LPS25H_REG_TEMP_OUTH);
+	regmap_set_volatile(map, LPS25H_REG_FIFO_STATUS,
+			    LPS25H_REG_FIFO_STATUS);
+	/* AutoZero loads the reference pressure */
+	regmap_set_volatile(map, LPS25H_REG_REF_PXL, LPS25H_REG_REF_PH);
+
 	uint8_t conf_reg1 = LPS25H_CTRL1_BDU;
 
 	/* Power up the sensor at the start */
@@ -298,18 +441,49 @@ int lps25h_init_c_l(struct lps25h *lps, const char *i2c_device,
 		conf_reg1 |= LPS25H_CTRL1_PD;
 	}
 
-	/* Configure sensor */
-	if (write_byte(fd, LPS25H_REG_CTRL_R1, conf_reg1) < 0) {
+	/* Configure sensor, CTRL_R1 to CTRL_R3 in a single transfer */
+	const uint8_t ctrl[3] = { conf_reg1, 0x0, 0x0 };
+	if (regmap_bulk_write(map, LPS25H_REG_CTRL_R1, ctrl, sizeof(ctrl)) <
+	    0) {
 		int err = errno;
+		regmap_close(fd);
 		(void)close(fd);
 		errno = err;
 		return LPS25H_ERR_WRITE;
 	}
 
+	/* The sensor starts powered down and wakes on the first conversion */
+	if (options & LPS25H_OPT_WAKEUP) {
+		lps->pm = (struct runtime_pm *)malloc(sizeof(*lps->pm));
+		if (!lps->pm ||
+		    runtime_pm_init(lps->pm, _lps25h_suspend, _lps25h_resume,
+				    (void *)(intptr_t)fd, LPS25H_AUTOSUSPEND_MS,
+				    0) < 0) {
+			free(lps->pm);
+			lps->pm = NULL;
+			regmap_close(fd);
+			(void)close(fd);
+			return LPS25H_ERR;
+		}
+	}
+
+	/* Keeps the address of lps, the structure must not move */
+	lps->sf = (struct single_flight *)malloc(sizeof(*lps->sf));
+	if (!lps->sf || single_flight_init(lps->sf, _lps25h_fetch, (void *)lps,
+					   2) < 0) {
+		free(lps->sf);
+		lps->sf = NULL;
+		if (lps->pm) {
+			runtime_pm_remove(lps->pm);
+			free(lps->pm);
+			lps->pm = NULL;
+		}
+		regmap_close(fd);
+		(void)close(fd);
+		return LPS25H_ERR;
+	}
+
 	lps->i2c_fd = fd;
-	lps->ctrl_r1 = conf_reg1;
-	lps->ctrl_r2 = 0x0;
-	lps->ctrl_r3 = 0x0;
 
 	return 0;
 }
@@ -339,6 +513,18 @@ int lps25h_close(struct lps25h *lps)
 		return LPS25H_ERR_NOPEN;
 	}
 
+	if (lps->pm) {
+		runtime_pm_remove(lps->pm);
+		free(lps->pm);
+		lps->pm = NULL;
+	}
+	if (lps->sf) {
+		single_flight_destroy(lps->sf);
+		free(lps->sf);
+		lps->sf = NULL;
+	}
+
+	regmap_close(lps->i2c_fd);
 	if (close(lps->i2c_fd) < 0) {
 		return LPS25H_ERR;
 	}
@@ -347,11 +533,73 @@ int lps25h_close(struct lps25h *lps)
 }
 
 /**
- * @brief Read pressure value from sensor.
- * @param i2c_fd Connection to the LPS25H.
- * @return Pressure value, 24bits, negative value on failure.
+ * @brief Request a one-shot conversion of pressure and temperature.
+ * @param lps Connection to the LPS25H.
+ * @return 0 on success, negative value on failure.
+ * @note Use @ref lps25h_conversion_done to know when the results are available.
+ * @note Probe `lps25h:conversion_start(lps)`, the wake-up of the sensor is part of the conversion.
  */
-double lps25h_get_pressure(const struct lps25h *lps)
+int lps25h_request_conversion(const struct lps25h *lps)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	RPI_PROBE1(lps25h, conversion_start, lps);
+
+	/* Power on sensor, held until the result is read. */
+	if (lps->pm && runtime_pm_get(lps->pm) < 0) {
+		return LPS25H_ERR_WRITE;
+	}
+
+	/* Request a conversion. */
+	if (regmap_write(regmap_get(lps->i2c_fd), LPS25H_REG_CTRL_R2,
+			 LPS25H_CTRL2_ONESHOT) < 0) {
+		if (lps->pm) {
+			runtime_pm_put(lps->pm);
+		}
+		return LPS25H_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check whether the one-shot conversion is finished.
+ * @param lps Connection to the LPS25H.
+ * @return 1 if finished, 0 if still converting, negative value on failure.
+ *
+ * This checks whether the LPS25H_CTRL2_ONESHOT bit went back to 0.
+ * Probe `lps25h:conversion_end(lps)` once finished, every check is a `regmap:read_start`.
+ */
+int lps25h_conversion_done(const struct lps25h *lps)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	uint8_t ctrl_r2;
+	if (regmap_read(regmap_get(lps->i2c_fd), LPS25H_REG_CTRL_R2,
+			&ctrl_r2) < 0) {
+		return LPS25H_ERR_READ;
+	}
+
+	if (ctrl_r2 & LPS25H_CTRL2_ONESHOT) {
+		return 0;
+	}
+
+	RPI_PROBE1(lps25h, conversion_end, lps);
+	return 1;
+}
+
+/**
+ * @brief Read the pressure of the last conversion.
+ * @param lps Connection to the LPS25H.
+ * @return Pressure value, negative value on failure.
+ * @note Probe `lps25h:pressure(lps, raw pressure)`.
+ * @note With LPS25H_OPT_WAKEUP the sensor is powered off once idle for the autosuspend delay.
+ */
+double lps25h_read_pressure(const struct lps25h *lps)
 {
 	/*
 	 * From official datasheets:
@@ -364,40 +612,264 @@ double lps25h_get_pressure(const struct lps25h *lps)
 		return LPS25H_ERR_NOPEN;
 	}
 
-	/* Power on sensor. */
-	if (lps->options & LPS25H_OPT_WAKEUP) {
-		change_power_status(lps->i2c_fd, lps->ctrl_r1, 1);
+	struct regmap *map = regmap_get(lps->i2c_fd);
+
+	/* Read conversion data, OUTXL to OUTH in a single transfer. */
+	uint8_t raw_pressure[3];
+	if (regmap_bulk_read(map, LPS25H_REG_PRESS_OUTXL, raw_pressure,
+			     sizeof(raw_pressure)) < 0) {
+		return LPS25H_ERR_READ;
 	}
 
-	/* Request a conversion. */
-	if (write_byte(lps->i2c_fd, LPS25H_REG_CTRL_R2,
-		       LPS25H_CTRL2_ONESHOT | lps->ctrl_r2) < 0) {
-		return LPS25H_ERR_WRITE;
+	int32_t pressure =
+		raw_pressure[2] << 16 | raw_pressure[1] << 8 | raw_pressure[0];
+	RPI_PROBE2(lps25h, pressure, lps, pressure);
+
+	/* Release device, powered off after the autosuspend delay. */
+	if (lps->pm) {
+		runtime_pm_put(lps->pm);
+	}
+
+	return (pressure / LPS25H_PRESS_LSB);
+}
+
+/**
+ * @brief Read the temperature of the last conversion.
+ * @param lps Connection to the LPS25H.
+ * @return Temperature.
+ * @note Probe `lps25h:temperature(lps, raw temperature)`.
+ * @note With LPS25H_OPT_WAKEUP the sensor is powered off once idle for the autosuspend delay.
+ */
+double lps25h_read_temperature(const struct lps25h *lps)
+{
+	/*
+	 * From official datasheets:
+	 * Temperature data are expressed as TEMP_OUT_H & TEMP_OUT_L as 2’s
+         * complement numbers. Temperature output data:
+	 * T(°C) = 42.5 + (TEMP_OUT / 480)
+         * If TEMP_OUT = 0 LSB then Temperature is 42.5 °C
+	 */
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	/* Read conversion data, OUTL and OUTH in a single transfer. */
+	uint8_t raw_temperature[2];
+	if (regmap_bulk_read(regmap_get(lps->i2c_fd), LPS25H_REG_TEMP_OUTL,
+			     raw_temperature, sizeof(raw_temperature)) < 0) {
+		return LPS25H_ERR_READ;
+	}
+
+	int16_t temperature = raw_temperature[1] << 8 | raw_temperature[0];
+	RPI_PROBE2(lps25h, temperature, lps, temperature);
+
+	/* Release device, powered off after the autosuspend delay. */
+	if (lps->pm) {
+		runtime_pm_put(lps->pm);
+	}
+
+	return LPS25H_TEMP_CONSTANT + (temperature / LPS25H_TEMP_LSB);
+}
+
+/**
+ * @brief Read pressure value from sensor.
+ * @param i2c_fd Connection to the LPS25H.
+ * @return Pressure value, 24bits, negative value on failure.
+ * @warning Not thread-safe, use @ref lps25h_get_cached from several threads.
+ */
+double lps25h_get_pressure(const struct lps25h *lps)
+{
+	int ret = lps25h_request_conversion(lps);
+	if (ret < 0) {
+		return ret;
 	}
 
 	/* 
 	 * Wait for the conversion to be finished.
-	 * This waits for the LPS25H_CTRL2_ONESHOT bit to be 0 again.
 	 * WARNING: This way spams the I2C bus.
 	 */
-	while (read_register(lps->i2c_fd, LPS25H_REG_CTRL_R2) ^ lps->ctrl_r2)
+	while (lps25h_conversion_done(lps) == 0)
 		;
 
-	/* Read conversion data. */
-	uint8_t raw_pressure[3];
-	raw_pressure[0] = read_register(lps->i2c_fd, LPS25H_REG_PRESS_OUTH);
-	raw_pressure[1] = read_register(lps->i2c_fd, LPS25H_REG_PRESS_OUTL);
-	raw_pressure[2] = read_register(lps->i2c_fd, LPS25H_REG_PRESS_OUTXL);
+	return lps25h_read_pressure(lps);
+}
 
-	int32_t pressure =
-		raw_pressure[0] << 16 | raw_pressure[1] << 8 | raw_pressure[2];
+/**
+ * @brief Change the autosuspend delay of a sensor opened with LPS25H_OPT_WAKEUP.
+ * @param lps Connection to the LPS25H.
+ * @param delay_ms Time without reading before powering down (ms), 0 to power down after every reading.
+ * @return 0 on success, negative value on failure.
+ */
+int lps25h_set_autosuspend(const struct lps25h *lps, int delay_ms)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+	if (!lps->pm || delay_ms < 0) {
+		return LPS25H_ERR_ARG;
+	}
 
-	/* Power off device. */
-	if (lps->options & LPS25H_OPT_WAKEUP) {
-		change_power_status(lps->i2c_fd, lps->ctrl_r1, 0);
+	if (runtime_pm_set_autosuspend(lps->pm, delay_ms) < 0) {
+		return LPS25H_ERR_WRITE;
 	}
 
-	return (pressure / LPS25H_PRESS_LSB);
+	return 0;
+}
+
+/**
+ * @brief Set the output data rate, the sensor converts continuously at this rate.
+ * @param lps Connection to the LPS25H.
+ * @param odr Output data rate (e.g. LPS25H_ODR_1HZ), LPS25H_ODR_ONESHOT to stop.
+ * @return 0 on success, negative value on failure.
+ * @note Threshold interrupts are only evaluated when a conversion happens.
+ * @note Continuous conversions stop while the sensor is powered down, do not use LPS25H_OPT_WAKEUP with them.
+ */
+int lps25h_set_rate(const struct lps25h *lps, int odr)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+	if (odr & ~(LPS25H_CTRL1_ODR2 | LPS25H_CTRL1_ODR1 | LPS25H_CRTL1_ODR0)) {
+		return LPS25H_ERR_ARG;
+	}
+
+	if (regmap_update_bits(regmap_get(lps->i2c_fd), LPS25H_REG_CTRL_R1,
+			       LPS25H_CTRL1_ODR2 | LPS25H_CTRL1_ODR1 |
+				       LPS25H_CRTL1_ODR0,
+			       odr) < 0) {
+		return LPS25H_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Set the reference pressure the thresholds are compared to.
+ * @param lps Connection to the LPS25H.
+ * @param hpa Reference pressure in hPa.
+ * @return 0 on success, negative value on failure.
+ */
+int lps25h_set_reference(const struct lps25h *lps, double hpa)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+	if (hpa < 0 || hpa * LPS25H_PRESS_LSB > 0x7FFFFF) {
+		return LPS25H_ERR_ARG;
+	}
+
+	const int32_t ref = hpa * LPS25H_PRESS_LSB;
+	const uint8_t raw[3] = { (uint8_t)ref, (uint8_t)(ref >> 8),
+				 (uint8_t)(ref >> 16) };
+	if (regmap_bulk_write(regmap_get(lps->i2c_fd), LPS25H_REG_REF_PXL, raw,
+			      sizeof(raw)) < 0) {
+		return LPS25H_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Use the next measured pressure as the reference pressure (AutoZero).
+ * @param lps Connection to the LPS25H.
+ * @return 0 on success, negative value on failure.
+ */
+int lps25h_autozero(const struct lps25h *lps)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	if (regmap_write(regmap_get(lps->i2c_fd), LPS25H_REG_CTRL_R2,
+			 LPS25H_CTRL2_AUTOZERO) < 0) {
+		return LPS25H_ERR_WRITE;
+	}
+	/* Pressures become relative to the reference */
+	single_flight_invalidate(lps->sf);
+
+	return 0;
+}
+
+/**
+ * @brief Configure the electrical behavior of the INT pin.
+ * @param lps Connection to the LPS25H.
+ * @param active_low 1 for an active low pin, 0 for active high (default).
+ * @param open_drain 1 for open drain, 0 for push-pull (default).
+ * @return 0 on success, negative value on failure.
+ */
+int lps25h_set_int_pin(const struct lps25h *lps, int active_low,
+		       int open_drain)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	if (regmap_update_bits(regmap_get(lps->i2c_fd), LPS25H_REG_CTRL_R3,
+			       LPS25H_CTRL3_INTHL | LPS25H_CTRL3_PPOD,
+			       (active_low ? LPS25H_CTRL3_INTHL : 0) |
+				       (open_drain ? LPS25H_CTRL3_PPOD : 0)) <
+	    0) {
+		return LPS25H_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Raise the INT pin when the pressure moves away from the reference by more than a threshold.
+ * @param lps Connection to the LPS25H.
+ * @param hpa Threshold in hPa (resolution of 1/16 hPa).
+ * @param events LPS25H_INT_HIGH and/or LPS25H_INT_LOW, 0 to disable the interrupt.
+ * @return 0 on success, negative value on failure.
+ * @note The interrupt is latched until @ref lps25h_interrupt_source is called.
+ */
+int lps25h_set_threshold(const struct lps25h *lps, double hpa, int events)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+	if (hpa < 0 || hpa * 16 > 0xFFFF ||
+	    (events & ~(LPS25H_INT_HIGH | LPS25H_INT_LOW))) {
+		return LPS25H_ERR_ARG;
+	}
+
+	struct regmap *map = regmap_get(lps->i2c_fd);
+	const uint16_t ths = hpa * 16;
+	const uint8_t raw[2] = { (uint8_t)ths, (uint8_t)(ths >> 8) };
+
+	/* INT_CFG and CTRL3 use the same bits for high and low events */
+	if (regmap_bulk_write(map, LPS25H_REG_THS_PL, raw, sizeof(raw)) < 0 ||
+	    regmap_write(map, LPS25H_REG_INT_CFG,
+			 events ? LPS25H_INTCFG_LIR | events : 0) < 0 ||
+	    regmap_update_bits(map, LPS25H_REG_CTRL_R3,
+			       LPS25H_CTRL3_INT1S2 | LPS25H_CTRL3_INT1S1,
+			       events) < 0 ||
+	    regmap_update_bits(map, LPS25H_REG_CTRL_R1, LPS25H_CTRL1_DIFFEN,
+			       events ? LPS25H_CTRL1_DIFFEN : 0) < 0) {
+		return LPS25H_ERR_WRITE;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the events that raised the INT pin, this also releases the pin.
+ * @param lps Connection to the LPS25H.
+ * @return LPS25H_INT_HIGH and/or LPS25H_INT_LOW, 0 if none, negative value on failure.
+ */
+int lps25h_interrupt_source(const struct lps25h *lps)
+{
+	if (!lps || lps->i2c_fd < 0) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	uint8_t src;
+	if (regmap_read(regmap_get(lps->i2c_fd), LPS25H_REG_INT_SRC, &src) <
+	    0) {
+		return LPS25H_ERR_READ;
+	}
+
+	return src & (LPS25H_INTSRC_PH | LPS25H_INTSRC_PL);
 }
 
 ///**
@@ -413,52 +885,106 @@ double lps25h_get_pressure(const struct lps25h *lps)
  * @brief Read current temperature value from sensor.
  * @param lps Connection to the sensor.
  * @return Temperature. 
+ * @warning Not thread-safe, use @ref lps25h_get_cached from several threads.
  */
 double lps25h_get_temperature(const struct lps25h *lps)
 {
-	/*
-	 * From official datasheets:
-	 * Temperature data are expressed as TEMP_OUT_H & TEMP_OUT_L as 2’s
-         * complement numbers. Temperature output data:
-	 * T(°C) = 42.5 + (TEMP_OUT / 480)
-         * If TEMP_OUT = 0 LSB then Temperature is 42.5 °C
-	 */
-	if (!lps || lps->i2c_fd < 0) {
-		return LPS25H_ERR_NOPEN;
-	}
-
-	/* Power on sensor. */
-	if (lps->options & LPS25H_OPT_WAKEUP) {
-		change_power_status(lps->i2c_fd, lps->ctrl_r1, 1);
-	}
-
-	/* Request a conversion. */
-	if (write_byte(lps->i2c_fd, LPS25H_REG_CTRL_R2,
-		       LPS25H_CTRL2_ONESHOT | lps->ctrl_r2) < 0) {
-		return LPS25H_ERR_WRITE;
+	int ret = lps25h_request_conversion(lps);
+	if (ret < 0) {
+		return ret;
 	}
 
 	/* 
 	 * Wait for the conversion to be finished.
-	 * This waits for the LPS25H_CTRL2_ONESHOT bit to be 0 again.
 	 * WARNING: This way spams the I2C bus.
 	 */
-	while (read_register(lps->i2c_fd, LPS25H_REG_CTRL_R2) ^ lps->ctrl_r2)
+	while (lps25h_conversion_done(lps) == 0)
 		;
 
-	/* Read conversion data. */
-	uint8_t raw_temperature[2];
-	raw_temperature[0] = read_register(lps->i2c_fd, LPS25H_REG_TEMP_OUTH);
-	raw_temperature[1] = read_register(lps->i2c_fd, LPS25H_REG_TEMP_OUTL);
+	return lps25h_read_temperature(lps);
+}
+
+/**
+ * @brief Run a one-shot conversion for the sampling front-end, pressure and temperature in one burst.
+ * @param data Connection to the LPS25H.
+ * @param key Quantity requested, both are converted.
+ * @param values Pressure (hPa) and temperature (°C).
+ * @return Keys filled, negative value on failure.
+ */
+static int _lps25h_fetch(void *data, unsigned int key, double *values)
+{
+	const struct lps25h *lps = (const struct lps25h *)data;
+	(void)key;
 
-	int16_t temperature = raw_temperature[0] << 8 | raw_temperature[1];
+	int ret = lps25h_request_conversion(lps);
+	if (ret < 0) {
+		return ret;
+	}
+
+	while ((ret = lps25h_conversion_done(lps)) == 0)
+		;
 
-	/* Power off device. */
-	if (lps->options & LPS25H_OPT_WAKEUP) {
-		change_power_status(lps->i2c_fd, lps->ctrl_r1, 0);
+	/* PRESS_OUT_XL to TEMP_OUT_H */
+	uint8_t raw[5];
+	if (ret > 0 && regmap_bulk_read(regmap_get(lps->i2c_fd),
+					LPS25H_REG_PRESS_OUTXL, raw,
+					sizeof(raw)) < 0) {
+		ret = LPS25H_ERR_READ;
 	}
 
-	return LPS25H_TEMP_CONSTANT + (temperature / LPS25H_TEMP_LSB);
+	/* Release device, powered off after the autosuspend delay. */
+	if (lps->pm) {
+		runtime_pm_put(lps->pm);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+
+	const int32_t pressure = raw[2] << 16 | raw[1] << 8 | raw[0];
+	const int16_t temperature = raw[4] << 8 | raw[3];
+	RPI_PROBE2(lps25h, pressure, lps, pressure);
+	RPI_PROBE2(lps25h, temperature, lps, temperature);
+	values[LPS25H_KEY_PRESSURE] = pressure / LPS25H_PRESS_LSB;
+	values[LPS25H_KEY_TEMPERATURE] =
+		LPS25H_TEMP_CONSTANT + (temperature / LPS25H_TEMP_LSB);
+
+	return 1 << LPS25H_KEY_PRESSURE | 1 << LPS25H_KEY_TEMPERATURE;
+}
+
+/**
+ * @brief Get pressure and temperature from any thread, sharing conversions.
+ * @param lps Connection to the LPS25H.
+ * @param max_age_us Oldest value accepted (us), 0 for a new conversion (or the one running).
+ * @param pressure Pressure (hPa), can be NULL.
+ * @param temperature Temperature (°C), can be NULL.
+ * @return 0 on success, negative value on failure.
+ */
+int lps25h_get_cached(const struct lps25h *lps, unsigned int max_age_us,
+		      double *pressure, double *temperature)
+{
+	if (!lps || lps->i2c_fd < 0 || !lps->sf) {
+		return LPS25H_ERR_NOPEN;
+	}
+
+	/* Both come from the same conversion */
+	double values[2];
+	int ret = single_flight_get(lps->sf, LPS25H_KEY_PRESSURE, max_age_us,
+				    values);
+	if (ret >= 0 && !(ret & 1 << LPS25H_KEY_TEMPERATURE)) {
+		ret = LPS25H_ERR_READ;
+	}
+	if (ret < 0) {
+		return ret == -1 ? LPS25H_ERR : ret;
+	}
+
+	if (pressure) {
+		*pressure = values[LPS25H_KEY_PRESSURE];
+	}
+	if (temperature) {
+		*temperature = values[LPS25H_KEY_TEMPERATURE];
+	}
+
+	return 0;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,661 @@
+/**
+ * @brief Library for the LSM9DS1, a 3D accelerometer, 3D gyroscope and 3D magnetometer from STM
+ * @file lsm9ds1.h
+ * @ingroup Sense-Hat
+ * @date 2022-03-04
+ *
+ * @copyright (c) Pierre Boisselier
+ *
+ * @details
+ * More information about the sensor itself can be found here: https://www.st.com/en/mems-and-sensors/lsm9ds1.html
+ * More information about the I2C device driver: https://www.kernel.org/doc/html/v5.4/i2c/dev-interface.html
+ *
+ * The chip answers on two slave addresses: one for the accelerometer and gyroscope, one for the magnetometer.
+ *
+ * ## FIFO
+ *
+ * The accelerometer and the gyroscope run at the same output data rate (up to 952 Hz) into a 32-level FIFO.
+ * Instead of polling every sample, the FIFO is drained in batches: FIFO_SRC gives the number of levels,
+ * then each level (gyroscope output followed by accelerometer output) is read
+ * with as many levels as possible in a single I2C_RDWR combined transfer (10 levels per ioctl).
+ * Draining the full FIFO costs 5 syscalls instead of 64 writes and 64 reads.
+ * Adapters that only support SMBus (e.g. i2c-stub) fall back to two block reads per level.
+ *
+ * Samples come out scaled (rad/s and g) as `struct imu_sample`, ready for the orientation filters of imu-fusion.h.
+ * The magnetometer (80 Hz at most) is read separately, once per batch is enough.
+ *
+ * ## Usage
+ *
+ * ```c
+ * struct lsm9ds1 imu;
+ * lsm9ds1_init(&imu);
+ * lsm9ds1_set_rate(&imu, LSM9DS1_ODR_476HZ);
+ * lsm9ds1_fifo_enable(&imu, 1);
+ *
+ * struct imu_fusion fusion;
+ * imu_fusion_init(&fusion, IMU_FUSION_MADGWICK, imu.rate_hz);
+ *
+ * struct imu_sample samples[LSM9DS1_FIFO_SIZE];
+ * float mag[3];
+ * for (;;) {
+ * 	usleep(20000); // ~10 levels at 476 Hz
+ * 	int n = lsm9ds1_fifo_read(&imu, samples, LSM9DS1_FIFO_SIZE);
+ * 	lsm9ds1_read_mag(&imu, mag);
+ * 	imu_fusion_update_batch(&fusion, samples, n, mag);
+ * }
+ *
+ * lsm9ds1_close(&imu);
+ * ```
+ *
+ * ## Specifics to the Sense-Hat
+ *
+ * - The interrupt pins are not wired, the FIFO has to be polled (at least every 33 ms at 952 Hz).
+ * - The magnetometer axes are converted to the accelerometer frame (its x axis is reversed).
+ */
+
+#ifndef LSM9DS1_H
+#define LSM9DS1_H
+
+/**
+ * @name I2C default settings
+ * @{
+ */
+
+#ifndef LSM9DS1_AG_I2C_ADDR
+/** @brief Default I2C slave address of the accelerometer and gyroscope on the Sense-Hat */
+#define LSM9DS1_AG_I2C_ADDR 0x6A
+#endif
+#ifndef LSM9DS1_M_I2C_ADDR
+/** @brief Default I2C slave address of the magnetometer on the Sense-Hat */
+#define LSM9DS1_M_I2C_ADDR 0x1C
+#endif
+#ifndef RPI_I2C_DEVICE
+/** @brief Default I2C device for the Raspberry Pi */
+#define RPI_I2C_DEVICE "/dev/i2c-1"
+#endif
+
+/**
+ * @}
+ * @name LSM9DS1 accelerometer and gyroscope register addresses
+ * @{
+ */
+
+#define LSM9DS1_REG_WHOAMI 0x0F
+#define LSM9DS1_REG_CTRL_REG1_G 0x10
+#define LSM9DS1_REG_INT_GEN_SRC_G 0x14
+#define LSM9DS1_REG_OUT_X_L_G 0x18
+#define LSM9DS1_REG_CTRL_REG6_XL 0x20
+#define LSM9DS1_REG_CTRL_REG8 0x22
+#define LSM9DS1_REG_CTRL_REG9 0x23
+#define LSM9DS1_REG_INT_GEN_SRC_XL 0x26
+#define LSM9DS1_REG_OUT_X_L_XL 0x28
+#define LSM9DS1_REG_FIFO_CTRL 0x2E
+#define LSM9DS1_REG_FIFO_SRC 0x2F
+
+/**
+ * @}
+ * @name LSM9DS1 magnetometer register addresses
+ * @{
+ */
+
+#define LSM9DS1_REG_WHOAMI_M 0x0F
+#define LSM9DS1_REG_CTRL_REG1_M 0x20
+#define LSM9DS1_REG_CTRL_REG3_M 0x22
+#define LSM9DS1_REG_STATUS_REG_M 0x27
+#define LSM9DS1_REG_OUT_X_L_M 0x28
+#define LSM9DS1_REG_INT_SRC_M 0x31
+
+/**
+ * @}
+ * @name LSM9DS1 register values
+ * @{
+ */
+
+/** @brief Content of WHO_AM_I of the accelerometer and gyroscope */
+#define LSM9DS1_WHOAMI_AG 0x68
+/** @brief Content of WHO_AM_I of the magnetometer */
+#define LSM9DS1_WHOAMI_M 0x3D
+/** @brief Register address bit for auto-increment on the magnetometer */
+#define LSM9DS1_AUTO_INCREMENT_M 0x80
+
+#define LSM9DS1_CTRL_ODR 0xE0
+#define LSM9DS1_CTRL_FS 0x18
+#define LSM9DS1_CTRL8_BDU 0x40
+#define LSM9DS1_CTRL8_IF_ADD_INC 0x04
+#define LSM9DS1_CTRL9_FIFO_EN 0x02
+#define LSM9DS1_FIFO_CONTINUOUS 0xC0
+#define LSM9DS1_FIFO_BYPASS 0x00
+#define LSM9DS1_FIFO_SRC_OVRN 0x40
+#define LSM9DS1_FIFO_SRC_FSS 0x3F
+#define LSM9DS1_CTRL3_M_POWER_DOWN 0x03
+
+/** @brief Number of levels of the FIFO. */
+#define LSM9DS1_FIFO_SIZE 32
+/** @brief Bytes of a FIFO level (gyroscope then accelerometer). */
+#define LSM9DS1_LEVEL_SIZE 12
+/** @brief Levels read per I2C_RDWR transfer, 4 messages each (I2C_RDWR_IOCTL_MAX_MSGS is 42). */
+#define LSM9DS1_LEVELS_PER_TRANSFER 10
+
+/**
+ * @}
+ * @name Output data rates of the accelerometer and gyroscope.
+ * @{
+ */
+
+#define LSM9DS1_ODR_POWER_DOWN 0
+#define LSM9DS1_ODR_14_9HZ 1
+#define LSM9DS1_ODR_59_5HZ 2
+#define LSM9DS1_ODR_119HZ 3
+#define LSM9DS1_ODR_238HZ 4
+#define LSM9DS1_ODR_476HZ 5
+#define LSM9DS1_ODR_952HZ 6
+
+/**
+ * @}
+ * @name Full scales.
+ * @{
+ */
+
+#define LSM9DS1_ACCEL_2G 0
+#define LSM9DS1_ACCEL_16G 1
+#define LSM9DS1_ACCEL_4G 2
+#define LSM9DS1_ACCEL_8G 3
+#define LSM9DS1_GYRO_245DPS 0
+#define LSM9DS1_GYRO_500DPS 1
+#define LSM9DS1_GYRO_2000DPS 3
+
+/**
+ * @}
+ * @name Error returned by functions
+ * @{
+ */
+
+/** @brief Generic error. */
+#define LSM9DS1_ERR -1
+/** @brief Bad argument provided to function. */
+#define LSM9DS1_ERR_ARG -10
+/** @brief I2C device not opened. */
+#define LSM9DS1_ERR_NOPEN -11
+/** @brief Cannot read from I2C device. */
+#define LSM9DS1_ERR_READ -20
+/** @brief Connot write to I2C device. */
+#define LSM9DS1_ERR_WRITE -21
+/** @brief The device is not an LSM9DS1. */
+#define LSM9DS1_ERR_DEVICE -30
+
+/**
+ * @}
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "../regmap.h"
+#include "../imu-fusion.h"
+#include "../rpi-probes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lsm9ds1 {
+	int ag_fd;
+	///< I2C file descriptor of the accelerometer and gyroscope.
+	uint16_t ag_addr;
+	///< Slave address of the accelerometer and gyroscope.
+	int m_fd;
+	///< I2C file descriptor of the magnetometer, -1 if not used.
+	float rate_hz;
+	///< Output data rate of the accelerometer and gyroscope (Hz).
+	float accel_scale;
+	///< Acceleration per LSB (g).
+	float gyro_scale;
+	///< Angular rate per LSB (rad/s).
+	float mag_scale;
+	///< Magnetic field per LSB (gauss).
+	unsigned long samples;
+	///< Number of samples read from the FIFO.
+	unsigned long overruns;
+	///< Number of times the FIFO was found full and samples were lost.
+	unsigned long transfers;
+	///< Number of transfers used to drain the FIFO.
+};
+
+/** @brief Output data rates (Hz), indexed by LSM9DS1_ODR_*. */
+static const float _lsm9ds1_rates[] = { 0.0f,	  14.9f,  59.5f, 119.0f,
+					238.0f, 476.0f, 952.0f };
+/** @brief Accelerometer sensitivities (mg/LSB), indexed by LSM9DS1_ACCEL_*. */
+static const float _lsm9ds1_accel_mg[] = { 0.061f, 0.732f, 0.122f, 0.244f };
+/** @brief Gyroscope sensitivities (mdps/LSB), indexed by LSM9DS1_GYRO_*. */
+static const float _lsm9ds1_gyro_mdps[] = { 8.75f, 17.5f, 0.0f, 70.0f };
+
+/**
+ * @brief Open one of the two slave addresses.
+ * @param i2c_device I2C device path.
+ * @param slave_addr Slave address.
+ * @param burst Bits added to the register address for multi-register transfers.
+ * @param whoami Expected content of WHO_AM_I.
+ * @return File descriptor on success, negative value on failure.
+ */
+static int _lsm9ds1_open(const char *i2c_device, long slave_addr,
+			 uint8_t burst, uint8_t whoami)
+{
+	int fd = open(i2c_device, O_RDWR);
+	if (fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+
+	if (ioctl(fd, I2C_SLAVE, slave_addr) < 0) {
+		(void)close(fd);
+		return LSM9DS1_ERR_NOPEN;
+	}
+
+	struct regmap *map = regmap_open(fd, burst);
+	if (!map) {
+		(void)close(fd);
+		return LSM9DS1_ERR;
+	}
+
+	uint8_t value;
+	int ret = LSM9DS1_ERR_READ;
+	if (regmap_read(map, LSM9DS1_REG_WHOAMI, &value) < 0)
+		goto err;
+	ret = LSM9DS1_ERR_DEVICE;
+	if (value != whoami)
+		goto err;
+
+	return fd;
+
+err:
+	regmap_close(fd);
+	(void)close(fd);
+	return ret;
+}
+
+/**
+ * @brief Close the connection to the magnetometer and to the accelerometer and gyroscope.
+ * @param imu Access to the LSM9DS1.
+ */
+static void _lsm9ds1_release(struct lsm9ds1 *imu)
+{
+	if (imu->m_fd >= 0) {
+		regmap_close(imu->m_fd);
+		(void)close(imu->m_fd);
+		imu->m_fd = -1;
+	}
+	if (imu->ag_fd >= 0) {
+		regmap_close(imu->ag_fd);
+		(void)close(imu->ag_fd);
+		imu->ag_fd = -1;
+	}
+}
+
+/**
+ * @brief Open connection to the LSM9DS1, accelerometer and gyroscope run at 119 Hz, ±2 g and ±245 dps.
+ * @param imu Allocated structure that will serve as access.
+ * @param i2c_device I2C device path.
+ * @param ag_addr Slave address of the accelerometer and gyroscope.
+ * @param m_addr Slave address of the magnetometer, negative to leave it off.
+ * @return 0 on success, negative value on failure.
+ * @note The magnetometer runs continuously at 80 Hz and ±4 gauss.
+ */
+int lsm9ds1_init_c_l_l(struct lsm9ds1 *imu, const char *i2c_device,
+		       const long ag_addr, const long m_addr)
+{
+	if (!imu || !i2c_device)
+		return LSM9DS1_ERR_ARG;
+
+	memset(imu, 0, sizeof(*imu));
+	imu->m_fd = -1;
+	imu->ag_addr = (uint16_t)ag_addr;
+
+	imu->ag_fd = _lsm9ds1_open(i2c_device, ag_addr, 0, LSM9DS1_WHOAMI_AG);
+	if (imu->ag_fd < 0)
+		return imu->ag_fd;
+
+	struct regmap *map = regmap_get(imu->ag_fd);
+	/* Outputs, status and FIFO level, SW_RESET clears itself */
+	regmap_set_volatile(map, LSM9DS1_REG_INT_GEN_SRC_G,
+			    LSM9DS1_REG_OUT_X_L_G + 5);
+	regmap_set_volatile(map, LSM9DS1_REG_CTRL_REG8, LSM9DS1_REG_CTRL_REG8);
+	regmap_set_volatile(map, LSM9DS1_REG_INT_GEN_SRC_XL,
+			    LSM9DS1_REG_OUT_X_L_XL + 5);
+	regmap_set_volatile(map, LSM9DS1_REG_FIFO_SRC, LSM9DS1_REG_FIFO_SRC);
+
+	/*
+	 * Magnetometer: temperature compensation, ultra-high performance, 80 Hz,
+	 * ±4 gauss, continuous conversion, outputs not updated while being read
+	 */
+	const uint8_t ctrl_m[] = { 0xFC, 0x00, 0x00, 0x0C, 0x40 };
+
+	/* Auto-increment for the bursts, outputs not updated while being read */
+	int ret = LSM9DS1_ERR_WRITE;
+	if (regmap_write(map, LSM9DS1_REG_CTRL_REG8,
+			 LSM9DS1_CTRL8_IF_ADD_INC | LSM9DS1_CTRL8_BDU) < 0 ||
+	    regmap_write(map, LSM9DS1_REG_CTRL_REG1_G,
+			 LSM9DS1_ODR_119HZ << 5 | LSM9DS1_GYRO_245DPS << 3) <
+		    0 ||
+	    regmap_write(map, LSM9DS1_REG_CTRL_REG6_XL,
+			 LSM9DS1_ODR_119HZ << 5 | LSM9DS1_ACCEL_2G << 3) < 0)
+		goto err;
+	imu->rate_hz = _lsm9ds1_rates[LSM9DS1_ODR_119HZ];
+	imu->accel_scale = _lsm9ds1_accel_mg[LSM9DS1_ACCEL_2G] / 1000.0f;
+	imu->gyro_scale = _lsm9ds1_gyro_mdps[LSM9DS1_GYRO_245DPS] / 1000.0f *
+			  (float)M_PI / 180.0f;
+
+	if (m_addr < 0)
+		return 0;
+
+	imu->m_fd = _lsm9ds1_open(i2c_device, m_addr, LSM9DS1_AUTO_INCREMENT_M,
+				  LSM9DS1_WHOAMI_M);
+	if (imu->m_fd < 0) {
+		ret = imu->m_fd;
+		goto err;
+	}
+	map = regmap_get(imu->m_fd);
+	regmap_set_volatile(map, LSM9DS1_REG_STATUS_REG_M,
+			    LSM9DS1_REG_OUT_X_L_M + 5);
+	regmap_set_volatile(map, LSM9DS1_REG_INT_SRC_M, LSM9DS1_REG_INT_SRC_M);
+
+	ret = LSM9DS1_ERR_WRITE;
+	if (regmap_bulk_write(map, LSM9DS1_REG_CTRL_REG1_M, ctrl_m,
+			      sizeof(ctrl_m)) < 0)
+		goto err;
+	imu->mag_scale = 0.14f / 1000.0f;
+
+	return 0;
+
+err:
+	_lsm9ds1_release(imu);
+	return ret;
+}
+
+/**
+ * @brief Open connection to the LSM9DS1 with default values.
+ * @param imu Allocated structure that will serve as access.
+ * @return 0 on success, negative value on failure.
+ */
+int lsm9ds1_init(struct lsm9ds1 *imu)
+{
+	return lsm9ds1_init_c_l_l(imu, RPI_I2C_DEVICE, LSM9DS1_AG_I2C_ADDR,
+				  LSM9DS1_M_I2C_ADDR);
+}
+
+/**
+ * @brief Power the sensor down and close the connection.
+ * @param imu Connection to the LSM9DS1.
+ * @return 0 on success, negative value on failure.
+ */
+int lsm9ds1_close(struct lsm9ds1 *imu)
+{
+	if (!imu)
+		return LSM9DS1_ERR_ARG;
+	if (imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+
+	struct regmap *map = regmap_get(imu->ag_fd);
+	regmap_update_bits(map, LSM9DS1_REG_CTRL_REG1_G, LSM9DS1_CTRL_ODR, 0);
+	regmap_update_bits(map, LSM9DS1_REG_CTRL_REG6_XL, LSM9DS1_CTRL_ODR, 0);
+	if (imu->m_fd >= 0)
+		regmap_write(regmap_get(imu->m_fd), LSM9DS1_REG_CTRL_REG3_M,
+			     LSM9DS1_CTRL3_M_POWER_DOWN);
+	_lsm9ds1_release(imu);
+
+	return 0;
+}
+
+/**
+ * @brief Set the output data rate of the accelerometer and gyroscope.
+ * @param imu Connection to the LSM9DS1.
+ * @param odr Output data rate (e.g. LSM9DS1_ODR_476HZ).
+ * @return 0 on success, negative value on failure.
+ * @note The step of the fusion filter is 1 / `imu->rate_hz`.
+ * @note LSM9DS1_ODR_POWER_DOWN stops both sensors and sets `imu->rate_hz` to 0,
+ *       a running rate must be set again before reading or starting a fusion filter.
+ */
+int lsm9ds1_set_rate(struct lsm9ds1 *imu, int odr)
+{
+	if (!imu || imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+	if (odr < LSM9DS1_ODR_POWER_DOWN || odr > LSM9DS1_ODR_952HZ)
+		return LSM9DS1_ERR_ARG;
+
+	struct regmap *map = regmap_get(imu->ag_fd);
+	if (regmap_update_bits(map, LSM9DS1_REG_CTRL_REG1_G, LSM9DS1_CTRL_ODR,
+			       (uint8_t)(odr << 5)) < 0 ||
+	    regmap_update_bits(map, LSM9DS1_REG_CTRL_REG6_XL, LSM9DS1_CTRL_ODR,
+			       (uint8_t)(odr << 5)) < 0)
+		return LSM9DS1_ERR_WRITE;
+	imu->rate_hz = _lsm9ds1_rates[odr];
+
+	return 0;
+}
+
+/**
+ * @brief Set the full scales of the accelerometer and gyroscope.
+ * @param imu Connection to the LSM9DS1.
+ * @param accel Accelerometer full scale (e.g. LSM9DS1_ACCEL_4G).
+ * @param gyro Gyroscope full scale (e.g. LSM9DS1_GYRO_500DPS).
+ * @return 0 on success, negative value on failure.
+ * @warning Samples already in the FIFO are converted with the new scales.
+ */
+int lsm9ds1_set_scale(struct lsm9ds1 *imu, int accel, int gyro)
+{
+	if (!imu || imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+	if (accel < 0 || accel > LSM9DS1_ACCEL_8G || gyro < 0 ||
+	    gyro > LSM9DS1_GYRO_2000DPS || _lsm9ds1_gyro_mdps[gyro] == 0.0f)
+		return LSM9DS1_ERR_ARG;
+
+	struct regmap *map = regmap_get(imu->ag_fd);
+	if (regmap_update_bits(map, LSM9DS1_REG_CTRL_REG1_G, LSM9DS1_CTRL_FS,
+			       (uint8_t)(gyro << 3)) < 0 ||
+	    regmap_update_bits(map, LSM9DS1_REG_CTRL_REG6_XL, LSM9DS1_CTRL_FS,
+			       (uint8_t)(accel << 3)) < 0)
+		return LSM9DS1_ERR_WRITE;
+	imu->accel_scale = _lsm9ds1_accel_mg[accel] / 1000.0f;
+	imu->gyro_scale =
+		_lsm9ds1_gyro_mdps[gyro] / 1000.0f * (float)M_PI / 180.0f;
+
+	return 0;
+}
+
+/**
+ * @brief Enable or disable the FIFO, enabling empties it.
+ * @param imu Connection to the LSM9DS1.
+ * @param enable Non-zero to store samples in the FIFO (continuous mode), 0 to bypass it.
+ * @return 0 on success, negative value on failure.
+ */
+int lsm9ds1_fifo_enable(const struct lsm9ds1 *imu, int enable)
+{
+	if (!imu || imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+
+	struct regmap *map = regmap_get(imu->ag_fd);
+	/* Going through bypass mode resets the FIFO */
+	if (regmap_write(map, LSM9DS1_REG_FIFO_CTRL, LSM9DS1_FIFO_BYPASS) < 0 ||
+	    regmap_update_bits(map, LSM9DS1_REG_CTRL_REG9,
+			       LSM9DS1_CTRL9_FIFO_EN,
+			       enable ? LSM9DS1_CTRL9_FIFO_EN : 0) < 0)
+		return LSM9DS1_ERR_WRITE;
+	if (enable && regmap_write(map, LSM9DS1_REG_FIFO_CTRL,
+				   LSM9DS1_FIFO_CONTINUOUS) < 0)
+		return LSM9DS1_ERR_WRITE;
+
+	return 0;
+}
+
+/**
+ * @brief Read levels of the FIFO (or the current outputs), gyroscope then accelerometer for each.
+ * @param imu Connection to the LSM9DS1.
+ * @param raw Raw outputs, LSM9DS1_LEVEL_SIZE bytes per level.
+ * @param levels Number of levels, at most LSM9DS1_LEVELS_PER_TRANSFER.
+ * @return 0 on success, -1 on failure.
+ */
+static int _lsm9ds1_read_levels(struct lsm9ds1 *imu, uint8_t *raw,
+				unsigned int levels)
+{
+	struct regmap *map = regmap_get(imu->ag_fd);
+
+	++imu->transfers;
+	if (map->smbus) {
+		for (unsigned int i = 0; i < levels; ++i, raw += 12)
+			if (regmap_bulk_read(map, LSM9DS1_REG_OUT_X_L_G, raw,
+					     6) < 0 ||
+			    regmap_bulk_read(map, LSM9DS1_REG_OUT_X_L_XL,
+					     raw + 6, 6) < 0)
+				return -1;
+		return 0;
+	}
+
+	/* Both output addresses, then a repeated start for each read */
+	uint8_t out_g = LSM9DS1_REG_OUT_X_L_G;
+	uint8_t out_xl = LSM9DS1_REG_OUT_X_L_XL;
+	struct i2c_msg msgs[LSM9DS1_LEVELS_PER_TRANSFER * 4];
+	for (unsigned int i = 0; i < levels * 4; ++i) {
+		msgs[i].addr = imu->ag_addr;
+		msgs[i].flags = i & 1 ? I2C_M_RD : 0;
+		msgs[i].len = i & 1 ? 6 : 1;
+		msgs[i].buf = i & 1 ? raw + i / 2 * 6 : i & 2 ? &out_xl : &out_g;
+	}
+
+	struct i2c_rdwr_ioctl_data xfer;
+	xfer.msgs = msgs;
+	xfer.nmsgs = levels * 4;
+	return ioctl(imu->ag_fd, I2C_RDWR, &xfer) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Scale raw levels into samples.
+ * @param imu Connection to the LSM9DS1.
+ * @param raw Raw outputs, LSM9DS1_LEVEL_SIZE bytes per level.
+ * @param samples Scaled samples.
+ * @param num_samples Number of samples.
+ */
+static void _lsm9ds1_scale(const struct lsm9ds1 *imu, const uint8_t *raw,
+			   struct imu_sample *samples, unsigned int num_samples)
+{
+	for (unsigned int i = 0; i < num_samples; ++i, raw += 12) {
+		for (int j = 0; j < 3; ++j) {
+			samples[i].gyro[j] =
+				imu->gyro_scale *
+				(int16_t)(raw[2 * j + 1] << 8 | raw[2 * j]);
+			samples[i].accel[j] =
+				imu->accel_scale *
+				(int16_t)(raw[2 * j + 7] << 8 | raw[2 * j + 6]);
+		}
+	}
+}
+
+/**
+ * @brief Drain the FIFO.
+ * @param imu Connection to the LSM9DS1.
+ * @param samples Samples read, oldest first.
+ * @param max_samples Maximum number of samples, LSM9DS1_FIFO_SIZE to drain the FIFO.
+ * @return Number of samples read, negative value on failure.
+ * @note When the FIFO was full, the oldest samples were overwritten and `imu->overruns` is incremented.
+ * @note Probes `lsm9ds1:fifo_start(imu)` and `lsm9ds1:fifo_end(imu, ret)`, `lsm9ds1:overrun(imu)` when samples were lost.
+ */
+int lsm9ds1_fifo_read(struct lsm9ds1 *imu, struct imu_sample *samples,
+		      unsigned int max_samples)
+{
+	if (!imu || imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+	if (!samples)
+		return LSM9DS1_ERR_ARG;
+
+	RPI_PROBE1(lsm9ds1, fifo_start, imu);
+
+	uint8_t src;
+	if (regmap_read(regmap_get(imu->ag_fd), LSM9DS1_REG_FIFO_SRC, &src) <
+	    0) {
+		RPI_PROBE2(lsm9ds1, fifo_end, imu, LSM9DS1_ERR_READ);
+		return LSM9DS1_ERR_READ;
+	}
+	if (src & LSM9DS1_FIFO_SRC_OVRN) {
+		RPI_PROBE1(lsm9ds1, overrun, imu);
+		++imu->overruns;
+	}
+
+	unsigned int levels = src & LSM9DS1_FIFO_SRC_FSS;
+	if (levels > LSM9DS1_FIFO_SIZE)
+		levels = LSM9DS1_FIFO_SIZE;
+	if (levels > max_samples)
+		levels = max_samples;
+
+	uint8_t raw[LSM9DS1_FIFO_SIZE * LSM9DS1_LEVEL_SIZE];
+	for (unsigned int i = 0; i < levels; i += LSM9DS1_LEVELS_PER_TRANSFER) {
+		const unsigned int n = levels - i < LSM9DS1_LEVELS_PER_TRANSFER ?
+					       levels - i :
+					       LSM9DS1_LEVELS_PER_TRANSFER;
+		if (_lsm9ds1_read_levels(imu, raw + i * LSM9DS1_LEVEL_SIZE,
+					 n) < 0) {
+			RPI_PROBE2(lsm9ds1, fifo_end, imu, LSM9DS1_ERR_READ);
+			return LSM9DS1_ERR_READ;
+		}
+	}
+	_lsm9ds1_scale(imu, raw, samples, levels);
+	imu->samples += levels;
+	RPI_PROBE2(lsm9ds1, fifo_end, imu, levels);
+
+	return (int)levels;
+}
+
+/**
+ * @brief Read the current outputs of the accelerometer and gyroscope, without the FIFO.
+ * @param imu Connection to the LSM9DS1.
+ * @param sample Sample read.
+ * @return 0 on success, negative value on failure.
+ */
+int lsm9ds1_read(struct lsm9ds1 *imu, struct imu_sample *sample)
+{
+	if (!imu || imu->ag_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+	if (!sample)
+		return LSM9DS1_ERR_ARG;
+
+	uint8_t raw[LSM9DS1_LEVEL_SIZE];
+	if (_lsm9ds1_read_levels(imu, raw, 1) < 0)
+		return LSM9DS1_ERR_READ;
+	_lsm9ds1_scale(imu, raw, sample, 1);
+
+	return 0;
+}
+
+/**
+ * @brief Read the magnetic field, in the frame of the accelerometer.
+ * @param imu Connection to the LSM9DS1.
+ * @param mag Magnetic field along x, y and z (gauss).
+ * @return 0 on success, negative value on failure.
+ */
+int lsm9ds1_read_mag(const struct lsm9ds1 *imu, float mag[3])
+{
+	if (!imu || imu->m_fd < 0)
+		return LSM9DS1_ERR_NOPEN;
+	if (!mag)
+		return LSM9DS1_ERR_ARG;
+
+	uint8_t raw[6];
+	if (regmap_bulk_read(regmap_get(imu->m_fd), LSM9DS1_REG_OUT_X_L_M, raw,
+			     sizeof(raw)) < 0)
+		return LSM9DS1_ERR_READ;
+
+	for (int j = 0; j < 3; ++j)
+		mag[j] = imu->mag_scale * (int16_t)(raw[2 * j + 1] << 8 |
+						    raw[2 * j]);
+	mag[0] = -mag[0];
+
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSM9DS1_H
@@ -8,5 +8,9 @@
 #define SENSE_HAT_H
 
 #include "led-matrix.h"
+#include "joystick.h"
+#include "lps25h.h"
+#include "hts221.h"
+#include "lsm9ds1.h"
 
 #endif // SENSE_HAT_H
\ No newline at end of file
@@ -0,0 +1,282 @@
+/**
+ * @brief Single-flight sampling front-end shared by the threads using a sensor
+ *
+ * @file single-flight.h
+ * @copyright (c) Pierre Boisselier <pb@pboisselier.fr>
+ * @date 2022-03-05
+ *
+ * @details
+ * When several threads read the same sensor, each read normally runs its own conversion on the bus,
+ * and two conversions running at once on the same device step on each other.
+ * A front-end sits between the callers and the driver:
+ * - Only one conversion runs at a time on the device.
+ * - A caller asking for a quantity that is being converted joins that conversion and gets its result.
+ * - A caller accepting a value up to `max_age_us` old gets the last value without any bus transfer.
+ * - A conversion can produce several quantities at once (e.g. pressure and temperature), all are cached
+ *   and all are given back to the caller.
+ *
+ * The number of conversions then follows the demand for fresh values, not the number of callers.
+ *
+ * Quantities are identified by a key (e.g. the channel of an ADC), up to @ref SINGLE_FLIGHT_MAX_KEYS.
+ * The conversion itself is a callback given by the driver, run without any lock held.
+ *
+ * ## Usage
+ *
+ * ```c
+ * // Fill values[key] (and any other key converted at the same time), return the keys filled
+ * int fetch(void *data, unsigned int key, double *values)
+ * {
+ * 	values[key] = read_channel(data, key);
+ * 	return 1U << key;
+ * }
+ *
+ * struct single_flight sf;
+ * single_flight_init(&sf, fetch, adc, 8);
+ *
+ * // From any thread: a value at most 10 ms old
+ * double values[8];
+ * single_flight_get(&sf, 3, 10000, values); // values[3]
+ *
+ * single_flight_destroy(&sf);
+ * ```
+ *
+ * The drivers embed one per device, see `lps25h_get_cached()` and `tlc1543_get_sample_cached()`.
+ */
+
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of quantities of a device. */
+#define SINGLE_FLIGHT_MAX_KEYS 16
+
+/**
+ * @brief Run a conversion.
+ * @param data Data given to @ref single_flight_init.
+ * @param key Quantity requested.
+ * @param values Values of the quantities, values[key] at least must be filled.
+ * @return Bitmask of the keys filled, negative value on failure (given back to the callers).
+ */
+typedef int (*single_flight_fetch)(void *data, unsigned int key,
+				   double *values);
+
+/**
+ * @brief Sampling front-end of a device.
+ */
+struct single_flight {
+	single_flight_fetch fetch;
+	///< Runs a conversion
+	void *data;
+	///< Given to fetch
+	unsigned int num_keys;
+	///< Number of quantities
+	double values[SINGLE_FLIGHT_MAX_KEYS];
+	///< Last value of each quantity
+	int errors[SINGLE_FLIGHT_MAX_KEYS];
+	///< Result of the last conversion of each quantity
+	int64_t times_ns[SINGLE_FLIGHT_MAX_KEYS];
+	///< Start of the conversion that gave each value (CLOCK_MONOTONIC)
+	uint32_t valid;
+	///< Bit set when the value of the quantity is known
+	int busy;
+	///< Whether a conversion is running
+	unsigned int busy_key;
+	///< Quantity being converted
+	unsigned long flights;
+	///< Number of conversions finished
+	unsigned long hits;
+	///< Number of requests served by the cache
+	unsigned long joined;
+	///< Number of requests served by joining a running conversion
+	pthread_mutex_t lock;
+	///< Protects everything above
+	pthread_cond_t done;
+	///< Signaled at the end of each conversion
+};
+
+/**
+ * @brief Current time.
+ * @return CLOCK_MONOTONIC time (ns).
+ */
+static inline int64_t _single_flight_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Initialize a front-end, nothing is cached.
+ * @param sf Front-end.
+ * @param fetch Runs a conversion.
+ * @param data Given to fetch.
+ * @param num_keys Number of quantities, at most SINGLE_FLIGHT_MAX_KEYS.
+ * @return 0 on success, -1 on failure.
+ */
+int single_flight_init(struct single_flight *sf, single_flight_fetch fetch,
+		       void *data, unsigned int num_keys)
+{
+	if (!sf || !fetch || num_keys == 0 ||
+	    num_keys > SINGLE_FLIGHT_MAX_KEYS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(sf, 0, sizeof(*sf));
+	sf->fetch = fetch;
+	sf->data = data;
+	sf->num_keys = num_keys;
+	int err = pthread_mutex_init(&sf->lock, NULL);
+	if (err == 0) {
+		err = pthread_cond_init(&sf->done, NULL);
+		if (err != 0)
+			pthread_mutex_destroy(&sf->lock);
+	}
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Destroy a front-end.
+ * @param sf Front-end, no request must be running.
+ */
+void single_flight_destroy(struct single_flight *sf)
+{
+	if (!sf)
+		return;
+
+	pthread_cond_destroy(&sf->done);
+	pthread_mutex_destroy(&sf->lock);
+}
+
+/**
+ * @brief Forget every cached value, e.g. after changing the configuration of the device.
+ * @param sf Front-end.
+ * @note A running conversion still delivers its values.
+ */
+void single_flight_invalidate(struct single_flight *sf)
+{
+	pthread_mutex_lock(&sf->lock);
+	sf->valid = 0;
+	pthread_mutex_unlock(&sf->lock);
+}
+
+/**
+ * @brief Copy the values converted along with a quantity, lock held.
+ * @param sf Front-end.
+ * @param key Quantity.
+ * @param values Values.
+ * @return Bitmask of the keys copied.
+ */
+static inline int _single_flight_copy(const struct single_flight *sf,
+				      unsigned int key, double *values)
+{
+	int filled = 0;
+	for (unsigned int i = 0; i < sf->num_keys; ++i) {
+		if (!(sf->valid & (1U << i)) ||
+		    sf->times_ns[i] != sf->times_ns[key])
+			continue;
+		values[i] = sf->values[i];
+		filled |= 1 << i;
+	}
+	return filled;
+}
+
+/**
+ * @brief Get the value of a quantity, from the cache, a running conversion or a new one.
+ * @param sf Front-end.
+ * @param key Quantity.
+ * @param max_age_us Oldest cached value accepted (us), 0 to always get a conversion (a running one is joined).
+ * @param values Values, one per quantity: values[key] and those converted at the same time are filled.
+ * @return Bitmask of the keys filled on success, -1 on bad arguments, negative value returned by the conversion on failure.
+ * @note The age of a value counts from the start of its conversion.
+ */
+int single_flight_get(struct single_flight *sf, unsigned int key,
+		      unsigned int max_age_us, double *values)
+{
+	if (!sf || key >= sf->num_keys || !values) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const uint32_t bit = 1U << key;
+	int ret;
+
+	pthread_mutex_lock(&sf->lock);
+	for (;;) {
+		if ((sf->valid & bit) &&
+		    _single_flight_now_ns() - sf->times_ns[key] <=
+			    (int64_t)max_age_us * 1000) {
+			++sf->hits;
+			ret = _single_flight_copy(sf, key, values);
+			pthread_mutex_unlock(&sf->lock);
+			return ret;
+		}
+		if (!sf->busy)
+			break;
+
+		/* One conversion at a time, same quantity: take its result */
+		const unsigned long flight = sf->flights;
+		const int same = sf->busy_key == key;
+		while (sf->flights == flight)
+			pthread_cond_wait(&sf->done, &sf->lock);
+		if (same) {
+			++sf->joined;
+			ret = sf->errors[key];
+			if (ret == 0)
+				ret = _single_flight_copy(sf, key, values);
+			pthread_mutex_unlock(&sf->lock);
+			return ret;
+		}
+		/* Other quantity: it may have been converted as well */
+	}
+
+	sf->busy = 1;
+	sf->busy_key = key;
+	pthread_mutex_unlock(&sf->lock);
+
+	const int64_t start = _single_flight_now_ns();
+	ret = sf->fetch(sf->data, key, values);
+
+	pthread_mutex_lock(&sf->lock);
+	if (ret < 0) {
+		sf->errors[key] = ret;
+	} else {
+		const uint32_t filled = ((uint32_t)ret | bit) &
+					((1U << sf->num_keys) - 1);
+		for (unsigned int i = 0; i < sf->num_keys; ++i) {
+			if (!(filled & (1U << i)))
+				continue;
+			sf->values[i] = values[i];
+			sf->times_ns[i] = start;
+			sf->errors[i] = 0;
+		}
+		sf->valid |= filled;
+		ret = (int)filled;
+	}
+	sf->busy = 0;
+	++sf->flights;
+	pthread_cond_broadcast(&sf->done);
+	pthread_mutex_unlock(&sf->lock);
+
+	return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SINGLE_FLIGHT_H